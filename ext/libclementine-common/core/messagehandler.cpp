@@ -22,8 +22,12 @@
 #include "core/logging.h"
 
 #include <QAbstractSocket>
+#include <QDataStream>
 #include <QLocalSocket>
 
+const int _MessageHandlerBase::kSharedMemoryThreshold = 64 * 1024;
+const int _MessageHandlerBase::kMaxFrameSize = ~FrameFlagsMask;
+
 _MessageHandlerBase::_MessageHandlerBase(QIODevice* device, QObject* parent)
     : QObject(parent),
       device_(nullptr),
@@ -31,6 +35,7 @@ _MessageHandlerBase::_MessageHandlerBase(QIODevice* device, QObject* parent)
       flush_local_socket_(nullptr),
       reading_protobuf_(false),
       expected_length_(0),
+      expected_flags_(0),
       is_device_closed_(false) {
   if (device) {
     SetDevice(device);
@@ -63,6 +68,8 @@ void _MessageHandlerBase::DeviceReadyRead() {
       QDataStream s(device_);
       s >> expected_length_;
 
+      expected_flags_ = expected_length_ & FrameFlagsMask;
+      expected_length_ &= ~FrameFlagsMask;
       reading_protobuf_ = true;
     }
 
@@ -72,7 +79,7 @@ void _MessageHandlerBase::DeviceReadyRead() {
     // Did we get everything?
     if (buffer_.size() == expected_length_) {
       // Parse the message
-      if (!RawMessageArrived(buffer_.data())) {
+      if (!FrameArrived(expected_flags_, buffer_.data())) {
         qLog(Error) << "Malformed protobuf message";
         device_->close();
         return;
@@ -87,9 +94,92 @@ void _MessageHandlerBase::DeviceReadyRead() {
   }
 }
 
+bool _MessageHandlerBase::FrameArrived(quint32 flags, const QByteArray& data) {
+  switch (flags) {
+    case 0:
+      return RawMessageArrived(data);
+
+    case Frame_SharedMemoryMessage: {
+      if (!incoming_ring_ || data.size() != 2 * sizeof(quint32)) return false;
+
+      quint32 offset = 0;
+      quint32 size = 0;
+      QDataStream s(data);
+      s >> offset >> size;
+
+      const char* message = incoming_ring_->Data(offset, size);
+      if (!message) {
+        qLog(Error) << "Shared memory message at" << offset << "of" << size
+                    << "bytes is outside the ring";
+        return false;
+      }
+
+      // Parse the message straight out of the shared memory.
+      const bool ret =
+          RawMessageArrived(QByteArray::fromRawData(message, size));
+      incoming_ring_->Release(offset, size);
+      return ret;
+    }
+
+    case Frame_SharedMemoryOffer: {
+      const QString key = QString::fromUtf8(data.constData(), data.size());
+
+      QScopedPointer<SharedMemoryRing> ring(new SharedMemoryRing);
+      if (ring->Attach(key)) {
+        qLog(Debug) << "Writing large messages to shared memory" << key;
+        outgoing_ring_.swap(ring);
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool _MessageHandlerBase::OfferSharedMemory(const QString& key, int size) {
+  QScopedPointer<SharedMemoryRing> ring(new SharedMemoryRing);
+  if (!ring->Create(key, size)) {
+    return false;
+  }
+
+  incoming_ring_.swap(ring);
+  WriteFrame(Frame_SharedMemoryOffer, key.toUtf8());
+  return true;
+}
+
+char* _MessageHandlerBase::AllocateSharedMemory(quint32 size,
+                                                quint32* offset) {
+  if (!outgoing_ring_) return nullptr;
+  return outgoing_ring_->Allocate(size, offset);
+}
+
+void _MessageHandlerBase::WriteSharedMemoryMessage(quint32 offset,
+                                                   quint32 size) {
+  QByteArray data;
+  QDataStream s(&data, QIODevice::WriteOnly);
+  s << offset << size;
+
+  WriteFrame(Frame_SharedMemoryMessage, data);
+}
+
 void _MessageHandlerBase::WriteMessage(const QByteArray& data) {
+  WriteFrame(0, data);
+}
+
+void _MessageHandlerBase::WriteFrame(quint32 flags, const QByteArray& data) {
+  if (data.length() > kMaxFrameSize) {
+    // The length would run into the flags, and the other end would read
+    // garbage from then on.  Nothing else can be sent after a lost request, so
+    // close the connection and let the pending replies be aborted.
+    qLog(Error) << "Can't send a message of" << data.length()
+                << "bytes, the most is" << kMaxFrameSize;
+    device_->close();
+    return;
+  }
+
   QDataStream s(device_);
-  s << quint32(data.length());
+  s << quint32(flags | data.length());
   s.writeRawData(data.data(), data.length());
 
   // Sorry.
@@ -26,11 +26,13 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QObject>
+#include <QScopedPointer>
 #include <QSemaphore>
 #include <QThread>
 
 #include "core/logging.h"
 #include "core/messagereply.h"
+#include "core/sharedmemoryring.h"
 
 class QAbstractSocket;
 class QIODevice;
@@ -40,6 +42,11 @@ class QLocalSocket;
 #define DataCommaSizeFromQString(x) x.toUtf8().constData(), x.toUtf8().length()
 
 // Reads and writes uint32 length encoded protobufs to a socket.
+// If both ends are on the same machine, large messages can be passed through a
+// shared memory ring buffer instead: the reader calls OfferSharedMemory, and
+// once the writer has attached to the ring it serialises messages bigger than
+// kSharedMemoryThreshold straight into it and only sends their location over
+// the socket.  The socket is still used if the ring is full.
 // This base QObject is separate from AbstractMessageHandler because moc can't
 // handle templated classes.  Use AbstractMessageHandler instead.
 class _MessageHandlerBase : public QObject {
@@ -50,8 +57,23 @@ class _MessageHandlerBase : public QObject {
   // any messages.
   _MessageHandlerBase(QIODevice* device, QObject* parent);
 
+  static const int kSharedMemoryThreshold;
+  // The length of each frame shares its word with the flags below, so
+  // messages sent over the socket must be smaller than 1GB.  Trying to send a
+  // bigger one closes the connection.
+  static const int kMaxFrameSize;
+
   void SetDevice(QIODevice* device);
 
+  // Creates a shared memory ring of the given size and asks the other end to
+  // send large messages through it.  Returns false if shared memory isn't
+  // available, in which case everything keeps going through the socket.
+  bool OfferSharedMemory(const QString& key, int size);
+
+  // True once the other end's shared memory ring has been attached, and large
+  // messages are being written to it.
+  bool is_writing_shared_memory() const { return !outgoing_ring_.isNull(); }
+
   // After this is true, messages cannot be sent to the handler any more.
   bool is_device_closed() const { return is_device_closed_; }
 
@@ -64,6 +86,28 @@ class _MessageHandlerBase : public QObject {
   virtual bool RawMessageArrived(const QByteArray& data) = 0;
   virtual void AbortAll() = 0;
 
+  // Reserves size bytes in the other end's shared memory ring.  Returns
+  // nullptr if there isn't one or it's full.
+  char* AllocateSharedMemory(quint32 size, quint32* offset);
+  // Tells the other end about a message that was written to shared memory.
+  void WriteSharedMemoryMessage(quint32 offset, quint32 size);
+
+ private:
+  // The top bits of the length word say what sort of frame follows.  The rest
+  // is the frame's length, which limits it to kMaxFrameSize.
+  enum FrameFlags {
+    // A message in the shared memory ring.  The frame contains its offset and
+    // size.
+    Frame_SharedMemoryMessage = 0x80000000,
+    // The key of a shared memory ring the other end should write to.
+    Frame_SharedMemoryOffer = 0x40000000,
+
+    FrameFlagsMask = 0xC0000000
+  };
+
+  void WriteFrame(quint32 flags, const QByteArray& data);
+  bool FrameArrived(quint32 flags, const QByteArray& data);
+
  protected:
   typedef bool (QAbstractSocket::*FlushAbstractSocket)();
   typedef bool (QLocalSocket::*FlushLocalSocket)();
@@ -74,8 +118,12 @@ class _MessageHandlerBase : public QObject {
 
   bool reading_protobuf_;
   quint32 expected_length_;
+  quint32 expected_flags_;
   QBuffer buffer_;
 
+  QScopedPointer<SharedMemoryRing> incoming_ring_;
+  QScopedPointer<SharedMemoryRing> outgoing_ring_;
+
   bool is_device_closed_;
 };
 
@@ -129,8 +177,22 @@ template <typename MT>
 void AbstractMessageHandler<MT>::SendMessage(const MessageType& message) {
   Q_ASSERT(QThread::currentThread() == thread());
 
-  std::string data = message.SerializeAsString();
-  WriteMessage(QByteArray(data.data(), data.size()));
+  const int size = message.ByteSize();
+
+  if (size >= kSharedMemoryThreshold) {
+    quint32 offset = 0;
+    char* data = AllocateSharedMemory(size, &offset);
+    if (data) {
+      message.SerializeToArray(data, size);
+      WriteSharedMemoryMessage(offset, size);
+      return;
+    }
+  }
+
+  QByteArray data;
+  data.resize(size);
+  message.SerializeToArray(data.data(), size);
+  WriteMessage(data);
 }
 
 template <typename MT>
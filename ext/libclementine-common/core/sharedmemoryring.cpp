@@ -0,0 +1,133 @@
+/* This file is part of Clementine.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Note: this file is licensed under the Apache License instead of GPL because
+// it is used by the Spotify blob which links against libspotify and is not GPL
+// compatible.
+
+#include "sharedmemoryring.h"
+#include "core/logging.h"
+
+SharedMemoryRing::SharedMemoryRing()
+    : header_(nullptr), data_(nullptr), capacity_(0) {}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  if (memory_.isAttached()) {
+    memory_.detach();
+  }
+}
+
+bool SharedMemoryRing::Create(const QString& key, int size) {
+  memory_.setKey(key);
+
+  // On unix the segment outlives a process that crashes.  Detaching from it
+  // deletes it if nothing else is still attached.
+  if (memory_.attach()) {
+    qLog(Debug) << "Removing stale shared memory" << key;
+    memory_.detach();
+  }
+
+  if (!memory_.create(sizeof(Header) + size)) {
+    qLog(Warning) << "Failed to create shared memory" << key
+                  << memory_.errorString();
+    return false;
+  }
+
+  header_ = reinterpret_cast<Header*>(memory_.data());
+  data_ = reinterpret_cast<char*>(memory_.data()) + sizeof(Header);
+
+  capacity_ = size;
+
+  memory_.lock();
+  header_->capacity = size;
+  header_->write_pos = 0;
+  header_->read_pos = 0;
+  header_->used = 0;
+  memory_.unlock();
+
+  return true;
+}
+
+bool SharedMemoryRing::Attach(const QString& key) {
+  memory_.setKey(key);
+  if (!memory_.attach()) {
+    qLog(Warning) << "Failed to attach to shared memory" << key
+                  << memory_.errorString();
+    return false;
+  }
+
+  header_ = reinterpret_cast<Header*>(memory_.data());
+  data_ = reinterpret_cast<char*>(memory_.data()) + sizeof(Header);
+  capacity_ =
+      qMin(header_->capacity, quint32(memory_.size() - sizeof(Header)));
+  return true;
+}
+
+char* SharedMemoryRing::Allocate(quint32 size, quint32* offset) {
+  if (!header_) return nullptr;
+
+  memory_.lock();
+
+  quint32 used = header_->used;
+  quint32 write_pos = header_->write_pos;
+
+  if (write_pos > capacity_ || used > capacity_) {
+    qLog(Warning) << "Shared memory ring" << key() << "is corrupt";
+    memory_.unlock();
+    return nullptr;
+  }
+
+  if (size > capacity_ - write_pos) {
+    // There's not enough room at the end of the buffer - skip the rest of it
+    // and start again at the beginning.
+    used += capacity_ - write_pos;
+    write_pos = 0;
+  }
+
+  if (quint64(used) + size > capacity_) {
+    memory_.unlock();
+    return nullptr;
+  }
+
+  *offset = write_pos;
+  header_->write_pos = write_pos + size;
+  header_->used = used + size;
+
+  memory_.unlock();
+
+  return data_ + *offset;
+}
+
+const char* SharedMemoryRing::Data(quint32 offset, quint32 size) const {
+  if (!header_ || offset > capacity_ || size > capacity_ - offset) {
+    return nullptr;
+  }
+  return data_ + offset;
+}
+
+void SharedMemoryRing::Release(quint32 offset, quint32 size) {
+  memory_.lock();
+
+  if (offset < header_->read_pos && header_->read_pos <= capacity_) {
+    // The writer wrapped around, so the space it skipped at the end of the
+    // buffer is free again as well.
+    header_->used -= capacity_ - header_->read_pos;
+  }
+
+  header_->read_pos = offset + size;
+  header_->used -= size;
+
+  memory_.unlock();
+}
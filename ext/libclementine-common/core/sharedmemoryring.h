@@ -0,0 +1,80 @@
+/* This file is part of Clementine.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Note: this file is licensed under the Apache License instead of GPL because
+// it is used by the Spotify blob which links against libspotify and is not GPL
+// compatible.
+
+#ifndef SHAREDMEMORYRING_H
+#define SHAREDMEMORYRING_H
+
+#include <QSharedMemory>
+#include <QString>
+
+// A ring buffer in a shared memory segment that carries messages from one
+// process (the writer) to another (the reader).  Space is allocated by the
+// writer and released by the reader in the same order, so each message is one
+// contiguous block and can be serialised into and parsed from the shared
+// memory directly.  The writer tells the reader about each block by some other
+// means (_MessageHandlerBase uses its socket).
+class SharedMemoryRing {
+ public:
+  SharedMemoryRing();
+  ~SharedMemoryRing();
+
+  // Creates a new segment that can hold size bytes of messages.  Returns false
+  // if the segment could not be created.  A segment with the same key that
+  // was left behind by a process that crashed is deleted first.
+  bool Create(const QString& key, int size);
+
+  // Attaches to a segment created by another process.
+  bool Attach(const QString& key);
+
+  QString key() const { return memory_.key(); }
+  bool is_valid() const { return header_ != nullptr; }
+
+  // Writer side.  Reserves size contiguous bytes and returns a pointer to them,
+  // or nullptr if there isn't enough free space.  The offset of the block must
+  // be passed to the reader.
+  char* Allocate(quint32 size, quint32* offset);
+
+  // Reader side.  Returns a pointer to the block at offset, and frees it again
+  // when the reader is done with it.  Blocks must be released in the order they
+  // were allocated.  Data returns nullptr if the block isn't inside the ring -
+  // the offset and size come from the other process, so they can't be
+  // trusted.
+  const char* Data(quint32 offset, quint32 size) const;
+  void Release(quint32 offset, quint32 size);
+
+ private:
+  struct Header {
+    quint32 capacity;
+    quint32 write_pos;
+    quint32 read_pos;
+    // Bytes between read_pos and write_pos, including any space skipped at
+    // the end of the buffer when the writer wrapped around.
+    quint32 used;
+  };
+
+  Q_DISABLE_COPY(SharedMemoryRing);
+
+  QSharedMemory memory_;
+  Header* header_;
+  char* data_;
+  // A copy of header_->capacity that the other process can't change.
+  quint32 capacity_;
+};
+
+#endif  // SHAREDMEMORYRING_H
@@ -20,6 +20,7 @@
 
 #include <QAtomicInt>
 #include <QCoreApplication>
+#include <QDir>
 #include <QFile>
 #include <QLocalServer>
 #include <QLocalSocket>
@@ -74,12 +75,18 @@ class WorkerPool : public _WorkerPoolBase {
   // Sets the number of worker process to use.  Defaults to
   // 1 <= (processors / 2) <= 2.
   void SetWorkerCount(int count);
+  int worker_count() const { return worker_count_; }
 
   // Sets the prefix to use for the local server (on unix this is a named pipe
   // in /tmp).  Defaults to QApplication::applicationName().  A random number
   // is appended to this name when creating each server.
   void SetLocalServerName(const QString& local_server_name);
 
+  // Sets the size of the shared memory ring buffer offered to each worker for
+  // sending large replies.  Defaults to 0, which sends everything over the
+  // local socket.
+  void SetSharedMemorySize(int bytes);
+
   // Starts all workers.
   void Start();
 
@@ -124,6 +131,13 @@ class WorkerPool : public _WorkerPoolBase {
     return NULL;
   }
 
+  int WorkerIndex(const Worker* worker) const {
+    for (int i = 0; i < workers_.count(); ++i) {
+      if (&workers_[i] == worker) return i;
+    }
+    return -1;
+  }
+
   template <typename T>
   void DeleteQObjectPointerLater(T** p) {
     if (*p) {
@@ -147,6 +161,7 @@ class WorkerPool : public _WorkerPoolBase {
   QString executable_path_;
 
   int worker_count_;
+  int shared_memory_size_;
   mutable int next_worker_;
   QList<Worker> workers_;
 
@@ -158,7 +173,10 @@ class WorkerPool : public _WorkerPoolBase {
 
 template <typename HandlerType>
 WorkerPool<HandlerType>::WorkerPool(QObject* parent)
-    : _WorkerPoolBase(parent), next_worker_(0), next_id_(0) {
+    : _WorkerPoolBase(parent),
+      shared_memory_size_(0),
+      next_worker_(0),
+      next_id_(0) {
   worker_count_ = qBound(1, QThread::idealThreadCount() / 2, 2);
   local_server_name_ = qApp->applicationName().toLower();
 
@@ -206,6 +224,12 @@ void WorkerPool<HandlerType>::SetLocalServerName(
   local_server_name_ = local_server_name;
 }
 
+template <typename HandlerType>
+void WorkerPool<HandlerType>::SetSharedMemorySize(int bytes) {
+  Q_ASSERT(workers_.isEmpty());
+  shared_memory_size_ = bytes;
+}
+
 template <typename HandlerType>
 void WorkerPool<HandlerType>::SetExecutableName(
     const QString& executable_name) {
@@ -312,6 +336,17 @@ void WorkerPool<HandlerType>::NewConnection() {
   // Create the handler.
   worker->handler_ = new HandlerType(worker->local_socket_, this);
 
+  if (shared_memory_size_ > 0) {
+    // The key stays the same for each worker, so if a segment outlives a
+    // crash it's found and deleted the next time instead of being leaked.
+    const QString shared_memory_key =
+        QString("%1_%2_shm%3")
+            .arg(local_server_name_)
+            .arg(qHash(QDir::homePath()))
+            .arg(WorkerIndex(worker));
+    worker->handler_->OfferSharedMemory(shared_memory_key, shared_memory_size_);
+  }
+
   SendQueuedMessages();
 }
 
@@ -22,10 +22,13 @@
 #include <cstring>
 #include <cmath>
 
+#include <QByteArray>
+#include <QMap>
 #include <QMutex>
 #include <QMutexLocker>
 
 #include "gstfastspectrum.h"
+#include "plugin.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_fastspectrum_debug);
 #define GST_CAT_DEFAULT gst_fastspectrum_debug
@@ -113,6 +116,8 @@ gst_fastspectrum_class_init (GstFastSpectrumClass * klass)
   gst_caps_unref (caps);
 
   klass->fftw_lock = new QMutex;
+  klass->plans = new QMap<guint, fftw_plan>;
+  klass->wisdom_filename = new QByteArray;
 }
 
 static void
@@ -126,6 +131,34 @@ gst_fastspectrum_init (GstFastSpectrum * spectrum)
   g_mutex_init (&spectrum->lock);
 }
 
+static fftw_plan
+gst_fastspectrum_get_plan (GstFastSpectrumClass * klass, guint nfft)
+{
+  QMutexLocker l(klass->fftw_lock);
+
+  QMap<guint, fftw_plan>::const_iterator it = klass->plans->constFind(nfft);
+  if (it != klass->plans->constEnd())
+    return it.value();
+
+  /* The plan lives as long as the process, so it's worth measuring.
+   * FFTW_MEASURE overwrites the arrays it plans with, so use scratch ones.
+   * fftw_malloc gives them the same alignment as every instance's arrays. */
+  double* in = fftw_alloc_real(nfft);
+  fftw_complex* out = fftw_alloc_complex(nfft / 2 + 1);
+  fftw_plan plan = fftw_plan_dft_r2c_1d(nfft, in, out, FFTW_MEASURE);
+  fftw_free(in);
+  fftw_free(out);
+
+  klass->plans->insert(nfft, plan);
+
+  if (!klass->wisdom_filename->isEmpty() &&
+      !fftw_export_wisdom_to_filename(klass->wisdom_filename->constData()))
+    GST_WARNING ("failed to save FFTW wisdom to %s",
+        klass->wisdom_filename->constData());
+
+  return plan;
+}
+
 static void
 gst_fastspectrum_alloc_channel_data (GstFastSpectrum * spectrum)
 {
@@ -142,27 +175,14 @@ gst_fastspectrum_alloc_channel_data (GstFastSpectrum * spectrum)
 
   GstFastSpectrumClass* klass = reinterpret_cast<GstFastSpectrumClass*>(
       G_OBJECT_GET_CLASS(spectrum));
-  {
-    QMutexLocker l(klass->fftw_lock);
-    spectrum->plan = fftw_plan_dft_r2c_1d(
-        nfft,
-        spectrum->fft_input,
-        spectrum->fft_output,
-        FFTW_ESTIMATE);
-  }
+  spectrum->plan = gst_fastspectrum_get_plan (klass, nfft);
   spectrum->channel_data_initialised = true;
 }
 
 static void
 gst_fastspectrum_free_channel_data (GstFastSpectrum * spectrum)
 {
-  GstFastSpectrumClass* klass = reinterpret_cast<GstFastSpectrumClass*>(
-      G_OBJECT_GET_CLASS(spectrum));
   if (spectrum->channel_data_initialised) {
-    {
-      QMutexLocker l(klass->fftw_lock);
-      fftw_destroy_plan(spectrum->plan);
-    }
     fftw_free(spectrum->fft_input);
     fftw_free(spectrum->fft_output);
     delete[] spectrum->input_ring_buffer;
@@ -394,8 +414,9 @@ gst_fastspectrum_run_fft (GstFastSpectrum * spectrum, guint input_pos)
     spectrum->fft_input[i] =
         spectrum->input_ring_buffer[(input_pos + i) % nfft];
 
-  // Should be safe to execute the same plan multiple times in parallel.
-  fftw_execute(spectrum->plan);
+  // The plan is shared, so it has to be given this instance's arrays.
+  fftw_execute_dft_r2c(spectrum->plan, spectrum->fft_input,
+      spectrum->fft_output);
 
   gdouble val;
   /* Calculate magnitude in db */
@@ -551,3 +572,16 @@ gst_fastspectrum_transform_ip (GstBaseTransform * trans, GstBuffer * buffer)
 
   return GST_FLOW_OK;
 }
+
+void gstfastspectrum_set_wisdom_filename(const char* filename) {
+  GstFastSpectrumClass* klass = reinterpret_cast<GstFastSpectrumClass*>(
+      g_type_class_ref(GST_TYPE_FASTSPECTRUM));
+  {
+    QMutexLocker l(klass->fftw_lock);
+    *klass->wisdom_filename = filename;
+
+    // There won't be a file the first time.
+    fftw_import_wisdom_from_filename(filename);
+  }
+  g_type_class_unref(klass);
+}
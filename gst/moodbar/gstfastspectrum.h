@@ -31,6 +31,8 @@
 
 #include <functional>
 
+#include <QtCore/qcontainerfwd.h>
+
 #include <gst/gst.h>
 #include <gst/audio/gstaudiofilter.h>
 #include <fftw3.h>
@@ -43,6 +45,7 @@ G_BEGIN_DECLS
 #define GST_FASTSPECTRUM_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_FASTSPECTRUM,GstFastSpectrumClass))
 #define GST_IS_FASTSPECTRUM_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_FASTSPECTRUM))
 
+class QByteArray;
 class QMutex;
 
 typedef void (*GstFastSpectrumInputData)(const guint8* in, double* out,
@@ -71,7 +74,7 @@ struct GstFastSpectrum {
   double* fft_input;
   fftw_complex* fft_output;
   double* spect_magnitude;
-  fftw_plan plan;
+  fftw_plan plan;               /* shared, owned by the class */
 
   guint input_pos;
   guint64 error_per_interval;
@@ -87,8 +90,16 @@ struct GstFastSpectrum {
 struct GstFastSpectrumClass {
   GstAudioFilterClass parent_class;
 
-  // Static lock for creating & destroying FFTW plans.
+  // Static lock for everything that uses the FFTW planner.
   QMutex* fftw_lock;
+
+  // Plans for each FFT size, shared by all instances and never destroyed.
+  // Instances execute them on their own arrays with fftw_execute_dft_r2c(),
+  // which is safe to do from several threads at once.
+  QMap<guint, fftw_plan>* plans;
+
+  // Where to save FFTW wisdom after measuring a new plan, or empty.
+  QByteArray* wisdom_filename;
 };
 
 GType gst_fastspectrum_get_type (void);
@@ -20,6 +20,10 @@
 
 extern "C" {
   int gstfastspectrum_register_static();
+
+  // Loads FFTW wisdom from filename, and saves it there whenever a new FFT
+  // size has been measured.
+  void gstfastspectrum_set_wisdom_filename(const char* filename);
 }
 
 #endif  // GST_MOODBAR_PLUGIN_H_
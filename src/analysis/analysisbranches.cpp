@@ -0,0 +1,266 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "analysisbranches.h"
+
+#include <string.h>
+
+#include <chromaprint.h>
+
+#include "core/logging.h"
+
+#ifdef HAVE_MOODBAR
+#include "gst/moodbar/gstfastspectrum.h"
+#include "moodbar/moodbarbuilder.h"
+#include "moodbar/moodbarpipeline.h"
+#endif
+
+GstElement* AnalysisBranch::CreateElement(const char* factory_name,
+                                          GstElement* bin) {
+  GstElement* ret = gst_element_factory_make(factory_name, nullptr);
+
+  if (ret) {
+    gst_bin_add(GST_BIN(bin), ret);
+  } else {
+    qLog(Warning) << "Unable to create gstreamer element" << factory_name;
+  }
+
+  return ret;
+}
+
+GstElement* AnalysisBranch::CreateCapsFilter(GstElement* bin,
+                                             const char* format, int channels,
+                                             int rate) {
+  GstElement* ret = CreateElement("capsfilter", bin);
+  if (!ret) return nullptr;
+
+  GstCaps* caps = gst_caps_new_empty_simple("audio/x-raw");
+  if (format) {
+    gst_caps_set_simple(caps, "format", G_TYPE_STRING, format, nullptr);
+  }
+  if (channels) {
+    gst_caps_set_simple(caps, "channels", G_TYPE_INT, channels, nullptr);
+  }
+  if (rate) {
+    gst_caps_set_simple(caps, "rate", G_TYPE_INT, rate, nullptr);
+  }
+
+  g_object_set(ret, "caps", caps, nullptr);
+  gst_caps_unref(caps);
+  return ret;
+}
+
+GstElement* AppSinkBranch::CreateAppSink(GstElement* bin) {
+  GstElement* ret = CreateElement("appsink", bin);
+  if (!ret) return nullptr;
+
+  GstAppSinkCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.new_sample = NewSampleCallback;
+  gst_app_sink_set_callbacks(GST_APP_SINK(ret), &callbacks, this, nullptr);
+  g_object_set(ret, "sync", FALSE, nullptr);
+  return ret;
+}
+
+GstFlowReturn AppSinkBranch::NewSampleCallback(GstAppSink* sink,
+                                               gpointer self) {
+  AppSinkBranch* me = reinterpret_cast<AppSinkBranch*>(self);
+
+  GstSample* sample = gst_app_sink_pull_sample(sink);
+  if (!sample) return GST_FLOW_OK;
+
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+  GstMapInfo map;
+  if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    me->AddData(reinterpret_cast<const char*>(map.data), map.size);
+    gst_buffer_unmap(buffer, &map);
+  }
+  gst_sample_unref(sample);
+
+  return GST_FLOW_OK;
+}
+
+GstElement* ReplayGainBranch::CreateElements(GstElement* bin) {
+  GstElement* convert = CreateElement("audioconvert", bin);
+  GstElement* resample = CreateElement("audioresample", bin);
+  GstElement* capsfilter =
+      CreateCapsFilter(bin, "F32LE", 2, ReplayGain::kSampleRate);
+  GstElement* sink = CreateAppSink(bin);
+
+  if (!convert || !resample || !capsfilter || !sink ||
+      !gst_element_link_many(convert, resample, capsfilter, sink, nullptr)) {
+    return nullptr;
+  }
+  return convert;
+}
+
+void ReplayGainBranch::AddData(const char* data, int size) {
+  replaygain_.AddSamples(reinterpret_cast<const float*>(data),
+                         size / (2 * sizeof(float)));
+}
+
+void ReplayGainBranch::Finish(SongAnalysis* result) {
+  result->has_replaygain = replaygain_.TrackGain(&result->track_gain);
+  result->track_peak = replaygain_.peak();
+  result->loudness = replaygain_.histogram();
+}
+
+const int FingerprintBranch::kRate = 11025;
+const int FingerprintBranch::kSeconds = 30;
+
+GstElement* FingerprintBranch::CreateElements(GstElement* bin) {
+  // Chromaprint expects mono 16-bit ints at a sample rate of 11025Hz.
+  GstElement* convert = CreateElement("audioconvert", bin);
+  GstElement* resample = CreateElement("audioresample", bin);
+  GstElement* capsfilter = CreateCapsFilter(bin, "S16LE", 1, kRate);
+  GstElement* sink = CreateAppSink(bin);
+
+  if (!convert || !resample || !capsfilter || !sink ||
+      !gst_element_link_many(convert, resample, capsfilter, sink, nullptr)) {
+    return nullptr;
+  }
+
+  buffer_.reserve(kRate * kSeconds * sizeof(qint16));
+  return convert;
+}
+
+void FingerprintBranch::AddData(const char* data, int size) {
+  // The other branches need the rest of the file, so this one keeps taking
+  // buffers and just ignores them.
+  const int wanted = kRate * kSeconds * sizeof(qint16) - buffer_.size();
+  if (wanted > 0) buffer_.append(data, qMin(size, wanted));
+}
+
+void FingerprintBranch::Finish(SongAnalysis* result) {
+  if (buffer_.isEmpty()) return;
+
+  ChromaprintContext* chromaprint =
+      chromaprint_new(CHROMAPRINT_ALGORITHM_DEFAULT);
+  chromaprint_start(chromaprint, kRate, 1);
+  chromaprint_feed(chromaprint, reinterpret_cast<void*>(buffer_.data()),
+                   buffer_.size() / sizeof(qint16));
+  chromaprint_finish(chromaprint);
+
+  void* fprint = nullptr;
+  int size = 0;
+  if (chromaprint_get_raw_fingerprint(chromaprint, &fprint, &size) == 1) {
+    void* encoded = nullptr;
+    int encoded_size = 0;
+    chromaprint_encode_fingerprint(fprint, size, CHROMAPRINT_ALGORITHM_DEFAULT,
+                                   &encoded, &encoded_size, 1);
+
+    result->fingerprint = QString::fromAscii(
+        reinterpret_cast<const char*>(encoded), encoded_size);
+
+    chromaprint_dealloc(fprint);
+    chromaprint_dealloc(encoded);
+  }
+  chromaprint_free(chromaprint);
+
+  buffer_.clear();
+}
+
+BpmBranch::BpmBranch() : bpmdetect_(nullptr), sink_(nullptr), bpm_(-1) {}
+
+GstElement* BpmBranch::CreateElements(GstElement* bin) {
+  GstElement* convert = CreateElement("audioconvert", bin);
+  bpmdetect_ = CreateElement("bpmdetect", bin);
+  sink_ = CreateElement("fakesink", bin);
+
+  if (!convert || !bpmdetect_ || !sink_ ||
+      !gst_element_link_many(convert, bpmdetect_, sink_, nullptr)) {
+    return nullptr;
+  }
+
+  return convert;
+}
+
+void BpmBranch::HandleMessage(GstMessage* message) {
+  if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_TAG) return;
+
+  // Only look at bpmdetect's own tags.  The sink posts every tag that
+  // reaches it, including any BPM tag the file already has.
+  if (GST_MESSAGE_SRC(message) != GST_OBJECT(bpmdetect_)) return;
+
+  GstTagList* tags = nullptr;
+  gst_message_parse_tag(message, &tags);
+
+  // bpmdetect sends a new estimate every so often, the last one has heard
+  // the most of the song.
+  gdouble bpm = 0;
+  if (gst_tag_list_get_double(tags, GST_TAG_BEATS_PER_MINUTE, &bpm) &&
+      bpm > 0) {
+    bpm_ = bpm;
+  }
+  gst_tag_list_unref(tags);
+}
+
+void BpmBranch::Finish(SongAnalysis* result) {
+  if (bpm_ > 0) result->bpm = bpm_;
+}
+
+#ifdef HAVE_MOODBAR
+
+MoodbarBranch::MoodbarBranch() : spectrum_(nullptr) {}
+
+MoodbarBranch::~MoodbarBranch() {}
+
+GstElement* MoodbarBranch::CreateElements(GstElement* bin) {
+  GstElement* convert = CreateElement("audioconvert", bin);
+  spectrum_ = CreateElement("fastspectrum", bin);
+  GstElement* sink = CreateElement("fakesink", bin);
+
+  if (!convert || !spectrum_ || !sink ||
+      !gst_element_link_many(convert, spectrum_, sink, nullptr)) {
+    return nullptr;
+  }
+
+  g_object_set(spectrum_, "bands", MoodbarPipeline::kBands, nullptr);
+
+  GST_FASTSPECTRUM(spectrum_)->output_callback = [this](double* magnitudes,
+                                                        int size) {
+    // The bands depend on the rate the file was decoded at, which isn't
+    // known until the audio arrives.
+    if (!builder_) {
+      builder_.reset(new MoodbarBuilder);
+      builder_->Init(MoodbarPipeline::kBands, Rate());
+    }
+    builder_->AddFrame(magnitudes, size);
+  };
+
+  return convert;
+}
+
+int MoodbarBranch::Rate() const {
+  int rate = 0;
+  GstPad* pad = gst_element_get_static_pad(spectrum_, "sink");
+  GstCaps* caps = gst_pad_get_current_caps(pad);
+  if (caps) {
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "rate", &rate);
+    gst_caps_unref(caps);
+  }
+  gst_object_unref(pad);
+  return rate;
+}
+
+void MoodbarBranch::Finish(SongAnalysis* result) {
+  if (builder_) {
+    result->moodbar = builder_->Finish(1000);
+    builder_.reset();
+  }
+}
+
+#endif  // HAVE_MOODBAR
@@ -0,0 +1,108 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_ANALYSISBRANCHES_H_
+#define ANALYSIS_ANALYSISBRANCHES_H_
+
+#include <memory>
+
+#include <QByteArray>
+
+#include <gst/app/gstappsink.h>
+
+#include "config.h"
+#include "analysis/analysispipeline.h"
+#include "analysis/replaygain.h"
+
+class MoodbarBuilder;
+
+// A branch that ends in an appsink and looks at the raw samples itself.
+class AppSinkBranch : public AnalysisBranch {
+ protected:
+  // Creates an appsink in bin that passes everything to AddData().
+  GstElement* CreateAppSink(GstElement* bin);
+
+  virtual void AddData(const char* data, int size) = 0;
+
+ private:
+  static GstFlowReturn NewSampleCallback(GstAppSink* sink, gpointer self);
+};
+
+// Track gain and peak, and the loudness histogram for the album gain.
+class ReplayGainBranch : public AppSinkBranch {
+ public:
+  GstElement* CreateElements(GstElement* bin);
+  void Finish(SongAnalysis* result);
+
+ protected:
+  void AddData(const char* data, int size);
+
+ private:
+  ReplayGain replaygain_;
+};
+
+// An AcoustID fingerprint of the first 30 seconds, the same as Chromaprinter
+// makes.
+class FingerprintBranch : public AppSinkBranch {
+ public:
+  GstElement* CreateElements(GstElement* bin);
+  void Finish(SongAnalysis* result);
+
+ protected:
+  void AddData(const char* data, int size);
+
+ private:
+  static const int kRate;
+  static const int kSeconds;
+
+  QByteArray buffer_;
+};
+
+// Tempo from the soundtouch bpmdetect element, which is in gst-plugins-bad
+// and so might not be installed.
+class BpmBranch : public AnalysisBranch {
+ public:
+  BpmBranch();
+
+  GstElement* CreateElements(GstElement* bin);
+  void HandleMessage(GstMessage* message);
+  void Finish(SongAnalysis* result);
+
+ private:
+  GstElement* bpmdetect_;
+  GstElement* sink_;
+  double bpm_;
+};
+
+#ifdef HAVE_MOODBAR
+// The same moodbar as MoodbarPipeline makes.
+class MoodbarBranch : public AnalysisBranch {
+ public:
+  MoodbarBranch();
+  ~MoodbarBranch();
+
+  GstElement* CreateElements(GstElement* bin);
+  void Finish(SongAnalysis* result);
+
+ private:
+  int Rate() const;
+
+  GstElement* spectrum_;
+  std::unique_ptr<MoodbarBuilder> builder_;
+};
+#endif  // HAVE_MOODBAR
+
+#endif  // ANALYSIS_ANALYSISBRANCHES_H_
@@ -0,0 +1,234 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "analysispipeline.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include "config.h"
+#include "analysis/analysisbranches.h"
+#include "core/logging.h"
+#include "core/signalchecker.h"
+#include "core/utilities.h"
+
+AnalysisPipeline::AnalysisPipeline(int song_id, const QUrl& url,
+                                   Analyzers analyzers)
+    : QObject(nullptr),
+      analyzers_(analyzers),
+      pipeline_(nullptr),
+      tee_(nullptr),
+      stopped_(0),
+      success_(false) {
+  result_.id = song_id;
+  result_.url = url;
+}
+
+AnalysisPipeline::~AnalysisPipeline() { Cleanup(); }
+
+void AnalysisPipeline::Start() {
+  Q_ASSERT(QThread::currentThread() != qApp->thread());
+
+  Utilities::SetThreadIOPriority(Utilities::IOPRIO_CLASS_IDLE);
+
+  if (pipeline_) {
+    return;
+  }
+
+  pipeline_ = gst_pipeline_new("analysis-pipeline");
+
+  GstElement* decodebin = gst_element_factory_make("uridecodebin", nullptr);
+  tee_ = gst_element_factory_make("tee", nullptr);
+  if (!decodebin || !tee_) {
+    qLog(Warning) << "Unable to create gstreamer elements for analysis";
+    if (decodebin) gst_object_unref(decodebin);
+    if (tee_) gst_object_unref(tee_);
+    tee_ = nullptr;
+    Cleanup();
+    emit Finished(false);
+    return;
+  }
+  gst_bin_add_many(GST_BIN(pipeline_), decodebin, tee_, nullptr);
+
+  CreateBranches(analyzers_);
+  if (branches_.empty()) {
+    qLog(Error) << "None of the analyzers could be created";
+    Cleanup();
+    emit Finished(false);
+    return;
+  }
+
+  // Set properties
+  g_object_set(decodebin, "uri", result_.url.toEncoded().constData(),
+               nullptr);
+
+  // Connect signals
+  CHECKED_GCONNECT(decodebin, "pad-added", &NewPadCallback, this);
+  GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline_));
+  gst_bus_set_sync_handler(bus, BusCallbackSync, this, nullptr);
+  gst_object_unref(bus);
+
+  // Start playing
+  gst_element_set_state(pipeline_, GST_STATE_PLAYING);
+}
+
+void AnalysisPipeline::CreateBranches(Analyzers analyzers) {
+  std::vector<std::unique_ptr<AnalysisBranch>> wanted;
+#ifdef HAVE_MOODBAR
+  if (analyzers & Analyzer_Moodbar) wanted.emplace_back(new MoodbarBranch);
+#endif
+  if (analyzers & Analyzer_ReplayGain) {
+    wanted.emplace_back(new ReplayGainBranch);
+  }
+  if (analyzers & Analyzer_Fingerprint) {
+    wanted.emplace_back(new FingerprintBranch);
+  }
+  if (analyzers & Analyzer_Bpm) wanted.emplace_back(new BpmBranch);
+
+  for (std::unique_ptr<AnalysisBranch>& branch : wanted) {
+    // Each branch lives in a bin of its own, so one that can't be built can
+    // be thrown away without leaving an unlinked sink in the pipeline.
+    GstElement* bin = gst_bin_new(nullptr);
+    GstElement* queue = gst_element_factory_make("queue", nullptr);
+    GstElement* first = queue ? branch->CreateElements(bin) : nullptr;
+
+    if (!first) {
+      if (queue) gst_object_unref(queue);
+      gst_object_unref(bin);
+      continue;
+    }
+
+    gst_bin_add(GST_BIN(bin), queue);
+    gst_element_link(queue, first);
+
+    GstPad* pad = gst_element_get_static_pad(queue, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(pad);
+
+    gst_bin_add(GST_BIN(pipeline_), bin);
+    if (!gst_element_link(tee_, bin)) {
+      qLog(Warning) << "Failed to link analysis branch";
+      gst_bin_remove(GST_BIN(pipeline_), bin);
+      continue;
+    }
+
+    branches_.push_back(std::move(branch));
+  }
+}
+
+void AnalysisPipeline::ReportError(GstMessage* msg) {
+  GError* error;
+  gchar* debugs;
+
+  gst_message_parse_error(msg, &error, &debugs);
+  QString message = QString::fromLocal8Bit(error->message);
+
+  g_error_free(error);
+  free(debugs);
+
+  qLog(Error) << "Error analyzing" << result_.url << ":" << message;
+}
+
+void AnalysisPipeline::NewPadCallback(GstElement*, GstPad* pad,
+                                      gpointer data) {
+  AnalysisPipeline* self = reinterpret_cast<AnalysisPipeline*>(data);
+
+  // Ignore video streams and album art.
+  GstCaps* caps = gst_pad_query_caps(pad, nullptr);
+  const bool is_audio =
+      caps && gst_caps_get_size(caps) > 0 &&
+      g_str_has_prefix(
+          gst_structure_get_name(gst_caps_get_structure(caps, 0)), "audio/");
+  if (caps) gst_caps_unref(caps);
+  if (!is_audio) return;
+
+  GstPad* const teepad = gst_element_get_static_pad(self->tee_, "sink");
+
+  if (GST_PAD_IS_LINKED(teepad)) {
+    qLog(Warning) << "Only analyzing the first audio stream of"
+                  << self->result_.url;
+  } else {
+    gst_pad_link(pad, teepad);
+  }
+  gst_object_unref(teepad);
+}
+
+GstBusSyncReply AnalysisPipeline::BusCallbackSync(GstBus*, GstMessage* msg,
+                                                  gpointer data) {
+  AnalysisPipeline* self = reinterpret_cast<AnalysisPipeline*>(data);
+
+  switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_EOS:
+      self->Stop(true);
+      break;
+
+    case GST_MESSAGE_ERROR:
+      self->ReportError(msg);
+      self->Stop(false);
+      break;
+
+    case GST_MESSAGE_STREAM_STATUS: {
+      // Streaming threads post this from themselves when they start, so this
+      // is where we can lower the IO priority of the thread doing the reads.
+      GstStreamStatusType type;
+      gst_message_parse_stream_status(msg, &type, nullptr);
+      if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        Utilities::SetThreadIOPriority(Utilities::IOPRIO_CLASS_IDLE);
+      }
+      break;
+    }
+
+    default:
+      for (const std::unique_ptr<AnalysisBranch>& branch : self->branches_) {
+        branch->HandleMessage(msg);
+      }
+      break;
+  }
+  return GST_BUS_PASS;
+}
+
+void AnalysisPipeline::Stop(bool success) {
+  // Every queue has a streaming thread of its own, so a second error can
+  // arrive while we're handling the first.
+  if (!stopped_.testAndSetOrdered(0, 1)) return;
+
+  success_ = success;
+  if (success) {
+    for (const std::unique_ptr<AnalysisBranch>& branch : branches_) {
+      branch->Finish(&result_);
+    }
+  }
+
+  emit Finished(success);
+}
+
+void AnalysisPipeline::Cleanup() {
+  Q_ASSERT(QThread::currentThread() == thread());
+  Q_ASSERT(QThread::currentThread() != qApp->thread());
+
+  if (pipeline_) {
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline_));
+    gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline_, GST_STATE_NULL);
+    gst_object_unref(pipeline_);
+    pipeline_ = nullptr;
+    tee_ = nullptr;
+  }
+
+  branches_.clear();
+}
@@ -0,0 +1,112 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_ANALYSISPIPELINE_H_
+#define ANALYSIS_ANALYSISPIPELINE_H_
+
+#include <memory>
+#include <vector>
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QUrl>
+
+#include <gst/gst.h>
+
+#include "analysis/songanalysis.h"
+
+// One analyzer fed by an AnalysisPipeline.  Each branch gets its own copy of
+// the decoded audio through a queue, and converts it to whatever format it
+// needs.  Branches run on GStreamer's streaming threads.
+class AnalysisBranch {
+ public:
+  virtual ~AnalysisBranch() {}
+
+  // Adds the branch's elements to bin and links them together.  Returns the
+  // first element, which the decoded audio will be linked to, or nullptr if
+  // the branch can't run on this system.
+  virtual GstElement* CreateElements(GstElement* bin) = 0;
+
+  // Sees every message posted on the pipeline's bus.
+  virtual void HandleMessage(GstMessage*) {}
+
+  // Called once the whole file has been decoded.
+  virtual void Finish(SongAnalysis* result) = 0;
+
+ protected:
+  static GstElement* CreateElement(const char* factory_name, GstElement* bin);
+
+  // Creates a capsfilter for raw audio in the given format.  A channels or
+  // rate of 0 leaves it unconstrained.
+  static GstElement* CreateCapsFilter(GstElement* bin, const char* format,
+                                      int channels, int rate);
+};
+
+// Decodes a local file once and tees the audio into several analyzers, so a
+// library-wide analysis doesn't have to decode each file once per analyzer.
+class AnalysisPipeline : public QObject {
+  Q_OBJECT
+
+ public:
+  enum Analyzer {
+    Analyzer_Moodbar = 0x01,
+    Analyzer_ReplayGain = 0x02,
+    Analyzer_Fingerprint = 0x04,
+    Analyzer_Bpm = 0x08,
+
+    Analyzer_All = 0xff
+  };
+  Q_DECLARE_FLAGS(Analyzers, Analyzer)
+
+  AnalysisPipeline(int song_id, const QUrl& url,
+                   Analyzers analyzers = Analyzer_All);
+  ~AnalysisPipeline();
+
+  bool success() const { return success_; }
+  const SongAnalysis& result() const { return result_; }
+
+ public slots:
+  void Start();
+
+ signals:
+  void Finished(bool success);
+
+ private:
+  void CreateBranches(Analyzers analyzers);
+
+  void ReportError(GstMessage* message);
+  void Stop(bool success);
+  void Cleanup();
+
+  static void NewPadCallback(GstElement*, GstPad* pad, gpointer data);
+  static GstBusSyncReply BusCallbackSync(GstBus*, GstMessage* msg,
+                                         gpointer data);
+
+ private:
+  Analyzers analyzers_;
+  GstElement* pipeline_;
+  GstElement* tee_;
+
+  std::vector<std::unique_ptr<AnalysisBranch>> branches_;
+
+  QAtomicInt stopped_;
+  bool success_;
+  SongAnalysis result_;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(AnalysisPipeline::Analyzers)
+
+#endif  // ANALYSIS_ANALYSISPIPELINE_H_
@@ -0,0 +1,242 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libraryanalyzer.h"
+
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+#include "config.h"
+#include "analysis/analysispipeline.h"
+#include "core/application.h"
+#include "core/closure.h"
+#include "core/logging.h"
+#include "library/librarybackend.h"
+
+#ifdef HAVE_MOODBAR
+#include "moodbar/moodbarloader.h"
+#endif
+
+// Small enough that a crash doesn't lose much, big enough that the library
+// views aren't refreshed for every song.
+const int LibraryAnalyzer::kBatchSize = 50;
+
+LibraryAnalyzer::LibraryAnalyzer(Application* app, QObject* parent)
+    : QObject(parent),
+      app_(app),
+      thread_(new QThread(this)),
+      kMaxActivePipelines(qMax(1, QThread::idealThreadCount())),
+      task_id_(-1),
+      active_pipelines_(0),
+      done_(0),
+      total_(0) {}
+
+LibraryAnalyzer::~LibraryAnalyzer() {
+  // The pipelines are deleted in their own thread, which does any deferred
+  // deletes before it finishes.
+  for (AnalysisPipeline* pipeline : pipelines_) {
+    pipeline->deleteLater();
+  }
+
+  thread_->quit();
+  thread_->wait(1000);
+}
+
+void LibraryAnalyzer::AnalyzeLibrary() {
+  if (is_running()) return;
+
+  task_id_ = app_->task_manager()->StartTask(tr("Analyzing library"));
+
+  QFuture<SongList> future = QtConcurrent::run(
+      &LibraryAnalyzer::FindSongsToAnalyze, app_->library_backend());
+  NewClosure(future, this, SLOT(SongListReady(QFuture<SongList>)), future);
+}
+
+QString LibraryAnalyzer::AlbumKey(const Song& song) {
+  // Songs without an album don't get an album gain.
+  if (song.album().isEmpty()) return QString();
+  return song.effective_albumartist() + "\t" + song.album();
+}
+
+SongList LibraryAnalyzer::FindSongsToAnalyze(LibraryBackend* backend) {
+  SongList ret;
+
+  for (const Song& song : backend->GetAllSongs()) {
+    // The gain of a whole cue sheet image would be wrong for every track.
+    if (song.url().scheme() != "file" || song.is_unavailable() ||
+        song.has_cue()) {
+      continue;
+    }
+    ret << song;
+  }
+
+  // Keep the tracks of each album together.
+  std::stable_sort(ret.begin(), ret.end(), [](const Song& a, const Song& b) {
+    return AlbumKey(a) < AlbumKey(b);
+  });
+  return ret;
+}
+
+void LibraryAnalyzer::SongListReady(QFuture<SongList> future) {
+  queue_ = future.result();
+  done_ = 0;
+  total_ = queue_.count();
+  progress_.Start(app_->task_manager(), task_id_, tr("songs"));
+
+  for (const Song& song : queue_) {
+    const QString album = AlbumKey(song);
+    if (!album.isEmpty()) album_remaining_[album]++;
+  }
+
+  qLog(Info) << "Analyzing" << total_ << "library songs";
+
+  MaybeStartNext();
+}
+
+void LibraryAnalyzer::MaybeStartNext() {
+  Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+  if (!thread_->isRunning()) thread_->start(QThread::IdlePriority);
+
+  while (!queue_.isEmpty() && active_pipelines_ < kMaxActivePipelines) {
+    const Song song = queue_.takeFirst();
+
+    AnalysisPipeline::Analyzers analyzers = AnalysisPipeline::Analyzer_All;
+#ifdef HAVE_MOODBAR
+    // Don't redo moodbars the moodbar loader already has.
+    if (app_->moodbar_loader()->HasData(song.url())) {
+      analyzers &= ~AnalysisPipeline::Analyzer_Moodbar;
+    }
+#endif
+
+    AnalysisPipeline* pipeline =
+        new AnalysisPipeline(song.id(), song.url(), analyzers);
+    pipeline->moveToThread(thread_);
+    pipelines_ << pipeline;
+    NewClosure(pipeline, SIGNAL(Finished(bool)), this,
+               SLOT(PipelineFinished(AnalysisPipeline*, QString)), pipeline,
+               AlbumKey(song));
+
+    active_pipelines_++;
+    QMetaObject::invokeMethod(pipeline, "Start", Qt::QueuedConnection);
+  }
+
+  UpdateProgress();
+}
+
+void LibraryAnalyzer::PipelineFinished(AnalysisPipeline* pipeline,
+                                       const QString& album) {
+  Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+  active_pipelines_--;
+  done_++;
+
+  if (pipeline->success()) {
+    const SongAnalysis& result = pipeline->result();
+
+#ifdef HAVE_MOODBAR
+    if (!result.moodbar.isEmpty()) {
+      app_->moodbar_loader()->SaveData(result.url, result.moodbar);
+    }
+#endif
+
+    if (album.isEmpty()) {
+      pending_writes_ << result;
+    } else {
+      albums_[album] << result;
+    }
+  }
+
+  if (!album.isEmpty() && --album_remaining_[album] == 0) {
+    AlbumFinished(album);
+  }
+
+  // Give the pipeline's streaming threads a moment to finish with it.
+  QTimer* timer = new QTimer(this);
+  timer->setSingleShot(true);
+  NewClosure(timer, SIGNAL(timeout()), this,
+             SLOT(DeletePipeline(AnalysisPipeline*)), pipeline);
+  connect(timer, SIGNAL(timeout()), timer, SLOT(deleteLater()));
+  timer->start(1000);
+
+  if (pending_writes_.count() >= kBatchSize ||
+      (queue_.isEmpty() && active_pipelines_ == 0)) {
+    FlushResults();
+  }
+
+  MaybeStartNext();
+}
+
+void LibraryAnalyzer::DeletePipeline(AnalysisPipeline* pipeline) {
+  pipelines_.remove(pipeline);
+  pipeline->deleteLater();
+}
+
+void LibraryAnalyzer::AlbumFinished(const QString& album) {
+  album_remaining_.remove(album);
+  QList<SongAnalysis> results = albums_.take(album);
+
+  ReplayGain::Histogram loudness;
+  float peak = 0;
+  for (const SongAnalysis& result : results) {
+    if (!result.has_replaygain) continue;
+    ReplayGain::AddHistogram(result.loudness, &loudness);
+    peak = qMax(peak, result.track_peak);
+  }
+
+  double gain = 0;
+  const bool has_gain = ReplayGain::Gain(loudness, &gain);
+
+  for (SongAnalysis& result : results) {
+    result.has_album_gain = has_gain;
+    result.album_gain = gain;
+    result.album_peak = peak;
+
+    // Nobody needs the histogram any more, and they add up to a lot of
+    // memory over a whole library.
+    result.loudness.clear();
+  }
+
+  pending_writes_ << results;
+}
+
+void LibraryAnalyzer::FlushResults() {
+  if (pending_writes_.isEmpty()) return;
+
+  QtConcurrent::run(app_->library_backend(),
+                    &LibraryBackend::UpdateSongsAnalysis, pending_writes_);
+  pending_writes_.clear();
+}
+
+void LibraryAnalyzer::UpdateProgress() {
+  // The task is still looking for songs until progress_ starts.
+  if (!is_running() || !progress_.is_started()) return;
+
+  if (queue_.isEmpty() && active_pipelines_ == 0) {
+    qLog(Info) << "Analyzed" << done_ << "library songs in"
+               << progress_.elapsed_msec() / 1000 << "seconds";
+
+    progress_.Finish();
+    task_id_ = -1;
+    return;
+  }
+
+  progress_.Update(done_, total_, done_);
+}
@@ -0,0 +1,90 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_LIBRARYANALYZER_H_
+#define ANALYSIS_LIBRARYANALYZER_H_
+
+#include <QFuture>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+
+#include "analysis/songanalysis.h"
+#include "core/song.h"
+#include "core/taskmanager.h"
+
+class Application;
+class AnalysisPipeline;
+class LibraryBackend;
+
+// Runs every song in the library through an AnalysisPipeline, a few at a
+// time, and saves the moodbar, ReplayGain, fingerprint and BPM it finds.
+// Songs are taken an album at a time so the album gain can be worked out as
+// soon as the last track of each album is done.
+class LibraryAnalyzer : public QObject {
+  Q_OBJECT
+
+ public:
+  LibraryAnalyzer(Application* app, QObject* parent = nullptr);
+  ~LibraryAnalyzer();
+
+  bool is_running() const { return task_id_ != -1; }
+
+ public slots:
+  void AnalyzeLibrary();
+
+ private slots:
+  void SongListReady(QFuture<SongList> future);
+  void PipelineFinished(AnalysisPipeline* pipeline, const QString& album);
+  void DeletePipeline(AnalysisPipeline* pipeline);
+
+ private:
+  static SongList FindSongsToAnalyze(LibraryBackend* backend);
+  static QString AlbumKey(const Song& song);
+
+  void MaybeStartNext();
+  void AlbumFinished(const QString& album);
+  void FlushResults();
+  void UpdateProgress();
+
+ private:
+  static const int kBatchSize;
+
+  Application* app_;
+  QThread* thread_;
+  const int kMaxActivePipelines;
+
+  int task_id_;
+  SongList queue_;
+  int active_pipelines_;
+  // Every pipeline that hasn't been deleted yet, including finished ones.
+  QSet<AnalysisPipeline*> pipelines_;
+
+  // Results waiting for the rest of their album, and how many of the album's
+  // songs are still in queue_ or being analyzed.
+  QMap<QString, QList<SongAnalysis>> albums_;
+  QMap<QString, int> album_remaining_;
+
+  // Results waiting to be written to the database.
+  QList<SongAnalysis> pending_writes_;
+
+  int done_;
+  int total_;
+  TaskManager::ProgressReporter progress_;
+};
+
+#endif  // ANALYSIS_LIBRARYANALYZER_H_
@@ -0,0 +1,147 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replaygain.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <QtGlobal>
+
+const int ReplayGain::kSampleRate = 44100;
+
+namespace {
+
+const double kReferenceLevel = 64.82;  // 89dB SPL on the 16-bit scale
+const int kStepsPerDb = 100;
+const int kMaxDb = 120;
+const double kBlockSeconds = 0.050;
+const double kPercentile = 0.95;
+
+// Approximates the inverse of the equal loudness curve at 44.1kHz.
+const double kYuleB[] = {0.05418656406430,  -0.02911007808948,
+                         -0.00848709379851, -0.00851165645469,
+                         -0.00834990904936, 0.02245293253339,
+                         -0.02596338512915, 0.01624864962975,
+                         -0.00240879051584, 0.00674613682247,
+                         -0.00187763777362};
+const double kYuleA[] = {1.0,               -3.47845948550071,
+                         6.36317777566148,  -8.54751527471874,
+                         9.47693607801280,  -8.81498681370155,
+                         6.85401540936998,  -4.39470996079559,
+                         2.19611684890774,  -0.75104302451432,
+                         0.13149317958808};
+
+// 150Hz high pass, for the bass the Yule filter can't get down to.
+const double kButterB[] = {0.98500175787242, -1.97000351574484,
+                           0.98500175787242};
+const double kButterA[] = {1.0, -1.96977855582618, 0.97022847566350};
+
+// Shifts history along by one and puts value at the front.
+template <int N>
+void Push(double (&history)[N], double value) {
+  memmove(history + 1, history, (N - 1) * sizeof(double));
+  history[0] = value;
+}
+
+}  // namespace
+
+ReplayGain::Channel::Channel() {
+  memset(yule_in, 0, sizeof(yule_in));
+  memset(yule_out, 0, sizeof(yule_out));
+  memset(butter_in, 0, sizeof(butter_in));
+  memset(butter_out, 0, sizeof(butter_out));
+}
+
+double ReplayGain::Channel::Filter(double sample) {
+  // The 1e-10 keeps the feedback out of denormals during silence, which
+  // would otherwise slow the loop down a lot.
+  double yule = 1e-10 + kYuleB[0] * sample;
+  for (int i = 0; i < kYuleOrder; ++i) {
+    yule += kYuleB[i + 1] * yule_in[i] - kYuleA[i + 1] * yule_out[i];
+  }
+  Push(yule_in, sample);
+  Push(yule_out, yule);
+
+  double butter = kButterB[0] * yule;
+  for (int i = 0; i < kButterOrder; ++i) {
+    butter += kButterB[i + 1] * butter_in[i] - kButterA[i + 1] * butter_out[i];
+  }
+  Push(butter_in, yule);
+  Push(butter_out, butter);
+
+  return butter;
+}
+
+ReplayGain::ReplayGain()
+    : block_sum_(0),
+      block_frames_(0),
+      frames_per_block_(int(ceil(kSampleRate * kBlockSeconds))),
+      histogram_(kStepsPerDb * kMaxDb, 0),
+      peak_(0) {}
+
+void ReplayGain::AddSamples(const float* samples, int frames) {
+  for (int i = 0; i < frames; ++i) {
+    const float l = samples[i * 2];
+    const float r = samples[i * 2 + 1];
+    peak_ = qMax(peak_, qMax(qAbs(l), qAbs(r)));
+
+    // The filters and levels are all defined on the 16-bit scale.
+    const double left = left_.Filter(l * 32768.0);
+    const double right = right_.Filter(r * 32768.0);
+    block_sum_ += left * left + right * right;
+
+    if (++block_frames_ < frames_per_block_) continue;
+
+    const double mean_square = block_sum_ / block_frames_ * 0.5;
+    const double level = kStepsPerDb * 10.0 * log10(mean_square + 1e-37);
+    const int bucket =
+        qBound(0, level <= 0 ? 0 : int(level), histogram_.size() - 1);
+    histogram_[bucket]++;
+
+    block_sum_ = 0;
+    block_frames_ = 0;
+  }
+}
+
+void ReplayGain::AddHistogram(const Histogram& other, Histogram* total) {
+  if (total->isEmpty()) {
+    *total = other;
+    return;
+  }
+
+  Q_ASSERT(total->size() == other.size());
+  for (int i = 0; i < other.size(); ++i) {
+    (*total)[i] += other[i];
+  }
+}
+
+bool ReplayGain::Gain(const Histogram& histogram, double* gain) {
+  qint64 blocks = 0;
+  for (quint32 count : histogram) blocks += count;
+  if (blocks == 0) return false;
+
+  // Walk down from the loudest bucket until 5% of the blocks are above us.
+  qint64 remaining = qint64(ceil(blocks * (1.0 - kPercentile)));
+  int i = histogram.size();
+  while (i-- > 0) {
+    remaining -= histogram[i];
+    if (remaining <= 0) break;
+  }
+
+  *gain = kReferenceLevel - double(qMax(0, i)) / kStepsPerDb;
+  return true;
+}
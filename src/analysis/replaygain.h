@@ -0,0 +1,78 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_REPLAYGAIN_H_
+#define ANALYSIS_REPLAYGAIN_H_
+
+#include <QVector>
+
+// Measures the ReplayGain 1.0 loudness of 44.1kHz stereo audio, the same way
+// as the reference gain_analysis.c.  The audio is run through an equal
+// loudness filter and its level is recorded every 50ms in a histogram.  The
+// gain is taken from the 95th percentile of that histogram, so the histograms
+// of all the tracks of an album can be added together to get the album gain.
+class ReplayGain {
+ public:
+  ReplayGain();
+
+  static const int kSampleRate;
+
+  // One bucket per 1/100th of a dB, from 0 to 120dB.
+  typedef QVector<quint32> Histogram;
+
+  // Adds frames of interleaved stereo samples in the range [-1, 1].
+  void AddSamples(const float* samples, int frames);
+
+  const Histogram& histogram() const { return histogram_; }
+  float peak() const { return peak_; }
+
+  // Adds the blocks of other to total, which may start empty.
+  static void AddHistogram(const Histogram& other, Histogram* total);
+
+  // The gain in dB that brings the audio to the 89dB reference level.
+  // Returns false if there wasn't enough audio to fill a single block.
+  static bool Gain(const Histogram& histogram, double* gain);
+  bool TrackGain(double* gain) const { return Gain(histogram_, gain); }
+
+ private:
+  static const int kYuleOrder = 10;
+  static const int kButterOrder = 2;
+
+  struct Channel {
+    Channel();
+
+    // The last inputs and outputs of each filter, newest first.
+    double yule_in[kYuleOrder];
+    double yule_out[kYuleOrder];
+    double butter_in[kButterOrder];
+    double butter_out[kButterOrder];
+
+    // Runs one sample through both filters.
+    double Filter(double sample);
+  };
+
+  Channel left_;
+  Channel right_;
+
+  double block_sum_;
+  int block_frames_;
+  const int frames_per_block_;
+
+  Histogram histogram_;
+  float peak_;
+};
+
+#endif  // ANALYSIS_REPLAYGAIN_H_
@@ -0,0 +1,58 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYSIS_SONGANALYSIS_H_
+#define ANALYSIS_SONGANALYSIS_H_
+
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+
+#include "analysis/replaygain.h"
+
+// Everything an AnalysisPipeline found out about one file.  Fields that an
+// analyzer couldn't fill in are left at their defaults.
+struct SongAnalysis {
+  SongAnalysis()
+      : id(-1),
+        has_replaygain(false),
+        track_gain(0),
+        track_peak(0),
+        has_album_gain(false),
+        album_gain(0),
+        album_peak(0),
+        bpm(-1) {}
+
+  int id;
+  QUrl url;
+
+  QByteArray moodbar;
+  QString fingerprint;
+
+  bool has_replaygain;
+  double track_gain;
+  float track_peak;
+  ReplayGain::Histogram loudness;
+
+  // Filled in by LibraryAnalyzer once every track of the album is done.
+  bool has_album_gain;
+  double album_gain;
+  float album_peak;
+
+  float bpm;
+};
+
+#endif  // ANALYSIS_SONGANALYSIS_H_
@@ -60,15 +60,29 @@ static const int sBarkBands[] = {
 
 static const int sBarkBandCount = arraysize(sBarkBands);
 
+const int Analyzer::Base::kMaxSkippedFrames = 3;
+const int Analyzer::Base::kMaxSkippedSteadyFrames = 1;
+const float Analyzer::Base::kSteadyEnergyChange = 0.05;
+
+// Frames in a row that have to be steady before each further skipped tick.
+static const int kSteadyFramesPerSkip = 8;
+
 Analyzer::Base::Base(QWidget* parent, uint scopeSize)
     : QWidget(parent),
       timeout_(40)  // msec
       ,
-      fht_(new FHT(scopeSize)),
+      fft_(new FFT(scopeSize)),
       engine_(nullptr),
       lastScope_(512),
       new_frame_(false),
       is_playing_(false),
+      adaptive_frame_rate_(false),
+      frame_changed_(true),
+      frame_ticks_(1),
+      skipped_ticks_(0),
+      frames_to_skip_(0),
+      steady_frames_(0),
+      last_energy_(0),
       barkband_table_(QList<uint>()),
       prev_color_index_(0),
       bands_(0),
@@ -82,24 +96,27 @@ void Analyzer::Base::transform(Scope& scope) {
   // this is a standard transformation that should give
   // an FFT scope that has bands for pretty analyzers
 
-  // NOTE resizing here is redundant as FHT routines only calculate FHT::size()
+  // NOTE resizing here is redundant as FFT routines only calculate FFT::size()
   // values
-  // scope.resize( fht_->size() );
+  // scope.resize( fft_->size() );
 
   float* front = static_cast<float*>(&scope.front());
 
-  float* f = new float[fht_->size()];
-  fht_->copy(&f[0], front);
-  fht_->logSpectrum(front, &f[0]);
-  fht_->scale(front, 1.0 / 20);
+  fft_->logSpectrum(front);
+  fft_->scale(front, 1.0 / 20);
 
-  scope.resize(fht_->size() / 2);  // second half of values are rubbish
-  delete[] f;
+  scope.resize(fft_->size() / 2);  // second half of values are rubbish
 }
 
 void Analyzer::Base::paintEvent(QPaintEvent* e) {
   QPainter p(this);
-  p.fillRect(e->rect(), palette().color(QPalette::Window));
+  // Analyzers that cover every pixel themselves set WA_OpaquePaintEvent.
+  if (!testAttribute(Qt::WA_OpaquePaintEvent)) {
+    p.fillRect(e->rect(), palette().color(QPalette::Window));
+  }
+
+  const bool new_frame = new_frame_;
+  frame_changed_ = true;
 
   switch (engine_->state()) {
     case Engine::Playing: {
@@ -108,7 +125,7 @@ void Analyzer::Base::paintEvent(QPaintEvent* e) {
 
       // convert to mono here - our built in analyzers need mono, but the
       // engines provide interleaved pcm
-      for (uint x = 0; static_cast<int>(x) < fht_->size(); ++x) {
+      for (uint x = 0; static_cast<int>(x) < fft_->size(); ++x) {
         lastScope_[x] = static_cast<double>(thescope[i] + thescope[i + 1]) /
                         (2 * (1 << 15));
         i += 2;
@@ -117,33 +134,59 @@ void Analyzer::Base::paintEvent(QPaintEvent* e) {
       is_playing_ = true;
       transform(lastScope_);
       analyze(p, lastScope_, new_frame_);
+      if (new_frame && adaptive_frame_rate_) updateFrameSkip(lastScope_);
 
-      // scope.resize( fht_->size() );
+      // scope.resize( fft_->size() );
 
       break;
     }
     case Engine::Paused:
       is_playing_ = false;
       analyze(p, lastScope_, new_frame_);
+      if (new_frame && adaptive_frame_rate_) updateFrameSkip(lastScope_);
       break;
 
     default:
       is_playing_ = false;
+      frames_to_skip_ = 0;
       demo(p);
   }
 
   new_frame_ = false;
 }
 
+void Analyzer::Base::updateFrameSkip(const Scope& scope) {
+  float energy = 0;
+  for (float value : scope) energy += value * value;
+
+  const float change = std::abs(energy - last_energy_);
+  const bool energy_steady =
+      change <= kSteadyEnergyChange * qMax(energy, last_energy_);
+  last_energy_ = energy;
+
+  if (frame_changed_ && !energy_steady) {
+    steady_frames_ = 0;
+    frames_to_skip_ = 0;
+    return;
+  }
+
+  // A picture that doesn't change can drop further than one that still moves
+  // with steady audio, where the animation has to stay smooth.
+  ++steady_frames_;
+  frames_to_skip_ =
+      qMin(steady_frames_ / kSteadyFramesPerSkip,
+           frame_changed_ ? kMaxSkippedSteadyFrames : kMaxSkippedFrames);
+}
+
 int Analyzer::Base::resizeExponent(int exp) {
   if (exp < 3)
     exp = 3;
   else if (exp > 9)
     exp = 9;
 
-  if (exp != fht_->sizeExp()) {
-    delete fht_;
-    fht_ = new FHT(exp);
+  if (exp != fft_->sizeExp()) {
+    delete fft_;
+    fft_ = new FFT(exp);
   }
   return exp;
 }
@@ -164,7 +207,7 @@ int Analyzer::Base::resizeForBands(int bands) {
     exp = 9;
 
   resizeExponent(exp);
-  return fht_->size() / 2;
+  return fft_->size() / 2;
 }
 
 void Analyzer::Base::demo(QPainter& p) {
@@ -284,6 +327,17 @@ void Analyzer::Base::timerEvent(QTimerEvent* e) {
   QWidget::timerEvent(e);
   if (e->timerId() != timer_.timerId()) return;
 
+  // Nothing to see: hideEvent() stops the timer, but a minimised window
+  // leaves its widgets visible.
+  if (window()->isMinimized()) return;
+
+  if (skipped_ticks_ < frames_to_skip_) {
+    ++skipped_ticks_;
+    return;
+  }
+
+  frame_ticks_ = skipped_ticks_ + 1;
+  skipped_ticks_ = 0;
   new_frame_ = true;
   update();
 }
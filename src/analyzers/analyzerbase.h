@@ -30,7 +30,7 @@
 #include <sys/types.h>
 #endif
 
-#include "fht.h"
+#include "fft.h"
 #include "engines/engine_fwd.h"
 #include "engines/enginebase.h"
 #include <QPixmap>
@@ -59,7 +59,7 @@ class Base : public QWidget {
   Q_OBJECT
 
  public:
-  ~Base() { delete fht_; }
+  ~Base() { delete fft_; }
 
   uint timeout() const { return timeout_; }
 
@@ -86,6 +86,9 @@ class Base : public QWidget {
 
   void polishEvent();
 
+  // Lowers the frame rate while the picture or the audio energy is steady.
+  void updateFrameSkip(const Scope&);
+
   int resizeExponent(int);
   int resizeForBands(int);
   int BandFrequency(int) const;
@@ -100,15 +103,35 @@ class Base : public QWidget {
   static const int kSampleRate =
       44100;  // we shouldn't need to care about ultrasonics
 
+  // The longest run of timer ticks skipped between frames that didn't change
+  // the picture, and between frames whose audio energy barely changed.
+  static const int kMaxSkippedFrames;
+  static const int kMaxSkippedSteadyFrames;
+  // Relative change in scope energy below which the audio counts as steady.
+  static const float kSteadyEnergyChange;
+
   QBasicTimer timer_;
   uint timeout_;
-  FHT* fht_;
+  FFT* fft_;
   EngineBase* engine_;
   Scope lastScope_;
 
   bool new_frame_;
   bool is_playing_;
 
+  // Analyzers that set this skip timer ticks while the picture or the audio
+  // is steady.  They must scale anything they animate by a fixed step per
+  // frame by frame_ticks_, the number of ticks the current frame stands for.
+  bool adaptive_frame_rate_;
+  // Analyzers that can tell when a frame left the picture as it was clear
+  // this in analyze().  It is set again before every frame.
+  bool frame_changed_;
+  int frame_ticks_;
+  int skipped_ticks_;
+  int frames_to_skip_;
+  int steady_frames_;
+  float last_energy_;
+
   QList<uint> barkband_table_;
   double prev_colors_[10][3];
   int prev_color_index_;
@@ -48,10 +48,11 @@ BlockAnalyzer::BlockAnalyzer(QWidget* parent)
       columns_(0),
       rows_(0),
       y_(0),
-      barPixmap_(1, 1),
-      topBarPixmap_(kWidth, kHeight),
+      barImage_(1, 1, RasterCanvas::format()),
+      topBarColor_(0),
       scope_(kMinColumns),
       store_(1 << 8, 0),
+      drawn_(kMaxColumns),
       fade_bars_(kFadeSize),
       fade_pos_(1 << 8, 50),
       fade_intensity_(1 << 8, 32) {
@@ -59,8 +60,13 @@ BlockAnalyzer::BlockAnalyzer(QWidget* parent)
   // -1 is padding, no drawing takes place there
   setMaximumWidth(kMaxColumns * (kWidth + 1) - 1);
 
+  // Every pixel comes from canvas_
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  adaptive_frame_rate_ = true;
+
   // mxcl says null pixmaps cause crashes, so let's play it safe
-  for (uint i = 0; i < kFadeSize; ++i) fade_bars_[i] = QPixmap(1, 1);
+  for (uint i = 0; i < kFadeSize; ++i)
+    fade_bars_[i] = QImage(1, 1, RasterCanvas::format());
 }
 
 BlockAnalyzer::~BlockAnalyzer() {}
@@ -68,8 +74,8 @@ BlockAnalyzer::~BlockAnalyzer() {}
 void BlockAnalyzer::resizeEvent(QResizeEvent* e) {
   QWidget::resizeEvent(e);
 
-  background_ = QPixmap(size());
-  canvas_ = QPixmap(size());
+  background_ = QImage(size(), RasterCanvas::format());
+  canvas_.resize(size());
 
   const uint oldRows = rows_;
 
@@ -86,10 +92,11 @@ void BlockAnalyzer::resizeEvent(QResizeEvent* e) {
   scope_.resize(columns_);
 
   if (rows_ != oldRows) {
-    barPixmap_ = QPixmap(kWidth, rows_ * (kHeight + 1));
+    barImage_ = QImage(kWidth, rows_ * (kHeight + 1), RasterCanvas::format());
 
     for (uint i = 0; i < kFadeSize; ++i)
-      fade_bars_[i] = QPixmap(kWidth, rows_ * (kHeight + 1));
+      fade_bars_[i] =
+          QImage(kWidth, rows_ * (kHeight + 1), RasterCanvas::format());
 
     yscale_.resize(rows_ + 1);
 
@@ -129,8 +136,8 @@ void BlockAnalyzer::transform(Analyzer::Scope& s) {
 
   float* front = static_cast<float*>(&s.front());
 
-  fht_->spectrum(front);
-  fht_->scale(front, 1.0 / 20);
+  fft_->spectrum(front);
+  fft_->scale(front, 1.0 / 20);
 
   // the second half is pretty dull, so only show it if the user has a large
   // analyzer
@@ -155,22 +162,19 @@ void BlockAnalyzer::analyze(QPainter& p, const Analyzer::Scope& s,
   // if it contains 6 elements there are 5 rows in the analyzer
 
   if (!new_frame) {
-    p.drawPixmap(0, 0, canvas_);
+    p.drawImage(0, 0, canvas_.image());
     return;
   }
 
-  QPainter canvas_painter(&canvas_);
-
   Analyzer::interpolate(s, scope_);
 
+  canvas_.clearDirty();
+
   // update the graphics with the new colour
   if (psychedelic_enabled_) {
     paletteChange(QPalette());
   }
 
-  // Paint the background
-  canvas_painter.drawPixmap(0, 0, background_);
-
   for (uint y, x = 0; x < scope_.size(); ++x) {
     // determine y
     for (y = 0; scope_[x] < yscale_[y]; ++y) continue;
@@ -178,7 +182,8 @@ void BlockAnalyzer::analyze(QPainter& p, const Analyzer::Scope& s,
     // this is opposite to what you'd think, higher than y
     // means the bar is lower than y (physically)
     if (static_cast<float>(y) > store_[x])
-      y = static_cast<int>(store_[x] += step_);
+      y = static_cast<int>(store_[x] = qMin(store_[x] + step_ * frame_ticks_,
+                                            static_cast<float>(y)));
     else
       store_[x] = y;
 
@@ -190,28 +195,53 @@ void BlockAnalyzer::analyze(QPainter& p, const Analyzer::Scope& s,
       fade_intensity_[x] = kFadeSize;
     }
 
+    // REMEMBER: y is a number from 0 to rows_, 0 means all blocks are glowing,
+    // rows_ means none are
+    Column column;
+    column.bar = y;
+    column.top = static_cast<int>(store_[x]);
+
     if (fade_intensity_[x] > 0) {
-      const uint offset = --fade_intensity_[x];
-      const uint y = y_ + (fade_pos_[x] * (kHeight + 1));
-      canvas_painter.drawPixmap(x * (kWidth + 1), y, fade_bars_[offset], 0, 0,
-                                kWidth, height() - y);
+      fade_intensity_[x] = qMax(0, fade_intensity_[x] - frame_ticks_);
+      column.fade_pos = fade_pos_[x];
+      column.fade_bar = fade_intensity_[x];
     }
 
     if (fade_intensity_[x] == 0) fade_pos_[x] = rows_;
 
-    // REMEMBER: y is a number from 0 to rows_, 0 means all blocks are glowing,
-    // rows_ means none are
-    canvas_painter.drawPixmap(x * (kWidth + 1), y * (kHeight + 1) + y_, *bar(),
-                              0, y * (kHeight + 1), bar()->width(),
-                              bar()->height());
+    if (column != drawn_[x]) {
+      drawColumn(x, column);
+      drawn_[x] = column;
+    }
   }
 
-  for (uint x = 0; x < store_.size(); ++x)
-    canvas_painter.drawPixmap(x * (kWidth + 1),
-                              static_cast<int>(store_[x]) * (kHeight + 1) + y_,
-                              topBarPixmap_);
+  frame_changed_ = canvas_.isDirty();
+  p.drawImage(0, 0, canvas_.image());
+}
 
-  p.drawPixmap(0, 0, canvas_);
+void BlockAnalyzer::drawColumn(uint x, const Column& column) {
+  const int left = x * (kWidth + 1);
+
+  canvas_.blit(left, 0, background_, left, 0, kWidth, height());
+
+  if (column.fade_bar >= 0) {
+    const int y = y_ + column.fade_pos * (kHeight + 1);
+    canvas_.blit(left, y, fade_bars_[column.fade_bar], 0, 0, kWidth,
+                 height() - y);
+  }
+
+  canvas_.blit(left, column.bar * (kHeight + 1) + y_, *bar(), 0,
+               column.bar * (kHeight + 1), kWidth, bar()->height());
+
+  canvas_.fillRect(left, column.top * (kHeight + 1) + y_, kWidth, kHeight,
+                   topBarColor_);
+}
+
+void BlockAnalyzer::invalidateColumns() {
+  // Start again from a blank background; the next frame draws every column.
+  canvas_.blit(0, 0, background_, 0, 0, background_.width(),
+               background_.height());
+  drawn_.assign(drawn_.size(), Column());
 }
 
 static inline void adjustToLimits(int& b, int& f, uint& amount) {
@@ -347,7 +377,7 @@ void BlockAnalyzer::paletteChange(const QPalette&) {
     fg = ensureContrast(bg, palette().color(QPalette::Highlight));
   }
 
-  topBarPixmap_.fill(fg);
+  topBarColor_ = fg.rgb();
 
   const double dr =
       15 * static_cast<double>(bg.red() - fg.red()) / (rows_ * 16);
@@ -357,7 +387,7 @@ void BlockAnalyzer::paletteChange(const QPalette&) {
       15 * static_cast<double>(bg.blue() - fg.blue()) / (rows_ * 16);
   const int r = fg.red(), g = fg.green(), b = fg.blue();
 
-  bar()->fill(bg);
+  bar()->fill(bg.rgb());
 
   QPainter p(bar());
 
@@ -384,7 +414,7 @@ void BlockAnalyzer::paletteChange(const QPalette&) {
 
     // Precalculate all fade-bar pixmaps
     for (uint y = 0; y < kFadeSize; ++y) {
-      fade_bars_[y].fill(palette().color(QPalette::Background));
+      fade_bars_[y].fill(palette().color(QPalette::Background).rgb());
       QPainter f(&fade_bars_[y]);
       for (int z = 0; static_cast<uint>(z) < rows_; ++z) {
         const double Y = 1.0 - (log10(kFadeSize - y) / log10(kFadeSize));
@@ -403,16 +433,18 @@ void BlockAnalyzer::drawBackground() {
   const QColor bg = palette().color(QPalette::Background);
   const QColor bgdark = bg.dark(112);
 
-  background_.fill(bg);
+  background_.fill(bg.rgb());
 
-  QPainter p(&background_);
+  {
+    QPainter p(&background_);
 
-  if (p.paintEngine() == 0) {
-    return;
+    if (p.paintEngine() != 0) {
+      for (int x = 0; (uint)x < columns_; ++x)
+        for (int y = 0; (uint)y < rows_; ++y)
+          p.fillRect(x * (kWidth + 1), y * (kHeight + 1) + y_, kWidth,
+                     kHeight, bgdark);
+    }
   }
 
-  for (int x = 0; (uint)x < columns_; ++x)
-    for (int y = 0; (uint)y < rows_; ++y)
-      p.fillRect(x * (kWidth + 1), y * (kHeight + 1) + y_, kWidth, kHeight,
-                 bgdark);
+  invalidateColumns();
 }
@@ -26,6 +26,7 @@
 #define ANALYZERS_BLOCKANALYZER_H_
 
 #include "analyzerbase.h"
+#include "rastercanvas.h"
 #include <qcolor.h>
 
 class QResizeEvent;
@@ -60,20 +61,37 @@ class BlockAnalyzer : public Analyzer::Base {
   void determineStep();
 
  private:
-  QPixmap* bar() { return &barPixmap_; }
+  // What was last drawn in a column, so unchanged columns can be skipped.
+  struct Column {
+    Column() : bar(-1), fade_pos(-1), fade_bar(-1), top(-1) {}
+    bool operator!=(const Column& other) const {
+      return bar != other.bar || fade_pos != other.fade_pos ||
+             fade_bar != other.fade_bar || top != other.top;
+    }
+
+    int bar;
+    int fade_pos;
+    int fade_bar;  // -1 if the fade bar has gone
+    int top;
+  };
+
+  QImage* bar() { return &barImage_; }
+  void drawColumn(uint x, const Column& column);
+  void invalidateColumns();
 
   uint columns_, rows_;  // number of rows and columns of blocks
   uint y_;               // y-offset from top of widget
-  QPixmap barPixmap_;
-  QPixmap topBarPixmap_;
-  QPixmap background_;
-  QPixmap canvas_;
+  QImage barImage_;
+  QRgb topBarColor_;
+  QImage background_;
+  RasterCanvas canvas_;
   Analyzer::Scope scope_;     // so we don't create a vector every frame
   std::vector<float> store_;  // current bar kHeights
   std::vector<float> yscale_;
+  std::vector<Column> drawn_;
 
   // FIXME why can't I namespace these? c++ issue?
-  std::vector<QPixmap> fade_bars_;
+  std::vector<QImage> fade_bars_;
   std::vector<uint> fade_pos_;
   std::vector<int> fade_intensity_;
 
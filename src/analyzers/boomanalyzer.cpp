@@ -23,6 +23,7 @@
  */
 
 #include "boomanalyzer.h"
+#include <algorithm>
 #include <cmath>
 #include <QPainter>
 
@@ -48,9 +49,16 @@ BoomAnalyzer::BoomAnalyzer(QWidget* parent)
       bar_height_(kMaxBandCount, 0),
       peak_height_(kMaxBandCount, 0),
       peak_speed_(kMaxBandCount, 0.01),
-      barPixmap_(kColumnWidth, 50) {
+      drawn_bar_(kMaxBandCount, -1),
+      drawn_peak_(kMaxBandCount, -1),
+      drawn_fg_(0),
+      barImage_(kColumnWidth, 50, RasterCanvas::format()) {
   setMinimumWidth(kMinBandCount * (kColumnWidth + 1) - 1);
   setMaximumWidth(kMaxBandCount * (kColumnWidth + 1) - 1);
+
+  // Every pixel comes from canvas_
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  adaptive_frame_rate_ = true;
 }
 
 void BoomAnalyzer::changeK_barHeight(int newValue) {
@@ -75,28 +83,35 @@ void BoomAnalyzer::resizeEvent(QResizeEvent* e) {
 
   F_ = static_cast<double>(HEIGHT) / (log10(256) * 1.1 /*<- max. amplitude*/);
 
-  barPixmap_ = QPixmap(kColumnWidth - 2, HEIGHT);
-  canvas_ = QPixmap(size());
-  canvas_.fill(palette().color(QPalette::Background));
+  barImage_ = QImage(kColumnWidth - 2, HEIGHT, RasterCanvas::format());
+  canvas_.resize(size());
+  invalidateColumns();
 
-  QPainter p(&barPixmap_);
   for (uint y = 0; y < HEIGHT; ++y) {
     const double F = static_cast<double>(y) * h;
 
-    p.setPen(QColor(qMax(0, 255 - static_cast<int>(229.0 * F)),
-                    qMax(0, 255 - static_cast<int>(229.0 * F)),
-                    qMax(0, 255 - static_cast<int>(191.0 * F))));
-    p.drawLine(0, y, kColumnWidth - 2, y);
+    const QRgb color = qRgb(qMax(0, 255 - static_cast<int>(229.0 * F)),
+                            qMax(0, 255 - static_cast<int>(229.0 * F)),
+                            qMax(0, 255 - static_cast<int>(191.0 * F)));
+    QRgb* line = reinterpret_cast<QRgb*>(barImage_.scanLine(y));
+    std::fill_n(line, barImage_.width(), color);
   }
 
   updateBandSize(bands_);
 }
 
+void BoomAnalyzer::invalidateColumns() {
+  // Start again from a blank canvas; the next frame draws every column.
+  canvas_.fill(palette().color(QPalette::Background).rgb());
+  drawn_bar_.assign(drawn_bar_.size(), -1);
+  drawn_peak_.assign(drawn_peak_.size(), -1);
+}
+
 void BoomAnalyzer::transform(Scope& s) {
   float* front = static_cast<float*>(&s.front());
 
-  fht_->spectrum(front);
-  fht_->scale(front, 1.0 / 50);
+  fft_->spectrum(front);
+  fft_->scale(front, 1.0 / 50);
 
   s.resize(scope_.size() <= kMaxBandCount / 2 ? kMaxBandCount / 2
                                               : scope_.size());
@@ -104,22 +119,30 @@ void BoomAnalyzer::transform(Scope& s) {
 
 void BoomAnalyzer::analyze(QPainter& p, const Scope& scope, bool new_frame) {
   if (!new_frame || engine_->state() == Engine::Paused) {
-    p.drawPixmap(0, 0, canvas_);
+    frame_changed_ = false;
+    p.drawImage(0, 0, canvas_.image());
     return;
   }
   float h;
   const uint MAX_HEIGHT = height() - 1;
 
-  QPainter canvas_painter(&canvas_);
-  canvas_.fill(palette().color(QPalette::Background));
-
   Analyzer::interpolate(scope, scope_);
 
+  canvas_.clearDirty();
+
   // update the graphics with the new colour
   if (psychedelic_enabled_) {
     paletteChange(QPalette());
   }
 
+  if (fg_.rgb() != drawn_fg_) {
+    invalidateColumns();
+    drawn_fg_ = fg_.rgb();
+  }
+
+  const QRgb bg = palette().color(QPalette::Background).rgb();
+  const QRgb midlight = palette().color(QPalette::Midlight).rgb();
+
   for (uint i = 0, x = 0, y; i < bands_; ++i, x += kColumnWidth + 1) {
     h = log10(scope_[i] * 256.0) * F_;
 
@@ -136,15 +159,17 @@ void BoomAnalyzer::analyze(QPainter& p, const Scope& scope, bool new_frame) {
       }
     } else {
       if (bar_height_[i] > 0.0) {
-        bar_height_[i] -= K_barHeight_;  // 1.4
+        bar_height_[i] -= K_barHeight_ * frame_ticks_;  // 1.4
         if (bar_height_[i] < 0.0) bar_height_[i] = 0.0;
       }
 
     peak_handling:
 
       if (peak_height_[i] > 0.0) {
-        peak_height_[i] -= peak_speed_[i];
-        peak_speed_[i] *= F_peakSpeed_;  // 1.12
+        for (int tick = 0; tick < frame_ticks_; ++tick) {
+          peak_height_[i] -= peak_speed_[i];
+          peak_speed_[i] *= F_peakSpeed_;  // 1.12
+        }
 
         if (peak_height_[i] < bar_height_[i]) peak_height_[i] = bar_height_[i];
         if (peak_height_[i] < 0.0) peak_height_[i] = 0.0;
@@ -152,17 +177,29 @@ void BoomAnalyzer::analyze(QPainter& p, const Scope& scope, bool new_frame) {
     }
 
     y = height() - uint(bar_height_[i]);
-    canvas_painter.drawPixmap(x + 1, y, barPixmap_, 0, y, -1, -1);
-    canvas_painter.setPen(fg_);
-    if (bar_height_[i] > 0)
-      canvas_painter.drawRect(x, y, kColumnWidth - 1, height() - y - 1);
-
-    y = height() - uint(peak_height_[i]);
-    canvas_painter.setPen(palette().color(QPalette::Midlight));
-    canvas_painter.drawLine(x, y, x + kColumnWidth - 1, y);
+    const uint peak_y = height() - uint(peak_height_[i]);
+    const int bar_top = bar_height_[i] > 0 ? y : height();
+    if (bar_top == drawn_bar_[i] && int(peak_y) == drawn_peak_[i]) continue;
+    drawn_bar_[i] = bar_top;
+    drawn_peak_[i] = peak_y;
+
+    canvas_.fillRect(x, 0, kColumnWidth, height(), bg);
+    canvas_.blit(x + 1, y, barImage_, 0, y, barImage_.width(),
+                 barImage_.height() - y);
+    if (bar_height_[i] > 0) {
+      // The outline QPainter::drawRect() used to draw with a one pixel pen
+      const int bar_h = height() - y;
+      canvas_.fillRect(x, y, kColumnWidth, 1, fg_.rgb());
+      canvas_.fillRect(x, height() - 1, kColumnWidth, 1, fg_.rgb());
+      canvas_.fillRect(x, y, 1, bar_h, fg_.rgb());
+      canvas_.fillRect(x + kColumnWidth - 1, y, 1, bar_h, fg_.rgb());
+    }
+
+    canvas_.fillRect(x, peak_y, kColumnWidth, 1, midlight);
   }
 
-  p.drawPixmap(0, 0, canvas_);
+  frame_changed_ = canvas_.isDirty();
+  p.drawImage(0, 0, canvas_.image());
 }
 
 void BoomAnalyzer::psychedelicModeChanged(bool enabled) {
@@ -179,4 +216,7 @@ void BoomAnalyzer::paletteChange(const QPalette&) {
     // so we use save and use the focused colour
     fg_ = palette().color(QPalette::Highlight);
   }
+
+  // Background and Midlight may have changed too
+  drawn_fg_ = 0;
 }
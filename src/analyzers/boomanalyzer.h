@@ -26,6 +26,7 @@
 #define ANALYZERS_BOOMANALYZER_H_
 
 #include "analyzerbase.h"
+#include "rastercanvas.h"
 
 class BoomAnalyzer : public Analyzer::Base {
   Q_OBJECT
@@ -46,6 +47,7 @@ class BoomAnalyzer : public Analyzer::Base {
  protected:
   void resizeEvent(QResizeEvent* e);
   void paletteChange(const QPalette&);
+  void invalidateColumns();
 
   static const uint kColumnWidth;
   static const uint kMaxBandCount;
@@ -61,8 +63,13 @@ class BoomAnalyzer : public Analyzer::Base {
   std::vector<float> peak_height_;
   std::vector<float> peak_speed_;
 
-  QPixmap barPixmap_;
-  QPixmap canvas_;
+  // The bar and peak tops last drawn in each column, -1 for none.
+  std::vector<int> drawn_bar_;
+  std::vector<int> drawn_peak_;
+  QRgb drawn_fg_;
+
+  QImage barImage_;
+  RasterCanvas canvas_;
 };
 
 #endif  // ANALYZERS_BOOMANALYZER_H_
@@ -0,0 +1,205 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fft.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+FFT::FFT(int n) {
+  if (n < 3) {
+    num_ = 0;
+    exp2_ = -1;
+    return;
+  }
+  exp2_ = n;
+  num_ = 1 << n;
+
+  re_.resize(num_ / 2);
+  im_.resize(num_ / 2);
+  work_.resize(num_);
+
+  makeTables();
+  makeLogBins();
+}
+
+void FFT::makeTables() {
+  const int half = num_ / 2;
+
+  bitrev_.resize(half);
+  for (int i = 0; i < half; ++i) {
+    int r = 0;
+    for (int bit = 1, rbit = half >> 1; bit < half; bit <<= 1, rbit >>= 1) {
+      if (i & bit) r |= rbit;
+    }
+    bitrev_[i] = r;
+  }
+
+  // The stage that combines blocks of h values uses h twiddle factors, which
+  // are stored at offset h - 1.
+  tw_re_.resize(half);
+  tw_im_.resize(half);
+  for (int h = 1; h < half; h <<= 1) {
+    for (int j = 0; j < h; ++j) {
+      tw_re_[h - 1 + j] = cos(M_PI * j / h);
+      tw_im_[h - 1 + j] = -sin(M_PI * j / h);
+    }
+  }
+
+  split_re_.resize(half);
+  split_im_.resize(half);
+  for (int k = 0; k < half; ++k) {
+    split_re_[k] = cos(2 * M_PI * k / num_);
+    split_im_[k] = -sin(2 * M_PI * k / num_);
+  }
+}
+
+void FFT::makeLogBins() {
+  // Precomputes the same mapping and interpolation FHT::logSpectrum works
+  // out on every call.
+  const int n = num_ / 2;
+  const float f = n / log10(static_cast<double>(n));
+
+  log_bins_.clear();
+  log_bins_.push_back(LogBin{0, 0, 0});
+
+  for (int i = 1, k = 1; i < n; ++i) {
+    int j = static_cast<int>(rint(log10(static_cast<double>(i)) * f));
+    if (j >= n) j = n - 1;
+
+    if (i == j) {
+      log_bins_.push_back(LogBin{i, i, 0});
+    } else {
+      const int base = k - 1;
+      for (int m = 0; k <= j; ++k, ++m) {
+        log_bins_.push_back(LogBin{base, j, float(m) / (j - base)});
+      }
+    }
+  }
+
+  log_bins_.resize(n, LogBin{n - 1, n - 1, 0});
+}
+
+void FFT::transform() {
+  const int half = num_ / 2;
+  float* re = &re_[0];
+  float* im = &im_[0];
+
+  for (int h = 1; h < half; h <<= 1) {
+    const float* wr = &tw_re_[h - 1];
+    const float* wi = &tw_im_[h - 1];
+
+    for (int s = 0; s < half; s += 2 * h) {
+      float* are = re + s;
+      float* aim = im + s;
+      float* bre = are + h;
+      float* bim = aim + h;
+      int j = 0;
+
+#ifdef __SSE__
+      for (; j + 4 <= h; j += 4) {
+        const __m128 w_re = _mm_loadu_ps(wr + j);
+        const __m128 w_im = _mm_loadu_ps(wi + j);
+        const __m128 b_re = _mm_loadu_ps(bre + j);
+        const __m128 b_im = _mm_loadu_ps(bim + j);
+        const __m128 a_re = _mm_loadu_ps(are + j);
+        const __m128 a_im = _mm_loadu_ps(aim + j);
+
+        const __m128 t_re =
+            _mm_sub_ps(_mm_mul_ps(w_re, b_re), _mm_mul_ps(w_im, b_im));
+        const __m128 t_im =
+            _mm_add_ps(_mm_mul_ps(w_re, b_im), _mm_mul_ps(w_im, b_re));
+
+        _mm_storeu_ps(bre + j, _mm_sub_ps(a_re, t_re));
+        _mm_storeu_ps(bim + j, _mm_sub_ps(a_im, t_im));
+        _mm_storeu_ps(are + j, _mm_add_ps(a_re, t_re));
+        _mm_storeu_ps(aim + j, _mm_add_ps(a_im, t_im));
+      }
+#endif
+
+      for (; j < h; ++j) {
+        const float t_re = wr[j] * bre[j] - wi[j] * bim[j];
+        const float t_im = wr[j] * bim[j] + wi[j] * bre[j];
+        bre[j] = are[j] - t_re;
+        bim[j] = aim[j] - t_im;
+        are[j] += t_re;
+        aim[j] += t_im;
+      }
+    }
+  }
+}
+
+void FFT::scale(float* p, float d) const {
+  for (int i = 0; i < (num_ / 2); i++) *p++ *= d;
+}
+
+void FFT::power2(float* p) {
+  const int half = num_ / 2;
+
+  // Pack even samples into the real part and odd samples into the imaginary
+  // part of a half-size complex FFT.
+  for (int i = 0; i < half; ++i) {
+    re_[bitrev_[i]] = p[2 * i];
+    im_[bitrev_[i]] = p[2 * i + 1];
+  }
+
+  transform();
+
+  // Split the result back into the spectrum of the real input.
+  for (int k = 0; k < half; ++k) {
+    const int mk = (half - k) & (half - 1);
+    const float even_re = (re_[k] + re_[mk]) * 0.5f;
+    const float even_im = (im_[k] - im_[mk]) * 0.5f;
+    const float odd_re = (im_[k] + im_[mk]) * 0.5f;
+    const float odd_im = (re_[mk] - re_[k]) * 0.5f;
+
+    const float f_re =
+        even_re + split_re_[k] * odd_re - split_im_[k] * odd_im;
+    const float f_im =
+        even_im + split_re_[k] * odd_im + split_im_[k] * odd_re;
+
+    p[k] = 2 * (f_re * f_re + f_im * f_im);
+  }
+}
+
+void FFT::spectrum(float* p) {
+  power2(p);
+  for (int i = 0; i < (num_ / 2); i++, p++)
+    *p = static_cast<float>(sqrt(*p * .5));
+}
+
+void FFT::semiLogSpectrum(float* p) {
+  power2(p);
+  for (int i = 0; i < (num_ / 2); i++, p++) {
+    const float e = 10.0 * log10(sqrt(*p * .5));
+    *p = e < 0 ? 0 : e;
+  }
+}
+
+void FFT::logSpectrum(float* p) {
+  float* w = &work_[0];
+  memcpy(w, p, num_ * sizeof(float));
+  semiLogSpectrum(w);
+  w[0] /= 100;
+
+  for (const LogBin& bin : log_bins_) {
+    *p++ = w[bin.from] + (w[bin.to] - w[bin.from]) * bin.weight;
+  }
+}
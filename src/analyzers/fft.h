@@ -0,0 +1,95 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYZERS_FFT_H_
+#define ANALYZERS_FFT_H_
+
+#include <vector>
+
+/**
+ * Real FFT used by the analyzers.  Produces the same spectra as FHT, but
+ * does the transform iteratively as a half-size complex FFT on separate
+ * real and imaginary arrays, with SSE butterflies where available.  All
+ * tables and work buffers are allocated once in the constructor, so none of
+ * the methods allocate memory.
+ */
+class FFT {
+ public:
+  /**
+   * Prepare transform for data sets with @f$2^n@f$ numbers, whereby @f$n@f$
+   * should be at least 3.
+   */
+  explicit FFT(int n);
+
+  inline int sizeExp() const { return exp2_; }
+  inline int size() const { return num_; }
+
+  void scale(float* p, float d) const;
+
+  /**
+   * Logarithmic audio spectrum, worked out in place.  Maps the
+   * semi-logarithmic spectrum to a logarithmic frequency scale and
+   * interpolates missing values.
+   */
+  void logSpectrum(float* p);
+
+  /**
+   * Semi-logarithmic audio spectrum.
+   */
+  void semiLogSpectrum(float* p);
+
+  /**
+   * Fourier spectrum.
+   */
+  void spectrum(float* p);
+
+  /**
+   * FFT power spectrum with doubled values, like FHT::power2().  Only the
+   * first @f$2^{n-1}@f$ values are meaningful.
+   */
+  void power2(float* p);
+
+ private:
+  struct LogBin {
+    int from;
+    int to;
+    float weight;
+  };
+
+  void makeTables();
+  void makeLogBins();
+
+  // Complex FFT of size num_ / 2 on re_ and im_.
+  void transform();
+
+  int exp2_;
+  int num_;
+
+  std::vector<int> bitrev_;
+  // Butterfly twiddle factors for each stage, one after the other.
+  std::vector<float> tw_re_;
+  std::vector<float> tw_im_;
+  // Twiddle factors that split the half-size FFT into a real one.
+  std::vector<float> split_re_;
+  std::vector<float> split_im_;
+  std::vector<LogBin> log_bins_;
+
+  std::vector<float> re_;
+  std::vector<float> im_;
+  std::vector<float> work_;
+};
+
+#endif  // ANALYZERS_FFT_H_
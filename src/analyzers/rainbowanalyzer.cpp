@@ -72,7 +72,7 @@ Rainbow::RainbowAnalyzer::RainbowAnalyzer(const RainbowType& rbtype, QWidget* pa
   }
 }
 
-void Rainbow::RainbowAnalyzer::transform(Scope& s) { fht_->spectrum(&s.front()); }
+void Rainbow::RainbowAnalyzer::transform(Scope& s) { fft_->spectrum(&s.front()); }
 
 void Rainbow::RainbowAnalyzer::timerEvent(QTimerEvent* e) {
   if (e->timerId() == timer_id_) {
@@ -24,15 +24,27 @@
 
 #include "sonogram.h"
 
+#include <algorithm>
+
 #include <QPainter>
 
 using Analyzer::Scope;
 
+// Sets the count pixels of row y that end at column x.
+static inline void setPixels(RasterCanvas* canvas, int x, int y, int count,
+                             QRgb color) {
+  std::fill_n(canvas->scanLine(y) + x - count + 1, count, color);
+}
+
 const char* Sonogram::kName =
     QT_TRANSLATE_NOOP("AnalyzerContainer", "Sonogram");
 
 Sonogram::Sonogram(QWidget* parent)
-    : Analyzer::Base(parent, 9), scope_size_(128) {}
+    : Analyzer::Base(parent, 9), scope_size_(128) {
+  // Every pixel comes from canvas_
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  adaptive_frame_rate_ = true;
+}
 
 Sonogram::~Sonogram() {}
 
@@ -44,8 +56,8 @@ void Sonogram::resizeEvent(QResizeEvent* e) {
   resizeForBands(height() < 128 ? 128 : height());
 #endif
 
-  canvas_ = QPixmap(size());
-  canvas_.fill(palette().color(QPalette::Background));
+  canvas_.resize(size());
+  canvas_.fill(palette().color(QPalette::Background).rgb());
   updateBandSize(scope_size_);
 }
 
@@ -56,15 +68,18 @@ void Sonogram::psychedelicModeChanged(bool enabled) {
 
 void Sonogram::analyze(QPainter& p, const Scope& s, bool new_frame) {
   if (!new_frame || engine_->state() == Engine::Paused) {
-    p.drawPixmap(0, 0, canvas_);
+    frame_changed_ = false;
+    p.drawImage(0, 0, canvas_.image());
     return;
   }
 
-  int x = width() - 1;
+  // Scroll one column for every timer tick so time runs at the same speed
+  // when frames are skipped.
+  const int x = width() - 1;
+  const int columns = qMin(frame_ticks_, width());
   QColor c;
 
-  QPainter canvas_painter(&canvas_);
-  canvas_painter.drawPixmap(0, 0, canvas_, 1, 0, x, -1);
+  canvas_.scrollLeft(columns);
 
   Scope::const_iterator it = s.begin(), end = s.end();
   if (scope_size_ != s.size()) {
@@ -85,8 +100,7 @@ void Sonogram::analyze(QPainter& p, const Scope& s, bool new_frame) {
         c = getPsychedelicColor(s, 10, 50);
       }
 
-      canvas_painter.setPen(c);
-      canvas_painter.drawPoint(x, y--);
+      setPixels(&canvas_, x, y--, columns, c.rgb());
 
       if (it < end) ++it;
     }
@@ -101,25 +115,22 @@ void Sonogram::analyze(QPainter& p, const Scope& s, bool new_frame) {
       else
         c = Qt::red;
 
-      canvas_painter.setPen(c);
-      canvas_painter.drawPoint(x, y--);
+      setPixels(&canvas_, x, y--, columns, c.rgb());
 
       if (it < end) ++it;
     }
   }
 
-  canvas_painter.end();
-
-  p.drawPixmap(0, 0, canvas_);
+  p.drawImage(0, 0, canvas_.image());
 }
 
 void Sonogram::transform(Scope& scope) {
   float* front = static_cast<float*>(&scope.front());
-  fht_->power2(front);
-  fht_->scale(front, 1.0 / 256);
-  scope.resize(fht_->size() / 2);
+  fft_->power2(front);
+  fft_->scale(front, 1.0 / 256);
+  scope.resize(fft_->size() / 2);
 }
 
 void Sonogram::demo(QPainter& p) {
-  analyze(p, Scope(fht_->size(), 0), new_frame_);
+  analyze(p, Scope(fft_->size(), 0), new_frame_);
 }
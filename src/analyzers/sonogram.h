@@ -26,6 +26,7 @@
 #define ANALYZERS_SONOGRAM_H_
 
 #include "analyzerbase.h"
+#include "rastercanvas.h"
 
 class Sonogram : public Analyzer::Base {
   Q_OBJECT
@@ -42,7 +43,7 @@ class Sonogram : public Analyzer::Base {
   void resizeEvent(QResizeEvent*);
   void psychedelicModeChanged(bool);
 
-  QPixmap canvas_;
+  RasterCanvas canvas_;
   int scope_size_;
 };
 
@@ -23,6 +23,7 @@
 #include "application.h"
 
 #include "config.h"
+#include "analysis/libraryanalyzer.h"
 #include "core/appearance.h"
 #include "core/database.h"
 #include "core/lazy.h"
@@ -34,6 +35,7 @@
 #include "covers/coverproviders.h"
 #include "covers/currentartloader.h"
 #include "covers/musicbrainzcoverprovider.h"
+#include "covers/thumbnailcache.h"
 #include "devices/devicemanager.h"
 #include "globalsearch/globalsearch.h"
 #include "internet/core/internetmodel.h"
@@ -109,9 +111,11 @@ class ApplicationImpl {
         player_([=]() { return new Player(app, app); }),
         playlist_manager_([=]() { return new PlaylistManager(app); }),
         current_art_loader_([=]() { return new CurrentArtLoader(app, app); }),
+        thumbnail_cache_([]() { return new ThumbnailCache; }),
         global_search_([=]() { return new GlobalSearch(app, app); }),
         internet_model_([=]() { return new InternetModel(app, app); }),
         library_([=]() { return new Library(app, app); }),
+        library_analyzer_([=]() { return new LibraryAnalyzer(app, app); }),
         device_manager_([=]() { return new DeviceManager(app, app); }),
         podcast_updater_([=]() { return new PodcastUpdater(app, app); }),
         podcast_deleter_([=]() {
@@ -161,9 +165,11 @@ class ApplicationImpl {
   Lazy<Player> player_;
   Lazy<PlaylistManager> playlist_manager_;
   Lazy<CurrentArtLoader> current_art_loader_;
+  Lazy<ThumbnailCache> thumbnail_cache_;
   Lazy<GlobalSearch> global_search_;
   Lazy<InternetModel> internet_model_;
   Lazy<Library> library_;
+  Lazy<LibraryAnalyzer> library_analyzer_;
   Lazy<DeviceManager> device_manager_;
   Lazy<PodcastUpdater> podcast_updater_;
   Lazy<PodcastDeleter> podcast_deleter_;
@@ -269,6 +275,10 @@ InternetModel* Application::internet_model() const {
 
 Library* Application::library() const { return p_->library_.get(); }
 
+LibraryAnalyzer* Application::library_analyzer() const {
+  return p_->library_analyzer_.get();
+}
+
 LibraryBackend* Application::library_backend() const {
   return library()->backend();
 }
@@ -326,3 +336,7 @@ TagReaderClient* Application::tag_reader_client() const {
 TaskManager* Application::task_manager() const {
   return p_->task_manager_.get();
 }
+
+ThumbnailCache* Application::thumbnail_cache() const {
+  return p_->thumbnail_cache_.get();
+}
@@ -39,6 +39,7 @@ class GlobalSearch;
 class GPodderSync;
 class InternetModel;
 class Library;
+class LibraryAnalyzer;
 class LibraryBackend;
 class LibraryModel;
 class MoodbarController;
@@ -55,6 +56,7 @@ class PodcastUpdater;
 class Scrobbler;
 class TagReaderClient;
 class TaskManager;
+class ThumbnailCache;
 
 class Application : public QObject {
   Q_OBJECT
@@ -81,6 +83,7 @@ class Application : public QObject {
   GPodderSync* gpodder_sync() const;
   InternetModel* internet_model() const;
   Library* library() const;
+  LibraryAnalyzer* library_analyzer() const;
   LibraryBackend* library_backend() const;
   LibraryModel* library_model() const;
   MoodbarController* moodbar_controller() const;
@@ -97,6 +100,7 @@ class Application : public QObject {
   Scrobbler* scrobbler() const;
   TagReaderClient* tag_reader_client() const;
   TaskManager* task_manager() const;
+  ThumbnailCache* thumbnail_cache() const;
 
   void MoveToNewThread(QObject* object);
   void MoveToThread(QObject* object, QThread* thread);
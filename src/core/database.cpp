@@ -37,6 +37,7 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QLibrary>
 #include <QLibraryInfo>
 #include <QSqlDriver>
@@ -47,8 +48,10 @@
 #include <QVariant>
 
 const char* Database::kDatabaseFilename = "clementine.db";
-const int Database::kSchemaVersion = 50;
+const int Database::kSchemaVersion = 52;
 const char* Database::kMagicAllSongsTables = "%allsongstables";
+const int Database::kBusyTimeoutMsec = 5000;
+const int Database::kSlowLockWaitMsec = 100;
 
 int Database::sNextConnectionId = 1;
 QMutex Database::sNextConnectionIdMutex;
@@ -211,7 +214,9 @@ Database::Database(Application* app, QObject* parent,
                    const QString& database_name)
     : QObject(parent),
       app_(app),
-      mutex_(QMutex::Recursive),
+      connections_lock_(QReadWriteLock::Recursive),
+      writer_mutex_(QMutex::Recursive),
+      wal_enabled_(0),
       injected_database_name_(database_name),
       query_hash_(0),
       startup_schema_version_(-1) {
@@ -226,10 +231,52 @@ Database::Database(Application* app, QObject* parent,
   attached_databases_["jamendo"] = AttachedDatabase(
       directory_ + "/jamendo.db", ":/schema/jamendo.sql", false);
 
-  QMutexLocker l(&mutex_);
+  Locker l(this, Lock_Exclusive);
   Connect();
 }
 
+Database::Locker::Locker(Database* db, LockType type)
+    : db_(db), holds_writer_mutex_(false) {
+  QElapsedTimer timer;
+  timer.start();
+
+  if (type == Lock_Exclusive) {
+    db_->connections_lock_.lockForWrite();
+  } else {
+    db_->connections_lock_.lockForRead();
+  }
+
+  if (type != Lock_Read || !db_->is_wal()) {
+    db_->writer_mutex_.lock();
+    holds_writer_mutex_ = true;
+  }
+
+  db_->RecordLockWait(type, timer.nsecsElapsed() / 1000);
+}
+
+Database::Locker::~Locker() {
+  if (holds_writer_mutex_) db_->writer_mutex_.unlock();
+  db_->connections_lock_.unlock();
+}
+
+void Database::RecordLockWait(LockType type, qint64 usec) {
+  if (usec >= kSlowLockWaitMsec * 1000) {
+    qLog(Debug) << "Waited" << usec / 1000 << "ms for a database lock of type"
+                << type;
+  }
+
+  QMutexLocker l(&lock_stats_mutex_);
+  LockStats* stats = &lock_stats_[type];
+  stats->count++;
+  stats->total_wait_usec += usec;
+  stats->max_wait_usec = qMax(stats->max_wait_usec, usec);
+}
+
+Database::LockStats Database::lock_stats(LockType type) const {
+  QMutexLocker l(&lock_stats_mutex_);
+  return lock_stats_[type];
+}
+
 QSqlDatabase Database::Connect() {
   QMutexLocker l(&connect_mutex_);
 
@@ -250,6 +297,8 @@ QSqlDatabase Database::Connect() {
   }
 
   db = QSqlDatabase::addDatabase("QSQLITE", connection_id);
+  db.setConnectOptions(
+      QString("QSQLITE_BUSY_TIMEOUT=%1").arg(kBusyTimeoutMsec));
 
   if (!injected_database_name_.isNull())
     db.setDatabaseName(injected_database_name_);
@@ -299,6 +348,8 @@ QSqlDatabase Database::Connect() {
     }
   }
 
+  EnableWal(db);
+
   if (startup_schema_version_ == -1) {
     UpdateMainSchema(&db);
   }
@@ -323,6 +374,30 @@ QSqlDatabase Database::Connect() {
   return db;
 }
 
+void Database::EnableWal(QSqlDatabase& db) {
+  // The journal mode is stored in the database file, but it's cheap to set
+  // again and this catches attached databases that have been recreated.
+  QStringList schemas = QStringList() << "main";
+  for (const QString& key : attached_databases_.keys()) {
+    if (!attached_databases_[key].is_temporary_) schemas << key;
+  }
+
+  for (const QString& schema : schemas) {
+    QSqlQuery q(QString("PRAGMA %1.journal_mode = WAL").arg(schema), db);
+    const bool wal = q.next() && q.value(0).toString() == "wal";
+
+    // In-memory databases can't use WAL, and neither can some filesystems.
+    if (schema == "main") {
+      if (wal_enabled_.fetchAndStoreOrdered(wal) != int(wal)) {
+        qLog(Debug) << "Database WAL mode" << (wal ? "enabled" : "disabled");
+      }
+    }
+    if (wal) {
+      QSqlQuery sync(QString("PRAGMA %1.synchronous = NORMAL").arg(schema), db);
+    }
+  }
+}
+
 void Database::UpdateMainSchema(QSqlDatabase* db) {
   // Get the database's schema version
   int schema_version = 0;
@@ -356,10 +431,14 @@ void Database::RecreateAttachedDb(const QString& database_name) {
 
   const QString filename = attached_databases_[database_name].filename_;
 
-  QMutexLocker l(&mutex_);
+  Locker l(this, Lock_Exclusive);
   {
     QSqlDatabase db(Connect());
 
+    // Leaving WAL mode checkpoints the log and deletes it.
+    QSqlQuery journal(
+        QString("PRAGMA %1.journal_mode = DELETE").arg(database_name), db);
+
     QSqlQuery q("DETACH DATABASE :alias", db);
     q.bindValue(":alias", database_name);
     if (!q.exec()) {
@@ -370,6 +449,11 @@ void Database::RecreateAttachedDb(const QString& database_name) {
     if (!QFile::remove(filename)) {
       qLog(Warning) << "Failed to remove file" << filename;
     }
+
+    // The other threads' connections can stop the journal mode changing, so
+    // make sure an old log isn't replayed into the new database.
+    QFile::remove(filename + "-wal");
+    QFile::remove(filename + "-shm");
   }
 
   // We can't just re-attach the database now because it needs to be done for
@@ -401,7 +485,7 @@ void Database::AttachDatabaseOnDbConnection(const QString& database_name,
 }
 
 void Database::DetachDatabase(const QString& database_name) {
-  QMutexLocker l(&mutex_);
+  Locker l(this, Lock_Exclusive);
   {
     QSqlDatabase db(Connect());
 
@@ -617,7 +701,7 @@ void Database::DoBackup() {
   QSqlDatabase db(this->Connect());
 
   // Before we overwrite anything, make sure the database is not corrupt
-  QMutexLocker l(&mutex_);
+  Locker l(this, Lock_Write);
   const bool ok = IntegrityCheck(db);
 
   if (ok) {
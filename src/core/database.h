@@ -24,9 +24,11 @@
 #ifndef CORE_DATABASE_H_
 #define CORE_DATABASE_H_
 
+#include <QAtomicInt>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QReadWriteLock>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QStringList>
@@ -61,13 +63,48 @@ class Database : public QObject {
     bool is_temporary_;
   };
 
+  // How a call is going to use the database.  The database is in WAL mode
+  // where possible, so readers can run at the same time as each other and as
+  // the writer.  Writers are serialised.  Lock_Exclusive waits for every
+  // other connection to become idle, and is only needed when connections
+  // are going to be closed or databases detached.
+  enum LockType { Lock_Read = 0, Lock_Write, Lock_Exclusive };
+
+  // Holds the database lock of the given type for the lifetime of the object.
+  // Backends should take one of these at the start of any call that uses
+  // Connect().
+  class Locker {
+   public:
+    Locker(Database* db, LockType type);
+    ~Locker();
+
+   private:
+    Q_DISABLE_COPY(Locker)
+
+    Database* db_;
+    bool holds_writer_mutex_;
+  };
+
+  // How long callers have spent waiting for a lock of one type.
+  struct LockStats {
+    LockStats() : count(0), total_wait_usec(0), max_wait_usec(0) {}
+
+    qint64 count;
+    qint64 total_wait_usec;
+    qint64 max_wait_usec;
+  };
+
   static const int kSchemaVersion;
   static const char* kDatabaseFilename;
   static const char* kMagicAllSongsTables;
+  static const int kBusyTimeoutMsec;
+  static const int kSlowLockWaitMsec;
 
   QSqlDatabase Connect();
   bool CheckErrors(const QSqlQuery& query);
-  QMutex* Mutex() { return &mutex_; }
+
+  bool is_wal() const { return wal_enabled_ != 0; }
+  LockStats lock_stats(LockType type) const;
 
   void RecreateAttachedDb(const QString& database_name);
   void ExecSchemaCommands(QSqlDatabase& db, const QString& schema,
@@ -104,6 +141,8 @@ class Database : public QObject {
   bool IntegrityCheck(QSqlDatabase db);
   void BackupFile(const QString& filename);
   bool OpenDatabase(const QString& filename, sqlite3** connection) const;
+  void EnableWal(QSqlDatabase& db);
+  void RecordLockWait(LockType type, qint64 usec);
 
   Application* app_;
 
@@ -112,7 +151,16 @@ class Database : public QObject {
 
   QString directory_;
   QMutex connect_mutex_;
-  QMutex mutex_;
+
+  // Held for reading by every Locker, and for writing by Lock_Exclusive.
+  QReadWriteLock connections_lock_;
+  // Held by writers, and by readers too if the database isn't in WAL mode.
+  QMutex writer_mutex_;
+  // Set by whichever thread connects, and read by Lockers on every thread.
+  QAtomicInt wal_enabled_;
+
+  mutable QMutex lock_stats_mutex_;
+  LockStats lock_stats_[Lock_Exclusive + 1];
 
   // This ID makes the QSqlDatabase name unique to the object as well as the
   // thread
@@ -18,12 +18,17 @@
 
 #include "filesystemwatcherinterface.h"
 
+#include "config.h"
 #include "qtfslistener.h"
 
 #ifdef Q_OS_DARWIN
 #include "macfslistener.h"
 #endif
 
+#ifdef HAVE_INOTIFY
+#include "linuxfslistener.h"
+#endif
+
 FileSystemWatcherInterface::FileSystemWatcherInterface(QObject* parent)
     : QObject(parent) {}
 
@@ -32,6 +37,8 @@ FileSystemWatcherInterface* FileSystemWatcherInterface::Create(
   FileSystemWatcherInterface* ret;
 #ifdef Q_OS_DARWIN
   ret = new MacFSListener(parent);
+#elif defined(HAVE_INOTIFY)
+  ret = new LinuxFSListener(parent);
 #else
   ret = new QtFSListener(parent);
 #endif
@@ -21,6 +21,7 @@
 #define CORE_FILESYSTEMWATCHERINTERFACE_H_
 
 #include <QObject>
+#include <QStringList>
 
 class FileSystemWatcherInterface : public QObject {
   Q_OBJECT
@@ -34,7 +35,15 @@ class FileSystemWatcherInterface : public QObject {
   static FileSystemWatcherInterface* Create(QObject* parent = nullptr);
 
  signals:
+  // Emitted when something in the directory changed.  The whole directory
+  // should be rescanned.
   void PathChanged(const QString& path);
+
+  // Emitted by backends that can tell which files changed, instead of
+  // PathChanged, when only files (not subdirectories) in the directory were
+  // created, modified or removed.  files are the names of the files, relative
+  // to path.
+  void FilesChanged(const QString& path, const QStringList& files);
 };
 
 #endif  // CORE_FILESYSTEMWATCHERINTERFACE_H_
@@ -0,0 +1,332 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "linuxfslistener.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QStringList>
+
+#include "config.h"
+#include "core/logging.h"
+
+#ifdef HAVE_FANOTIFY
+#include <sys/fanotify.h>
+#endif
+
+// Only use fanotify if the headers are new enough to report directory handles
+// and names.
+#if defined(HAVE_FANOTIFY) && defined(FAN_REPORT_DFID_NAME) && \
+    defined(FAN_MARK_FILESYSTEM)
+#define USE_FANOTIFY
+#endif
+
+namespace {
+const uint32_t kInotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB |
+                              IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// Big enough for a few hundred events at a time
+const int kEventBufferSize = 64 * 1024;
+}  // namespace
+
+const int LinuxFSListener::kCoalesceIntervalMsec = 500;
+
+LinuxFSListener::LinuxFSListener(QObject* parent)
+    : FileSystemWatcherInterface(parent),
+      inotify_fd_(-1),
+      inotify_notifier_(nullptr),
+      warned_watch_limit_(false),
+      fanotify_fd_(-1),
+      fanotify_notifier_(nullptr) {
+  coalesce_timer_.setSingleShot(true);
+  coalesce_timer_.setInterval(kCoalesceIntervalMsec);
+  connect(&coalesce_timer_, SIGNAL(timeout()), SLOT(EmitChanges()));
+}
+
+LinuxFSListener::~LinuxFSListener() {
+  if (inotify_fd_ != -1) close(inotify_fd_);
+  if (fanotify_fd_ != -1) close(fanotify_fd_);
+}
+
+void LinuxFSListener::Init() {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ == -1) {
+    qLog(Warning) << "inotify_init1 failed:" << strerror(errno);
+  } else {
+    inotify_notifier_ =
+        new QSocketNotifier(inotify_fd_, QSocketNotifier::Read, this);
+    connect(inotify_notifier_, SIGNAL(activated(int)),
+            SLOT(ReadInotifyEvents()));
+  }
+
+#ifdef USE_FANOTIFY
+  fanotify_fd_ =
+      fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK |
+                        FAN_CLOEXEC,
+                    O_RDONLY);
+  if (fanotify_fd_ == -1) {
+    // This is expected unless we're running with CAP_SYS_ADMIN.
+    qLog(Debug) << "Not using fanotify:" << strerror(errno);
+  } else {
+    fanotify_notifier_ =
+        new QSocketNotifier(fanotify_fd_, QSocketNotifier::Read, this);
+    connect(fanotify_notifier_, SIGNAL(activated(int)),
+            SLOT(ReadFanotifyEvents()));
+  }
+#endif
+}
+
+void LinuxFSListener::AddPath(const QString& path) {
+  if (path_watches_.contains(path) || path_handles_.contains(path)) return;
+
+  if (!AddFanotifyPath(path)) {
+    AddInotifyPath(path);
+  }
+}
+
+void LinuxFSListener::AddInotifyPath(const QString& path) {
+  if (inotify_fd_ == -1) return;
+
+  const int wd = inotify_add_watch(
+      inotify_fd_, QFile::encodeName(path).constData(), kInotifyMask);
+  if (wd == -1) {
+    if (errno == ENOSPC && !warned_watch_limit_) {
+      qLog(Warning) << "Reached the inotify watch limit, some library"
+                    << "directories won't be monitored.  Increase"
+                    << "fs.inotify.max_user_watches to fix this.";
+      warned_watch_limit_ = true;
+    } else if (errno != ENOSPC) {
+      qLog(Warning) << "Failed to watch" << path << strerror(errno);
+    }
+    return;
+  }
+
+  watch_paths_[wd] = path;
+  path_watches_[path] = wd;
+}
+
+bool LinuxFSListener::AddFanotifyPath(const QString& path) {
+#ifdef USE_FANOTIFY
+  if (fanotify_fd_ == -1) return false;
+
+  const QByteArray encoded_path = QFile::encodeName(path);
+
+  struct stat st;
+  struct statfs stfs;
+  if (stat(encoded_path.constData(), &st) != 0 ||
+      statfs(encoded_path.constData(), &stfs) != 0) {
+    return false;
+  }
+
+  // The key is the filesystem ID followed by the file handle, laid out the
+  // same way as in a fanotify_event_info_fid.
+  QByteArray key(reinterpret_cast<const char*>(&stfs.f_fsid),
+                 sizeof(stfs.f_fsid));
+  QByteArray handle_buffer(sizeof(file_handle) + MAX_HANDLE_SZ, '\0');
+  file_handle* handle = reinterpret_cast<file_handle*>(handle_buffer.data());
+  handle->handle_bytes = MAX_HANDLE_SZ;
+
+  int mount_id = 0;
+  if (name_to_handle_at(AT_FDCWD, encoded_path.constData(), handle, &mount_id,
+                        0) != 0) {
+    return false;
+  }
+  key.append(handle_buffer.constData(),
+             sizeof(file_handle) + handle->handle_bytes);
+
+  // Mark the whole filesystem the first time we see a directory on it.
+  if (!marked_filesystems_.contains(st.st_dev)) {
+    if (fanotify_mark(fanotify_fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO |
+                          FAN_CLOSE_WRITE | FAN_ATTRIB | FAN_DELETE_SELF |
+                          FAN_MOVE_SELF | FAN_ONDIR,
+                      AT_FDCWD, encoded_path.constData()) != 0) {
+      qLog(Debug) << "Couldn't add a fanotify mark for" << path
+                  << strerror(errno);
+      return false;
+    }
+    marked_filesystems_.insert(st.st_dev);
+  }
+
+  handle_paths_[key] = path;
+  path_handles_[path] = key;
+  return true;
+#else
+  Q_UNUSED(path);
+  return false;
+#endif
+}
+
+void LinuxFSListener::RemovePath(const QString& path) {
+  if (path_watches_.contains(path)) {
+    const int wd = path_watches_.take(path);
+    watch_paths_.remove(wd);
+    inotify_rm_watch(inotify_fd_, wd);
+  }
+
+  if (path_handles_.contains(path)) {
+    // The filesystem mark stays, events for directories we don't know about
+    // are ignored.
+    handle_paths_.remove(path_handles_.take(path));
+  }
+
+  changed_directories_.remove(path);
+  changed_files_.remove(path);
+}
+
+void LinuxFSListener::Clear() {
+  for (int wd : watch_paths_.keys()) {
+    inotify_rm_watch(inotify_fd_, wd);
+  }
+  watch_paths_.clear();
+  path_watches_.clear();
+
+  handle_paths_.clear();
+  path_handles_.clear();
+
+  changed_directories_.clear();
+  changed_files_.clear();
+}
+
+void LinuxFSListener::ReadInotifyEvents() {
+  char buffer[kEventBufferSize]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  forever {
+    const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (char* p = buffer; p < buffer + length;) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        qLog(Warning) << "inotify queue overflowed, rescanning everything";
+        AllDirectoriesChanged();
+        continue;
+      }
+
+      const QString path = watch_paths_.value(event->wd);
+      if (path.isEmpty()) continue;
+
+      if (event->mask & IN_IGNORED) {
+        // The directory was deleted or unmounted.
+        watch_paths_.remove(event->wd);
+        path_watches_.remove(path);
+        continue;
+      }
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF) ||
+          event->mask & IN_ISDIR || event->len == 0) {
+        DirectoryChanged(path);
+      } else {
+        FileChanged(path, QFile::decodeName(event->name));
+      }
+    }
+  }
+}
+
+void LinuxFSListener::ReadFanotifyEvents() {
+#ifdef USE_FANOTIFY
+  char buffer[kEventBufferSize]
+      __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+
+  forever {
+    ssize_t length = read(fanotify_fd_, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (const fanotify_event_metadata* event =
+             reinterpret_cast<const fanotify_event_metadata*>(buffer);
+         FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+      if (event->mask & FAN_Q_OVERFLOW) {
+        qLog(Warning) << "fanotify queue overflowed, rescanning everything";
+        AllDirectoriesChanged();
+        continue;
+      }
+
+      const fanotify_event_info_fid* info =
+          reinterpret_cast<const fanotify_event_info_fid*>(event + 1);
+      if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) continue;
+
+      const file_handle* handle =
+          reinterpret_cast<const file_handle*>(info->handle);
+      const QByteArray key(reinterpret_cast<const char*>(&info->fsid),
+                           sizeof(info->fsid) + sizeof(file_handle) +
+                               handle->handle_bytes);
+
+      const QString path = handle_paths_.value(key);
+      if (path.isEmpty()) continue;
+
+      const char* name = reinterpret_cast<const char*>(handle->f_handle) +
+                         handle->handle_bytes;
+
+      if (event->mask & (FAN_ONDIR | FAN_DELETE_SELF | FAN_MOVE_SELF) ||
+          strcmp(name, ".") == 0) {
+        DirectoryChanged(path);
+      } else {
+        FileChanged(path, QFile::decodeName(name));
+      }
+    }
+  }
+#endif
+}
+
+void LinuxFSListener::DirectoryChanged(const QString& path) {
+  changed_directories_.insert(path);
+  if (!coalesce_timer_.isActive()) coalesce_timer_.start();
+}
+
+void LinuxFSListener::FileChanged(const QString& path, const QString& name) {
+  changed_files_[path].insert(name);
+  if (!coalesce_timer_.isActive()) coalesce_timer_.start();
+}
+
+void LinuxFSListener::AllDirectoriesChanged() {
+  for (const QString& path : path_watches_.keys()) {
+    DirectoryChanged(path);
+  }
+  for (const QString& path : path_handles_.keys()) {
+    DirectoryChanged(path);
+  }
+}
+
+void LinuxFSListener::EmitChanges() {
+  // A directory that's being rescanned completely doesn't need its files
+  // rescanned as well.
+  for (const QString& path : changed_directories_) {
+    changed_files_.remove(path);
+    emit PathChanged(path);
+  }
+
+  for (QHash<QString, QSet<QString> >::const_iterator it =
+           changed_files_.constBegin();
+       it != changed_files_.constEnd(); ++it) {
+    emit FilesChanged(it.key(), it.value().toList());
+  }
+
+  changed_directories_.clear();
+  changed_files_.clear();
+}
@@ -0,0 +1,82 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_LINUXFSLISTENER_H_
+#define CORE_LINUXFSLISTENER_H_
+
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+#include "filesystemwatcherinterface.h"
+
+class QSocketNotifier;
+
+// Watches directories with inotify, and reports which files changed as well as
+// which directories.  Events are read in batches and collected for
+// kCoalesceIntervalMsec before being emitted, so a burst of writes to the same
+// files (like copying an album into the library) results in one signal per
+// directory.
+// If the process is allowed to (it needs CAP_SYS_ADMIN and Linux 5.9), whole
+// filesystems are watched with one fanotify mark instead, which doesn't use up
+// an inotify watch for each directory.
+class LinuxFSListener : public FileSystemWatcherInterface {
+  Q_OBJECT
+
+ public:
+  explicit LinuxFSListener(QObject* parent = nullptr);
+  ~LinuxFSListener();
+
+  static const int kCoalesceIntervalMsec;
+
+  void Init();
+  void AddPath(const QString& path);
+  void RemovePath(const QString& path);
+  void Clear();
+
+ private slots:
+  void ReadInotifyEvents();
+  void ReadFanotifyEvents();
+  void EmitChanges();
+
+ private:
+  void DirectoryChanged(const QString& path);
+  void FileChanged(const QString& path, const QString& name);
+  void AllDirectoriesChanged();
+
+  bool AddFanotifyPath(const QString& path);
+  void AddInotifyPath(const QString& path);
+
+  int inotify_fd_;
+  QSocketNotifier* inotify_notifier_;
+  QHash<int, QString> watch_paths_;
+  QHash<QString, int> path_watches_;
+  bool warned_watch_limit_;
+
+  int fanotify_fd_;
+  QSocketNotifier* fanotify_notifier_;
+  QSet<quint64> marked_filesystems_;
+  // The filesystem ID and file handle of each directory, as they appear in
+  // fanotify events.
+  QHash<QByteArray, QString> handle_paths_;
+  QHash<QString, QByteArray> path_handles_;
+
+  QSet<QString> changed_directories_;
+  QHash<QString, QSet<QString> > changed_files_;
+  QTimer coalesce_timer_;
+};
+
+#endif  // CORE_LINUXFSLISTENER_H_
@@ -338,6 +338,7 @@ void Song::set_embedded_cover() { d->art_automatic_ = kEmbeddedCover; }
 const QImage& Song::image() const { return d->image_; }
 void Song::set_id(int id) { d->id_ = id; }
 void Song::set_valid(bool v) { d->valid_ = v; }
+void Song::set_init_from_file(bool v) { d->init_from_file_ = v; }
 void Song::set_title(const QString& v) { d->title_ = v; }
 void Song::set_album(const QString& v) { d->album_ = v; }
 void Song::set_artist(const QString& v) { d->artist_ = v; }
@@ -1066,6 +1067,8 @@ QString Song::TitleWithCompilationArtist() const {
   return title;
 }
 
+bool Song::SharesDataWith(const Song& other) const { return d == other.d; }
+
 bool Song::IsMetadataEqual(const Song& other) const {
   return d->title_ == other.d->title_ && d->album_ == other.d->album_ &&
          d->artist_ == other.d->artist_ &&
@@ -243,6 +243,7 @@ class Song {
 
   void set_id(int id);
   void set_valid(bool v);
+  void set_init_from_file(bool v);
   void set_title(const QString& v);
 
   void set_album(const QString& v);
@@ -295,6 +296,9 @@ class Song {
   bool IsMetadataEqual(const Song& other) const;
   bool IsOnSameAlbum(const Song& other) const;
   bool IsSimilar(const Song& other) const;
+  // True if both songs are copies of each other that haven't been changed
+  // since.  This is much cheaper than comparing their fields.
+  bool SharesDataWith(const Song& other) const;
 
   bool operator==(const Song& other) const;
 
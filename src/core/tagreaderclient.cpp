@@ -28,6 +28,8 @@
 #include <QUrl>
 
 const char* TagReaderClient::kWorkerExecutableName = "clementine-tagreader";
+const int TagReaderClient::kReadFilesChunkSize = 16;
+const int TagReaderClient::kSharedMemorySize = 16 * 1024 * 1024;
 TagReaderClient* TagReaderClient::sInstance = nullptr;
 
 TagReaderClient::TagReaderClient(QObject* parent)
@@ -36,6 +38,9 @@ TagReaderClient::TagReaderClient(QObject* parent)
 
   worker_pool_->SetExecutableName(kWorkerExecutableName);
   worker_pool_->SetWorkerCount(QThread::idealThreadCount());
+  // Embedded album art can be several megabytes, so let the workers hand it
+  // over through shared memory.
+  worker_pool_->SetSharedMemorySize(kSharedMemorySize);
   connect(worker_pool_, SIGNAL(WorkerFailedToStart()),
           SLOT(WorkerFailedToStart()));
 }
@@ -57,6 +62,25 @@ TagReaderReply* TagReaderClient::ReadFile(const QString& filename) {
   return worker_pool_->SendMessageWithReply(&message);
 }
 
+QList<TagReaderReply*> TagReaderClient::ReadFiles(
+    const QStringList& filenames) {
+  QList<TagReaderReply*> ret;
+
+  for (int i = 0; i < filenames.count(); i += kReadFilesChunkSize) {
+    pb::tagreader::Message message;
+    pb::tagreader::ReadFilesRequest* req = message.mutable_read_files_request();
+
+    for (const QString& filename : filenames.mid(i, kReadFilesChunkSize)) {
+      const QByteArray filename_utf8 = filename.toUtf8();
+      req->add_filenames(filename_utf8.constData(), filename_utf8.length());
+    }
+
+    ret << worker_pool_->SendMessageWithReply(&message);
+  }
+
+  return ret;
+}
+
 TagReaderReply* TagReaderClient::SaveFile(const QString& filename,
                                           const Song& metadata) {
   pb::tagreader::Message message;
@@ -42,9 +42,26 @@ class TagReaderClient : public QObject {
 
   static const char* kWorkerExecutableName;
 
+  // The maximum number of files read by one ReadFilesRequest.
+  static const int kReadFilesChunkSize;
+
+  // The size of the shared memory ring each worker sends large replies
+  // through.
+  static const int kSharedMemorySize;
+
   void Start();
 
+  // The number of worker processes that requests are spread across.
+  int worker_count() const { return worker_pool_->worker_count(); }
+
   ReplyType* ReadFile(const QString& filename);
+  // Reads the tags of many files with as few messages as possible.  The files
+  // are split into chunks of at most kReadFilesChunkSize, and each chunk is
+  // sent as a separate request so the chunks are read by the workers in
+  // parallel and the results of the first ones can be used before the whole
+  // batch has finished.  Each reply's read_files_response has one entry for
+  // each file in its chunk.
+  QList<ReplyType*> ReadFiles(const QStringList& filenames);
   ReplyType* SaveFile(const QString& filename, const Song& metadata);
   ReplyType* UpdateSongStatistics(const Song& metadata);
   ReplyType* UpdateSongRating(const Song& metadata);
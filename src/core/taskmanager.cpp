@@ -27,6 +27,7 @@ int TaskManager::StartTask(const QString& name) {
   t.name = name;
   t.progress = 0;
   t.progress_max = 0;
+  t.throughput = 0;
   t.blocks_library_scans = false;
 
   {
@@ -89,6 +90,20 @@ void TaskManager::IncreaseTaskProgress(int id, int progress, int max) {
   emit TasksChanged();
 }
 
+void TaskManager::SetTaskThroughput(int id, int items_per_second,
+                                    const QString& unit) {
+  {
+    QMutexLocker l(&mutex_);
+    if (!tasks_.contains(id)) return;
+
+    Task& t = tasks_[id];
+    t.throughput = items_per_second;
+    t.throughput_unit = unit;
+  }
+
+  emit TasksChanged();
+}
+
 void TaskManager::SetTaskFinished(int id) {
   bool resume_library_watchers = false;
 
@@ -120,3 +135,37 @@ int TaskManager::GetTaskProgress(int id) {
     return tasks_[id].progress;
   }
 }
+
+TaskManager::ProgressReporter::ProgressReporter()
+    : task_manager_(nullptr), task_id_(-1), last_throughput_update_(0) {}
+
+void TaskManager::ProgressReporter::Start(TaskManager* task_manager,
+                                          int task_id, const QString& unit) {
+  task_manager_ = task_manager;
+  task_id_ = task_id;
+  unit_ = unit;
+  last_throughput_update_ = 0;
+  timer_.start();
+}
+
+void TaskManager::ProgressReporter::Update(int done, int total,
+                                           int processed) {
+  if (!is_started()) return;
+
+  task_manager_->SetTaskProgress(task_id_, done, total);
+
+  const qint64 elapsed = timer_.elapsed();
+  if (elapsed - last_throughput_update_ < 1000) return;
+  last_throughput_update_ = elapsed;
+
+  task_manager_->SetTaskThroughput(
+      task_id_, int(qint64(processed) * 1000 / elapsed), unit_);
+}
+
+void TaskManager::ProgressReporter::Finish() {
+  if (!is_started()) return;
+
+  task_manager_->SetTaskFinished(task_id_);
+  task_id_ = -1;
+  timer_.invalidate();
+}
@@ -21,6 +21,7 @@
 #ifndef CORE_TASKMANAGER_H_
 #define CORE_TASKMANAGER_H_
 
+#include <QElapsedTimer>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
@@ -36,6 +37,10 @@ class TaskManager : public QObject {
     QString name;
     int progress;
     int progress_max;
+    // Items processed per second, or 0 if the task doesn't report it.
+    int throughput;
+    // What the items are, e.g. "files".
+    QString throughput_unit;
     bool blocks_library_scans;
   };
 
@@ -53,6 +58,35 @@ class TaskManager : public QObject {
     Q_DISABLE_COPY(ScopedTask);
   };
 
+  // Reports the progress of a task that works through a list of items, and
+  // how many of them it gets through a second.  The throughput is updated at
+  // most once a second, since every update wakes up the UI.
+  class ProgressReporter {
+   public:
+    ProgressReporter();
+
+    // Starts timing the task.
+    void Start(TaskManager* task_manager, int task_id, const QString& unit);
+    bool is_started() const { return timer_.isValid(); }
+    qint64 elapsed_msec() const { return timer_.elapsed(); }
+
+    // done out of total items are finished, and processed of those count
+    // towards the throughput.
+    void Update(int done, int total, int processed);
+
+    // Finishes the task and stops the timer.
+    void Finish();
+
+   private:
+    TaskManager* task_manager_;
+    int task_id_;
+    QString unit_;
+    QElapsedTimer timer_;
+    qint64 last_throughput_update_;
+
+    Q_DISABLE_COPY(ProgressReporter);
+  };
+
   // Everything here is thread safe
   QList<Task> GetTasks();
 
@@ -60,6 +94,7 @@ class TaskManager : public QObject {
   void SetTaskBlocksLibraryScans(int id);
   void SetTaskProgress(int id, int progress, int max = 0);
   void IncreaseTaskProgress(int id, int progress, int max = 0);
+  void SetTaskThroughput(int id, int items_per_second, const QString& unit);
   void SetTaskFinished(int id);
   int GetTaskProgress(int id);
 
@@ -21,14 +21,20 @@
 
 #include "albumcoverloader.h"
 
+#include <functional>
+
+#include <QBuffer>
 #include <QPainter>
 #include <QDir>
 #include <QCoreApplication>
+#include <QImageReader>
+#include <QThread>
 #include <QUrl>
 #include <QNetworkReply>
 
 #include "config.h"
 #include "core/closure.h"
+#include "core/concurrentrun.h"
 #include "core/logging.h"
 #include "core/network.h"
 #include "core/tagreaderclient.h"
@@ -41,7 +47,15 @@ AlbumCoverLoader::AlbumCoverLoader(QObject* parent)
       stop_requested_(false),
       next_id_(1),
       network_(new NetworkAccessManager(this)),
-      connected_spotify_(false) {}
+      connected_spotify_(false),
+      running_decodes_(0) {
+  decode_pool_.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+AlbumCoverLoader::~AlbumCoverLoader() {
+  stop_requested_ = true;
+  decode_pool_.waitForDone();
+}
 
 QString AlbumCoverLoader::ImageCacheDir() {
   return Utilities::GetConfigPath(Utilities::Path_AlbumCovers);
@@ -68,6 +82,22 @@ void AlbumCoverLoader::CancelTasks(const QSet<quint64>& ids) {
   }
 }
 
+void AlbumCoverLoader::PrioritiseTasks(const QSet<quint64>& ids) {
+  QMutexLocker l(&mutex_);
+  QQueue<Task> prioritised;
+  for (QQueue<Task>::iterator it = tasks_.begin(); it != tasks_.end();) {
+    if (ids.contains(it->id)) {
+      prioritised.enqueue(*it);
+      it = tasks_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  prioritised.append(tasks_);
+  tasks_.swap(prioritised);
+}
+
 quint64 AlbumCoverLoader::LoadImageAsync(const AlbumCoverLoaderOptions& options,
                                          const QString& art_automatic,
                                          const QString& art_manual,
@@ -94,11 +124,12 @@ quint64 AlbumCoverLoader::LoadImageAsync(const AlbumCoverLoaderOptions& options,
 
 void AlbumCoverLoader::ProcessTasks() {
   while (!stop_requested_) {
-    // Get the next task
+    // Get the next task, unless every decoding thread is busy
     Task task;
     {
       QMutexLocker l(&mutex_);
       if (tasks_.isEmpty()) return;
+      if (running_decodes_ >= decode_pool_.maxThreadCount()) return;
       task = tasks_.dequeue();
     }
 
@@ -106,29 +137,53 @@ void AlbumCoverLoader::ProcessTasks() {
   }
 }
 
+void AlbumCoverLoader::DecodeFinished() {
+  running_decodes_--;
+  ProcessTasks();
+}
+
+QString AlbumCoverLoader::CurrentFilename(const Task& task) {
+  switch (task.state) {
+    case State_TryingAuto:
+      return task.art_automatic;
+    case State_TryingManual:
+      return task.art_manual;
+  }
+  return QString();
+}
+
+bool AlbumCoverLoader::IsRemote(const QString& filename) {
+  const QString lower = filename.toLower();
+  return lower.startsWith("http://") || lower.startsWith("https://") ||
+         lower.startsWith("spotify://image/");
+}
+
 void AlbumCoverLoader::ProcessTask(Task* task) {
-  TryLoadResult result = TryLoadImage(*task);
-  if (result.started_async) {
+  const QString filename = CurrentFilename(*task);
+
+  // An image embedded in the song itself takes priority
+  if (task->embedded_image.isNull() && IsRemote(filename)) {
     // The image is being loaded from a remote URL, we'll carry on later
     // when it's done
+    StartRemoteLoad(*task, filename);
     return;
   }
 
-  if (result.loaded_success) {
-    QImage scaled = ScaleAndPad(task->options, result.image);
-    emit ImageLoaded(task->id, scaled);
-    emit ImageLoaded(task->id, scaled, result.image);
-    return;
-  }
-
-  NextState(task);
+  running_decodes_++;
+  ConcurrentRun::Run<void>(
+      &decode_pool_, std::bind(&AlbumCoverLoader::DecodeTask, this, *task));
 }
 
 void AlbumCoverLoader::NextState(Task* task) {
   if (task->state == State_TryingManual) {
-    // Try the automatic one next
+    // Try the automatic one next, before anything else in the queue, once
+    // there's a decoding thread free
     task->state = State_TryingAuto;
-    ProcessTask(task);
+    {
+      QMutexLocker l(&mutex_);
+      tasks_.prepend(*task);
+    }
+    ProcessTasks();
   } else {
     // Give up
     emit ImageLoaded(task->id, task->options.default_output_image_);
@@ -137,6 +192,28 @@ void AlbumCoverLoader::NextState(Task* task) {
   }
 }
 
+void AlbumCoverLoader::DecodeTask(Task task) {
+  TryLoadResult result = TryLoadImage(task);
+
+  if (result.loaded_success) {
+    QImage scaled = ScaleAndPad(task.options, result.image);
+    emit ImageLoaded(task.id, scaled);
+    emit ImageLoaded(task.id, scaled, result.image);
+  } else if (task.state == State_TryingManual) {
+    // Try the automatic one next, before anything else in the queue
+    task.state = State_TryingAuto;
+    QMutexLocker l(&mutex_);
+    tasks_.prepend(task);
+  } else {
+    // Give up
+    emit ImageLoaded(task.id, task.options.default_output_image_);
+    emit ImageLoaded(task.id, task.options.default_output_image_,
+                     task.options.default_output_image_);
+  }
+
+  metaObject()->invokeMethod(this, "DecodeFinished", Qt::QueuedConnection);
+}
+
 AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
     const Task& task) {
   // An image embedded in the song itself takes priority
@@ -144,15 +221,7 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
     return TryLoadResult(false, true,
                          ScaleAndPad(task.options, task.embedded_image));
 
-  QString filename;
-  switch (task.state) {
-    case State_TryingAuto:
-      filename = task.art_automatic;
-      break;
-    case State_TryingManual:
-      filename = task.art_manual;
-      break;
-  }
+  const QString filename = CurrentFilename(task);
 
   if (filename == Song::kManuallyUnsetCover)
     return TryLoadResult(false, true, task.options.default_output_image_);
@@ -167,16 +236,18 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
                            ScaleAndPad(task.options, taglib_image));
   }
 
-  if (filename.toLower().startsWith("http://") ||
-      filename.toLower().startsWith("https://")) {
-    QUrl url(filename);
-    QNetworkReply* reply = network_->get(QNetworkRequest(url));
-    NewClosure(reply, SIGNAL(finished()), this,
-               SLOT(RemoteFetchFinished(QNetworkReply*)), reply);
+  QImage image;
+  if (!filename.isEmpty()) {
+    image = ReadImage(task.options, filename);
+  }
+  return TryLoadResult(
+      false, !image.isNull(),
+      image.isNull() ? task.options.default_output_image_ : image);
+}
 
-    remote_tasks_.insert(reply, task);
-    return TryLoadResult(true, false, QImage());
-  } else if (filename.toLower().startsWith("spotify://image/")) {
+void AlbumCoverLoader::StartRemoteLoad(const Task& task,
+                                       const QString& filename) {
+  if (filename.toLower().startsWith("spotify://image/")) {
     // HACK: we should add generic image URL handlers
     SpotifyService* spotify = InternetModel::Service<SpotifyService>();
 
@@ -195,13 +266,15 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
     // Need to schedule this in the spotify service's thread
     QMetaObject::invokeMethod(spotify, "LoadImage", Qt::QueuedConnection,
                               Q_ARG(QString, id));
-    return TryLoadResult(true, false, QImage());
+    return;
   }
 
-  QImage image(filename);
-  return TryLoadResult(
-      false, !image.isNull(),
-      image.isNull() ? task.options.default_output_image_ : image);
+  QUrl url(filename);
+  QNetworkReply* reply = network_->get(QNetworkRequest(url));
+  NewClosure(reply, SIGNAL(finished()), this,
+             SLOT(RemoteFetchFinished(QNetworkReply*)), reply);
+
+  remote_tasks_.insert(reply, task);
 }
 
 void AlbumCoverLoader::SpotifyImageLoaded(const QString& id,
@@ -237,9 +310,13 @@ void AlbumCoverLoader::RemoteFetchFinished(QNetworkReply* reply) {
   }
 
   if (reply->error() == QNetworkReply::NoError) {
-    // Try to load the image
-    QImage image;
-    if (image.load(reply, 0)) {
+    // Try to load the image.  Read it all first - the reader can't seek
+    // back to the start of a network reply after it reads the image's size.
+    QByteArray data = reply->readAll();
+    QBuffer buffer(&data);
+    QImageReader reader(&buffer);
+    QImage image = ReadImage(task.options, &reader);
+    if (!image.isNull()) {
       QImage scaled = ScaleAndPad(task.options, image);
       emit ImageLoaded(task.id, scaled);
       emit ImageLoaded(task.id, scaled, image);
@@ -278,6 +355,25 @@ QImage AlbumCoverLoader::ScaleAndPad(const AlbumCoverLoaderOptions& options,
   return padded_image;
 }
 
+QImage AlbumCoverLoader::ReadImage(const AlbumCoverLoaderOptions& options,
+                                   const QString& filename) {
+  QImageReader reader(filename);
+  return ReadImage(options, &reader);
+}
+
+QImage AlbumCoverLoader::ReadImage(const AlbumCoverLoaderOptions& options,
+                                   QImageReader* reader) {
+  if (options.scale_output_image_ && !options.keep_original_image_) {
+    const QSize size = reader->size();
+    const QSize desired(options.desired_height_, options.desired_height_);
+    if (size.isValid() && (size.width() > desired.width() ||
+                           size.height() > desired.height())) {
+      reader->setScaledSize(size.scaled(desired, Qt::KeepAspectRatio));
+    }
+  }
+  return reader->read();
+}
+
 QPixmap AlbumCoverLoader::TryLoadPixmap(const QString& automatic,
                                         const QString& manual,
                                         const QString& filename) {
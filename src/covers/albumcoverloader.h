@@ -28,9 +28,11 @@
 #include <QMutex>
 #include <QObject>
 #include <QQueue>
+#include <QThreadPool>
 #include <QUrl>
 
 class NetworkAccessManager;
+class QImageReader;
 class QNetworkReply;
 
 class AlbumCoverLoader : public QObject {
@@ -38,6 +40,7 @@ class AlbumCoverLoader : public QObject {
 
  public:
   explicit AlbumCoverLoader(QObject* parent = nullptr);
+  ~AlbumCoverLoader();
 
   void Stop() { stop_requested_ = true; }
 
@@ -54,17 +57,28 @@ class AlbumCoverLoader : public QObject {
   void CancelTask(quint64 id);
   void CancelTasks(const QSet<quint64>& ids);
 
+  // Moves these tasks to the front of the queue, so covers that are visible
+  // can be loaded before ones that aren't.
+  void PrioritiseTasks(const QSet<quint64>& ids);
+
   static QPixmap TryLoadPixmap(const QString& automatic, const QString& manual,
                                const QString& filename = QString());
   static QImage ScaleAndPad(const AlbumCoverLoaderOptions& options,
                             const QImage& image);
 
+  // Reads an image file, decoding it at the desired size if it's going to be
+  // scaled down anyway.  JPEGs are scaled while they're decoded, which is
+  // much faster than decoding the full image and scaling it afterwards.
+  static QImage ReadImage(const AlbumCoverLoaderOptions& options,
+                          const QString& filename);
+
  signals:
   void ImageLoaded(quint64 id, const QImage& image);
   void ImageLoaded(quint64 id, const QImage& scaled, const QImage& original);
 
  protected slots:
   void ProcessTasks();
+  void DecodeFinished();
   void RemoteFetchFinished(QNetworkReply* reply);
   void SpotifyImageLoaded(const QString& url, const QImage& image);
 
@@ -94,8 +108,19 @@ class AlbumCoverLoader : public QObject {
     QImage image;
   };
 
+  static QImage ReadImage(const AlbumCoverLoaderOptions& options,
+                          QImageReader* reader);
+  static QString CurrentFilename(const Task& task);
+  static bool IsRemote(const QString& filename);
+
+  // Remote images are fetched in this object's thread, everything else is
+  // decoded in the thread pool.
   void ProcessTask(Task* task);
   void NextState(Task* task);
+  void StartRemoteLoad(const Task& task, const QString& filename);
+
+  // Runs in the thread pool.
+  void DecodeTask(Task task);
   TryLoadResult TryLoadImage(const Task& task);
 
   bool stop_requested_;
@@ -110,6 +135,10 @@ class AlbumCoverLoader : public QObject {
 
   bool connected_spotify_;
 
+  // Only used from this object's thread.
+  int running_decodes_;
+  QThreadPool decode_pool_;
+
   static const int kMaxRedirects = 3;
 };
 
@@ -26,11 +26,17 @@ struct AlbumCoverLoaderOptions {
   AlbumCoverLoaderOptions()
       : desired_height_(120),
         scale_output_image_(true),
-        pad_output_image_(true) {}
+        pad_output_image_(true),
+        keep_original_image_(false) {}
 
   int desired_height_;
   bool scale_output_image_;
   bool pad_output_image_;
+
+  // Scaled images are normally decoded straight at the desired size, so the
+  // "original" image passed to ImageLoaded is the scaled one.  Set this to
+  // decode the full image instead.
+  bool keep_original_image_;
   QImage default_output_image_;
 };
 
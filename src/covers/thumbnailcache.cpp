@@ -0,0 +1,223 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnailcache.h"
+
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMultiMap>
+
+#include "core/logging.h"
+#include "core/utilities.h"
+
+const int ThumbnailCache::kMemoryCacheBytes = 32 * 1024 * 1024;  // 32MB
+const qint64 ThumbnailCache::kDiskCacheBytes = 100 * 1024 * 1024;  // 100MB
+
+const quint32 ThumbnailCache::kFileMagic = 0x43544e42;  // "CTNB"
+const quint16 ThumbnailCache::kFileVersion = 1;
+
+const int ThumbnailCache::kMarkUsedIntervalSecs = 60 * 60;  // 1 hour
+
+ThumbnailCache::ThumbnailCache(const QString& directory)
+    : directory_(directory), memory_(kMemoryCacheBytes), disk_usage_(-1) {
+  if (directory_.isEmpty()) {
+    directory_ =
+        Utilities::GetConfigPath(Utilities::Path_CacheRoot) + "/thumbnails";
+
+    // Thumbnails used to be kept in a QNetworkDiskCache in here.
+    const QString old_directory =
+        Utilities::GetConfigPath(Utilities::Path_CacheRoot) + "/pixmapcache";
+    if (QFile::exists(old_directory)) {
+      qLog(Info) << "Removing old thumbnail cache" << old_directory;
+      Utilities::RemoveRecursive(old_directory);
+    }
+  }
+}
+
+QString ThumbnailCache::MemoryKey(const QString& key, int size) {
+  return QString::number(size) + ":" + key;
+}
+
+QString ThumbnailCache::Filename(const QString& key, int size) const {
+  const QByteArray hash =
+      QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+  return directory_ + "/" + QString::number(size) + "/" + hash.toHex();
+}
+
+bool ThumbnailCache::Find(const QString& key, int size, QPixmap* pixmap) {
+  const QString memory_key = MemoryKey(key, size);
+  if (QPixmap* cached = memory_.object(memory_key)) {
+    *pixmap = *cached;
+    return true;
+  }
+
+  const QString filename = Filename(key, size);
+  const QImage image = ReadFile(filename);
+  if (image.isNull()) return false;
+  MarkUsed(filename);
+
+  *pixmap = QPixmap::fromImage(image);
+  InsertInMemory(key, size, *pixmap);
+  return true;
+}
+
+void ThumbnailCache::Insert(const QString& key, int size,
+                            const QImage& image) {
+  if (image.isNull()) return;
+
+  const QImage converted =
+      image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  InsertInMemory(key, size, QPixmap::fromImage(converted));
+
+  if (WriteFile(Filename(key, size), converted)) {
+    ExpireDiskCache();
+  }
+}
+
+void ThumbnailCache::InsertInMemory(const QString& key, int size,
+                                    const QPixmap& pixmap) {
+  const int cost = pixmap.width() * pixmap.height() * 4;
+  memory_.insert(MemoryKey(key, size), new QPixmap(pixmap), qMax(1, cost));
+}
+
+void ThumbnailCache::Remove(const QString& key, int size) {
+  memory_.remove(MemoryKey(key, size));
+
+  QFile file(Filename(key, size));
+  const qint64 file_size = file.size();
+  if (file.remove() && disk_usage_ != -1) {
+    disk_usage_ -= file_size;
+  }
+}
+
+QImage ThumbnailCache::ReadFile(const QString& filename) const {
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) return QImage();
+
+  const qint64 file_size = file.size();
+  if (file_size < qint64(sizeof(FileHeader))) return QImage();
+
+  const uchar* data = file.map(0, file_size);
+  if (!data) return QImage();
+
+  FileHeader header;
+  memcpy(&header, data, sizeof(header));
+
+  const qint64 pixel_bytes = qint64(header.width) * header.height * 4;
+  if (header.magic != kFileMagic || header.version != kFileVersion ||
+      header.width == 0 || header.height == 0 ||
+      file_size != qint64(sizeof(header)) + pixel_bytes) {
+    qLog(Warning) << "Ignoring invalid thumbnail" << filename;
+    file.unmap(const_cast<uchar*>(data));
+    return QImage();
+  }
+
+  // Copy the pixels out of the mapping so it can be closed straight away.
+  QImage image(header.width, header.height,
+               QImage::Format_ARGB32_Premultiplied);
+  const uchar* pixels = data + sizeof(header);
+  const int line_bytes = header.width * 4;
+  for (int y = 0; y < image.height(); ++y) {
+    memcpy(image.scanLine(y), pixels + y * line_bytes, line_bytes);
+  }
+
+  file.unmap(const_cast<uchar*>(data));
+  return image;
+}
+
+void ThumbnailCache::MarkUsed(const QString& filename) {
+  QFile file(filename);
+  const QDateTime modified = QFileInfo(file).lastModified();
+  if (modified.secsTo(QDateTime::currentDateTime()) < kMarkUsedIntervalSecs) {
+    return;
+  }
+
+  // Writing the first byte back again is enough to update the time.
+  char byte = 0;
+  if (!file.open(QIODevice::ReadWrite) || !file.getChar(&byte)) return;
+  file.seek(0);
+  file.putChar(byte);
+}
+
+bool ThumbnailCache::WriteFile(const QString& filename, const QImage& image) {
+  const QString dir = QFileInfo(filename).path();
+  if (!QDir().mkpath(dir)) {
+    qLog(Warning) << "Couldn't create thumbnail directory" << dir;
+    return false;
+  }
+
+  FileHeader header;
+  header.magic = kFileMagic;
+  header.version = kFileVersion;
+  header.reserved = 0;
+  header.width = image.width();
+  header.height = image.height();
+
+  QFile file(filename);
+  const qint64 old_size = file.exists() ? file.size() : 0;
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qLog(Warning) << "Couldn't write thumbnail" << filename;
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const int line_bytes = image.width() * 4;
+  for (int y = 0; y < image.height(); ++y) {
+    file.write(reinterpret_cast<const char*>(image.constScanLine(y)),
+               line_bytes);
+  }
+
+  if (disk_usage_ != -1) {
+    disk_usage_ += file.size() - old_size;
+  }
+  return true;
+}
+
+void ThumbnailCache::ExpireDiskCache() {
+  if (disk_usage_ == -1) {
+    disk_usage_ = 0;
+    QDirIterator it(directory_, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+      it.next();
+      disk_usage_ += it.fileInfo().size();
+    }
+  }
+
+  if (disk_usage_ <= kDiskCacheBytes) return;
+
+  // Delete the least recently used files until we're at 90% of the limit,
+  // so we don't have to scan the directory again on the next insert.
+  QMultiMap<QDateTime, QFileInfo> files;
+  QDirIterator it(directory_, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    it.next();
+    files.insert(it.fileInfo().lastModified(), it.fileInfo());
+  }
+
+  const qint64 target = kDiskCacheBytes * 9 / 10;
+  for (const QFileInfo& info : files) {
+    if (disk_usage_ <= target) break;
+    if (QFile::remove(info.filePath())) {
+      disk_usage_ -= info.size();
+    }
+  }
+}
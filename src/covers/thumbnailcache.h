@@ -0,0 +1,90 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COVERS_THUMBNAILCACHE_H_
+#define COVERS_THUMBNAILCACHE_H_
+
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+#include <QString>
+
+// Keeps small album art thumbnails for the library, global search and the
+// cover manager.  Recently used thumbnails are kept in memory, and every
+// thumbnail is also written to disk as raw premultiplied ARGB pixels, one
+// directory per size.  Reading one back after a restart is a single mmap and
+// copy - no image decoding.
+// Thumbnails are stored as QPixmaps, so this must only be used from the GUI
+// thread.
+class ThumbnailCache {
+ public:
+  // Uses a directory in the cache root if directory is empty.
+  explicit ThumbnailCache(const QString& directory = QString());
+
+  static const int kMemoryCacheBytes;
+  static const qint64 kDiskCacheBytes;
+
+  // Returns false if the thumbnail isn't in memory or on disk.
+  bool Find(const QString& key, int size, QPixmap* pixmap);
+
+  // Saves a thumbnail in memory and on disk.
+  void Insert(const QString& key, int size, const QImage& image);
+
+  // Saves a thumbnail in memory only.  Use this for placeholders that
+  // shouldn't survive a restart.
+  void InsertInMemory(const QString& key, int size, const QPixmap& pixmap);
+
+  void Remove(const QString& key, int size);
+
+  const QString& directory() const { return directory_; }
+
+ private:
+  static const quint32 kFileMagic;
+  static const quint16 kFileVersion;
+
+  // How often a thumbnail's modification time is updated when it's read.
+  static const int kMarkUsedIntervalSecs;
+
+  struct FileHeader {
+    quint32 magic;
+    quint16 version;
+    quint16 reserved;
+    quint32 width;
+    quint32 height;
+  };
+
+  static QString MemoryKey(const QString& key, int size);
+  QString Filename(const QString& key, int size) const;
+
+  QImage ReadFile(const QString& filename) const;
+  bool WriteFile(const QString& filename, const QImage& image);
+
+  // Files are expired by their modification time, which is updated when
+  // they're read.  Access times can't be relied on, since most filesystems
+  // are mounted with noatime or relatime.
+  void MarkUsed(const QString& filename);
+
+  // Deletes the least recently used thumbnails until the disk cache fits in its limit.
+  void ExpireDiskCache();
+
+  QString directory_;
+  QCache<QString, QPixmap> memory_;
+
+  // -1 until the directory has been scanned.
+  qint64 disk_usage_;
+};
+
+#endif  // COVERS_THUMBNAILCACHE_H_
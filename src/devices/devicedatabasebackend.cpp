@@ -31,7 +31,7 @@ DeviceDatabaseBackend::DeviceDatabaseBackend(QObject* parent)
 void DeviceDatabaseBackend::Init(Database* db) { db_ = db; }
 
 DeviceDatabaseBackend::DeviceList DeviceDatabaseBackend::GetAllDevices() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   DeviceList ret;
@@ -59,7 +59,7 @@ DeviceDatabaseBackend::DeviceList DeviceDatabaseBackend::GetAllDevices() {
 }
 
 int DeviceDatabaseBackend::AddDevice(const Device& device) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   ScopedTransaction t(&db);
@@ -97,7 +97,7 @@ int DeviceDatabaseBackend::AddDevice(const Device& device) {
 }
 
 void DeviceDatabaseBackend::RemoveDevice(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   ScopedTransaction t(&db);
@@ -122,7 +122,7 @@ void DeviceDatabaseBackend::SetDeviceOptions(int id,
                                              const QString& icon_name,
                                              MusicStorage::TranscodeMode mode,
                                              Song::FileType format) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -22,6 +22,7 @@
 #ifndef AMAROK_GSTENGINE_H
 #define AMAROK_GSTENGINE_H
 
+#include <atomic>
 #include <memory>
 
 #include <gst/gst.h>
@@ -35,6 +36,7 @@
 
 #include "bufferconsumer.h"
 #include "enginebase.h"
+#include "scopering.h"
 #include "core/timeconstants.h"
 
 class QTimer;
@@ -87,6 +89,12 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   Engine::State state() const;
   const Engine::Scope& scope(int chunk_length);
 
+  // How long the newest scope samples took to reach the GUI thread.
+  qint64 scope_latency_nsec() const;
+
+  // How long the last gapless track change took to produce its first sample.
+  qint64 track_change_latency_nsec() const;
+
   OutputDetailsList GetOutputsList() const;
 
   GstElement* CreateElement(const QString& factoryName, GstElement* bin = 0);
@@ -133,7 +141,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   void HandlePipelineError(int pipeline_id, const QString& message, int domain,
                            int error_code);
   void NewMetaData(int pipeline_id, const Engine::SimpleMetaBundle& bundle);
-  void AddBufferToScope(GstBuffer* buf, int pipeline_id);
   void FadeoutFinished();
   void FadeoutPauseFinished();
   void SeekNow();
@@ -158,6 +165,9 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   void StartFadeout();
   void StartFadeoutPause();
 
+  // Also makes the scope take buffers from the new pipeline only.
+  void SetCurrentPipeline(std::shared_ptr<GstEnginePipeline> pipeline);
+
   void StartTimers();
   void StopTimers();
 
@@ -165,8 +175,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   std::shared_ptr<GstEnginePipeline> CreatePipeline(const QUrl& url,
                                                     qint64 end_nanosec);
 
-  void UpdateScope(int chunk_length);
-
   int AddBackgroundStream(std::shared_ptr<GstEnginePipeline> pipeline);
 
   static QUrl FixupUrl(const QUrl& url);
@@ -194,8 +202,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
 
   QList<BufferConsumer*> buffer_consumers_;
 
-  GstBuffer* latest_buffer_;
-
   bool equalizer_enabled_;
   int equalizer_preamp_;
   QList<int> equalizer_gains_;
@@ -229,9 +235,10 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   bool is_fading_out_to_pause_;
   bool has_faded_out_;
 
-  int scope_chunk_;
-  bool have_new_buffer_;
-  int scope_chunks_;
+  // Written by the streaming thread in ConsumeBuffer, read by scope().
+  ScopeRing scope_ring_;
+  // The ID of current_pipeline_, read by the streaming thread.
+  std::atomic<int> scope_pipeline_id_;
 
   QList<DeviceFinder*> device_finders_;
 
@@ -37,7 +37,6 @@
 #include "internet/spotify/spotifyserver.h"
 #include "internet/spotify/spotifyservice.h"
 
-const int GstEnginePipeline::kGstStateTimeoutNanosecs = 10000000;
 const int GstEnginePipeline::kFaderFudgeMsec = 2000;
 
 const int GstEnginePipeline::kEqBandCount = 10;
@@ -93,7 +92,14 @@ GstEnginePipeline::GstEnginePipeline(GstEngine* engine)
       stereo_panorama_(nullptr),
       volume_(nullptr),
       audioscale_(nullptr),
-      audiosink_(nullptr) {
+      audiosink_(nullptr),
+      state_(GST_STATE_NULL),
+      preroll_bin_(nullptr),
+      preroll_pad_(nullptr),
+      preroll_probe_id_(0),
+      preroll_failed_(false),
+      track_change_start_usec_(0),
+      track_change_latency_nsec_(0) {
   if (!sElementDeleter) {
     sElementDeleter = new GstElementDeleter;
   }
@@ -144,12 +150,20 @@ bool GstEnginePipeline::ReplaceDecodeBin(GstElement* new_bin) {
   segment_start_ = 0;
   segment_start_received_ = false;
   pipeline_is_connected_ = false;
-  gst_bin_add(GST_BIN(pipeline_), uridecodebin_);
+
+  // A prerolled bin is in the pipeline already.
+  if (GST_ELEMENT_PARENT(uridecodebin_) != GST_ELEMENT(pipeline_)) {
+    gst_bin_add(GST_BIN(pipeline_), uridecodebin_);
+  }
 
   return true;
 }
 
 bool GstEnginePipeline::ReplaceDecodeBin(const QUrl& url) {
+  return ReplaceDecodeBin(CreateDecodeBin(url));
+}
+
+GstElement* GstEnginePipeline::CreateDecodeBin(const QUrl& url) {
   GstElement* new_bin = nullptr;
 
   if (url.scheme() == "spotify") {
@@ -158,7 +172,7 @@ bool GstEnginePipeline::ReplaceDecodeBin(const QUrl& url) {
     // Create elements
     GstElement* src = engine_->CreateElement("tcpserversrc", new_bin);
     GstElement* gdp = engine_->CreateElement("gdpdepay", new_bin);
-    if (!src || !gdp) return false;
+    if (!src || !gdp) return nullptr;
 
     // Pick a port number
     const int port = Utilities::PickUnusedPort();
@@ -182,6 +196,8 @@ bool GstEnginePipeline::ReplaceDecodeBin(const QUrl& url) {
         Q_ARG(QString, url.toString()), Q_ARG(quint16, port));
   } else {
     new_bin = engine_->CreateElement("uridecodebin");
+    if (!new_bin) return nullptr;
+
     g_object_set(G_OBJECT(new_bin), "uri", url.toEncoded().constData(),
                  nullptr);
     CHECKED_GCONNECT(G_OBJECT(new_bin), "drained", &SourceDrainedCallback,
@@ -191,7 +207,7 @@ bool GstEnginePipeline::ReplaceDecodeBin(const QUrl& url) {
                      this);
   }
 
-  return ReplaceDecodeBin(new_bin);
+  return new_bin;
 }
 
 GstElement* GstEnginePipeline::CreateDecodeBinFromString(const char* pipeline) {
@@ -494,6 +510,8 @@ bool GstEnginePipeline::InitFromUrl(const QUrl& url, qint64 end_nanosec) {
 }
 
 GstEnginePipeline::~GstEnginePipeline() {
+  if (preroll_pad_) gst_object_unref(preroll_pad_);
+
   if (pipeline_) {
     gst_bus_set_sync_handler(gst_pipeline_get_bus(GST_PIPELINE(pipeline_)),
                              nullptr, nullptr, nullptr);
@@ -554,6 +572,11 @@ GstBusSyncReply GstEnginePipeline::BusCallbackSync(GstBus*, GstMessage* msg,
       break;
 
     case GST_MESSAGE_STATE_CHANGED:
+      if (GST_MESSAGE_SRC(msg) == GST_OBJECT(instance->pipeline_)) {
+        GstState new_state;
+        gst_message_parse_state_changed(msg, nullptr, &new_state, nullptr);
+        instance->state_ = new_state;
+      }
       instance->StateChangedMessageReceived(msg);
       break;
 
@@ -632,6 +655,17 @@ void GstEnginePipeline::ErrorMessageReceived(GstMessage* msg) {
   g_error_free(error);
   free(debugs);
 
+  if (IsFromPreroll(msg)) {
+    // This isn't about the song that's playing.  Forget the preroll and let
+    // TransitionToNext() open the next song the usual way, so the error comes
+    // up again once it's the current song.
+    QMutexLocker l(&preroll_mutex_);
+    qLog(Warning) << id() << "Couldn't preroll" << preroll_url_ << ":"
+                  << message;
+    preroll_failed_ = true;
+    return;
+  }
+
   if (!redirect_url_.isEmpty() &&
       debugstr.contains(
           "A redirect message was posted on the bus and should have been "
@@ -670,6 +704,9 @@ bool IsAkamaiTag(const QString& tag) { return tag.contains("- text=\""); }
 }
 
 void GstEnginePipeline::TagMessageReceived(GstMessage* msg) {
+  // Tags from the next song will come again once it's playing.
+  if (IsFromPreroll(msg)) return;
+
   GstTagList* taglist = nullptr;
   gst_message_parse_tag(msg, &taglist);
 
@@ -764,16 +801,34 @@ void GstEnginePipeline::BufferingMessageReceived(GstMessage* msg) {
   }
 }
 
-void GstEnginePipeline::NewPadCallback(GstElement*, GstPad* pad,
+void GstEnginePipeline::NewPadCallback(GstElement* bin, GstPad* pad,
                                        gpointer self) {
   GstEnginePipeline* instance = reinterpret_cast<GstEnginePipeline*>(self);
-  GstPad* const audiopad =
-      gst_element_get_static_pad(instance->audiobin_, "sink");
+
+  {
+    QMutexLocker l(&instance->preroll_mutex_);
+    if (bin == instance->preroll_bin_) {
+      // The next song has been opened early.  Hold its data back until it's
+      // time to play it.
+      if (!instance->preroll_pad_) {
+        instance->preroll_pad_ = GST_PAD(gst_object_ref(pad));
+        instance->preroll_probe_id_ =
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+                              PrerollBlockProbe, instance, nullptr);
+      }
+      return;
+    }
+  }
+
+  instance->LinkDecodeBinPad(pad);
+}
+
+void GstEnginePipeline::LinkDecodeBinPad(GstPad* pad) {
+  GstPad* const audiopad = gst_element_get_static_pad(audiobin_, "sink");
 
   // Link decodebin's sink pad to audiobin's src pad.
   if (GST_PAD_IS_LINKED(audiopad)) {
-    qLog(Warning) << instance->id()
-                  << "audiopad is already linked, unlinking old pad";
+    qLog(Warning) << id() << "audiopad is already linked, unlinking old pad";
     gst_pad_unlink(audiopad, GST_PAD_PEER(audiopad));
   }
 
@@ -785,8 +840,8 @@ void GstEnginePipeline::NewPadCallback(GstElement*, GstPad* pad,
   // decodebin.
   // "Running time" is the time since the last flushing seek.
   GstClockTime running_time = gst_segment_to_running_time(
-      &instance->last_decodebin_segment_, GST_FORMAT_TIME,
-      instance->last_decodebin_segment_.position);
+      &last_decodebin_segment_, GST_FORMAT_TIME,
+      last_decodebin_segment_.position);
   gst_pad_set_offset(pad, running_time);
 
   // Add a probe to the pad so we can update last_decodebin_segment_.
@@ -794,14 +849,41 @@ void GstEnginePipeline::NewPadCallback(GstElement*, GstPad* pad,
       pad, static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER |
                                         GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
                                         GST_PAD_PROBE_TYPE_EVENT_FLUSH),
-      DecodebinProbe, instance, nullptr);
+      DecodebinProbe, this, nullptr);
 
-  instance->pipeline_is_connected_ = true;
-  if (instance->pending_seek_nanosec_ != -1 &&
-      instance->pipeline_is_initialised_) {
-    QMetaObject::invokeMethod(instance, "Seek", Qt::QueuedConnection,
-                              Q_ARG(qint64, instance->pending_seek_nanosec_));
+  if (track_change_start_usec_ != 0) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FirstBufferProbe, this,
+                      nullptr);
   }
+
+  pipeline_is_connected_ = true;
+  if (pending_seek_nanosec_ != -1 && pipeline_is_initialised_) {
+    QMetaObject::invokeMethod(this, "Seek", Qt::QueuedConnection,
+                              Q_ARG(qint64, pending_seek_nanosec_));
+  }
+}
+
+GstPadProbeReturn GstEnginePipeline::PrerollBlockProbe(GstPad*,
+                                                       GstPadProbeInfo*,
+                                                       gpointer) {
+  // Returning OK from a blocking probe keeps the pad blocked.
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn GstEnginePipeline::FirstBufferProbe(GstPad*,
+                                                      GstPadProbeInfo*,
+                                                      gpointer self) {
+  GstEnginePipeline* instance = reinterpret_cast<GstEnginePipeline*>(self);
+
+  const gint64 start = instance->track_change_start_usec_.exchange(0);
+  if (start != 0) {
+    const qint64 latency = (g_get_monotonic_time() - start) * kNsecPerUsec;
+    instance->track_change_latency_nsec_ = latency;
+    qLog(Debug) << instance->id() << "track change took"
+                << latency / kNsecPerMsec << "ms";
+  }
+
+  return GST_PAD_PROBE_REMOVE;
 }
 
 GstPadProbeReturn GstEnginePipeline::DecodebinProbe(GstPad* pad,
@@ -941,6 +1023,10 @@ void GstEnginePipeline::SourceDrainedCallback(GstURIDecodeBin* bin,
                                               gpointer self) {
   GstEnginePipeline* instance = reinterpret_cast<GstEnginePipeline*>(self);
 
+  // A prerolled bin can't drain while it's blocked, but don't let a stale one
+  // switch tracks either.
+  if (GST_ELEMENT(bin) != instance->uridecodebin_) return;
+
   if (instance->has_next_valid_url() &&
       // I'm not sure why, but calling this when previous track is a local song
       // and the next track is a Spotify song is buggy: the Spotify song will
@@ -992,10 +1078,35 @@ void GstEnginePipeline::TransitionToNext() {
   GstElement* old_decode_bin = uridecodebin_;
 
   ignore_tags_ = true;
+  track_change_start_usec_ = g_get_monotonic_time();
+
+  QMutexLocker l(&preroll_mutex_);
+  if (preroll_bin_ && preroll_url_ == next_url_ && !preroll_failed_) {
+    // The next song is open already, and maybe even decoded up to the first
+    // buffer.  Swap it in while NewPadCallback can't race us for its pad.
+    GstPad* pad = preroll_pad_;
+    const gulong probe_id = preroll_probe_id_;
+    ReplaceDecodeBin(preroll_bin_);
+    preroll_bin_ = nullptr;
+    preroll_pad_ = nullptr;
+    preroll_url_ = QUrl();
+    l.unlock();
+
+    // If it hasn't got a pad yet NewPadCallback will link it the usual way
+    // when it does.
+    if (pad) {
+      LinkDecodeBinPad(pad);
+      gst_pad_remove_probe(pad, probe_id);
+      gst_object_unref(pad);
+    }
+  } else {
+    l.unlock();
+    DiscardPreroll();
 
-  ReplaceDecodeBin(next_url_);
-  gst_element_set_state(uridecodebin_, GST_STATE_PLAYING);
-  MaybeLinkDecodeToAudio();
+    ReplaceDecodeBin(next_url_);
+    gst_element_set_state(uridecodebin_, GST_STATE_PLAYING);
+    MaybeLinkDecodeToAudio();
+  }
 
   url_ = next_url_;
   end_offset_nanosec_ = next_end_offset_nanosec_;
@@ -1030,15 +1141,6 @@ qint64 GstEnginePipeline::length() const {
   return value;
 }
 
-GstState GstEnginePipeline::state() const {
-  GstState s, sp;
-  if (gst_element_get_state(pipeline_, &s, &sp, kGstStateTimeoutNanosecs) ==
-      GST_STATE_CHANGE_FAILURE)
-    return GST_STATE_NULL;
-
-  return s;
-}
-
 QFuture<GstStateChangeReturn> GstEnginePipeline::SetState(GstState state) {
   if (url_.scheme() == "spotify" && !buffering_) {
     const GstState current_state = this->state();
@@ -1226,4 +1328,66 @@ void GstEnginePipeline::SetNextUrl(const QUrl& url, qint64 beginning_nanosec,
   next_url_ = url;
   next_beginning_offset_nanosec_ = beginning_nanosec;
   next_end_offset_nanosec_ = end_nanosec;
+
+  StartPreroll(url);
+}
+
+void GstEnginePipeline::StartPreroll(const QUrl& url) {
+  {
+    QMutexLocker l(&preroll_mutex_);
+    if (preroll_bin_ && preroll_url_ == url && !preroll_failed_) return;
+  }
+  DiscardPreroll();
+
+  // Another section of the same file carries on without a new decoder, and
+  // the spotify bin has to wait until spotify is told to send the next song.
+  if (!pipeline_ || !audiobin_ || !url.isValid() || url == url_ ||
+      url.scheme() == "spotify") {
+    return;
+  }
+
+  GstElement* bin = CreateDecodeBin(url);
+  if (!bin) return;
+
+  {
+    // This has to be set before the bin starts, pad-added can come straight
+    // away.
+    QMutexLocker l(&preroll_mutex_);
+    preroll_bin_ = bin;
+    preroll_url_ = url;
+    preroll_failed_ = false;
+  }
+
+  qLog(Debug) << id() << "Prerolling" << url;
+  gst_bin_add(GST_BIN(pipeline_), bin);
+  gst_element_sync_state_with_parent(bin);
+}
+
+void GstEnginePipeline::DiscardPreroll() {
+  GstElement* bin = nullptr;
+  {
+    QMutexLocker l(&preroll_mutex_);
+    if (!preroll_bin_) return;
+
+    bin = preroll_bin_;
+    preroll_bin_ = nullptr;
+    preroll_url_ = QUrl();
+    preroll_failed_ = false;
+
+    // The pad stays blocked, stopping the bin flushes it.
+    if (preroll_pad_) {
+      gst_object_unref(preroll_pad_);
+      preroll_pad_ = nullptr;
+    }
+  }
+
+  gst_bin_remove(GST_BIN(pipeline_), bin);
+  sElementDeleter->DeleteElementLater(bin);
+}
+
+bool GstEnginePipeline::IsFromPreroll(GstMessage* msg) {
+  QMutexLocker l(&preroll_mutex_);
+  return preroll_bin_ &&
+         gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg),
+                                    GST_OBJECT(preroll_bin_));
 }
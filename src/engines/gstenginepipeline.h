@@ -18,6 +18,7 @@
 #ifndef GSTENGINEPIPELINE_H
 #define GSTENGINEPIPELINE_H
 
+#include <atomic>
 #include <memory>
 
 #include <QBasicTimer>
@@ -79,7 +80,9 @@ class GstEnginePipeline : public QObject {
                   bool use_fudge_timer = true);
 
   // If this is set then it will be loaded automatically when playback finishes
-  // for gapless playback
+  // for gapless playback.  The next URL is opened straight away and its first
+  // buffers are held back, so the switch doesn't wait for the source or the
+  // decoder.
   void SetNextUrl(const QUrl& url, qint64 beginning_nanosec,
                   qint64 end_nanosec);
   bool has_next_valid_url() const { return next_url_.isValid(); }
@@ -93,11 +96,18 @@ class GstEnginePipeline : public QObject {
   // Please note that this method (unlike GstEngine's.length()) is
   // multiple-section media unaware.
   qint64 length() const;
-  // Returns this pipeline's state. May return GST_STATE_NULL if the state check
-  // timed out. The timeout value is a reasonable default.
-  GstState state() const;
+  // Returns the state the pipeline last reported on its bus.  Doesn't wait
+  // for a state change that is still in progress.
+  GstState state() const { return GstState(state_.load()); }
   qint64 segment_start() const { return segment_start_; }
 
+  // How long the last gapless track change took, from the old track's decoder
+  // running dry to the first buffer of the new one.  0 if there hasn't been
+  // one yet.
+  qint64 track_change_latency_nsec() const {
+    return track_change_latency_nsec_;
+  }
+
   // Don't allow the user to change the playback state (playing/paused) while
   // the pipeline is buffering.
   bool is_buffering() const { return buffering_; }
@@ -135,6 +145,10 @@ signals:
   static GstPadProbeReturn EventHandoffCallback(GstPad*, GstPadProbeInfo*,
                                                 gpointer);
   static GstPadProbeReturn DecodebinProbe(GstPad*, GstPadProbeInfo*, gpointer);
+  static GstPadProbeReturn PrerollBlockProbe(GstPad*, GstPadProbeInfo*,
+                                             gpointer);
+  static GstPadProbeReturn FirstBufferProbe(GstPad*, GstPadProbeInfo*,
+                                            gpointer);
   static void SourceDrainedCallback(GstURIDecodeBin*, gpointer);
   static void SourceSetupCallback(GstURIDecodeBin*, GParamSpec* pspec,
                                   gpointer);
@@ -157,6 +171,14 @@ signals:
   void UpdateStereoBalance();
   bool ReplaceDecodeBin(GstElement* new_bin);
   bool ReplaceDecodeBin(const QUrl& url);
+  GstElement* CreateDecodeBin(const QUrl& url);
+  void LinkDecodeBinPad(GstPad* pad);
+
+  // Opens url in a new decode bin next to the playing one.  Its src pad gets
+  // blocked until TransitionToNext() links it up.
+  void StartPreroll(const QUrl& url);
+  void DiscardPreroll();
+  bool IsFromPreroll(GstMessage* msg);
 
   void TransitionToNext();
 
@@ -168,7 +190,6 @@ signals:
   void FaderTimelineFinished();
 
  private:
-  static const int kGstStateTimeoutNanosecs;
   static const int kFaderFudgeMsec;
   static const int kEqBandCount;
   static const int kEqBandFrequencies[];
@@ -299,6 +320,23 @@ signals:
   QThreadPool set_state_threadpool_;
 
   GstSegment last_decodebin_segment_;
+
+  // Written from the sync bus handler, so reading it never blocks.
+  std::atomic<int> state_;
+
+  // The decode bin that was opened ahead of time for next_url_, and its src
+  // pad once it has one.  Touched by the main thread and by the streaming
+  // threads of both decode bins, so it's guarded by preroll_mutex_.
+  QMutex preroll_mutex_;
+  GstElement* preroll_bin_;
+  QUrl preroll_url_;
+  GstPad* preroll_pad_;
+  gulong preroll_probe_id_;
+  bool preroll_failed_;
+
+  // g_get_monotonic_time() when the last track change started, or 0.
+  std::atomic<gint64> track_change_start_usec_;
+  std::atomic<qint64> track_change_latency_nsec_;
 };
 
 #endif  // GSTENGINEPIPELINE_H
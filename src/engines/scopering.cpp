@@ -0,0 +1,131 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scopering.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "core/timeconstants.h"
+
+// About 0.75 seconds of 44.1kHz stereo - several probe buffers.
+const int ScopeRing::kDefaultCapacity = 1 << 16;
+
+namespace {
+int RoundUpToPowerOfTwo(int value) {
+  int ret = 1;
+  while (ret < value) ret <<= 1;
+  return ret;
+}
+}  // namespace
+
+ScopeRing::ScopeRing(int capacity)
+    : buffer_(RoundUpToPowerOfTwo(capacity)),
+      mask_(buffer_.size() - 1),
+      write_pos_(0),
+      reserved_pos_(0),
+      block_start_(0),
+      write_time_nsec_(0),
+      samples_per_sec_(0),
+      read_pos_(0),
+      last_seen_write_pos_(0),
+      latency_nsec_(0) {}
+
+qint64 ScopeRing::NowNsec() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ScopeRing::Write(const int16_t* samples, int count,
+                      qint64 duration_nsec) {
+  const int capacity = buffer_.size();
+  if (count > capacity) {
+    // Only the end of a huge buffer fits.
+    samples += count - capacity;
+    duration_nsec = duration_nsec * capacity / count;
+    count = capacity;
+  }
+  if (count <= 0) return;
+
+  QMutexLocker l(&write_mutex_);
+
+  const qint64 start = write_pos_.load(std::memory_order_relaxed);
+  reserved_pos_.store(start + count, std::memory_order_relaxed);
+  // Makes sure the reader sees reserved_pos_ if it sees any of the new
+  // samples.
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const int offset = start & mask_;
+  const int first = qMin(count, capacity - offset);
+  memcpy(&buffer_[offset], samples, first * sizeof(int16_t));
+  memcpy(&buffer_[0], samples + first, (count - first) * sizeof(int16_t));
+
+  if (duration_nsec > 0) {
+    samples_per_sec_.store(count * kNsecPerSec / duration_nsec,
+                           std::memory_order_relaxed);
+  }
+  block_start_.store(start, std::memory_order_relaxed);
+  write_time_nsec_.store(NowNsec(), std::memory_order_relaxed);
+
+  // Publishes the samples and everything above to the reader.
+  write_pos_.store(start + count, std::memory_order_release);
+}
+
+bool ScopeRing::Read(int16_t* dest, int count, int advance_msec) {
+  qint64 write_pos = write_pos_.load(std::memory_order_acquire);
+  if (write_pos == 0) return false;
+
+  if (write_pos != last_seen_write_pos_) {
+    latency_nsec_ =
+        NowNsec() - write_time_nsec_.load(std::memory_order_relaxed);
+    last_seen_write_pos_ = write_pos;
+  }
+
+  read_pos_ += qint64(advance_msec) *
+               samples_per_sec_.load(std::memory_order_relaxed) / 1000;
+
+  forever {
+    // Start again from the newest buffer if we've fallen behind it, and never
+    // read past what has been written.
+    read_pos_ = qMax(read_pos_, block_start_.load(std::memory_order_relaxed));
+    read_pos_ = qMin(read_pos_, write_pos - count);
+    read_pos_ = qMax(read_pos_, write_pos - qint64(buffer_.size()));
+    read_pos_ = qMax(read_pos_, qint64(0));
+
+    const int available = qMin(qint64(count), write_pos - read_pos_);
+    if (CopyOut(dest, read_pos_, available)) {
+      memset(dest + available, 0, (count - available) * sizeof(int16_t));
+      return true;
+    }
+
+    // The writer lapped us, so try again with the newer samples.
+    write_pos = write_pos_.load(std::memory_order_acquire);
+  }
+}
+
+bool ScopeRing::CopyOut(int16_t* dest, qint64 from, int count) const {
+  const int capacity = buffer_.size();
+  const int offset = from & mask_;
+  const int first = qMin(count, capacity - offset);
+  memcpy(dest, &buffer_[offset], first * sizeof(int16_t));
+  memcpy(dest + first, &buffer_[0], (count - first) * sizeof(int16_t));
+
+  // Samples before this have been, or are being, overwritten.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const qint64 oldest =
+      reserved_pos_.load(std::memory_order_relaxed) - capacity;
+  return from >= oldest;
+}
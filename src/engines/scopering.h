@@ -0,0 +1,83 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENGINES_SCOPERING_H_
+#define ENGINES_SCOPERING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <QMutex>
+#include <QtGlobal>
+
+// A ring of interleaved PCM samples.
+// The GStreamer streaming thread writes every probe buffer into it, and the
+// GUI thread reads a window of samples whenever an analyzer repaints, so
+// there's no event loop traffic between the two.
+// The reader never blocks the writer.  If the reader falls more than a buffer
+// behind it skips ahead to the newest buffer, like the old one-buffer scope
+// did, and if a write overwrites the samples it was copying it copies them
+// again.  Writers are serialised with a mutex, since two pipelines can be
+// streaming at once during a crossfade.
+class ScopeRing {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit ScopeRing(int capacity = kDefaultCapacity);
+
+  static const int kDefaultCapacity;
+
+  // Called from the streaming thread.  duration_nsec is the length of the
+  // samples in time, and is used to pace the reader.
+  void Write(const int16_t* samples, int count, qint64 duration_nsec);
+
+  // Called from the GUI thread.  Moves the read position on by advance_msec
+  // and copies count samples from there into dest.  Returns false if nothing
+  // has been written yet.
+  bool Read(int16_t* dest, int count, int advance_msec);
+
+  // Time between the newest samples being written and the reader first
+  // seeing them, as measured by the last Read.
+  qint64 latency_nsec() const { return latency_nsec_; }
+
+ private:
+  static qint64 NowNsec();
+
+  // Returns false if a write overwrote some of the samples while they were
+  // being copied.
+  bool CopyOut(int16_t* dest, qint64 from, int count) const;
+
+  std::vector<int16_t> buffer_;
+  const qint64 mask_;
+
+  // Written by the producers only, while holding write_mutex_.  Positions
+  // count samples since creation.
+  QMutex write_mutex_;
+  std::atomic<qint64> write_pos_;
+  // Set before samples are copied in, so the reader can tell if they
+  // overwrote what it was reading.
+  std::atomic<qint64> reserved_pos_;
+  std::atomic<qint64> block_start_;
+  std::atomic<qint64> write_time_nsec_;
+  std::atomic<int> samples_per_sec_;
+
+  // Used by the consumer only.
+  qint64 read_pos_;
+  qint64 last_seen_write_pos_;
+  qint64 latency_nsec_;
+};
+
+#endif  // ENGINES_SCOPERING_H_
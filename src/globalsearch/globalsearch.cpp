@@ -21,6 +21,7 @@
 #include "core/application.h"
 #include "core/logging.h"
 #include "covers/albumcoverloader.h"
+#include "covers/thumbnailcache.h"
 
 #include <QSettings>
 #include <QStringBuilder>
@@ -143,8 +144,12 @@ void GlobalSearch::timerEvent(QTimerEvent* e) {
 
 QString GlobalSearch::PixmapCacheKey(const SearchProvider::Result& result)
     const {
-  return "globalsearch:" % QString::number(qulonglong(result.provider_)) % "," %
-         result.metadata_.url().toString();
+  // Thumbnails are kept on disk, so the key must stay the same across
+  // restarts, and must change when the song's art does.
+  return "globalsearch:" % result.provider_->id() % "," %
+         result.metadata_.url().toString() % "," %
+         result.metadata_.art_manual() % "," %
+         result.metadata_.art_automatic();
 }
 
 void GlobalSearch::ResultsAvailableSlot(int id,
@@ -261,8 +266,8 @@ void GlobalSearch::HandleLoadedArt(int id, const QImage& image,
                                    SearchProvider* provider) {
   const QString key = pending_art_searches_.take(id);
 
+  app_->thumbnail_cache()->Insert(key, SearchProvider::kArtHeight, image);
   QPixmap pixmap = QPixmap::fromImage(image);
-  pixmap_cache_.insert(key, pixmap);
 
   emit ArtLoaded(id, pixmap);
 
@@ -275,7 +280,8 @@ void GlobalSearch::HandleLoadedArt(int id, const QImage& image,
 
 bool GlobalSearch::FindCachedPixmap(const SearchProvider::Result& result,
                                     QPixmap* pixmap) const {
-  return pixmap_cache_.find(result.pixmap_cache_key_, pixmap);
+  return app_->thumbnail_cache()->Find(result.pixmap_cache_key_,
+                                       SearchProvider::kArtHeight, pixmap);
 }
 
 MimeData* GlobalSearch::LoadTracks(const SearchProvider::ResultList& results) {
@@ -19,7 +19,7 @@
 #define GLOBALSEARCH_H
 
 #include <QObject>
-#include <QPixmapCache>
+#include <QPixmap>
 
 #include "searchprovider.h"
 #include "covers/albumcoverloaderoptions.h"
@@ -124,7 +124,6 @@ signals:
   int next_id_;
   QMap<int, int> pending_search_providers_;
 
-  QPixmapCache pixmap_cache_;
   QMap<int, QString> pending_art_searches_;
 
   // Used for providers with ArtIsInSongMetadata set.
@@ -35,7 +35,7 @@ void IcecastBackend::Init(Database* db) { db_ = db; }
 
 QStringList IcecastBackend::GetGenresAlphabetical(const QString& filter) {
   QStringList ret;
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db = db_->Connect();
 
   QString where = filter.isEmpty() ? "" : "WHERE name LIKE :filter";
@@ -59,7 +59,7 @@ QStringList IcecastBackend::GetGenresAlphabetical(const QString& filter) {
 
 QStringList IcecastBackend::GetGenresByPopularity(const QString& filter) {
   QStringList ret;
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db = db_->Connect();
 
   QString where = filter.isEmpty() ? "" : "WHERE name LIKE :filter";
@@ -86,7 +86,7 @@ QStringList IcecastBackend::GetGenresByPopularity(const QString& filter) {
 IcecastBackend::StationList IcecastBackend::GetStations(const QString& filter,
                                                         const QString& genre) {
   StationList ret;
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db = db_->Connect();
 
   QStringList where_clauses;
@@ -132,7 +132,7 @@ IcecastBackend::StationList IcecastBackend::GetStations(const QString& filter,
 }
 
 bool IcecastBackend::IsEmpty() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db = db_->Connect();
   QSqlQuery q(QString("SELECT ROWID FROM %1 LIMIT 1").arg(kTableName), db);
   q.exec();
@@ -141,7 +141,7 @@ bool IcecastBackend::IsEmpty() {
 
 void IcecastBackend::ClearAndAddStations(const StationList& stations) {
   {
-    QMutexLocker l(db_->Mutex());
+    Database::Locker l(db_, Database::Lock_Write);
     QSqlDatabase db = db_->Connect();
     ScopedTransaction t(&db);
 
@@ -280,7 +280,7 @@ void JamendoService::ParseDirectory(QIODevice* device) const {
 }
 
 void JamendoService::InsertTrackIds(const TrackIdList& ids) const {
-  QMutexLocker l(library_backend_->db()->Mutex());
+  Database::Locker l(library_backend_->db(), Database::Lock_Write);
   QSqlDatabase db(library_backend_->db()->Connect());
 
   ScopedTransaction t(&db);
@@ -405,6 +405,8 @@ Song JamendoService::ReadTrack(const QString& artist, const QString& album,
 void JamendoService::ParseDirectoryFinished() {
   // show smart playlists
   library_model_->set_show_smart_playlists(true);
+  // The model wasn't told about the new songs while they were being imported.
+  library_model_->InvalidateSongStore();
   library_model_->Reset();
 
   app_->task_manager()->SetTaskFinished(load_database_task_id_);
@@ -42,7 +42,7 @@ void PodcastBackend::Subscribe(Podcast* podcast) {
     return;
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -81,7 +81,7 @@ void PodcastBackend::Unsubscribe(const Podcast& podcast) {
     return;
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -121,7 +121,7 @@ void PodcastBackend::AddEpisodes(PodcastEpisodeList* episodes,
 }
 
 void PodcastBackend::AddEpisodes(PodcastEpisodeList* episodes) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -132,7 +132,7 @@ void PodcastBackend::AddEpisodes(PodcastEpisodeList* episodes) {
 }
 
 void PodcastBackend::UpdateEpisodes(const PodcastEpisodeList& episodes) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -163,7 +163,7 @@ void PodcastBackend::UpdateEpisodes(const PodcastEpisodeList& episodes) {
 PodcastList PodcastBackend::GetAllSubscriptions() {
   PodcastList ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + Podcast::kColumnSpec + " FROM podcasts", db);
@@ -182,7 +182,7 @@ PodcastList PodcastBackend::GetAllSubscriptions() {
 Podcast PodcastBackend::GetSubscriptionById(int id) {
   Podcast ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + Podcast::kColumnSpec +
@@ -201,7 +201,7 @@ Podcast PodcastBackend::GetSubscriptionById(int id) {
 Podcast PodcastBackend::GetSubscriptionByUrl(const QUrl& url) {
   Podcast ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + Podcast::kColumnSpec +
@@ -220,7 +220,7 @@ Podcast PodcastBackend::GetSubscriptionByUrl(const QUrl& url) {
 PodcastEpisodeList PodcastBackend::GetEpisodes(int podcast_id) {
   PodcastEpisodeList ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -244,7 +244,7 @@ PodcastEpisodeList PodcastBackend::GetEpisodes(int podcast_id) {
 PodcastEpisode PodcastBackend::GetEpisodeById(int id) {
   PodcastEpisode ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -263,7 +263,7 @@ PodcastEpisode PodcastBackend::GetEpisodeById(int id) {
 PodcastEpisode PodcastBackend::GetEpisodeByUrl(const QUrl& url) {
   PodcastEpisode ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -282,7 +282,7 @@ PodcastEpisode PodcastBackend::GetEpisodeByUrl(const QUrl& url) {
 PodcastEpisode PodcastBackend::GetEpisodeByUrlOrLocalUrl(const QUrl& url) {
   PodcastEpisode ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -303,7 +303,7 @@ PodcastEpisodeList PodcastBackend::GetOldDownloadedEpisodes(
     const QDateTime& max_listened_date) {
   PodcastEpisodeList ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -327,7 +327,7 @@ PodcastEpisodeList PodcastBackend::GetOldDownloadedEpisodes(
 PodcastEpisode PodcastBackend::GetOldestDownloadedListenedEpisode() {
   PodcastEpisode ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
@@ -347,7 +347,7 @@ PodcastEpisode PodcastBackend::GetOldestDownloadedListenedEpisode() {
 PodcastEpisodeList PodcastBackend::GetNewDownloadedEpisodes() {
   PodcastEpisodeList ret;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q("SELECT ROWID, " + PodcastEpisode::kColumnSpec +
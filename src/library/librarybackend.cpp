@@ -17,7 +17,9 @@
 
 #include "librarybackend.h"
 #include "libraryquery.h"
+#include "songdecoder.h"
 #include "sqlrow.h"
+#include "analysis/songanalysis.h"
 #include "core/application.h"
 #include "core/database.h"
 #include "core/scopedtransaction.h"
@@ -96,7 +98,7 @@ void LibraryBackend::UpdateSongsRatingAsync(const QList<int>& ids,
 void LibraryBackend::LoadDirectories() {
   DirectoryList dirs = GetAllDirectories();
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   for (const Directory& dir : dirs) {
@@ -106,7 +108,7 @@ void LibraryBackend::LoadDirectories() {
 
 void LibraryBackend::ChangeDirPath(int id, const QString& old_path,
                                    const QString& new_path) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction t(&db);
 
@@ -151,7 +153,7 @@ void LibraryBackend::ChangeDirPath(int id, const QString& old_path,
 }
 
 DirectoryList LibraryBackend::GetAllDirectories() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   DirectoryList ret;
@@ -171,7 +173,7 @@ DirectoryList LibraryBackend::GetAllDirectories() {
 }
 
 SubdirectoryList LibraryBackend::SubdirsInDirectory(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db = db_->Connect();
   return SubdirsInDirectory(id, db);
 }
@@ -198,7 +200,7 @@ SubdirectoryList LibraryBackend::SubdirsInDirectory(int id, QSqlDatabase& db) {
 }
 
 void LibraryBackend::UpdateTotalSongCount() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString("SELECT COUNT(*) FROM %1 WHERE unavailable = 0")
@@ -222,7 +224,7 @@ void LibraryBackend::AddDirectory(const QString& path) {
     qLog(Debug) << "db_path" << db_path;
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString(
@@ -241,7 +243,7 @@ void LibraryBackend::AddDirectory(const QString& path) {
 }
 
 void LibraryBackend::RemoveDirectory(const Directory& dir) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   // Remove songs first
@@ -269,28 +271,22 @@ void LibraryBackend::RemoveDirectory(const Directory& dir) {
 }
 
 SongList LibraryBackend::FindSongsInDirectory(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery q(
-      QString("SELECT ROWID, " + Song::kColumnSpec +
-              " FROM %1 WHERE directory = :directory").arg(songs_table_),
-      db);
-  q.bindValue(":directory", id);
-  q.exec();
-  if (db_->CheckErrors(q)) return SongList();
-
   SongList ret;
-  while (q.next()) {
-    Song song;
-    song.InitFromQuery(q, true);
-    ret << song;
+  SongDecoder decoder;
+  if (!decoder.Exec(db, QString("SELECT ROWID, " + Song::kColumnSpec +
+                                " FROM %1 WHERE directory = ?")
+                            .arg(songs_table_),
+                    QVariantList() << id, &ret)) {
+    return SongList();
   }
   return ret;
 }
 
 void LibraryBackend::AddOrUpdateSubdirs(const SubdirectoryList& subdirs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   QSqlQuery find_query(
       QString(
@@ -346,7 +342,7 @@ void LibraryBackend::AddOrUpdateSubdirs(const SubdirectoryList& subdirs) {
 }
 
 void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery check_dir(
@@ -437,7 +433,7 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
 }
 
 void LibraryBackend::UpdateMTimesOnly(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString("UPDATE %1 SET mtime = :mtime WHERE ROWID = :id")
@@ -455,7 +451,7 @@ void LibraryBackend::UpdateMTimesOnly(const SongList& songs) {
 }
 
 void LibraryBackend::DeleteSongs(const SongList& songs) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery remove(
@@ -482,7 +478,7 @@ void LibraryBackend::DeleteSongs(const SongList& songs) {
 
 void LibraryBackend::MarkSongsUnavailable(const SongList& songs,
                                           bool unavailable) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery remove(QString("UPDATE %1 SET unavailable = %2 WHERE ROWID = :id")
@@ -508,7 +504,7 @@ QStringList LibraryBackend::GetAll(const QString& column,
   query.SetColumnSpec("DISTINCT " + column);
   query.AddCompilationRequirement(false);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   if (!ExecQuery(&query)) return QStringList();
 
   QStringList ret;
@@ -528,7 +524,7 @@ QStringList LibraryBackend::GetAllArtistsWithAlbums(const QueryOptions& opt) {
   query.AddCompilationRequirement(false);
   query.AddWhere("album", "", "!=");
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   if (!ExecQuery(&query)) return QStringList();
 
   QStringList ret;
@@ -567,26 +563,25 @@ SongList LibraryBackend::GetSongs(const QString& artist, const QString& album,
 
 SongList LibraryBackend::ExecLibraryQuery(LibraryQuery* query) {
   query->SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
-  QMutexLocker l(db_->Mutex());
-  if (!ExecQuery(query)) return SongList();
+  Database::Locker l(db_, Database::Lock_Read);
 
   SongList ret;
-  while (query->Next()) {
-    Song song;
-    song.InitFromQuery(*query, true);
-    ret << song;
+  SongDecoder decoder;
+  if (!decoder.Exec(db_->Connect(), query->GetSql(songs_table_, fts_table_),
+                    query->bound_values(), &ret)) {
+    return SongList();
   }
   return ret;
 }
 
 Song LibraryBackend::GetSongById(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
   return GetSongById(id, db);
 }
 
 SongList LibraryBackend::GetSongsById(const QList<int>& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QStringList str_ids;
@@ -598,7 +593,7 @@ SongList LibraryBackend::GetSongsById(const QList<int>& ids) {
 }
 
 SongList LibraryBackend::GetSongsById(const QStringList& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   return GetSongsById(ids, db);
@@ -607,7 +602,7 @@ SongList LibraryBackend::GetSongsById(const QStringList& ids) {
 SongList LibraryBackend::GetSongsByForeignId(const QStringList& ids,
                                              const QString& table,
                                              const QString& column) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QString in = ids.join(",");
@@ -644,18 +639,13 @@ SongList LibraryBackend::GetSongsById(const QStringList& ids,
                                       QSqlDatabase& db) {
   QString in = ids.join(",");
 
-  QSqlQuery q(QString("SELECT ROWID, " + Song::kColumnSpec +
-                      " FROM %1"
-                      " WHERE ROWID IN (%2)").arg(songs_table_, in),
-              db);
-  q.exec();
-  if (db_->CheckErrors(q)) return SongList();
-
   SongList ret;
-  while (q.next()) {
-    Song song;
-    song.InitFromQuery(q, true);
-    ret << song;
+  SongDecoder decoder;
+  if (!decoder.Exec(db, QString("SELECT ROWID, " + Song::kColumnSpec +
+                                " FROM %1"
+                                " WHERE ROWID IN (%2)").arg(songs_table_, in),
+                    QVariantList(), &ret)) {
+    return SongList();
   }
   return ret;
 }
@@ -702,7 +692,7 @@ SongList LibraryBackend::GetCompilationSongs(const QString& album,
   query.AddCompilationRequirement(true);
   query.AddWhere("album", album);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   if (!ExecQuery(&query)) return SongList();
 
   SongList ret;
@@ -715,7 +705,7 @@ SongList LibraryBackend::GetCompilationSongs(const QString& album,
 }
 
 void LibraryBackend::UpdateCompilations() {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   // Look for albums that have songs by more than one 'effective album artist'
@@ -847,7 +837,7 @@ LibraryBackend::AlbumList LibraryBackend::GetAlbums(const QString& artist,
     query.AddWhere("artist", artist);
   }
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   if (!ExecQuery(&query)) return ret;
 
   QString last_album;
@@ -884,7 +874,7 @@ LibraryBackend::Album LibraryBackend::GetAlbumArt(const QString& artist,
   query.AddWhere("artist", artist);
   query.AddWhere("album", album);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   if (!ExecQuery(&query)) return ret;
 
   if (query.Next()) {
@@ -907,7 +897,7 @@ void LibraryBackend::UpdateManualAlbumArtAsync(const QString& artist,
 void LibraryBackend::UpdateManualAlbumArt(const QString& artist,
                                           const QString& album,
                                           const QString& art) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   // Get the songs before they're updated
@@ -958,7 +948,7 @@ void LibraryBackend::UpdateManualAlbumArt(const QString& artist,
 
 void LibraryBackend::ForceCompilation(const QString& album,
                                       const QList<QString>& artists, bool on) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   SongList deleted_songs, added_songs;
 
@@ -1017,7 +1007,7 @@ bool LibraryBackend::ExecQuery(LibraryQuery* q) {
 }
 
 SongList LibraryBackend::FindSongs(const smart_playlists::Search& search) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   // Build the query
@@ -1025,19 +1015,44 @@ SongList LibraryBackend::FindSongs(const smart_playlists::Search& search) {
 
   // Run the query
   SongList ret;
-  QSqlQuery query(sql, db);
-  query.exec();
-  if (db_->CheckErrors(query)) return ret;
+  SongDecoder decoder;
+  if (!decoder.Exec(db, sql, search.BoundValues(), &ret)) return SongList();
+  return ret;
+}
 
-  // Read the results
-  while (query.next()) {
-    Song song;
-    song.InitFromQuery(query, true);
-    ret << song;
+QList<int> LibraryBackend::FindSongIds(const smart_playlists::Search& search,
+                                       bool* ok) {
+  Database::Locker l(db_, Database::Lock_Read);
+  QSqlDatabase db(db_->Connect());
+
+  QList<int> ret;
+  if (ok) *ok = false;
+
+  QSqlQuery q(search.ToIdsSql(songs_table()), db);
+  q.exec();
+  if (db_->CheckErrors(q)) return ret;
+  if (ok) *ok = true;
+
+  while (q.next()) {
+    ret << q.value(0).toInt();
   }
   return ret;
 }
 
+QVariant LibraryBackend::GetSongColumn(int id, const QString& column) {
+  Database::Locker l(db_, Database::Lock_Read);
+  QSqlDatabase db(db_->Connect());
+
+  QSqlQuery q(QString("SELECT %1 FROM %2 WHERE ROWID = :id")
+                  .arg(column, songs_table_),
+              db);
+  q.bindValue(":id", id);
+  q.exec();
+  if (db_->CheckErrors(q) || !q.next()) return QVariant();
+
+  return q.value(0);
+}
+
 SongList LibraryBackend::GetAllSongs() {
   // Get all the songs!
   return FindSongs(smart_playlists::Search(
@@ -1049,7 +1064,7 @@ SongList LibraryBackend::GetAllSongs() {
 void LibraryBackend::IncrementPlayCount(int id) {
   if (id == -1) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString(
@@ -1072,7 +1087,7 @@ void LibraryBackend::IncrementSkipCount(int id, float progress) {
   if (id == -1) return;
   progress = qBound(0.0f, progress, 1.0f);
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString(
@@ -1092,7 +1107,7 @@ void LibraryBackend::IncrementSkipCount(int id, float progress) {
 void LibraryBackend::ResetStatistics(int id) {
   if (id == -1) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(QString(
@@ -1120,7 +1135,7 @@ void LibraryBackend::UpdateSongsRating(const QList<int>& id_list,
                                        float rating) {
   if (id_list.isEmpty()) return;
 
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QStringList id_str_list;
@@ -1139,9 +1154,65 @@ void LibraryBackend::UpdateSongsRating(const QList<int>& id_list,
   emit SongsRatingChanged(new_song_list);
 }
 
+void LibraryBackend::UpdateSongsAnalysis(const QList<SongAnalysis>& results) {
+  if (results.isEmpty()) return;
+
+  Database::Locker l(db_, Database::Lock_Write);
+  QSqlDatabase db(db_->Connect());
+
+  // Anything an analyzer couldn't work out is bound as NULL, which leaves
+  // the old value alone.  A BPM from the file's tags is never replaced.
+  QSqlQuery q(QString(
+                  "UPDATE %1 SET"
+                  " bpm = CASE WHEN bpm IS NULL OR bpm <= 0"
+                  "   THEN COALESCE(:bpm, bpm) ELSE bpm END,"
+                  " replaygain_track_gain = COALESCE(:track_gain,"
+                  "   replaygain_track_gain),"
+                  " replaygain_track_peak = COALESCE(:track_peak,"
+                  "   replaygain_track_peak),"
+                  " replaygain_album_gain = COALESCE(:album_gain,"
+                  "   replaygain_album_gain),"
+                  " replaygain_album_peak = COALESCE(:album_peak,"
+                  "   replaygain_album_peak),"
+                  " acoustid_fingerprint = COALESCE(:fingerprint,"
+                  "   acoustid_fingerprint)"
+                  " WHERE ROWID = :id").arg(songs_table_),
+              db);
+
+  QStringList id_str_list;
+
+  ScopedTransaction transaction(&db);
+  for (const SongAnalysis& result : results) {
+    q.bindValue(":bpm", result.bpm > 0 ? QVariant(result.bpm) : QVariant());
+    q.bindValue(":track_gain", result.has_replaygain
+                                   ? QVariant(result.track_gain)
+                                   : QVariant());
+    q.bindValue(":track_peak", result.has_replaygain
+                                   ? QVariant(result.track_peak)
+                                   : QVariant());
+    q.bindValue(":album_gain", result.has_album_gain
+                                   ? QVariant(result.album_gain)
+                                   : QVariant());
+    q.bindValue(":album_peak", result.has_album_gain
+                                   ? QVariant(result.album_peak)
+                                   : QVariant());
+    q.bindValue(":fingerprint", result.fingerprint.isEmpty()
+                                    ? QVariant()
+                                    : QVariant(result.fingerprint));
+    q.bindValue(":id", result.id);
+    q.exec();
+    if (db_->CheckErrors(q)) return;
+
+    id_str_list << QString::number(result.id);
+  }
+  transaction.Commit();
+
+  emit SongsStatisticsChanged(GetSongsById(id_str_list, db));
+}
+
 void LibraryBackend::DeleteAll() {
   {
-    QMutexLocker l(db_->Mutex());
+    Database::Locker l(db_, Database::Lock_Write);
     QSqlDatabase db(db_->Connect());
     ScopedTransaction t(&db);
 
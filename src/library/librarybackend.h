@@ -27,6 +27,7 @@
 #include "core/song.h"
 
 class Database;
+struct SongAnalysis;
 
 namespace smart_playlists {
 class Search;
@@ -178,14 +179,25 @@ class LibraryBackend : public LibraryBackendInterface {
   bool ExecQuery(LibraryQuery* q);
   SongList ExecLibraryQuery(LibraryQuery* query);
   SongList FindSongs(const smart_playlists::Search& search);
+  // ok is set to false if the query failed.
+  QList<int> FindSongIds(const smart_playlists::Search& search,
+                         bool* ok = nullptr);
   SongList GetAllSongs();
 
+  // Returns the value of one column of a song, or a null QVariant if there
+  // isn't a song with that ID.
+  QVariant GetSongColumn(int id, const QString& column);
+
   void IncrementPlayCountAsync(int id);
   void IncrementSkipCountAsync(int id, float progress);
   void ResetStatisticsAsync(int id);
   void UpdateSongRatingAsync(int id, float rating);
   void UpdateSongsRatingAsync(const QList<int>& ids, float rating);
 
+  // Stores what LibraryAnalyzer found out about some songs, in one
+  // transaction.
+  void UpdateSongsAnalysis(const QList<SongAnalysis>& results);
+
   void DeleteAll();
 
  public slots:
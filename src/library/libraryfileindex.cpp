@@ -0,0 +1,283 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libraryfileindex.h"
+
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+
+#include "core/logging.h"
+
+#ifndef Q_OS_WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+const quint32 LibraryFileIndex::kMagic = 0x49464c43;  // "CLFI"
+const quint32 LibraryFileIndex::kVersion = 1;
+
+LibraryFileIndex::LibraryFileIndex() : entry_count_(0), records_in_file_(0) {}
+
+quint64 LibraryFileIndex::Hash(const char* data, int length) {
+  // 64 bit FNV-1a
+  quint64 hash = Q_UINT64_C(14695981039346656037);
+  for (int i = 0; i < length; ++i) {
+    hash ^= quint8(data[i]);
+    hash *= Q_UINT64_C(1099511628211);
+  }
+  return hash;
+}
+
+quint64 LibraryFileIndex::HashPath(const QString& path) {
+  const QByteArray encoded = QFile::encodeName(path);
+  return Hash(encoded.constData(), encoded.length());
+}
+
+quint64 LibraryFileIndex::HashName(const QString& name) {
+  return HashPath(name);
+}
+
+void LibraryFileIndex::Load(const QString& filename) {
+  if (filename_ == filename) return;
+
+  filename_ = filename;
+  directories_.clear();
+  entry_count_ = 0;
+  records_in_file_ = 0;
+  unsaved_records_.clear();
+
+  QFile file(filename_);
+  if (!file.open(QIODevice::ReadOnly)) return;
+
+  const qint64 header_size = sizeof(quint32) * 2;
+  if (file.size() < header_size) return;
+
+  const uchar* data = file.map(0, file.size());
+  if (!data) {
+    qLog(Warning) << "Couldn't map" << filename_ << file.errorString();
+    return;
+  }
+
+  quint32 header[2];
+  memcpy(header, data, header_size);
+  if (header[0] != kMagic || header[1] != kVersion) {
+    qLog(Info) << "Ignoring library file index with a different version"
+               << filename_;
+    return;
+  }
+
+  const qint64 count = (file.size() - header_size) / sizeof(Record);
+  for (qint64 i = 0; i < count; ++i) {
+    Record record;
+    memcpy(&record, data + header_size + i * sizeof(Record), sizeof(Record));
+    Apply(record);
+  }
+  records_in_file_ = count;
+
+  qLog(Debug) << "Loaded" << entry_count_ << "entries from" << filename_;
+}
+
+void LibraryFileIndex::Apply(const Record& record) {
+  DirectoryEntries& entries = directories_[record.dir_hash];
+
+  if (record.entry.size == -1) {
+    entry_count_ -= entries.remove(record.entry.name_hash);
+    if (entries.isEmpty()) directories_.remove(record.dir_hash);
+  } else {
+    if (!entries.contains(record.entry.name_hash)) entry_count_++;
+    entries[record.entry.name_hash] = record.entry;
+  }
+}
+
+bool LibraryFileIndex::ReadDirectory(const QString& path, EntryList* entries,
+                                     QStringList* names) {
+#ifdef Q_OS_WIN32
+  return false;
+#else
+  // readdir fetches the entries from the kernel in large getdents batches, and
+  // fstatat avoids resolving the directory's path again for each entry.
+  DIR* dir = opendir(QFile::encodeName(path).constData());
+  if (!dir) return false;
+
+  const int fd = dirfd(dir);
+
+  while (dirent* ent = readdir(dir)) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+
+    struct stat st;
+    if (fstatat(fd, ent->d_name, &st, 0) != 0) {
+      // Broken symlinks and files that disappeared since readdir.  These are
+      // skipped by the normal scan as well.
+      continue;
+    }
+
+    Entry entry;
+    entry.name_hash = Hash(ent->d_name, strlen(ent->d_name));
+    entry.inode = st.st_ino;
+    if (S_ISDIR(st.st_mode)) {
+      // Subdirectories are scanned separately, we only care whether they are
+      // still there.
+      entry.mtime = 0;
+      entry.size = 0;
+    } else {
+      entry.mtime = st.st_mtime;
+      entry.size = st.st_size;
+    }
+    *entries << entry;
+    if (names) *names << QFile::decodeName(ent->d_name);
+  }
+
+  closedir(dir);
+  return true;
+#endif
+}
+
+bool LibraryFileIndex::FindChanges(const QString& path,
+                                   const EntryList& entries,
+                                   const QStringList& names,
+                                   QStringList* changed,
+                                   QList<quint64>* removed) const {
+  QHash<quint64, DirectoryEntries>::const_iterator dir =
+      directories_.constFind(HashPath(path));
+  if (dir == directories_.constEnd()) return false;
+
+  QSet<quint64> seen;
+  for (int i = 0; i < entries.count(); ++i) {
+    const Entry& entry = entries[i];
+    seen.insert(entry.name_hash);
+
+    DirectoryEntries::const_iterator it = dir->constFind(entry.name_hash);
+    const bool known = it != dir->constEnd();
+    if (known && it->mtime == entry.mtime && it->size == entry.size &&
+        it->inode == entry.inode) {
+      continue;
+    }
+
+    if (IsDirectory(entry) || (known && IsDirectory(*it))) return false;
+    *changed << names[i];
+  }
+
+  for (const Entry& old_entry : *dir) {
+    if (seen.contains(old_entry.name_hash)) continue;
+
+    if (IsDirectory(old_entry)) return false;
+    *removed << old_entry.name_hash;
+  }
+
+  return true;
+}
+
+void LibraryFileIndex::SetDirectory(const QString& path,
+                                    const EntryList& entries) {
+  const quint64 dir_hash = HashPath(path);
+
+  QSet<quint64> names;
+  for (const Entry& entry : entries) {
+    names.insert(entry.name_hash);
+
+    Record record;
+    record.dir_hash = dir_hash;
+    record.entry = entry;
+    unsaved_records_ << record;
+    Apply(record);
+  }
+
+  // Remove the entries that aren't there any more
+  for (const Entry& old_entry : directories_.value(dir_hash).values()) {
+    if (names.contains(old_entry.name_hash)) continue;
+
+    Record record;
+    record.dir_hash = dir_hash;
+    record.entry = old_entry;
+    record.entry.size = -1;
+    unsaved_records_ << record;
+    Apply(record);
+  }
+}
+
+void LibraryFileIndex::Save() {
+  if (filename_.isEmpty() || unsaved_records_.isEmpty()) return;
+
+  QDir().mkpath(QFileInfo(filename_).path());
+
+  // Rewrite the whole file if most of it is out of date, otherwise just append
+  // the changes.
+  if (records_in_file_ + unsaved_records_.count() > entry_count_ * 2 + 1024) {
+    if (Rewrite()) {
+      unsaved_records_.clear();
+      return;
+    }
+  }
+
+  QFile file(filename_);
+  const bool exists = file.exists() && file.size() > 0;
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    qLog(Warning) << "Couldn't write" << filename_ << file.errorString();
+    return;
+  }
+
+  if (!exists) {
+    const quint32 header[2] = {kMagic, kVersion};
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  }
+
+  for (const Record& record : unsaved_records_) {
+    file.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+  }
+
+  records_in_file_ += unsaved_records_.count();
+  unsaved_records_.clear();
+}
+
+bool LibraryFileIndex::Rewrite() {
+  const QString temp_filename = filename_ + ".new";
+  QFile file(temp_filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qLog(Warning) << "Couldn't write" << temp_filename << file.errorString();
+    return false;
+  }
+
+  const quint32 header[2] = {kMagic, kVersion};
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+  for (QHash<quint64, DirectoryEntries>::const_iterator dir =
+           directories_.constBegin();
+       dir != directories_.constEnd(); ++dir) {
+    for (const Entry& entry : *dir) {
+      Record record;
+      record.dir_hash = dir.key();
+      record.entry = entry;
+      file.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+    }
+  }
+  file.close();
+
+  QFile::remove(filename_);
+  if (!QFile::rename(temp_filename, filename_)) {
+    qLog(Warning) << "Couldn't replace" << filename_;
+    return false;
+  }
+
+  records_in_file_ = entry_count_;
+  return true;
+}
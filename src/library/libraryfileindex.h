@@ -0,0 +1,105 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARYFILEINDEX_H
+#define LIBRARYFILEINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// A compact record of the (name, mtime, size, inode) of every entry in each
+// library subdirectory, as it was when the subdirectory was last scanned.
+// When a directory has changed LibraryWatcher uses it to find the files that
+// are different, and only looks at those instead of comparing every file in
+// the directory with its song in the database.
+// The index is kept in a binary file in the cache directory.  Changes are
+// appended to the end of the file, and the file is rewritten when it gets too
+// much bigger than the index.
+class LibraryFileIndex {
+ public:
+  LibraryFileIndex();
+
+  struct Entry {
+    quint64 name_hash;
+    qint64 mtime;
+    qint64 size;
+    quint64 inode;
+  };
+  typedef QList<Entry> EntryList;
+
+  // Loads the index from the file.  Does nothing if it's already loaded.
+  void Load(const QString& filename);
+
+  // Lists the entries of a directory with one readdir/fstatat pass, without
+  // creating a QFileInfo for each one.  If names isn't null it gets the name
+  // of each entry, in the same order.  Returns false if the directory can't
+  // be read this way, in which case it must be scanned normally.
+  static bool ReadDirectory(const QString& path, EntryList* entries,
+                            QStringList* names = nullptr);
+
+  // The hash of a file's name, as it's stored in Entry::name_hash.
+  static quint64 HashName(const QString& name);
+
+  // Compares a directory's entries with the ones recorded for it.  changed
+  // gets the names of the files that are new or different, and removed the
+  // name hashes of the ones that have gone.  Returns false if the directory
+  // isn't in the index, or if a subdirectory was added or removed - then the
+  // directory must be scanned normally.
+  bool FindChanges(const QString& path, const EntryList& entries,
+                   const QStringList& names, QStringList* changed,
+                   QList<quint64>* removed) const;
+
+  // Replaces the entries recorded for a directory.
+  void SetDirectory(const QString& path, const EntryList& entries);
+
+  // Writes any changes to the file.
+  void Save();
+
+ private:
+  // The layout of each record in the file.  A record with a size of -1 removes
+  // the entry.
+  struct Record {
+    quint64 dir_hash;
+    Entry entry;
+  };
+
+  typedef QHash<quint64, Entry> DirectoryEntries;
+
+  static quint64 Hash(const char* data, int length);
+  static quint64 HashPath(const QString& path);
+
+  // Subdirectories are recorded with a zero mtime and size.
+  static bool IsDirectory(const Entry& entry) {
+    return entry.mtime == 0 && entry.size == 0;
+  }
+
+  void Apply(const Record& record);
+  bool Rewrite();
+
+  static const quint32 kMagic;
+  static const quint32 kVersion;
+
+  QString filename_;
+  QHash<quint64, DirectoryEntries> directories_;
+
+  int entry_count_;
+  int records_in_file_;
+  QList<Record> unsaved_records_;
+};
+
+#endif  // LIBRARYFILEINDEX_H
@@ -22,9 +22,6 @@
 #include <QFuture>
 #include <QIODevice>
 #include <QMetaEnum>
-#include <QNetworkCacheMetaData>
-#include <QNetworkDiskCache>
-#include <QPixmapCache>
 #include <QSettings>
 #include <QStringList>
 #include <QUrl>
@@ -41,6 +38,7 @@
 #include "core/taskmanager.h"
 #include "core/utilities.h"
 #include "covers/albumcoverloader.h"
+#include "covers/thumbnailcache.h"
 #include "playlist/songmimedata.h"
 #include "smartplaylists/generator.h"
 #include "smartplaylists/generatormimedata.h"
@@ -62,7 +60,6 @@ const char* LibraryModel::kSmartPlaylistsSettingsGroup =
 const char* LibraryModel::kSavedGroupingsSettingsGroup = "SavedGroupings";
 const int LibraryModel::kSmartPlaylistsVersion = 4;
 const int LibraryModel::kPrettyCoverSize = 32;
-const qint64 LibraryModel::kIconCacheSize = 100000000;  //~100MB
 
 static bool IsArtistGroupBy(const LibraryModel::GroupBy by) {
   return by == LibraryModel::GroupBy_Artist ||
@@ -86,7 +83,6 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
       album_icon_(IconLoader::Load("x-clementine-album", IconLoader::Base)),
       playlists_dir_icon_(IconLoader::Load("folder-sound", IconLoader::Base)),
       playlist_icon_(IconLoader::Load("x-clementine-albums", IconLoader::Base)),
-      icon_cache_(new QNetworkDiskCache(this)),
       init_task_id_(-1),
       use_pretty_covers_(false),
       show_dividers_(true) {
@@ -103,10 +99,6 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
   connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
           SLOT(AlbumArtLoaded(quint64, QImage)));
 
-  icon_cache_->setCacheDirectory(
-      Utilities::GetConfigPath(Utilities::Path_CacheRoot) + "/pixmapcache");
-  icon_cache_->setMaximumCacheSize(LibraryModel::kIconCacheSize);
-
   QIcon nocover = IconLoader::Load("nocover", IconLoader::Other);
   no_cover_icon_ = nocover.pixmap(nocover.availableSizes().last()).scaled(
                            kPrettyCoverSize, kPrettyCoverSize, 
@@ -121,7 +113,7 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
           SLOT(SongsSlightlyChanged(SongList)));
   connect(backend_, SIGNAL(SongsRatingChanged(SongList)),
           SLOT(SongsSlightlyChanged(SongList)));
-  connect(backend_, SIGNAL(DatabaseReset()), SLOT(Reset()));
+  connect(backend_, SIGNAL(DatabaseReset()), SLOT(BackendReset()));
   connect(backend_, SIGNAL(TotalSongCountUpdated(int)),
           SLOT(TotalSongCountUpdatedSlot(int)));
 
@@ -175,6 +167,8 @@ void LibraryModel::Init(bool async) {
 }
 
 void LibraryModel::SongsDiscovered(const SongList& songs) {
+  song_store_.AddOrUpdateSongs(songs);
+
   for (const Song& song : songs) {
     // Sanity check to make sure we don't add songs that are outside the user's
     // filter
@@ -392,6 +386,8 @@ QString LibraryModel::DividerDisplayText(GroupBy type,
 }
 
 void LibraryModel::SongsDeleted(const SongList& songs) {
+  song_store_.RemoveSongs(songs);
+
   // Delete the actual song nodes first, keeping track of each parent so we
   // might check to see if they're empty later.
   QSet<LibraryItem*> parents;
@@ -486,23 +482,14 @@ QVariant LibraryModel::AlbumIcon(const QModelIndex& index) {
   LibraryItem* item = IndexToItem(index);
   if (!item) return no_cover_icon_;
 
-  // Check the cache for a pixmap we already loaded.
+  // Check the memory and disk cache for a pixmap we already loaded.
   const QString cache_key = AlbumIconPixmapCacheKey(index);
   QPixmap cached_pixmap;
-  if (QPixmapCache::find(cache_key, &cached_pixmap)) {
+  if (app_->thumbnail_cache()->Find(cache_key, kPrettyCoverSize,
+                                    &cached_pixmap)) {
     return cached_pixmap;
   }
 
-  // Try to load it from the disk cache
-  std::unique_ptr<QIODevice> cache(icon_cache_->data(QUrl(cache_key)));
-  if (cache) {
-    QImage cached_pixmap;
-    if (cached_pixmap.load(cache.get(), "XPM")) {
-      QPixmapCache::insert(cache_key, QPixmap::fromImage(cached_pixmap));
-      return QPixmap::fromImage(cached_pixmap);
-    }
-  }
-
   // Maybe we're loading a pixmap already?
   if (pending_cache_keys_.contains(cache_key)) {
     return no_cover_icon_;
@@ -532,22 +519,10 @@ void LibraryModel::AlbumArtLoaded(quint64 id, const QImage& image) {
   // Insert this image in the cache.
   if (image.isNull()) {
     // Set the no_cover image so we don't continually try to load art.
-    QPixmapCache::insert(cache_key, no_cover_icon_);
+    app_->thumbnail_cache()->InsertInMemory(cache_key, kPrettyCoverSize,
+                                            no_cover_icon_);
   } else {
-    QPixmapCache::insert(cache_key, QPixmap::fromImage(image));
-  }
-
-  // if not already in the disk cache
-  std::unique_ptr<QIODevice> cached_img(icon_cache_->data(QUrl(cache_key)));
-  if (!cached_img) {
-    QNetworkCacheMetaData item_metadata;
-    item_metadata.setSaveToDisk(true);
-    item_metadata.setUrl(QUrl(cache_key));
-    QIODevice* cache = icon_cache_->prepare(item_metadata);
-    if (cache) {
-      image.save(cache, "XPM");
-      icon_cache_->insert(cache);
-    }
+    app_->thumbnail_cache()->Insert(cache_key, kPrettyCoverSize, image);
   }
 
   const QModelIndex index = ItemToIndex(item);
@@ -665,7 +640,7 @@ bool LibraryModel::HasCompilations(const LibraryQuery& query) {
   q.AddCompilationRequirement(true);
   q.SetLimit(1);
 
-  QMutexLocker l(backend_->db()->Mutex());
+  Database::Locker l(backend_->db(), Database::Lock_Read);
   if (!backend_->ExecQuery(&q)) return false;
 
   return q.Next();
@@ -678,6 +653,17 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
   int child_level = parent == root_ ? 0 : parent->container_level + 1;
   GroupBy child_type = child_level >= 3 ? GroupBy_None : group_by_[child_level];
 
+  // Containers can be found without going to the database.  Songs still need
+  // all their metadata, which isn't in the store.
+  if (child_type != GroupBy_None &&
+      LibrarySongStore::SupportsOptions(query_options_)) {
+    if (!song_store_.is_loaded()) song_store_.Load(backend_);
+    if (song_store_.is_loaded()) {
+      RunStoreQuery(parent, child_type, &result);
+      return result;
+    }
+  }
+
   // Initialise the query.  child_type says what type of thing we want (artists,
   // songs, etc.)
   LibraryQuery q(query_options_);
@@ -702,7 +688,7 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
   }
 
   // Execute the query
-  QMutexLocker l(backend_->db()->Mutex());
+  Database::Locker l(backend_->db(), Database::Lock_Read);
   if (!backend_->ExecQuery(&q)) return result;
 
   while (q.Next()) {
@@ -711,6 +697,40 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
   return result;
 }
 
+void LibraryModel::RunStoreQuery(LibraryItem* parent, GroupBy child_type,
+                                 QueryResult* result) {
+  LibrarySongStore::ConditionList conditions;
+
+  // Walk up through the item's parents adding filters as necessary
+  LibraryItem* p = parent;
+  while (p && p->type == LibraryItem::Type_Container) {
+    FilterStoreQuery(group_by_[p->container_level], p, &conditions);
+    p = p->parent;
+  }
+
+  // Artists GroupBy is special - we don't want compilation albums appearing
+  if (IsArtistGroupBy(child_type)) {
+    LibrarySongStore::ConditionList compilations(conditions);
+    compilations << LibrarySongStore::Condition(
+        LibrarySongStore::Field_EffectiveCompilation, 1);
+
+    // Add the special Various artists node
+    if (show_various_artists_ &&
+        song_store_.Any(query_options_, compilations)) {
+      result->create_va = true;
+    }
+
+    // Don't show compilations again outside the Various artists node
+    conditions << LibrarySongStore::Condition(
+        LibrarySongStore::Field_EffectiveCompilation, 0);
+  }
+
+  for (const QVariantList& columns : song_store_.Distinct(
+           StoreFields(child_type), query_options_, conditions)) {
+    result->rows << SqlRow(columns);
+  }
+}
+
 void LibraryModel::PostQuery(LibraryItem* parent,
                              const LibraryModel::QueryResult& result,
                              bool signal) {
@@ -789,6 +809,13 @@ void LibraryModel::BeginReset() {
     CreateSmartPlaylists();
 }
 
+void LibraryModel::InvalidateSongStore() { song_store_.Clear(); }
+
+void LibraryModel::BackendReset() {
+  InvalidateSongStore();
+  Reset();
+}
+
 void LibraryModel::Reset() {
   BeginReset();
 
@@ -921,6 +948,148 @@ void LibraryModel::FilterQuery(GroupBy type, LibraryItem* item,
   }
 }
 
+QList<LibrarySongStore::Field> LibraryModel::StoreFields(GroupBy type) {
+  // The same columns as InitQuery, in the same order.
+  QList<LibrarySongStore::Field> ret;
+  switch (type) {
+    case GroupBy_Artist:
+      ret << LibrarySongStore::Field_Artist;
+      break;
+    case GroupBy_Album:
+      ret << LibrarySongStore::Field_Album;
+      break;
+    case GroupBy_Composer:
+      ret << LibrarySongStore::Field_Composer;
+      break;
+    case GroupBy_Performer:
+      ret << LibrarySongStore::Field_Performer;
+      break;
+    case GroupBy_Disc:
+      ret << LibrarySongStore::Field_Disc;
+      break;
+    case GroupBy_Grouping:
+      ret << LibrarySongStore::Field_Grouping;
+      break;
+    case GroupBy_YearAlbum:
+      ret << LibrarySongStore::Field_Year << LibrarySongStore::Field_Album
+          << LibrarySongStore::Field_Grouping;
+      break;
+    case GroupBy_OriginalYearAlbum:
+      ret << LibrarySongStore::Field_Year
+          << LibrarySongStore::Field_OriginalYear
+          << LibrarySongStore::Field_Album << LibrarySongStore::Field_Grouping;
+      break;
+    case GroupBy_Year:
+      ret << LibrarySongStore::Field_Year;
+      break;
+    case GroupBy_OriginalYear:
+      ret << LibrarySongStore::Field_EffectiveOriginalYear;
+      break;
+    case GroupBy_Genre:
+      ret << LibrarySongStore::Field_Genre;
+      break;
+    case GroupBy_AlbumArtist:
+      ret << LibrarySongStore::Field_EffectiveAlbumArtist;
+      break;
+    case GroupBy_Bitrate:
+      ret << LibrarySongStore::Field_Bitrate;
+      break;
+    case GroupBy_FileType:
+      ret << LibrarySongStore::Field_FileType;
+      break;
+    case GroupBy_None:
+      qLog(Error) << "Songs can't be read from the song store";
+      break;
+  }
+  return ret;
+}
+
+void LibraryModel::FilterStoreQuery(
+    GroupBy type, LibraryItem* item,
+    LibrarySongStore::ConditionList* conditions) {
+  typedef LibrarySongStore::Condition Condition;
+
+  switch (type) {
+    case GroupBy_Artist:
+      if (IsCompilationArtistNode(item)) {
+        *conditions << Condition(LibrarySongStore::Field_EffectiveCompilation,
+                                 1);
+      } else {
+        // Don't duplicate compilations outside the Various artists node
+        *conditions << Condition(LibrarySongStore::Field_EffectiveCompilation,
+                                 0)
+                    << Condition(LibrarySongStore::Field_Artist, item->key);
+      }
+      break;
+    case GroupBy_Album:
+      *conditions << Condition(LibrarySongStore::Field_Album, item->key);
+      break;
+    case GroupBy_YearAlbum:
+      *conditions
+          << Condition(LibrarySongStore::Field_Year, item->metadata.year())
+          << Condition(LibrarySongStore::Field_Album, item->metadata.album())
+          << Condition(LibrarySongStore::Field_Grouping,
+                       item->metadata.grouping());
+      break;
+    case GroupBy_OriginalYearAlbum:
+      *conditions
+          << Condition(LibrarySongStore::Field_Year, item->metadata.year())
+          << Condition(LibrarySongStore::Field_OriginalYear,
+                       item->metadata.originalyear())
+          << Condition(LibrarySongStore::Field_Album, item->metadata.album())
+          << Condition(LibrarySongStore::Field_Grouping,
+                       item->metadata.grouping());
+      break;
+    case GroupBy_Year:
+      *conditions << Condition(LibrarySongStore::Field_Year,
+                               item->key.toInt());
+      break;
+    case GroupBy_OriginalYear:
+      *conditions << Condition(LibrarySongStore::Field_EffectiveOriginalYear,
+                               item->key.toInt());
+      break;
+    case GroupBy_Composer:
+      *conditions << Condition(LibrarySongStore::Field_Composer, item->key);
+      break;
+    case GroupBy_Performer:
+      *conditions << Condition(LibrarySongStore::Field_Performer, item->key);
+      break;
+    case GroupBy_Disc:
+      *conditions << Condition(LibrarySongStore::Field_Disc,
+                               item->key.toInt());
+      break;
+    case GroupBy_Grouping:
+      *conditions << Condition(LibrarySongStore::Field_Grouping, item->key);
+      break;
+    case GroupBy_Genre:
+      *conditions << Condition(LibrarySongStore::Field_Genre, item->key);
+      break;
+    case GroupBy_AlbumArtist:
+      if (IsCompilationArtistNode(item)) {
+        *conditions << Condition(LibrarySongStore::Field_EffectiveCompilation,
+                                 1);
+      } else {
+        // Don't duplicate compilations outside the Various artists node
+        *conditions << Condition(LibrarySongStore::Field_EffectiveCompilation,
+                                 0)
+                    << Condition(LibrarySongStore::Field_EffectiveAlbumArtist,
+                                 item->key);
+      }
+      break;
+    case GroupBy_FileType:
+      *conditions << Condition(LibrarySongStore::Field_FileType,
+                               item->metadata.filetype());
+      break;
+    case GroupBy_Bitrate:
+      *conditions << Condition(LibrarySongStore::Field_Bitrate,
+                               item->key.toInt());
+      break;
+    case GroupBy_None:
+      qLog(Error) << "Unknown GroupBy type" << type << "used in filter";
+      break;
+  }
+}
+
 LibraryItem* LibraryModel::InitItem(GroupBy type, bool signal,
                                     LibraryItem* parent, int container_level) {
   LibraryItem::Type item_type = type == GroupBy_None
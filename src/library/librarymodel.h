@@ -20,10 +20,10 @@
 
 #include <QAbstractItemModel>
 #include <QIcon>
-#include <QNetworkDiskCache>
 
 #include "libraryitem.h"
 #include "libraryquery.h"
+#include "librarysongstore.h"
 #include "librarywatcher.h"
 #include "sqlrow.h"
 #include "core/simpletreemodel.h"
@@ -58,7 +58,6 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   static const char* kSavedGroupingsSettingsGroup;
   static const int kSmartPlaylistsVersion;
   static const int kPrettyCoverSize;
-  static const qint64 kIconCacheSize;
 
   enum Role {
     Role_Type = Qt::UserRole + 1,
@@ -188,6 +187,11 @@ signals:
   void Reset();
   void ResetAsync();
 
+  // Forgets the songs read from the backend, so they're read again the next
+  // time the model needs them.  Call this before Reset() after changing the
+  // backend's songs without it emitting SongsDiscovered or SongsDeleted.
+  void InvalidateSongStore();
+
  protected:
   void LazyPopulate(LibraryItem* item) { LazyPopulate(item, true); }
   void LazyPopulate(LibraryItem* item, bool signal);
@@ -198,6 +202,7 @@ signals:
   void SongsDeleted(const SongList& songs);
   void SongsSlightlyChanged(const SongList& songs);
   void TotalSongCountUpdatedSlot(int count);
+  void BackendReset();
 
   // Called after ResetAsync
   void ResetAsyncQueryFinished(QFuture<LibraryModel::QueryResult> future);
@@ -223,6 +228,14 @@ signals:
   static void InitQuery(GroupBy type, LibraryQuery* q);
   void FilterQuery(GroupBy type, LibraryItem* item, LibraryQuery* q);
 
+  // The same as the functions above, but for finding container items in
+  // song_store_ instead of the database.
+  static QList<LibrarySongStore::Field> StoreFields(GroupBy type);
+  void FilterStoreQuery(GroupBy type, LibraryItem* item,
+                        LibrarySongStore::ConditionList* conditions);
+  void RunStoreQuery(LibraryItem* parent, GroupBy child_type,
+                     QueryResult* result);
+
   // Items can be created either from a query that's been run to populate a
   // node, or by a spontaneous SongsDiscovered emission from the backend.
   LibraryItem* ItemFromQuery(GroupBy type, bool signal, bool create_divider,
@@ -269,6 +282,9 @@ signals:
   QueryOptions query_options_;
   Grouping group_by_;
 
+  // Container nodes are populated from here rather than the database.
+  LibrarySongStore song_store_;
+
   // Keyed on database ID
   QMap<int, LibraryItem*> song_nodes_;
 
@@ -289,8 +305,6 @@ signals:
   QIcon playlists_dir_icon_;
   QIcon playlist_icon_;
 
-  QNetworkDiskCache* icon_cache_;
-
   int init_task_id_;
 
   bool use_pretty_covers_;
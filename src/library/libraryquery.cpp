@@ -138,7 +138,7 @@ void LibraryQuery::AddCompilationRequirement(bool compilation) {
                         .arg(compilation ? 1 : 0);
 }
 
-QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
+QString LibraryQuery::GetSql(const QString& songs_table,
                              const QString& fts_table) {
   QString sql;
 
@@ -165,8 +165,12 @@ QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
   sql.replace("%songs_table", songs_table);
   sql.replace("%fts_table_noprefix", fts_table.section('.', -1, -1));
   sql.replace("%fts_table", fts_table);
+  return sql;
+}
 
-  query_ = QSqlQuery(sql, db);
+QSqlQuery LibraryQuery::Exec(QSqlDatabase db, const QString& songs_table,
+                             const QString& fts_table) {
+  query_ = QSqlQuery(GetSql(songs_table, fts_table), db);
 
   // Bind values
   for (const QVariant& value : bound_values_) {
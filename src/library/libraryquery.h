@@ -86,6 +86,11 @@ class LibraryQuery {
     include_unavailable_ = include_unavailable;
   }
 
+  // Returns the query's SQL with the table names filled in.  Its values are
+  // bound positionally, in the order given by bound_values().
+  QString GetSql(const QString& songs_table, const QString& fts_table);
+  const QVariantList& bound_values() const { return bound_values_; }
+
   QSqlQuery Exec(QSqlDatabase db, const QString& songs_table,
                  const QString& fts_table);
   bool Next();
@@ -0,0 +1,319 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librarysongstore.h"
+
+#include <QDateTime>
+#include <QPair>
+#include <QSet>
+
+#include "librarybackend.h"
+#include "libraryquery.h"
+#include "core/database.h"
+#include "core/logging.h"
+
+namespace {
+
+// The columns read by Load(), in the same order as LibrarySongStore::Field.
+const char* kColumnSpec =
+    "%songs_table.ROWID, artist, album, effective_albumartist, composer,"
+    " performer, grouping, genre, title, year, originalyear,"
+    " effective_originalyear, disc, bitrate, filetype, effective_compilation,"
+    " ctime";
+
+// Up to four field values, used to find distinct combinations.
+typedef QPair<QPair<int, int>, QPair<int, int> > DistinctKey;
+
+}  // namespace
+
+LibrarySongStore::LibrarySongStore() : loaded_(false) { Clear(); }
+
+bool LibrarySongStore::is_loaded() const {
+  QMutexLocker l(&mutex_);
+  return loaded_;
+}
+
+int LibrarySongStore::song_count() const {
+  QMutexLocker l(&mutex_);
+  return ids_.count();
+}
+
+bool LibrarySongStore::IsStringField(Field field) {
+  return field <= Field_Title;
+}
+
+bool LibrarySongStore::SupportsOptions(const QueryOptions& options) {
+  return options.filter().isEmpty();
+}
+
+void LibrarySongStore::Clear() {
+  QMutexLocker l(&mutex_);
+
+  loaded_ = false;
+  ids_.clear();
+  for (int i = 0; i < FieldCount; ++i) {
+    columns_[i].clear();
+  }
+  rows_by_id_.clear();
+  strings_.clear();
+  string_ids_.clear();
+
+  // The empty string is always 0
+  InternString(QString());
+}
+
+int LibrarySongStore::InternString(const QString& string) {
+  QHash<QString, int>::const_iterator it = string_ids_.constFind(string);
+  if (it != string_ids_.constEnd()) return *it;
+
+  const int id = strings_.count();
+  strings_ << string;
+  string_ids_.insert(string, id);
+  return id;
+}
+
+void LibrarySongStore::Load(LibraryBackend* backend) {
+  Clear();
+
+  QMutexLocker l(&mutex_);
+
+  LibraryQuery q;
+  q.SetColumnSpec(kColumnSpec);
+
+  {
+    Database::Locker db_l(backend->db(), Database::Lock_Read);
+    if (!backend->ExecQuery(&q)) return;
+
+    while (q.Next()) {
+      const int id = q.Value(0).toInt();
+      rows_by_id_[id] = ids_.count();
+      ids_ << id;
+
+      for (int i = 0; i < FieldCount; ++i) {
+        const QVariant value = q.Value(i + 1);
+        if (IsStringField(Field(i))) {
+          columns_[i] << InternString(value.toString());
+        } else {
+          columns_[i] << int(value.toLongLong());
+        }
+      }
+    }
+  }
+
+  loaded_ = true;
+  qLog(Debug) << "Loaded" << ids_.count() << "songs with" << strings_.count()
+              << "distinct strings from" << backend->songs_table();
+}
+
+void LibrarySongStore::SetRow(int row, const Song& song) {
+  columns_[Field_Artist][row] = InternString(song.artist());
+  columns_[Field_Album][row] = InternString(song.album());
+  columns_[Field_EffectiveAlbumArtist][row] =
+      InternString(song.effective_albumartist());
+  columns_[Field_Composer][row] = InternString(song.composer());
+  columns_[Field_Performer][row] = InternString(song.performer());
+  columns_[Field_Grouping][row] = InternString(song.grouping());
+  columns_[Field_Genre][row] = InternString(song.genre());
+  columns_[Field_Title][row] = InternString(song.title());
+  columns_[Field_Year][row] = song.year();
+  columns_[Field_OriginalYear][row] = song.originalyear();
+  columns_[Field_EffectiveOriginalYear][row] = song.effective_originalyear();
+  columns_[Field_Disc][row] = song.disc();
+  columns_[Field_Bitrate][row] = song.bitrate();
+  columns_[Field_FileType][row] = song.filetype();
+  columns_[Field_EffectiveCompilation][row] = song.is_compilation() ? 1 : 0;
+  columns_[Field_Ctime][row] = int(song.ctime());
+}
+
+void LibrarySongStore::RemoveRow(int row) {
+  rows_by_id_.remove(ids_[row]);
+
+  // Move the last row into the gap
+  const int last = ids_.count() - 1;
+  if (row != last) {
+    ids_[row] = ids_[last];
+    for (int i = 0; i < FieldCount; ++i) {
+      columns_[i][row] = columns_[i][last];
+    }
+    rows_by_id_[ids_[row]] = row;
+  }
+
+  ids_.resize(last);
+  for (int i = 0; i < FieldCount; ++i) {
+    columns_[i].resize(last);
+  }
+}
+
+void LibrarySongStore::AddOrUpdateSongs(const SongList& songs) {
+  QMutexLocker l(&mutex_);
+
+  // Songs will be read from the database when it's loaded.
+  if (!loaded_) return;
+
+  for (const Song& song : songs) {
+    if (song.id() == -1) continue;
+
+    int row = rows_by_id_.value(song.id(), -1);
+    if (song.is_unavailable()) {
+      if (row != -1) RemoveRow(row);
+      continue;
+    }
+
+    if (row == -1) {
+      row = ids_.count();
+      rows_by_id_[song.id()] = row;
+      ids_ << song.id();
+      for (int i = 0; i < FieldCount; ++i) {
+        columns_[i] << 0;
+      }
+    }
+
+    SetRow(row, song);
+  }
+}
+
+void LibrarySongStore::RemoveSongs(const SongList& songs) {
+  QMutexLocker l(&mutex_);
+
+  for (const Song& song : songs) {
+    const int row = rows_by_id_.value(song.id(), -1);
+    if (row != -1) RemoveRow(row);
+  }
+}
+
+QVector<int> LibrarySongStore::MatchingRows(const QueryOptions& options,
+                                            const ConditionList& conditions,
+                                            int limit) const {
+  QVector<int> ret;
+
+  // Convert the conditions to the values stored in the columns
+  QVector<const QVector<int>*> condition_columns;
+  QVector<int> condition_values;
+  for (const Condition& condition : conditions) {
+    int value = 0;
+    if (IsStringField(condition.field)) {
+      QHash<QString, int>::const_iterator it =
+          string_ids_.constFind(condition.value.toString());
+      if (it == string_ids_.constEnd()) return ret;
+      value = *it;
+    } else {
+      value = condition.value.toInt();
+    }
+
+    condition_columns << &columns_[condition.field];
+    condition_values << value;
+  }
+  const int condition_count = condition_columns.count();
+
+  const bool check_age = options.max_age() != -1;
+  const uint cutoff =
+      check_age ? QDateTime::currentDateTime().toTime_t() - options.max_age()
+                : 0;
+
+  const bool untagged_only =
+      options.query_mode() == QueryOptions::QueryMode_Untagged;
+  const bool duplicates_only =
+      options.query_mode() == QueryOptions::QueryMode_Duplicates;
+
+  const QVector<int>& artists = columns_[Field_Artist];
+  const QVector<int>& albums = columns_[Field_Album];
+  const QVector<int>& titles = columns_[Field_Title];
+
+  // Songs with a fully tagged artist, album and title that appear more than
+  // once, like the duplicated_songs view.
+  typedef QPair<int, QPair<int, int> > Tags;
+  QHash<Tags, int> tag_counts;
+  if (duplicates_only) {
+    for (int row = 0; row < ids_.count(); ++row) {
+      if (artists[row] == 0 || albums[row] == 0 || titles[row] == 0) continue;
+      tag_counts[qMakePair(artists[row],
+                           qMakePair(albums[row], titles[row]))]++;
+    }
+  }
+
+  for (int row = 0; row < ids_.count(); ++row) {
+    bool matches = true;
+    for (int i = 0; i < condition_count && matches; ++i) {
+      matches = condition_columns[i]->at(row) == condition_values[i];
+    }
+    if (!matches) continue;
+
+    if (check_age && uint(columns_[Field_Ctime][row]) <= cutoff) continue;
+
+    if (untagged_only && artists[row] != 0 && albums[row] != 0 &&
+        titles[row] != 0) {
+      continue;
+    }
+
+    if (duplicates_only &&
+        tag_counts.value(qMakePair(artists[row],
+                                   qMakePair(albums[row], titles[row]))) < 2) {
+      continue;
+    }
+
+    ret << row;
+    if (limit != -1 && ret.count() >= limit) break;
+  }
+
+  return ret;
+}
+
+QList<QVariantList> LibrarySongStore::Distinct(
+    const QList<Field>& fields, const QueryOptions& options,
+    const ConditionList& conditions) const {
+  Q_ASSERT(fields.count() >= 1 && fields.count() <= 4);
+
+  QMutexLocker l(&mutex_);
+
+  const QVector<int> rows = MatchingRows(options, conditions, -1);
+
+  const QVector<int>* columns[4] = {nullptr, nullptr, nullptr, nullptr};
+  for (int i = 0; i < fields.count(); ++i) {
+    columns[i] = &columns_[fields[i]];
+  }
+
+  QList<QVariantList> ret;
+  QSet<DistinctKey> seen;
+  for (int row : rows) {
+    int values[4] = {0, 0, 0, 0};
+    for (int i = 0; i < fields.count(); ++i) {
+      values[i] = columns[i]->at(row);
+    }
+
+    const DistinctKey key(qMakePair(values[0], values[1]),
+                          qMakePair(values[2], values[3]));
+    if (seen.contains(key)) continue;
+    seen.insert(key);
+
+    QVariantList result;
+    for (int i = 0; i < fields.count(); ++i) {
+      if (IsStringField(fields[i])) {
+        result << strings_[values[i]];
+      } else {
+        result << values[i];
+      }
+    }
+    ret << result;
+  }
+
+  return ret;
+}
+
+bool LibrarySongStore::Any(const QueryOptions& options,
+                           const ConditionList& conditions) const {
+  QMutexLocker l(&mutex_);
+  return !MatchingRows(options, conditions, 1).isEmpty();
+}
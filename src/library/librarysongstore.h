@@ -0,0 +1,120 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARYSONGSTORE_H
+#define LIBRARYSONGSTORE_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QVariant>
+#include <QVector>
+
+#include "core/song.h"
+
+class LibraryBackend;
+struct QueryOptions;
+
+// An in-memory copy of the columns of the songs table that LibraryModel
+// groups by.  Each column is stored as an array of ints, with strings interned
+// into a shared pool, so listing the distinct albums of an artist is a scan
+// over a few arrays instead of an SQL query.
+// Only available songs are stored.  It's kept up to date with
+// AddOrUpdateSongs and RemoveSongs, and is safe to use from any thread.
+class LibrarySongStore {
+ public:
+  LibrarySongStore();
+
+  enum Field {
+    Field_Artist = 0,
+    Field_Album,
+    Field_EffectiveAlbumArtist,
+    Field_Composer,
+    Field_Performer,
+    Field_Grouping,
+    Field_Genre,
+    Field_Title,
+    Field_Year,
+    Field_OriginalYear,
+    Field_EffectiveOriginalYear,
+    Field_Disc,
+    Field_Bitrate,
+    Field_FileType,
+    Field_EffectiveCompilation,
+    Field_Ctime,
+
+    FieldCount
+  };
+
+  // Requires the value of a field to equal the given string or int.
+  struct Condition {
+    Condition(Field field, const QVariant& value)
+        : field(field), value(value) {}
+
+    Field field;
+    QVariant value;
+  };
+  typedef QList<Condition> ConditionList;
+
+  bool is_loaded() const;
+  int song_count() const;
+
+  // Reads every available song from the database, replacing what's stored.
+  void Load(LibraryBackend* backend);
+  void Clear();
+
+  void AddOrUpdateSongs(const SongList& songs);
+  void RemoveSongs(const SongList& songs);
+
+  // Full text filters can't be evaluated here - the caller should use
+  // LibraryQuery instead.
+  static bool SupportsOptions(const QueryOptions& options);
+
+  // Returns each distinct combination of the given fields among the songs
+  // that match the options and conditions, in no particular order.  Strings
+  // are returned as QStrings and everything else as ints, like the columns
+  // of an SQL query.
+  QList<QVariantList> Distinct(const QList<Field>& fields,
+                               const QueryOptions& options,
+                               const ConditionList& conditions) const;
+
+  // Returns true if any song matches the options and conditions.
+  bool Any(const QueryOptions& options, const ConditionList& conditions) const;
+
+ private:
+  static bool IsStringField(Field field);
+
+  int InternString(const QString& string);
+  void SetRow(int row, const Song& song);
+  void RemoveRow(int row);
+
+  // Returns the rows that match, stopping after limit rows if it isn't -1.
+  QVector<int> MatchingRows(const QueryOptions& options,
+                            const ConditionList& conditions, int limit) const;
+
+  mutable QMutex mutex_;
+  bool loaded_;
+
+  QVector<int> ids_;
+  QVector<int> columns_[FieldCount];
+  QHash<int, int> rows_by_id_;
+
+  // Strings are only removed from the pool when the store is reloaded.
+  QVector<QString> strings_;
+  QHash<QString, int> string_ids_;
+};
+
+#endif  // LIBRARYSONGSTORE_H
@@ -51,6 +51,8 @@ static const char *kNoMusicFile   = ".nomusic";
 QStringList LibraryWatcher::sValidImages;
 
 const char* LibraryWatcher::kSettingsGroup = "LibraryWatcher";
+const int LibraryWatcher::kMaxPendingReadsPerWorker = 2;
+const int LibraryWatcher::kSongsBatchSize = 1000;
 
 LibraryWatcher::LibraryWatcher(QObject* parent)
     : QObject(parent),
@@ -84,6 +86,10 @@ LibraryWatcher::ScanTransaction::ScanTransaction(LibraryWatcher* watcher,
                                                  bool ignores_mtime)
     : progress_(0),
       progress_max_(0),
+      files_scanned_(0),
+      max_pending_reads_(
+          qMax(1, TagReaderClient::Instance()->worker_count()) *
+          kMaxPendingReadsPerWorker),
       dir_(dir),
       incremental_(incremental),
       ignores_mtime_(ignores_mtime),
@@ -98,9 +104,17 @@ LibraryWatcher::ScanTransaction::ScanTransaction(LibraryWatcher* watcher,
 
   task_id_ = watcher_->task_manager_->StartTask(description);
   emit watcher_->ScanStarted(task_id_);
+
+  watcher_->file_index_.Load(watcher_->FileIndexFilename());
+
+  reporter_.Start(watcher_->task_manager_, task_id_, tr("files"));
 }
 
 LibraryWatcher::ScanTransaction::~ScanTransaction() {
+  // The replies still belong to the tagreader, so wait for them even if we're
+  // stopping.
+  FlushPendingReads();
+
   // If we're stopping then don't commit the transaction
   if (watcher_->stop_requested_) return;
 
@@ -117,6 +131,13 @@ LibraryWatcher::ScanTransaction::~ScanTransaction() {
   if (!touched_subdirs.isEmpty())
     emit watcher_->SubdirsMTimeUpdated(touched_subdirs);
 
+  for (QMap<QString, LibraryFileIndex::EntryList>::const_iterator it =
+           file_index_updates.constBegin();
+       it != file_index_updates.constEnd(); ++it) {
+    watcher_->file_index_.SetDirectory(it.key(), it.value());
+  }
+  watcher_->file_index_.Save();
+
   watcher_->task_manager_->SetTaskFinished(task_id_);
 
   if (watcher_->monitor_) {
@@ -129,7 +150,7 @@ LibraryWatcher::ScanTransaction::~ScanTransaction() {
 
 void LibraryWatcher::ScanTransaction::AddToProgress(int n) {
   progress_ += n;
-  watcher_->task_manager_->SetTaskProgress(task_id_, progress_, progress_max_);
+  reporter_.Update(progress_, progress_max_, files_scanned_);
 }
 
 void LibraryWatcher::ScanTransaction::AddToProgressMax(int n) {
@@ -137,19 +158,108 @@ void LibraryWatcher::ScanTransaction::AddToProgressMax(int n) {
   watcher_->task_manager_->SetTaskProgress(task_id_, progress_, progress_max_);
 }
 
+void LibraryWatcher::ScanTransaction::AddToFilesScanned(int n) {
+  files_scanned_ += n;
+}
+
+void LibraryWatcher::ScanTransaction::QueueReadFile(const QString& file,
+                                                    const QString& image,
+                                                    const Song& matching_song) {
+  PendingFile pending;
+  pending.file = file;
+  pending.image = image;
+  pending.matching_song = matching_song;
+  unsent_files_ << pending;
+
+  if (unsent_files_.count() >= TagReaderClient::kReadFilesChunkSize) {
+    SendUnsentFiles();
+  }
+}
+
+void LibraryWatcher::ScanTransaction::SendUnsentFiles() {
+  if (unsent_files_.isEmpty()) return;
+
+  while (pending_reads_.count() >= max_pending_reads_) {
+    FinishOldestRead();
+  }
+
+  QStringList filenames;
+  for (const PendingFile& pending : unsent_files_) {
+    filenames << pending.file;
+  }
+
+  // There are never more than kReadFilesChunkSize unsent files, so this is
+  // always a single request.
+  PendingRead read;
+  read.files = unsent_files_;
+  read.reply = TagReaderClient::Instance()->ReadFiles(filenames).first();
+  pending_reads_.enqueue(read);
+
+  unsent_files_.clear();
+}
+
+void LibraryWatcher::ScanTransaction::FlushPendingReads() {
+  SendUnsentFiles();
+
+  while (!pending_reads_.isEmpty()) {
+    FinishOldestRead();
+  }
+}
+
+void LibraryWatcher::ScanTransaction::FinishOldestRead() {
+  PendingRead read = pending_reads_.dequeue();
+
+  const bool success = read.reply->WaitForFinished();
+  const pb::tagreader::ReadFilesResponse& response =
+      read.reply->message().read_files_response();
+
+  for (int i = 0; i < read.files.count(); ++i) {
+    if (watcher_->stop_requested_) break;
+    if (!success || i >= response.metadata_size()) break;
+
+    const PendingFile& pending = read.files[i];
+
+    Song song;
+    song.set_directory_id(dir_);
+    song.InitFromProtobuf(response.metadata(i));
+    if (!song.is_valid()) continue;
+
+    if (pending.matching_song.is_valid()) {
+      watcher_->PreserveUserSetData(pending.file, pending.image,
+                                    pending.matching_song, &song, this);
+    } else {
+      qLog(Debug) << pending.file << "created";
+      if (song.art_automatic().isEmpty()) song.set_art_automatic(pending.image);
+      new_songs << song;
+    }
+  }
+
+  read.reply->deleteLater();
+
+  if (new_songs.count() + touched_songs.count() >= kSongsBatchSize) {
+    CommitNewOrUpdatedSongs();
+  }
+}
+
+void LibraryWatcher::ScanTransaction::CommitNewOrUpdatedSongs() {
+  if (!new_songs.isEmpty()) emit watcher_->NewOrUpdatedSongs(new_songs);
+  if (!touched_songs.isEmpty()) emit watcher_->SongsMTimeUpdated(touched_songs);
+
+  new_songs.clear();
+  touched_songs.clear();
+}
+
 SongList LibraryWatcher::ScanTransaction::FindSongsInSubdirectory(
     const QString& path) {
   if (cached_songs_dirty_) {
-    cached_songs_ = watcher_->backend_->FindSongsInDirectory(dir_);
+    cached_songs_.clear();
+    for (const Song& song : watcher_->backend_->FindSongsInDirectory(dir_)) {
+      cached_songs_[song.url().toLocalFile().section('/', 0, -2)] << song;
+    }
     cached_songs_dirty_ = false;
   }
 
-  // TODO: Make this faster
-  SongList ret;
-  for (const Song& song : cached_songs_) {
-    if (song.url().toLocalFile().section('/', 0, -2) == path) ret << song;
-  }
-  return ret;
+  return cached_songs_.value(path);
 }
 
 void LibraryWatcher::ScanTransaction::SetKnownSubdirs(
@@ -224,33 +334,31 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
                                       ScanTransaction* t,
                                       bool force_noincremental) {
   QFileInfo path_info(path);
-  QDir      path_dir(path);
 
-  // Do not scan symlinked dirs that are already in collection
-  if (path_info.isSymLink()) {
-    QString real_path = path_info.symLinkTarget();
-    for (const Directory& dir : watched_dirs_) {
-      if (real_path.startsWith(dir.path)) {
-        t->AddToProgress(1);
-        return;
-      }
-    }
-  }
-
-  // Do not scan directories containing a .nomedia or .nomusic file
-  if (path_dir.exists(kNoMediaFile) ||
-      path_dir.exists(kNoMusicFile)) {
+  if (IsExcludedDirectory(path)) {
     t->AddToProgress(1);
     return;
   }
 
-  if (!t->ignores_mtime() && !force_noincremental && t->is_incremental() &&
-      subdir.mtime == path_info.lastModified().toTime_t()) {
-    // The directory hasn't changed since last time
-    t->AddToProgress(1);
-    return;
+  if (!t->ignores_mtime() && !force_noincremental && t->is_incremental()) {
+    if (subdir.mtime == path_info.lastModified().toTime_t()) {
+      // The directory hasn't changed since last time
+      t->AddToProgress(1);
+      return;
+    }
+
+    // Something in the directory was added, removed or renamed.  If the file
+    // index knows what was there before, only the files that are different
+    // need to be looked at.
+    if (subdir.directory_id != -1 && ScanIndexedSubdirectory(path, t)) {
+      return;
+    }
   }
 
+  LibraryFileIndex::EntryList index_entries;
+  const bool have_index_entries =
+      LibraryFileIndex::ReadDirectory(path, &index_entries);
+
   QMap<QString, QStringList> album_art;
   QStringList files_on_disk;
   SubdirectoryList my_new_subdirs;
@@ -301,94 +409,25 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
 
   if (stop_requested_) return;
 
+  t->AddToFilesScanned(files_on_disk.count());
+
   // Ask the database for a list of files in this directory
   SongList songs_in_db = t->FindSongsInSubdirectory(path);
 
   QSet<QString> cues_processed;
 
   // Now compare the list from the database with the list of files on disk
+  QStringList vanished_files;
   for (const QString& file : files_on_disk) {
     if (stop_requested_) return;
 
-    // associated cue
-    QString matching_cue = NoExtensionPart(file) + ".cue";
-
-    Song matching_song;
-    if (FindSongByPath(songs_in_db, file, &matching_song)) {
-      uint matching_cue_mtime = GetMtimeForCue(matching_cue);
-
-      // The song is in the database and still on disk.
-      // Check the mtime to see if it's been changed since it was added.
-      QFileInfo file_info(file);
-
-      if (!file_info.exists()) {
-        // Partially fixes race condition - if file was removed between being
-        // added to the list and now.
-        files_on_disk.removeAll(file);
-        continue;
-      }
-
-      // cue sheet's path from library (if any)
-      QString song_cue = matching_song.cue_path();
-      uint song_cue_mtime = GetMtimeForCue(song_cue);
-
-      bool cue_deleted = song_cue_mtime == 0 && matching_song.has_cue();
-      bool cue_added = matching_cue_mtime != 0 && !matching_song.has_cue();
-
-      // watch out for cue songs which have their mtime equal to
-      // qMax(media_file_mtime, cue_sheet_mtime)
-      bool changed =
-          (matching_song.mtime() !=
-           qMax(file_info.lastModified().toTime_t(), song_cue_mtime)) ||
-          cue_deleted || cue_added;
-
-      // Also want to look to see whether the album art has changed
-      QString image = ImageForSong(file, album_art);
-      if ((matching_song.art_automatic().isEmpty() && !image.isEmpty()) ||
-          (!matching_song.art_automatic().isEmpty() &&
-           !matching_song.has_embedded_cover() &&
-           !QFile::exists(matching_song.art_automatic()))) {
-        changed = true;
-      }
-
-      // the song's changed - reread the metadata from file
-      if (t->ignores_mtime() || changed) {
-        qLog(Debug) << file << "changed";
-
-        // if cue associated...
-        if (!cue_deleted && (matching_song.has_cue() || cue_added)) {
-          UpdateCueAssociatedSongs(file, path, matching_cue, image, t);
-          // if no cue or it's about to lose it...
-        } else {
-          UpdateNonCueAssociatedSong(file, matching_song, image, cue_deleted,
-                                     t);
-        }
-      }
-
-      // nothing has changed - mark the song available without re-scanning
-      if (matching_song.is_unavailable()) t->readded_songs << matching_song;
-
-    } else {
-      // The song is on disk but not in the DB
-      SongList song_list =
-          ScanNewFile(file, path, matching_cue, &cues_processed);
-
-      if (song_list.isEmpty()) {
-        continue;
-      }
-
-      qLog(Debug) << file << "created";
-      // choose an image for the song(s)
-      QString image = ImageForSong(file, album_art);
-
-      for (Song song : song_list) {
-        song.set_directory_id(t->dir());
-        if (song.art_automatic().isEmpty()) song.set_art_automatic(image);
-
-        t->new_songs << song;
-      }
+    if (!ScanFile(file, path, songs_in_db, album_art, &cues_processed, t)) {
+      vanished_files << file;
     }
   }
+  for (const QString& file : vanished_files) {
+    files_on_disk.removeAll(file);
+  }
 
   // Look for deleted songs
   for (const Song& song : songs_in_db) {
@@ -411,6 +450,10 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   else
     t->touched_subdirs << updated_subdir;
 
+  if (have_index_entries || !path_info.exists()) {
+    t->file_index_updates[path] = index_entries;
+  }
+
   t->AddToProgress(1);
 
   // Recurse into the new subdirs that we found
@@ -421,6 +464,189 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   }
 }
 
+bool LibraryWatcher::ScanIndexedSubdirectory(const QString& path,
+                                             ScanTransaction* t) {
+  LibraryFileIndex::EntryList entries;
+  QStringList names;
+  QStringList changed;
+  QList<quint64> removed;
+  if (!LibraryFileIndex::ReadDirectory(path, &entries, &names) ||
+      !file_index_.FindChanges(path, entries, names, &changed, &removed)) {
+    return false;
+  }
+  const int unchanged = entries.count() - changed.count();
+
+  // The index only has a hash of the names of the files that were removed, so
+  // find them among the songs.  Anything else that went, like a cue sheet or
+  // an image, can change other songs, so it needs a normal scan.
+  QSet<quint64> removed_songs;
+  for (const Song& song : t->FindSongsInSubdirectory(path)) {
+    const QString name = song.url().toLocalFile().section('/', -1);
+    const quint64 hash = LibraryFileIndex::HashName(name);
+    if (removed.contains(hash) && !removed_songs.contains(hash)) {
+      removed_songs.insert(hash);
+      changed << name;
+    }
+  }
+  if (removed_songs.count() != removed.count()) return false;
+
+  t->AddToFilesScanned(unchanged);
+  ScanChangedFiles(path, changed, t);
+  return true;
+}
+
+bool LibraryWatcher::IsExcludedDirectory(const QString& path) const {
+  // Do not scan symlinked dirs that are already in collection
+  QFileInfo path_info(path);
+  if (path_info.isSymLink()) {
+    QString real_path = path_info.symLinkTarget();
+    for (const Directory& dir : watched_dirs_) {
+      if (real_path.startsWith(dir.path)) return true;
+    }
+  }
+
+  // Do not scan directories containing a .nomedia or .nomusic file
+  QDir path_dir(path);
+  return path_dir.exists(kNoMediaFile) || path_dir.exists(kNoMusicFile);
+}
+
+void LibraryWatcher::ScanChangedFiles(const QString& path,
+                                      const QStringList& files,
+                                      ScanTransaction* t) {
+  if (IsExcludedDirectory(path)) {
+    t->AddToProgress(1);
+    return;
+  }
+
+  Subdirectory subdir;
+  subdir.directory_id = t->dir();
+  subdir.mtime = 0;
+  subdir.path = path;
+
+  // Cue sheets and images can change songs other than the ones that were
+  // touched, so fall back to scanning the whole directory.
+  for (const QString& file : files) {
+    const QString ext_part(ExtensionPart(file));
+    if (ext_part == "cue" || sValidImages.contains(ext_part)) {
+      ScanSubdirectory(path, subdir, t, true);
+      return;
+    }
+  }
+
+  QMap<QString, QStringList> album_art;
+  QDirIterator it(path, QDir::Files | QDir::NoDotAndDotDot);
+  while (it.hasNext()) {
+    QString child(it.next());
+    if (sValidImages.contains(ExtensionPart(child))) album_art[path] << child;
+  }
+
+  SongList songs_in_db = t->FindSongsInSubdirectory(path);
+  QSet<QString> cues_processed;
+
+  for (const QString& name : files) {
+    if (stop_requested_) return;
+
+    const QString file = path + "/" + name;
+    QFileInfo file_info(file);
+    if (file_info.exists() && !file_info.isHidden() && !file_info.isDir() &&
+        ScanFile(file, path, songs_in_db, album_art, &cues_processed, t)) {
+      continue;
+    }
+
+    // Each section of a cue sheet is a song with the same file.
+    for (const Song& song : songs_in_db) {
+      if (!song.is_unavailable() && song.url().toLocalFile() == file) {
+        qLog(Debug) << "Song deleted from disk:" << file;
+        t->deleted_songs << song;
+      }
+    }
+  }
+  t->AddToFilesScanned(files.count());
+
+  QFileInfo path_info(path);
+  subdir.mtime = path_info.exists() ? path_info.lastModified().toTime_t() : 0;
+  t->touched_subdirs << subdir;
+
+  // Every change in the directory has been seen, so the index can be brought
+  // up to date without comparing the rest of its files.
+  LibraryFileIndex::EntryList index_entries;
+  if (LibraryFileIndex::ReadDirectory(path, &index_entries)) {
+    t->file_index_updates[path] = index_entries;
+  }
+
+  t->AddToProgress(1);
+}
+
+bool LibraryWatcher::ScanFile(const QString& file, const QString& path,
+                              const SongList& songs_in_db,
+                              QMap<QString, QStringList>& album_art,
+                              QSet<QString>* cues_processed,
+                              ScanTransaction* t) {
+  // associated cue
+  QString matching_cue = NoExtensionPart(file) + ".cue";
+
+  Song matching_song;
+  if (FindSongByPath(songs_in_db, file, &matching_song)) {
+    uint matching_cue_mtime = GetMtimeForCue(matching_cue);
+
+    // The song is in the database and still on disk.
+    // Check the mtime to see if it's been changed since it was added.
+    QFileInfo file_info(file);
+
+    if (!file_info.exists()) {
+      // Partially fixes race condition - if file was removed between being
+      // added to the list and now.
+      return false;
+    }
+
+    // cue sheet's path from library (if any)
+    QString song_cue = matching_song.cue_path();
+    uint song_cue_mtime = GetMtimeForCue(song_cue);
+
+    bool cue_deleted = song_cue_mtime == 0 && matching_song.has_cue();
+    bool cue_added = matching_cue_mtime != 0 && !matching_song.has_cue();
+
+    // watch out for cue songs which have their mtime equal to
+    // qMax(media_file_mtime, cue_sheet_mtime)
+    bool changed =
+        (matching_song.mtime() !=
+         qMax(file_info.lastModified().toTime_t(), song_cue_mtime)) ||
+        cue_deleted || cue_added;
+
+    // Also want to look to see whether the album art has changed
+    QString image = ImageForSong(file, album_art);
+    if ((matching_song.art_automatic().isEmpty() && !image.isEmpty()) ||
+        (!matching_song.art_automatic().isEmpty() &&
+         !matching_song.has_embedded_cover() &&
+         !QFile::exists(matching_song.art_automatic()))) {
+      changed = true;
+    }
+
+    // the song's changed - reread the metadata from file
+    if (t->ignores_mtime() || changed) {
+      qLog(Debug) << file << "changed";
+
+      // if cue associated...
+      if (!cue_deleted && (matching_song.has_cue() || cue_added)) {
+        UpdateCueAssociatedSongs(file, path, matching_cue, image, t);
+        // if no cue or it's about to lose it...
+      } else {
+        UpdateNonCueAssociatedSong(file, matching_song, image, cue_deleted,
+                                   t);
+      }
+    }
+
+    // nothing has changed - mark the song available without re-scanning
+    if (matching_song.is_unavailable()) t->readded_songs << matching_song;
+
+  } else {
+    // The song is on disk but not in the DB
+    ScanNewFile(file, path, matching_cue, ImageForSong(file, album_art),
+                cues_processed, t);
+  }
+  return true;
+}
+
 void LibraryWatcher::UpdateCueAssociatedSongs(const QString& file,
                                               const QString& path,
                                               const QString& matching_cue,
@@ -478,25 +704,21 @@ void LibraryWatcher::UpdateNonCueAssociatedSong(const QString& file,
     }
   }
 
-  Song song_on_disk;
-  song_on_disk.set_directory_id(t->dir());
-  TagReaderClient::Instance()->ReadFileBlocking(file, &song_on_disk);
-
-  if (song_on_disk.is_valid()) {
-    PreserveUserSetData(file, image, matching_song, &song_on_disk, t);
-  }
+  t->QueueReadFile(file, image, matching_song);
 }
 
-SongList LibraryWatcher::ScanNewFile(const QString& file, const QString& path,
-                                     const QString& matching_cue,
-                                     QSet<QString>* cues_processed) {
-  SongList song_list;
-
+void LibraryWatcher::ScanNewFile(const QString& file, const QString& path,
+                                 const QString& matching_cue,
+                                 const QString& image,
+                                 QSet<QString>* cues_processed,
+                                 ScanTransaction* t) {
   uint matching_cue_mtime = GetMtimeForCue(matching_cue);
   // if it's a cue - create virtual tracks
   if (matching_cue_mtime) {
     // don't process the same cue many times
-    if (cues_processed->contains(matching_cue)) return song_list;
+    if (cues_processed->contains(matching_cue)) return;
+
+    SongList song_list;
 
     QFile cue(matching_cue);
     cue.open(QIODevice::ReadOnly);
@@ -513,21 +735,22 @@ SongList LibraryWatcher::ScanNewFile(const QString& file, const QString& path,
       }
     }
 
-    if (!song_list.isEmpty()) {
-      *cues_processed << matching_cue;
+    if (song_list.isEmpty()) return;
+
+    *cues_processed << matching_cue;
+    qLog(Debug) << file << "created";
+
+    for (Song song : song_list) {
+      song.set_directory_id(t->dir());
+      if (song.art_automatic().isEmpty()) song.set_art_automatic(image);
+
+      t->new_songs << song;
     }
 
     // it's a normal media file
   } else {
-    Song song;
-    TagReaderClient::Instance()->ReadFileBlocking(file, &song);
-
-    if (song.is_valid()) {
-      song_list << song;
-    }
+    t->QueueReadFile(file, image, Song());
   }
-
-  return song_list;
 }
 
 void LibraryWatcher::PreserveUserSetData(const QString& file,
@@ -576,17 +799,27 @@ uint LibraryWatcher::GetMtimeForCue(const QString& cue_path) {
   return cue_last_modified.isValid() ? cue_last_modified.toTime_t() : 0;
 }
 
+QString LibraryWatcher::FileIndexFilename() const {
+  return Utilities::GetConfigPath(Utilities::Path_CacheRoot) + "/fileindex/" +
+         backend_->songs_table() + ".idx";
+}
+
 void LibraryWatcher::AddWatch(const Directory& dir, const QString& path) {
   if (!QFile::exists(path)) return;
 
   connect(fs_watcher_, SIGNAL(PathChanged(const QString&)), this,
           SLOT(DirectoryChanged(const QString&)), Qt::UniqueConnection);
+  connect(fs_watcher_,
+          SIGNAL(FilesChanged(const QString&, const QStringList&)), this,
+          SLOT(FilesChanged(const QString&, const QStringList&)),
+          Qt::UniqueConnection);
   fs_watcher_->AddPath(path);
   subdir_mapping_[path] = dir;
 }
 
 void LibraryWatcher::RemoveDirectory(const Directory& dir) {
   rescan_queue_.remove(dir.id);
+  rescan_files_queue_.remove(dir.id);
   watched_dirs_.remove(dir.id);
 
   // Stop watching the directory's subdirectories
@@ -623,14 +856,54 @@ void LibraryWatcher::DirectoryChanged(const QString& subdir) {
   // Queue the subdir for rescanning
   if (!rescan_queue_[dir.id].contains(subdir)) rescan_queue_[dir.id] << subdir;
 
+  // Any files already queued in this subdir will be picked up by the full
+  // rescan.
+  if (rescan_files_queue_.contains(dir.id)) {
+    rescan_files_queue_[dir.id].remove(subdir);
+  }
+
+  if (!rescan_paused_) rescan_timer_->start();
+}
+
+void LibraryWatcher::FilesChanged(const QString& subdir,
+                                  const QStringList& files) {
+  QHash<QString, Directory>::const_iterator it =
+      subdir_mapping_.constFind(subdir);
+  if (it == subdir_mapping_.constEnd()) {
+    return;
+  }
+  Directory dir = *it;
+
+  // The whole subdir is going to be rescanned anyway
+  if (rescan_queue_.value(dir.id).contains(subdir)) return;
+
+  qLog(Debug) << files.count() << "files changed in" << subdir;
+
+  rescan_files_queue_[dir.id][subdir] += QSet<QString>::fromList(files);
+
   if (!rescan_paused_) rescan_timer_->start();
 }
 
 void LibraryWatcher::RescanPathsNow() {
-  for (int dir : rescan_queue_.keys()) {
+  QList<int> dirs = rescan_queue_.keys();
+  for (int dir : rescan_files_queue_.keys()) {
+    if (!dirs.contains(dir)) dirs << dir;
+  }
+
+  for (int dir : dirs) {
     if (stop_requested_) return;
     ScanTransaction transaction(this, dir, false);
-    transaction.AddToProgressMax(rescan_queue_[dir].count());
+    const QMap<QString, QSet<QString>>& changed_files =
+        rescan_files_queue_[dir];
+    transaction.AddToProgressMax(rescan_queue_[dir].count() +
+                                 changed_files.count());
+
+    for (QMap<QString, QSet<QString>>::const_iterator it =
+             changed_files.constBegin();
+         it != changed_files.constEnd(); ++it) {
+      if (stop_requested_) return;
+      ScanChangedFiles(it.key(), it.value().toList(), &transaction);
+    }
 
     for (const QString& path : rescan_queue_[dir]) {
       if (stop_requested_) return;
@@ -643,6 +916,7 @@ void LibraryWatcher::RescanPathsNow() {
   }
 
   rescan_queue_.clear();
+  rescan_files_queue_.clear();
 
   emit CompilationsNeedUpdating();
 }
@@ -748,7 +1022,10 @@ void LibraryWatcher::SetRescanPausedAsync(bool pause) {
 
 void LibraryWatcher::SetRescanPaused(bool pause) {
   rescan_paused_ = pause;
-  if (!rescan_paused_ && !rescan_queue_.isEmpty()) RescanPathsNow();
+  if (!rescan_paused_ &&
+      (!rescan_queue_.isEmpty() || !rescan_files_queue_.isEmpty())) {
+    RescanPathsNow();
+  }
 }
 
 void LibraryWatcher::IncrementalScanAsync() {
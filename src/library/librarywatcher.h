@@ -19,10 +19,15 @@
 #define LIBRARYWATCHER_H
 
 #include "directory.h"
+#include "libraryfileindex.h"
 #include "core/song.h"
+#include "core/tagreaderclient.h"
+#include "core/taskmanager.h"
 
 #include <QHash>
 #include <QObject>
+#include <QQueue>
+#include <QSet>
 #include <QStringList>
 #include <QMap>
 
@@ -42,6 +47,14 @@ class LibraryWatcher : public QObject {
 
   static const char* kSettingsGroup;
 
+  // The number of ReadFiles requests that are kept in flight for each
+  // tagreader worker while scanning.
+  static const int kMaxPendingReadsPerWorker;
+
+  // New and updated songs are sent to the backend in batches of this size
+  // while a scan is still running.
+  static const int kSongsBatchSize;
+
   void set_backend(LibraryBackend* backend) { backend_ = backend; }
   void set_task_manager(TaskManager* task_manager) {
     task_manager_ = task_manager;
@@ -84,6 +97,10 @@ signals:
   // to the library.  Multiple calls to FindSongsInSubdirectory during one
   // transaction will only result in one call to
   // LibraryBackend::FindSongsInDirectory.
+  // Tags are read in chunks through a bounded window of asynchronous
+  // TagReaderClient::ReadFiles requests so that all the tagreader workers are
+  // kept busy while the directory walk carries on.  The results are collected
+  // in the order the requests were made.
   class ScanTransaction {
    public:
     ScanTransaction(LibraryWatcher* watcher, int dir, bool incremental,
@@ -98,6 +115,19 @@ signals:
 
     void AddToProgress(int n = 1);
     void AddToProgressMax(int n);
+    void AddToFilesScanned(int n);
+
+    // Reads the tags of the file in the background.  Files are sent to the
+    // tagreader in chunks, and if the window of pending reads is full this
+    // blocks until the oldest one has finished.  matching_song is the song
+    // already in the library for this file, or an invalid Song if the file is
+    // new.
+    void QueueReadFile(const QString& file, const QString& image,
+                       const Song& matching_song);
+    // Waits for all pending reads to finish and adds their results.
+    void FlushPendingReads();
+    // Sends the new and updated songs found so far to the backend.
+    void CommitNewOrUpdatedSongs();
 
     int dir() const { return dir_; }
     bool is_incremental() const { return incremental_; }
@@ -109,15 +139,39 @@ signals:
     SongList touched_songs;
     SubdirectoryList new_subdirs;
     SubdirectoryList touched_subdirs;
+    // The contents of each scanned subdirectory, written to the file index
+    // when the transaction is committed.
+    QMap<QString, LibraryFileIndex::EntryList> file_index_updates;
 
    private:
+    struct PendingFile {
+      QString file;
+      QString image;
+      Song matching_song;
+    };
+
+    struct PendingRead {
+      QList<PendingFile> files;
+      TagReaderReply* reply;
+    };
+
     ScanTransaction(const ScanTransaction&) {}
     ScanTransaction& operator=(const ScanTransaction&) { return *this; }
 
+    void SendUnsentFiles();
+    void FinishOldestRead();
+
     int task_id_;
     int progress_;
     int progress_max_;
 
+    TaskManager::ProgressReporter reporter_;
+    int files_scanned_;
+
+    QList<PendingFile> unsent_files_;
+    QQueue<PendingRead> pending_reads_;
+    int max_pending_reads_;
+
     int dir_;
     // Incremental scan enters a directory only if it has changed since the
     // last scan.
@@ -130,7 +184,8 @@ signals:
 
     LibraryWatcher* watcher_;
 
-    SongList cached_songs_;
+    // Songs in the directory, keyed by the path of the subdirectory they are in
+    QHash<QString, SongList> cached_songs_;
     bool cached_songs_dirty_;
 
     SubdirectoryList known_subdirs_;
@@ -139,11 +194,23 @@ signals:
 
  private slots:
   void DirectoryChanged(const QString& path);
+  void FilesChanged(const QString& path, const QStringList& files);
   void IncrementalScanNow();
   void FullScanNow();
   void RescanPathsNow();
   void ScanSubdirectory(const QString& path, const Subdirectory& subdir,
                         ScanTransaction* t, bool force_noincremental = false);
+  // True for directories that aren't scanned: symlinks to somewhere that's
+  // already in the library, and directories with a .nomedia or .nomusic file.
+  bool IsExcludedDirectory(const QString& path) const;
+  // Uses the file index to rescan only the files in a subdirectory that have
+  // changed since it was last scanned.  Returns false if the subdirectory
+  // needs a normal scan instead.
+  bool ScanIndexedSubdirectory(const QString& path, ScanTransaction* t);
+  // Rescans only the given files in a subdirectory, falling back to
+  // ScanSubdirectory if a cue sheet or image changed.
+  void ScanChangedFiles(const QString& path, const QStringList& files,
+                        ScanTransaction* t);
 
  private:
   static bool FindSongByPath(const SongList& list, const QString& path,
@@ -155,7 +222,15 @@ signals:
   QString ImageForSong(const QString& path,
                        QMap<QString, QStringList>& album_art);
   void AddWatch(const Directory& dir, const QString& path);
+  // Compares a single file on disk with its entry in songs_in_db, queueing
+  // a tag read if it is new or has changed.  Returns false if the file has
+  // disappeared.
+  bool ScanFile(const QString& file, const QString& path,
+                const SongList& songs_in_db,
+                QMap<QString, QStringList>& album_art,
+                QSet<QString>* cues_processed, ScanTransaction* t);
   uint GetMtimeForCue(const QString& cue_path);
+  QString FileIndexFilename() const;
   void PerformScan(bool incremental, bool ignore_mtimes);
 
   // Updates the sections of a cue associated and altered (according to mtime)
@@ -177,10 +252,11 @@ signals:
   // Scans a single media file that's present on the disk but not yet in the
   // library.
   // It may result in a multiple files added to the library when the media file
-  // has many sections (like a CUE related media file).
-  SongList ScanNewFile(const QString& file, const QString& path,
-                       const QString& matching_cue,
-                       QSet<QString>* cues_processed);
+  // has many sections (like a CUE related media file).  Other files have their
+  // tags read in the background and are added when the read finishes.
+  void ScanNewFile(const QString& file, const QString& path,
+                   const QString& matching_cue, const QString& image,
+                   QSet<QString>* cues_processed, ScanTransaction* t);
 
  private:
   LibraryBackend* backend_;
@@ -188,6 +264,7 @@ signals:
   QString device_name_;
 
   FileSystemWatcherInterface* fs_watcher_;
+  LibraryFileIndex file_index_;
   QHash<QString, Directory> subdir_mapping_;
 
   /* A list of words use to try to identify the (likely) best image
@@ -205,6 +282,8 @@ signals:
   QTimer* rescan_timer_;
   QMap<int, QStringList>
       rescan_queue_;  // dir id -> list of subdirs to be scanned
+  QMap<int, QMap<QString, QSet<QString>>>
+      rescan_files_queue_;  // dir id -> subdir -> changed file names
   bool rescan_paused_;
 
   int total_watches_;
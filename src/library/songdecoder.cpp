@@ -0,0 +1,317 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "songdecoder.h"
+
+#include <sqlite3.h>
+
+#include <QFileInfo>
+#include <QSqlDriver>
+#include <QUrl>
+#include <QVariant>
+
+#include "core/application.h"
+#include "core/logging.h"
+
+namespace {
+
+// Column offsets, the same as the ones used by Song::InitFromQuery.
+enum Column {
+  Col_Id = 0,
+  Col_Title,
+  Col_Album,
+  Col_Artist,
+  Col_AlbumArtist,
+  Col_Composer,
+  Col_Track,
+  Col_Disc,
+  Col_Bpm,
+  Col_Year,
+  Col_Genre,
+  Col_Comment,
+  Col_Compilation,
+  Col_Bitrate,
+  Col_Samplerate,
+  Col_DirectoryId,
+  Col_Filename,
+  Col_Mtime,
+  Col_Ctime,
+  Col_Filesize,
+  Col_Sampler,
+  Col_ArtAutomatic,
+  Col_ArtManual,
+  Col_FileType,
+  Col_PlayCount,
+  Col_LastPlayed,
+  Col_Rating,
+  Col_ForcedCompilationOn,
+  Col_ForcedCompilationOff,
+  Col_EffectiveCompilation,
+  Col_SkipCount,
+  Col_Score,
+  Col_Beginning,
+  Col_Length,
+  Col_CuePath,
+  Col_Unavailable,
+  Col_EffectiveAlbumArtist,
+  Col_Etag,
+  Col_Performer,
+  Col_Grouping,
+  Col_Lyrics,
+  Col_OriginalYear,
+
+  ColumnCount
+};
+
+bool IsNull(sqlite3_stmt* stmt, int col) {
+  return sqlite3_column_type(stmt, col) == SQLITE_NULL;
+}
+
+// Null integers are -1, like in Song::InitFromQuery.
+int Int(sqlite3_stmt* stmt, int col) {
+  return IsNull(stmt, col) ? -1 : sqlite3_column_int(stmt, col);
+}
+
+qint64 Int64(sqlite3_stmt* stmt, int col) {
+  return IsNull(stmt, col) ? -1 : sqlite3_column_int64(stmt, col);
+}
+
+double Double(sqlite3_stmt* stmt, int col) {
+  return IsNull(stmt, col) ? -1 : sqlite3_column_double(stmt, col);
+}
+
+bool Bool(sqlite3_stmt* stmt, int col) {
+  return sqlite3_column_int(stmt, col) != 0;
+}
+
+// Returns the last path segment of an encoded file:// URL, which is what
+// QFileInfo(url.toLocalFile()).fileName() would return.
+QString BaseFilename(const char* data, int length) {
+  if (length < 5 || qstrncmp(data, "file:", 5) != 0) return QString();
+
+  int start = length;
+  while (start > 0 && data[start - 1] != '/') --start;
+
+  return QUrl::fromPercentEncoding(
+      QByteArray::fromRawData(data + start, length - start));
+}
+
+}  // namespace
+
+SongDecoder::SongDecoder(bool reliable_metadata)
+    : reliable_metadata_(reliable_metadata) {}
+
+bool SongDecoder::IsSupported(QSqlDatabase db) {
+  QVariant handle = db.driver()->handle();
+  return handle.isValid() && qstrcmp(handle.typeName(), "sqlite3*") == 0;
+}
+
+bool SongDecoder::Exec(QSqlDatabase db, const QString& sql,
+                       const QVariantList& bound_values, SongList* songs) {
+  if (!IsSupported(db)) {
+    qLog(Error) << "Not an sqlite database" << db.driverName();
+    return false;
+  }
+
+  sqlite3* handle = *static_cast<sqlite3**>(db.driver()->handle().data());
+
+  sqlite3_stmt* stmt = nullptr;
+  const QByteArray sql_utf8 = sql.toUtf8();
+  if (sqlite3_prepare_v2(handle, sql_utf8.constData(), sql_utf8.size(), &stmt,
+                         nullptr) != SQLITE_OK) {
+    qLog(Error) << "Failed to prepare query" << sqlite3_errmsg(handle) << sql;
+    return false;
+  }
+
+  if (sqlite3_column_count(stmt) < ColumnCount) {
+    qLog(Error) << "Query doesn't return every song column" << sql;
+    sqlite3_finalize(stmt);
+    return false;
+  }
+
+  if (!BindValues(stmt, bound_values)) {
+    qLog(Error) << "Failed to bind values" << sqlite3_errmsg(handle) << sql;
+    sqlite3_finalize(stmt);
+    return false;
+  }
+
+  int rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    Song song;
+    DecodeRow(stmt, &song);
+    songs->append(song);
+  }
+
+  if (rc != SQLITE_DONE) {
+    qLog(Error) << "Query failed" << sqlite3_errmsg(handle) << sql;
+  }
+
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE;
+}
+
+bool SongDecoder::BindValues(sqlite3_stmt* stmt, const QVariantList& values) {
+  for (int i = 0; i < values.count(); ++i) {
+    const QVariant& value = values[i];
+    const int index = i + 1;
+    int rc;
+
+    if (value.isNull()) {
+      rc = sqlite3_bind_null(stmt, index);
+    } else {
+      switch (value.type()) {
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+          rc = sqlite3_bind_int64(stmt, index, value.toLongLong());
+          break;
+
+        case QVariant::Double:
+          rc = sqlite3_bind_double(stmt, index, value.toDouble());
+          break;
+
+        case QVariant::ByteArray: {
+          const QByteArray data = value.toByteArray();
+          rc = sqlite3_bind_blob(stmt, index, data.constData(), data.size(),
+                                 SQLITE_TRANSIENT);
+          break;
+        }
+
+        default: {
+          const QString text = value.toString();
+          rc = sqlite3_bind_text16(stmt, index, text.utf16(),
+                                   text.size() * sizeof(ushort),
+                                   SQLITE_TRANSIENT);
+          break;
+        }
+      }
+    }
+
+    if (rc != SQLITE_OK) return false;
+  }
+  return true;
+}
+
+QString SongDecoder::Text(sqlite3_stmt* stmt, int col) const {
+  if (IsNull(stmt, col)) return QString();
+
+  const char* data =
+      reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+  return QString::fromUtf8(data, sqlite3_column_bytes(stmt, col));
+}
+
+QString SongDecoder::SharedText(sqlite3_stmt* stmt, int col) {
+  if (IsNull(stmt, col)) return QString();
+
+  const char* data =
+      reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+  const int length = sqlite3_column_bytes(stmt, col);
+
+  // Look the string up without copying the bytes sqlite gave us.
+  const QByteArray key = QByteArray::fromRawData(data, length);
+  QHash<QByteArray, QString>::const_iterator it = strings_.constFind(key);
+  if (it != strings_.constEnd()) return it.value();
+
+  const QString ret = QString::fromUtf8(data, length);
+  strings_.insert(QByteArray(data, length), ret);
+  return ret;
+}
+
+void SongDecoder::DecodeRow(sqlite3_stmt* stmt, Song* song) {
+  song->set_valid(true);
+  song->set_init_from_file(reliable_metadata_);
+
+  song->set_id(Int(stmt, Col_Id));
+  song->set_title(Text(stmt, Col_Title));
+  song->set_album(SharedText(stmt, Col_Album));
+  song->set_artist(SharedText(stmt, Col_Artist));
+  song->set_albumartist(SharedText(stmt, Col_AlbumArtist));
+  song->set_composer(SharedText(stmt, Col_Composer));
+  song->set_track(Int(stmt, Col_Track));
+  song->set_disc(Int(stmt, Col_Disc));
+  song->set_bpm(Double(stmt, Col_Bpm));
+  song->set_year(Int(stmt, Col_Year));
+  song->set_originalyear(Int(stmt, Col_OriginalYear));
+  song->set_genre(SharedText(stmt, Col_Genre));
+  song->set_comment(SharedText(stmt, Col_Comment));
+  song->set_compilation(Bool(stmt, Col_Compilation));
+
+  song->set_bitrate(Int(stmt, Col_Bitrate));
+  song->set_samplerate(Int(stmt, Col_Samplerate));
+
+  song->set_directory_id(Int(stmt, Col_DirectoryId));
+
+  // QUrl parses the encoded URL lazily, so this is cheap as long as we don't
+  // call toLocalFile() on it.
+  const char* filename =
+      reinterpret_cast<const char*>(sqlite3_column_blob(stmt, Col_Filename));
+  const int filename_length = sqlite3_column_bytes(stmt, Col_Filename);
+  song->set_url(QUrl::fromEncoded(QByteArray(filename, filename_length)));
+  if (Application::kIsPortable) {
+    // The URL might have been relative to the application directory.
+    song->set_basefilename(QFileInfo(song->url().toLocalFile()).fileName());
+  } else {
+    song->set_basefilename(BaseFilename(filename, filename_length));
+  }
+
+  song->set_mtime(Int(stmt, Col_Mtime));
+  song->set_ctime(Int(stmt, Col_Ctime));
+  song->set_filesize(Int(stmt, Col_Filesize));
+
+  song->set_sampler(Bool(stmt, Col_Sampler));
+
+  song->set_art_automatic(SharedText(stmt, Col_ArtAutomatic));
+  song->set_art_manual(SharedText(stmt, Col_ArtManual));
+
+  song->set_filetype(Song::FileType(sqlite3_column_int(stmt, Col_FileType)));
+  song->set_playcount(sqlite3_column_int(stmt, Col_PlayCount));
+  song->set_lastplayed(Int(stmt, Col_LastPlayed));
+  song->set_rating(Double(stmt, Col_Rating));
+
+  song->set_forced_compilation_on(Bool(stmt, Col_ForcedCompilationOn));
+  song->set_forced_compilation_off(Bool(stmt, Col_ForcedCompilationOff));
+
+  song->set_skipcount(sqlite3_column_int(stmt, Col_SkipCount));
+  song->set_score(sqlite3_column_int(stmt, Col_Score));
+
+  // The beginning must be set before the length.
+  song->set_beginning_nanosec(sqlite3_column_int64(stmt, Col_Beginning));
+  song->set_length_nanosec(Int64(stmt, Col_Length));
+
+  song->set_cue_path(SharedText(stmt, Col_CuePath));
+  song->set_unavailable(Bool(stmt, Col_Unavailable));
+
+  song->set_performer(SharedText(stmt, Col_Performer));
+  song->set_grouping(SharedText(stmt, Col_Grouping));
+  song->set_lyrics(Text(stmt, Col_Lyrics));
+
+  // Songs without art look for it in the cache, which means hashing the
+  // artist and album and checking whether a file exists.  Do that once per
+  // album rather than once per song.
+  if (song->art_automatic().isEmpty() && song->art_manual().isEmpty()) {
+    const QPair<QString, QString> key(song->artist(), song->album());
+    QHash<QPair<QString, QString>, QString>::const_iterator it =
+        art_manual_.constFind(key);
+    if (it == art_manual_.constEnd()) {
+      song->InitArtManual();
+      art_manual_.insert(key, song->art_manual());
+    } else {
+      song->set_art_manual(it.value());
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SONGDECODER_H
+#define SONGDECODER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariantList>
+
+#include "core/song.h"
+
+struct sqlite3_stmt;
+
+// Runs a query whose columns are "ROWID, " + Song::kColumnSpec and decodes
+// every row into a Song, reading the columns straight from sqlite instead of
+// going through QSqlQuery and QVariant.  This is much cheaper than
+// Song::InitFromQuery when loading thousands of songs at once:
+//  - strings that repeat between rows, like artists and albums, are decoded
+//    once and then share the same QString data,
+//  - the base filename is taken from the encoded URL without parsing it, and
+//  - the album art cache is only checked once per album.
+// A decoder can be reused for several queries on the same thread; strings
+// are shared across all of them.
+class SongDecoder {
+ public:
+  explicit SongDecoder(bool reliable_metadata = true);
+
+  // Returns false if the database isn't an sqlite database.
+  static bool IsSupported(QSqlDatabase db);
+
+  // Values are bound positionally.  Decoded songs are appended to songs.
+  // Returns false and logs the error if the query failed.
+  bool Exec(QSqlDatabase db, const QString& sql,
+            const QVariantList& bound_values, SongList* songs);
+
+ private:
+  bool BindValues(sqlite3_stmt* stmt, const QVariantList& values);
+  void DecodeRow(sqlite3_stmt* stmt, Song* song);
+
+  QString Text(sqlite3_stmt* stmt, int col) const;
+  QString SharedText(sqlite3_stmt* stmt, int col);
+
+  bool reliable_metadata_;
+
+  QHash<QByteArray, QString> strings_;
+  QHash<QPair<QString, QString>, QString> art_manual_;
+};
+
+#endif  // SONGDECODER_H
@@ -25,6 +25,8 @@ SqlRow::SqlRow(const QSqlQuery& query) { Init(query); }
 
 SqlRow::SqlRow(const LibraryQuery& query) { Init(query); }
 
+SqlRow::SqlRow(const QVariantList& columns) : columns_(columns) {}
+
 void SqlRow::Init(const QSqlQuery& query) {
   int rows = query.record().count();
   for (int i = 0; i < rows; ++i) {
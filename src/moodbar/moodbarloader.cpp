@@ -23,9 +23,11 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QNetworkDiskCache>
+#include <QSettings>
 #include <QTimer>
 #include <QThread>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 #include "moodbarpipeline.h"
 #include "core/application.h"
@@ -33,22 +35,40 @@
 #include "core/logging.h"
 #include "core/qhash_qurl.h"
 #include "core/utilities.h"
+#include "library/librarybackend.h"
 
 #ifdef Q_OS_WIN32
 #include <windows.h>
 #endif
 
+const char* MoodbarLoader::kSettingsGroup = "Moodbar";
+
+// Enough for 20,000 moodbars.
+const qint64 MoodbarLoader::kDefaultCacheBytes = 60 * 1024 * 1024;  // 60MB
+const qint64 MoodbarLoader::kCacheBytesPerMoodbar = 4 * 1024;      // 4kB
+
 MoodbarLoader::MoodbarLoader(Application* app, QObject* parent)
     : QObject(parent),
+      app_(app),
       cache_(new QNetworkDiskCache(this)),
       thread_(new QThread(this)),
       kMaxActiveRequests(qMax(1, QThread::idealThreadCount() / 2)),
+      kMaxPrecomputeRequests(qMax(1, QThread::idealThreadCount())),
+      precomputing_(false),
+      precompute_task_id_(-1),
+      precompute_done_(0),
+      precompute_total_(0),
+      precompute_generated_(0),
       save_alongside_originals_(false),
       disable_moodbar_calculation_(false) {
   cache_->setCacheDirectory(
       Utilities::GetConfigPath(Utilities::Path_MoodbarCache));
-  cache_->setMaximumCacheSize(60 * 1024 *
-                              1024);  // 60MB - enough for 20,000 moodbars
+
+  // The precompute job makes the cache bigger if the library needs it.
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  cache_->setMaximumCacheSize(
+      qMax(kDefaultCacheBytes, s.value("cache_size", 0).toLongLong()));
 
   connect(app, SIGNAL(SettingsChanged()), SLOT(ReloadSettings()));
   ReloadSettings();
@@ -61,7 +81,7 @@ MoodbarLoader::~MoodbarLoader() {
 
 void MoodbarLoader::ReloadSettings() {
   QSettings s;
-  s.beginGroup("Moodbar");
+  s.beginGroup(kSettingsGroup);
   save_alongside_originals_ =
       s.value("save_alongside_originals", false).toBool();
 
@@ -116,36 +136,85 @@ MoodbarLoader::Result MoodbarLoader::Load(const QUrl& url, QByteArray* data,
     }
   }
 
+  // There was no existing file, analyze the audio file and create one.
+  MoodbarPipeline* pipeline = CreatePipeline(url);
+  queued_requests_ << url;
+
+  MaybeTakeNextRequest();
+
+  *async_pipeline = pipeline;
+  return WillLoadAsync;
+}
+
+MoodbarPipeline* MoodbarLoader::CreatePipeline(const QUrl& url) {
   if (!thread_->isRunning()) thread_->start(QThread::IdlePriority);
 
-  // There was no existing file, analyze the audio file and create one.
   MoodbarPipeline* pipeline = new MoodbarPipeline(url);
   pipeline->moveToThread(thread_);
   NewClosure(pipeline, SIGNAL(Finished(bool)), this,
              SLOT(RequestFinished(MoodbarPipeline*, QUrl)), pipeline, url);
 
   requests_[url] = pipeline;
-  queued_requests_ << url;
+  return pipeline;
+}
 
-  MaybeTakeNextRequest();
+void MoodbarLoader::StartPipeline(const QUrl& url) {
+  active_requests_ << url;
 
-  *async_pipeline = pipeline;
-  return WillLoadAsync;
+  qLog(Info) << "Creating moodbar data for" << url.toLocalFile();
+  QMetaObject::invokeMethod(requests_[url], "Start", Qt::QueuedConnection);
+}
+
+bool MoodbarLoader::HasCachedData(const QUrl& url) const {
+  return cache_->metaData(url).isValid();
+}
+
+bool MoodbarLoader::HasData(const QUrl& url) const {
+  if (url.scheme() != "file") return false;
+
+  for (const QString& mood_file : MoodFilenames(url.toLocalFile())) {
+    if (QFile::exists(mood_file)) return true;
+  }
+  return HasCachedData(url);
 }
 
 void MoodbarLoader::MaybeTakeNextRequest() {
   Q_ASSERT(QThread::currentThread() == qApp->thread());
 
-  if (active_requests_.count() >= kMaxActiveRequests ||
-      queued_requests_.isEmpty() || disable_moodbar_calculation_) {
+  if (disable_moodbar_calculation_) {
+    // Give up on the rest of the precompute job.  It finishes when the songs
+    // it's already working on are done.
+    precompute_done_ += precompute_queue_.count();
+    precompute_queue_.clear();
+    UpdatePrecomputeProgress();
     return;
   }
 
-  const QUrl url = queued_requests_.takeFirst();
-  active_requests_ << url;
+  // Songs someone is looking at come first, and don't have to wait for the
+  // precompute job to free up a slot.
+  while (!queued_requests_.isEmpty() &&
+         active_requests_.count() - active_precompute_requests_.count() <
+             kMaxActiveRequests) {
+    StartPipeline(queued_requests_.takeFirst());
+  }
 
-  qLog(Info) << "Creating moodbar data for" << url.toLocalFile();
-  QMetaObject::invokeMethod(requests_[url], "Start", Qt::QueuedConnection);
+  // The precompute job gets whatever cores are left.
+  while (!precompute_queue_.isEmpty() &&
+         active_requests_.count() < kMaxPrecomputeRequests) {
+    const QUrl url = precompute_queue_.takeFirst();
+
+    // Someone may have asked for it through Load() since the list was made.
+    if (requests_.contains(url) || HasCachedData(url)) {
+      precompute_done_++;
+      continue;
+    }
+
+    CreatePipeline(url);
+    active_precompute_requests_ << url;
+    StartPipeline(url);
+  }
+
+  UpdatePrecomputeProgress();
 }
 
 void MoodbarLoader::RequestFinished(MoodbarPipeline* request, const QUrl& url) {
@@ -154,43 +223,156 @@ void MoodbarLoader::RequestFinished(MoodbarPipeline* request, const QUrl& url) {
   if (request->success()) {
     qLog(Info) << "Moodbar data generated successfully for"
                << url.toLocalFile();
+    SaveData(url, request->data());
+  }
 
-    // Save the data in the cache
-    QNetworkCacheMetaData metadata;
-    metadata.setUrl(url);
+  // Remove the request from the active list and delete it
+  requests_.remove(url);
+  active_requests_.remove(url);
 
-    QIODevice* cache_file = cache_->prepare(metadata);
-    if (cache_file) {
-      cache_file->write(request->data());
-      cache_->insert(cache_file);
-    }
+  if (active_precompute_requests_.remove(url)) {
+    precompute_done_++;
+    if (request->success()) precompute_generated_++;
+  }
 
-    // Save the data alongside the original as well if we're configured to.
-    if (save_alongside_originals_) {
-      const QString mood_filename(MoodFilenames(url.toLocalFile())[0]);
-      QFile mood_file(mood_filename);
-      if (mood_file.open(QIODevice::WriteOnly)) {
-        mood_file.write(request->data());
+  QTimer::singleShot(1000, request, SLOT(deleteLater()));
+
+  MaybeTakeNextRequest();
+}
+
+void MoodbarLoader::SaveData(const QUrl& url, const QByteArray& data) {
+  // Save the data in the cache
+  QNetworkCacheMetaData metadata;
+  metadata.setUrl(url);
+
+  QIODevice* cache_file = cache_->prepare(metadata);
+  if (cache_file) {
+    cache_file->write(data);
+    cache_->insert(cache_file);
+  }
+
+  // Save the data alongside the original as well if we're configured to.
+  if (save_alongside_originals_) {
+    const QString mood_filename(MoodFilenames(url.toLocalFile())[0]);
+    QFile mood_file(mood_filename);
+    if (mood_file.open(QIODevice::WriteOnly)) {
+      mood_file.write(data);
 
 #ifdef Q_OS_WIN32
-        if (!SetFileAttributes((LPCTSTR)mood_filename.utf16(),
-                               FILE_ATTRIBUTE_HIDDEN)) {
-          qLog(Warning) << "Error setting hidden attribute for file"
-                        << mood_filename;
-        }
+      if (!SetFileAttributes((LPCTSTR)mood_filename.utf16(),
+                             FILE_ATTRIBUTE_HIDDEN)) {
+        qLog(Warning) << "Error setting hidden attribute for file"
+                      << mood_filename;
+      }
 #endif
 
-      } else {
-        qLog(Warning) << "Error opening mood file for writing" << mood_filename;
+    } else {
+      qLog(Warning) << "Error opening mood file for writing" << mood_filename;
+    }
+  }
+}
+
+bool MoodbarLoader::IsPrecomputePending() {
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  return s.value("precompute_pending", false).toBool();
+}
+
+void MoodbarLoader::PrecomputeLibrary() {
+  if (precomputing_) return;
+
+  if (disable_moodbar_calculation_) {
+    qLog(Info) << "Not generating library moodbars, calculation is disabled";
+    return;
+  }
+
+  precomputing_ = true;
+  precompute_task_id_ =
+      app_->task_manager()->StartTask(tr("Generating library moodbars"));
+
+  // Remember that we're running so we can carry on after a restart.
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  s.setValue("precompute_pending", true);
+
+  QFuture<QList<QUrl>> future = QtConcurrent::run(
+      &MoodbarLoader::FindSongsWithoutMoodFiles, app_->library_backend());
+  NewClosure(future, this, SLOT(PrecomputeListReady(QFuture<QList<QUrl>>)),
+             future);
+}
+
+QList<QUrl> MoodbarLoader::FindSongsWithoutMoodFiles(LibraryBackend* backend) {
+  QList<QUrl> ret;
+  QSet<QUrl> seen;
+
+  for (const Song& song : backend->GetAllSongs()) {
+    const QUrl& url = song.url();
+    if (url.scheme() != "file" || song.is_unavailable()) continue;
+
+    // Songs from the same cue sheet share a file.
+    if (seen.contains(url)) continue;
+    seen << url;
+
+    bool has_mood_file = false;
+    for (const QString& mood_file : MoodFilenames(url.toLocalFile())) {
+      if (QFile::exists(mood_file)) {
+        has_mood_file = true;
+        break;
       }
     }
+
+    if (!has_mood_file) ret << url;
   }
 
-  // Remove the request from the active list and delete it
-  requests_.remove(url);
-  active_requests_.remove(url);
+  return ret;
+}
 
-  QTimer::singleShot(1000, request, SLOT(deleteLater()));
+void MoodbarLoader::PrecomputeListReady(QFuture<QList<QUrl>> future) {
+  precompute_queue_ = future.result();
+  precompute_done_ = 0;
+  precompute_total_ = precompute_queue_.count();
+  precompute_generated_ = 0;
+  precompute_progress_.Start(app_->task_manager(), precompute_task_id_,
+                             tr("moodbars"));
+
+  qLog(Info) << precompute_total_ << "library songs have no moodbar file";
+
+  // Make sure the cache can hold a moodbar for every one of them, or it would
+  // throw away the job's own results to make room for more.
+  const qint64 cache_size =
+      kDefaultCacheBytes + qint64(precompute_total_) * kCacheBytesPerMoodbar;
+  if (cache_size > cache_->maximumCacheSize()) {
+    qLog(Info) << "Increasing the moodbar cache to" << cache_size / 1024 / 1024
+               << "MB";
+    cache_->setMaximumCacheSize(cache_size);
+
+    QSettings s;
+    s.beginGroup(kSettingsGroup);
+    s.setValue("cache_size", cache_size);
+  }
 
   MaybeTakeNextRequest();
 }
+
+void MoodbarLoader::UpdatePrecomputeProgress() {
+  // The task is still looking for songs until precompute_progress_ starts.
+  if (!precomputing_ || !precompute_progress_.is_started()) return;
+
+  if (precompute_queue_.isEmpty() && active_precompute_requests_.isEmpty()) {
+    qLog(Info) << "Generated" << precompute_generated_
+               << "library moodbars in"
+               << precompute_progress_.elapsed_msec() / 1000 << "seconds";
+
+    precompute_progress_.Finish();
+    precomputing_ = false;
+    precompute_task_id_ = -1;
+
+    QSettings s;
+    s.beginGroup(kSettingsGroup);
+    s.remove("precompute_pending");
+    return;
+  }
+
+  precompute_progress_.Update(precompute_done_, precompute_total_,
+                              precompute_generated_);
+}
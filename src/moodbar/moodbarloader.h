@@ -18,14 +18,18 @@
 #ifndef MOODBARLOADER_H
 #define MOODBARLOADER_H
 
+#include <QFuture>
 #include <QMap>
 #include <QObject>
 #include <QSet>
 
+#include "core/taskmanager.h"
+
 class QNetworkDiskCache;
 class QUrl;
 
 class Application;
+class LibraryBackend;
 class MoodbarPipeline;
 
 class MoodbarLoader : public QObject {
@@ -51,25 +55,68 @@ class MoodbarLoader : public QObject {
   Result Load(const QUrl& url, QByteArray* data,
               MoodbarPipeline** async_pipeline);
 
+  // True if Load() would find data for this file without generating it.
+  bool HasData(const QUrl& url) const;
+
+  // Stores moodbar data that was generated somewhere else, so Load() finds it
+  // next time.
+  void SaveData(const QUrl& url, const QByteArray& data);
+
+  // True if PrecomputeLibrary() was interrupted by quitting Clementine.
+  static bool IsPrecomputePending();
+
+ public slots:
+  // Generates moodbar data for every song in the library that has none yet,
+  // using all cores once nothing else is waiting.  If Clementine quits before
+  // the job is done it should be started again on the next run; songs that
+  // got their moodbars in the meantime are skipped.
+  void PrecomputeLibrary();
+
  private slots:
   void ReloadSettings();
 
   void RequestFinished(MoodbarPipeline* request, const QUrl& filename);
   void MaybeTakeNextRequest();
 
+  void PrecomputeListReady(QFuture<QList<QUrl>> future);
+
  private:
   static QStringList MoodFilenames(const QString& song_filename);
+  static QList<QUrl> FindSongsWithoutMoodFiles(LibraryBackend* backend);
+
+  MoodbarPipeline* CreatePipeline(const QUrl& url);
+  void StartPipeline(const QUrl& url);
+  bool HasCachedData(const QUrl& url) const;
+
+  void UpdatePrecomputeProgress();
 
  private:
+  static const char* kSettingsGroup;
+  static const qint64 kDefaultCacheBytes;
+  static const qint64 kCacheBytesPerMoodbar;
+
+  Application* app_;
   QNetworkDiskCache* cache_;
   QThread* thread_;
 
   const int kMaxActiveRequests;
+  const int kMaxPrecomputeRequests;
 
   QMap<QUrl, MoodbarPipeline*> requests_;
   QList<QUrl> queued_requests_;
   QSet<QUrl> active_requests_;
 
+  // The library precompute job.  Its requests share requests_ and
+  // active_requests_ with the ones made through Load().
+  bool precomputing_;
+  int precompute_task_id_;
+  QList<QUrl> precompute_queue_;
+  QSet<QUrl> active_precompute_requests_;
+  int precompute_done_;
+  int precompute_total_;
+  int precompute_generated_;
+  TaskManager::ProgressReporter precompute_progress_;
+
   bool save_alongside_originals_;
   bool disable_moodbar_calculation_;
 };
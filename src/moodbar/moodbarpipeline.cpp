@@ -169,6 +169,17 @@ GstBusSyncReply MoodbarPipeline::BusCallbackSync(GstBus*, GstMessage* msg,
       self->Stop(false);
       break;
 
+    case GST_MESSAGE_STREAM_STATUS: {
+      // Streaming threads post this from themselves when they start, so this
+      // is where we can lower the IO priority of the thread doing the reads.
+      GstStreamStatusType type;
+      gst_message_parse_stream_status(msg, &type, nullptr);
+      if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        Utilities::SetThreadIOPriority(Utilities::IOPRIO_CLASS_IDLE);
+      }
+      break;
+    }
+
     default:
       break;
   }
@@ -38,6 +38,9 @@ class MoodbarPipeline : public QObject {
 
   static bool IsAvailable();
 
+  // For other pipelines that want to make the same moodbars.
+  static const int kBands;
+
   bool success() const { return success_; }
   const QByteArray& data() const { return data_; }
 
@@ -62,7 +65,6 @@ class MoodbarPipeline : public QObject {
 
  private:
   static bool sIsAvailable;
-  static const int kBands;
 
   QUrl local_filename_;
   GstElement* pipeline_;
@@ -99,7 +99,7 @@ void IncomingDataParser::Parse(const pb::remote::Message& msg) {
       SendPlaylists(msg);
       break;
     case pb::remote::REQUEST_PLAYLIST_SONGS:
-      GetPlaylistSongs(msg);
+      GetPlaylistSongs(client, msg);
       break;
     case pb::remote::SET_VOLUME:
       emit SetVolume(msg.request_set_volume().volume());
@@ -168,7 +168,7 @@ void IncomingDataParser::Parse(const pb::remote::Message& msg) {
       client->song_sender()->ResponseSongOffer(msg.response_song_offer().accepted());
       break;
     case pb::remote::GET_LIBRARY:
-      emit SendLibrary(client);
+      GetLibrary(client, msg);
       break;
     case pb::remote::RATE_SONG:
       RateSong(msg);
@@ -181,8 +181,24 @@ void IncomingDataParser::Parse(const pb::remote::Message& msg) {
   }
 }
 
-void IncomingDataParser::GetPlaylistSongs(const pb::remote::Message& msg) {
-  emit SendPlaylistSongs(msg.request_playlist_songs().id());
+void IncomingDataParser::GetPlaylistSongs(RemoteClient* client,
+                                          const pb::remote::Message& msg) {
+  const pb::remote::RequestPlaylistSongs& request =
+      msg.request_playlist_songs();
+
+  // Without a revision the client wants the whole playlist again.
+  client->set_playlist_revision(
+      request.id(),
+      request.has_known_revision() ? request.known_revision() : -1);
+  emit SendPlaylistSongs(request.id(), client);
+}
+
+void IncomingDataParser::GetLibrary(RemoteClient* client,
+                                    const pb::remote::Message& msg) {
+  client->set_library_revision(msg.request_library().has_known_revision()
+                                   ? msg.request_library().known_revision()
+                                   : -1);
+  emit SendLibrary(client);
 }
 
 void IncomingDataParser::ChangeSong(const pb::remote::Message& msg) {
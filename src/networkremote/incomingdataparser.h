@@ -22,7 +22,7 @@ signals:
   void SendFirstData(bool send_playlist_songs);
   void SendAllPlaylists();
   void SendAllActivePlaylists();
-  void SendPlaylistSongs(int id);
+  void SendPlaylistSongs(int id, RemoteClient* client);
   void Open(int id);
   void Close(int id);
   void GetLyrics();
@@ -57,7 +57,8 @@ signals:
   Application* app_;
   bool close_connection_;
 
-  void GetPlaylistSongs(const pb::remote::Message& msg);
+  void GetPlaylistSongs(RemoteClient* client, const pb::remote::Message& msg);
+  void GetLibrary(RemoteClient* client, const pb::remote::Message& msg);
   void ChangeSong(const pb::remote::Message& msg);
   void SetRepeatMode(const pb::remote::Repeat& repeat);
   void SetShuffleMode(const pb::remote::Shuffle& shuffle);
@@ -128,8 +128,10 @@ void NetworkRemote::AcceptConnection() {
             outgoing_data_creator_.get(), SLOT(SendAllPlaylists()));
     connect(incoming_data_parser_.get(), SIGNAL(SendAllActivePlaylists()),
             outgoing_data_creator_.get(), SLOT(SendAllActivePlaylists()));
-    connect(incoming_data_parser_.get(), SIGNAL(SendPlaylistSongs(int)),
-            outgoing_data_creator_.get(), SLOT(SendPlaylistSongs(int)));
+    connect(incoming_data_parser_.get(),
+            SIGNAL(SendPlaylistSongs(int, RemoteClient*)),
+            outgoing_data_creator_.get(),
+            SLOT(SendPlaylistSongs(int, RemoteClient*)));
 
     connect(app_->playlist_manager(), SIGNAL(ActiveChanged(Playlist*)),
             outgoing_data_creator_.get(), SLOT(ActiveChanged(Playlist*)));
@@ -27,17 +27,21 @@
 #include "library/librarybackend.h"
 #include "ui/iconloader.h"
 
+#include <QDateTime>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include "core/database.h"
 
 const quint32 OutgoingDataCreator::kFileChunkSize = 100000;  // in Bytes
+const int OutgoingDataCreator::kMaxLibraryChanges = 1000;
 
 OutgoingDataCreator::OutgoingDataCreator(Application* app)
     : app_(app),
       aww_(false),
       ultimate_reader_(new UltimateLyricsReader(this)),
-      fetcher_(new SongInfoFetcher(this)) {
+      fetcher_(new SongInfoFetcher(this)),
+      library_revision_(QDateTime::currentMSecsSinceEpoch()),
+      library_base_revision_(library_revision_) {
   // Create Keep Alive Timer
   keep_alive_timer_ = new QTimer(this);
   connect(keep_alive_timer_, SIGNAL(timeout()), this, SLOT(SendKeepAlive()));
@@ -81,6 +85,19 @@ void OutgoingDataCreator::SetClients(QList<RemoteClient*>* clients) {
 
   connect(app_->global_search(), SIGNAL(SearchFinished(int)),
           SLOT(SearchFinished(int)), Qt::QueuedConnection);
+
+  // Keep track of what changed in the library, so clients that already have
+  // it can be sent just the difference
+  LibraryBackend* library = app_->library_backend();
+  connect(library, SIGNAL(SongsDiscovered(SongList)),
+          SLOT(LibrarySongsChanged(SongList)));
+  connect(library, SIGNAL(SongsStatisticsChanged(SongList)),
+          SLOT(LibrarySongsChanged(SongList)));
+  connect(library, SIGNAL(SongsRatingChanged(SongList)),
+          SLOT(LibrarySongsChanged(SongList)));
+  connect(library, SIGNAL(SongsDeleted(SongList)),
+          SLOT(LibrarySongsDeleted(SongList)));
+  connect(library, SIGNAL(DatabaseReset()), SLOT(LibraryReset()));
 }
 
 void OutgoingDataCreator::CheckEnabledProviders() {
@@ -150,6 +167,9 @@ void OutgoingDataCreator::SendDataToClients(pb::remote::Message* msg) {
     return;
   }
 
+  // Serialize the message only once, all the clients share the data
+  const RemoteClient::Frame frame = RemoteClient::MakeFrame(msg);
+
   for (RemoteClient* client : *clients_) {
     // Do not send data to downloaders
     if (client->isDownloader()) {
@@ -162,7 +182,7 @@ void OutgoingDataCreator::SendDataToClients(pb::remote::Message* msg) {
 
     // Check if the client is still active
     if (client->State() == QTcpSocket::ConnectedState) {
-      client->SendData(msg);
+      client->SendFrame(frame);
     } else {
       clients_->removeAt(clients_->indexOf(client));
       delete client;
@@ -280,9 +300,15 @@ void OutgoingDataCreator::PlaylistAdded(int id, const QString& name,
   SendAllActivePlaylists();
 }
 
-void OutgoingDataCreator::PlaylistDeleted(int id) { SendAllActivePlaylists(); }
+void OutgoingDataCreator::PlaylistDeleted(int id) {
+  playlist_trackers_.remove(id);
+  SendAllActivePlaylists();
+}
 
-void OutgoingDataCreator::PlaylistClosed(int id) { SendAllActivePlaylists(); }
+void OutgoingDataCreator::PlaylistClosed(int id) {
+  playlist_trackers_.remove(id);
+  SendAllActivePlaylists();
+}
 
 void OutgoingDataCreator::PlaylistRenamed(int id, const QString& new_name) {
   SendAllActivePlaylists();
@@ -413,21 +439,77 @@ void OutgoingDataCreator::VolumeChanged(int volume) {
   SendDataToClients(&msg);
 }
 
-void OutgoingDataCreator::SendPlaylistSongs(int id) {
-  // Get the PlaylistQByteArray(data.data(), data.size()
+void OutgoingDataCreator::SendPlaylistSongs(int id, RemoteClient* requester) {
+  // Get the Playlist
   Playlist* playlist = app_->playlist_manager()->playlist(id);
   if (!playlist) {
     qLog(Info) << "Could not find playlist with id = " << id;
     return;
   }
 
+  // Bring the playlist's revision up to date
+  PlaylistDeltaTracker& tracker = playlist_trackers_[id];
+  if (tracker.revision() == 0) {
+    tracker.Reset(QDateTime::currentMSecsSinceEpoch(),
+                  playlist->GetAllItems());
+  } else {
+    tracker.Update(playlist->GetAllItems());
+  }
+
+  // The whole playlist and each delta are only made once, for all the clients
+  // that need them
+  RemoteClient::Frame full_frame;
+  QMap<qint64, RemoteClient::Frame> delta_frames;
+
+  for (RemoteClient* client : *clients_) {
+    if (client->isDownloader() ||
+        client->State() != QTcpSocket::ConnectedState) {
+      continue;
+    }
+
+    const qint64 known_revision = client->playlist_revision(id);
+
+    if (client->send_deltas() && !delta_frames.contains(known_revision)) {
+      // An empty frame means the client needs the whole playlist
+      RemoteClient::Frame frame;
+      pb::remote::Message delta_msg;
+      if (tracker.DeltaSince(known_revision,
+                             delta_msg.mutable_response_playlist_delta())) {
+        delta_msg.set_type(pb::remote::PLAYLIST_DELTA);
+        delta_msg.mutable_response_playlist_delta()->set_playlist_id(id);
+        frame = RemoteClient::MakeFrame(&delta_msg);
+      }
+      delta_frames.insert(known_revision, frame);
+    }
+
+    const RemoteClient::Frame delta_frame = delta_frames.value(known_revision);
+    if (!delta_frame.data.isEmpty()) {
+      if (known_revision == tracker.revision() && client != requester) {
+        continue;
+      }
+      client->SendFrame(delta_frame);
+    } else {
+      if (full_frame.data.isEmpty()) {
+        pb::remote::Message full_msg;
+        CreatePlaylistSongs(id, tracker, &full_msg);
+        full_frame = RemoteClient::MakeFrame(&full_msg);
+      }
+      client->SendFrame(full_frame);
+    }
+
+    client->set_playlist_revision(id, tracker.revision());
+  }
+}
+
+void OutgoingDataCreator::CreatePlaylistSongs(
+    int id, const PlaylistDeltaTracker& tracker, pb::remote::Message* msg) {
   // Create the message and the playlist
-  pb::remote::Message msg;
-  msg.set_type(pb::remote::PLAYLIST_SONGS);
+  msg->set_type(pb::remote::PLAYLIST_SONGS);
 
   // Create the Response message
   pb::remote::ResponsePlaylistSongs* pb_response_playlist_songs =
-      msg.mutable_response_playlist_songs();
+      msg->mutable_response_playlist_songs();
+  pb_response_playlist_songs->set_revision(tracker.revision());
 
   // Create a new playlist
   pb::remote::Playlist* pb_playlist =
@@ -436,16 +518,12 @@ void OutgoingDataCreator::SendPlaylistSongs(int id) {
 
   // Send all songs
   int index = 0;
-  SongList song_list = playlist->GetAllSongs();
-  QListIterator<Song> it(song_list);
   QImage null_img;
-  while (it.hasNext()) {
-    Song song = it.next();
+  for (const Song& song : tracker.songs()) {
     pb::remote::SongMetadata* pb_song = pb_response_playlist_songs->add_songs();
     CreateSong(song, null_img, index, pb_song);
     ++index;
   }
-  SendDataToClients(&msg);
 }
 
 void OutgoingDataCreator::PlaylistChanged(Playlist* playlist) {
@@ -593,26 +671,112 @@ void OutgoingDataCreator::SendLyrics(int id,
   results_.take(id);
 }
 
-void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
-  // Get a temporary file name
-  QString temp_file_name = Utilities::GetTemporaryFileName();
+void OutgoingDataCreator::LibrarySongsChanged(const SongList& songs) {
+  library_revision_++;
+  for (const Song& song : songs) {
+    library_changed_[song.id()] = library_revision_;
+    library_deleted_.remove(song.id());
+  }
+}
+
+void OutgoingDataCreator::LibrarySongsDeleted(const SongList& songs) {
+  library_revision_++;
+  for (const Song& song : songs) {
+    library_deleted_[song.id()] = library_revision_;
+    library_changed_.remove(song.id());
+  }
+}
+
+void OutgoingDataCreator::LibraryReset() {
+  // Everyone has to start again with the whole library
+  library_base_revision_ = ++library_revision_;
+  library_changed_.clear();
+  library_deleted_.clear();
+}
 
+bool OutgoingDataCreator::LibraryChangesSince(
+    const QHash<int, qint64>& changed, const QHash<int, qint64>& deleted,
+    qint64 known_revision, QList<int>* changed_ids, QList<int>* deleted_ids) {
+  for (auto it = changed.constBegin(); it != changed.constEnd(); ++it) {
+    if (it.value() <= known_revision) continue;
+
+    // The ids go in the query, so past this it's better to send everything.
+    if (changed_ids->count() == kMaxLibraryChanges) return false;
+    *changed_ids << it.key();
+  }
+  for (auto it = deleted.constBegin(); it != deleted.constEnd(); ++it) {
+    if (it.value() > known_revision) *deleted_ids << it.key();
+  }
+  return true;
+}
+
+bool OutgoingDataCreator::ExportLibrary(Database* database,
+                                        const QString& filename,
+                                        bool song_ids,
+                                        const QList<int>* changed_ids,
+                                        const QList<int>& deleted_ids) {
   // Attach this file to the database
-  Database::AttachedDatabase adb(temp_file_name, "", true);
-  QSqlDatabase db(app_->database()->Connect());
+  Database::AttachedDatabase adb(filename, "", true);
+  QSqlDatabase db(database->Connect());
+
+  database->AttachDatabaseOnDbConnection("songs_export", adb, db);
 
-  app_->database()->AttachDatabaseOnDbConnection("songs_export", adb, db);
+  // Clients that understand deltas need the song ids to apply the next one
+  QString columns = song_ids ? "ROWID AS song_id, *" : "*";
+  QString where = "unavailable = 0";
+
+  if (changed_ids) {
+    QStringList ids;
+    for (int id : *changed_ids) ids << QString::number(id);
+    where += " and ROWID in (" + ids.join(",") + ")";
+  }
 
   // Copy the content of the song table to this temporary database
-  QSqlQuery q(QString(
-                  "create table songs_export.songs as SELECT * FROM songs "
-                  "where unavailable = 0;"),
+  QSqlQuery q(QString("create table songs_export.songs as SELECT %1 FROM songs "
+                      "where %2;").arg(columns, where),
               db);
-
-  if (app_->database()->CheckErrors(q)) return;
+  bool ok = !database->CheckErrors(q);
+
+  if (ok && changed_ids) {
+    QSqlQuery create(
+        "create table songs_export.deleted_songs (song_id INTEGER);", db);
+    ok = !database->CheckErrors(create);
+
+    QSqlQuery insert(db);
+    insert.prepare(
+        "insert into songs_export.deleted_songs (song_id) values (:id)");
+    for (int id : deleted_ids) {
+      if (!ok) break;
+      insert.bindValue(":id", id);
+      insert.exec();
+      ok = !database->CheckErrors(insert);
+    }
+  }
 
   // Detach the database
-  app_->database()->DetachDatabase("songs_export");
+  database->DetachDatabase("songs_export");
+  return ok;
+}
+
+void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
+  // Only send the songs that changed if the client has a revision we know
+  const qint64 known_revision = client->library_revision();
+  QList<int> changed_ids;
+  QList<int> deleted_ids;
+  const bool incremental =
+      client->send_deltas() && known_revision >= library_base_revision_ &&
+      known_revision <= library_revision_ &&
+      LibraryChangesSince(library_changed_, library_deleted_, known_revision,
+                          &changed_ids, &deleted_ids);
+
+  // Get a temporary file name
+  QString temp_file_name = Utilities::GetTemporaryFileName();
+
+  if (!ExportLibrary(app_->database(), temp_file_name, client->send_deltas(),
+                     incremental ? &changed_ids : nullptr, deleted_ids)) {
+    QFile::remove(temp_file_name);
+    return;
+  }
 
   // Open the file
   QFile file(temp_file_name);
@@ -643,6 +807,8 @@ void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
     chunk->set_size(file.size());
     chunk->set_data(data.data(), data.size());
     chunk->set_file_hash(sha1.data(), sha1.size());
+    chunk->set_revision(library_revision_);
+    if (incremental) chunk->set_base_revision(known_revision);
 
     // Send data directly to the client
     client->SendData(&msg);
@@ -656,6 +822,8 @@ void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
 
   // Remove temporary file
   file.remove();
+
+  client->set_library_revision(library_revision_);
 }
 
 void OutgoingDataCreator::EnableKittens(bool aww) { aww_ = aww; }
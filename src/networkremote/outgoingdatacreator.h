@@ -8,6 +8,7 @@
 #include <QList>
 #include <QTimer>
 #include <QMap>
+#include <QHash>
 #include <QQueue>
 
 #include "core/player.h"
@@ -27,6 +28,9 @@
 #include "songinfo/ultimatelyricsreader.h"
 #include "remotecontrolmessages.pb.h"
 #include "remoteclient.h"
+#include "playlistdeltatracker.h"
+
+class Database;
 
 typedef QList<SongInfoProvider*> ProviderList;
 
@@ -53,12 +57,34 @@ class OutgoingDataCreator : public QObject {
   static void CreateSong(const Song& song, const QImage& art, const int index,
                   pb::remote::SongMetadata* song_metadata);
 
+  // Clients are sent the whole library rather than more changed songs than
+  // this, since their ids all go in the query that exports them.
+  static const int kMaxLibraryChanges;
+
+  // Finds the songs that changed or were deleted after known_revision.
+  // Returns false if there are too many and the whole library should be sent.
+  static bool LibraryChangesSince(const QHash<int, qint64>& changed,
+                                  const QHash<int, qint64>& deleted,
+                                  qint64 known_revision,
+                                  QList<int>* changed_ids,
+                                  QList<int>* deleted_ids);
+
+  // Copies the library into a new SQLite database at filename.  If
+  // changed_ids is set only those songs are copied, and deleted_ids are put
+  // in a deleted_songs table.
+  static bool ExportLibrary(Database* database, const QString& filename,
+                            bool song_ids, const QList<int>* changed_ids,
+                            const QList<int>& deleted_ids);
+
  public slots:
   void SendClementineInfo();
   void SendAllPlaylists();
   void SendAllActivePlaylists();
   void SendFirstData(bool send_playlist_songs);
-  void SendPlaylistSongs(int id);
+  // Sends clients that asked for deltas only what changed since the revision
+  // they have, and everyone else the whole playlist.  Clients that are up to
+  // date are only sent anything if they're the one that asked.
+  void SendPlaylistSongs(int id, RemoteClient* requester = nullptr);
   void PlaylistChanged(Playlist*);
   void VolumeChanged(int volume);
   void PlaylistAdded(int id, const QString& name, bool favorite);
@@ -78,6 +104,9 @@ class OutgoingDataCreator : public QObject {
   void GetLyrics();
   void SendLyrics(int id, const SongInfoFetcher::Result& result);
   void SendLibrary(RemoteClient* client);
+  void LibrarySongsChanged(const SongList& songs);
+  void LibrarySongsDeleted(const SongList& songs);
+  void LibraryReset();
   void EnableKittens(bool aww);
   void SendKitten(const QImage& kitten);
 
@@ -105,7 +134,20 @@ class OutgoingDataCreator : public QObject {
 
   QMap<int, GlobalSearchRequest> global_search_result_map_;
 
+  QMap<int, PlaylistDeltaTracker> playlist_trackers_;
+
+  // The library's revision goes up every time some songs change, and a client
+  // that has base revision or later can be sent just the songs that changed
+  // since.  These start at the time Clementine started so a revision from an
+  // earlier run is never mistaken for one from this one.
+  qint64 library_revision_;
+  qint64 library_base_revision_;
+  QHash<int, qint64> library_changed_;  // song id -> revision
+  QHash<int, qint64> library_deleted_;  // song id -> revision
+
   void SendDataToClients(pb::remote::Message* msg);
+  void CreatePlaylistSongs(int id, const PlaylistDeltaTracker& tracker,
+                           pb::remote::Message* msg);
   void SetEngineState(pb::remote::ResponseClementineInfo* msg);
   void CheckEnabledProviders();
   SongInfoProvider* ProviderByName(const QString& name) const;
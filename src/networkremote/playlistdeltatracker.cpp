@@ -0,0 +1,225 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "playlistdeltatracker.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+
+#include "outgoingdatacreator.h"
+
+// A client that's further behind than this gets the whole playlist again.
+const int PlaylistDeltaTracker::kMaxHistory = 20;
+
+PlaylistDeltaTracker::PlaylistDeltaTracker() : revision_(0) {}
+
+void PlaylistDeltaTracker::Reset(qint64 revision,
+                                 const PlaylistItemList& items) {
+  revision_ = revision;
+  items_ = items;
+  history_.clear();
+
+  songs_.clear();
+  songs_.reserve(items.count());
+  for (const PlaylistItemPtr& item : items) songs_ << item->Metadata();
+}
+
+bool PlaylistDeltaTracker::SongChanged(const Song& before,
+                                       const Song& after) {
+  return !before.IsMetadataEqual(after) ||
+         before.playcount() != after.playcount() || before.url() != after.url();
+}
+
+bool PlaylistDeltaTracker::Update(const PlaylistItemList& items) {
+  SongList songs;
+  songs.reserve(items.count());
+  for (const PlaylistItemPtr& item : items) songs << item->Metadata();
+
+  QHash<PlaylistItem*, int> old_rows;
+  old_rows.reserve(items_.count());
+  for (int i = 0; i < items_.count(); ++i) old_rows[items_[i].get()] = i;
+
+  // Which row each item was on before, or -1 if it's new.
+  QVector<int> from(items.count(), -1);
+  QBitArray kept(items_.count());
+  for (int i = 0; i < items.count(); ++i) {
+    const int row = old_rows.value(items[i].get(), -1);
+    if (row == -1 || kept.testBit(row)) continue;
+
+    from[i] = row;
+    kept.setBit(row);
+  }
+
+  pb::remote::ResponsePlaylistDelta delta;
+  delta.set_base_revision(revision_);
+  delta.set_revision(revision_ + 1);
+
+  // Removed rows go first, from the end so the rows in front of them don't
+  // move.
+  for (int end = items_.count(); end > 0;) {
+    if (kept.testBit(end - 1)) {
+      --end;
+      continue;
+    }
+
+    int begin = end - 1;
+    while (begin > 0 && !kept.testBit(begin - 1)) --begin;
+    AddChange(&delta, pb::remote::PlaylistChange::REMOVE, begin)
+        ->set_count(end - begin);
+    end = begin;
+  }
+
+  // Then the rows that are left get put in their new order.
+  QVector<int> kept_row(items_.count(), -1);
+  for (int i = 0, row = 0; i < items_.count(); ++i) {
+    if (kept.testBit(i)) kept_row[i] = row++;
+  }
+
+  QList<int> order;
+  for (int i = 0; i < items.count(); ++i) {
+    if (from[i] != -1) order << kept_row[from[i]];
+  }
+  AddReorder(order, &delta);
+
+  // The new rows go in front to back, so each one's row is already right.
+  for (int begin = 0; begin < items.count();) {
+    if (from[begin] != -1) {
+      ++begin;
+      continue;
+    }
+
+    int end = begin + 1;
+    while (end < items.count() && from[end] == -1) ++end;
+    AddSongs(songs, begin, end - begin,
+             AddChange(&delta, pb::remote::PlaylistChange::INSERT, begin));
+    begin = end;
+  }
+
+  // And last of all the songs whose metadata changed.
+  QBitArray changed(items.count());
+  for (int i = 0; i < items.count(); ++i) {
+    if (from[i] != -1 && SongChanged(songs_[from[i]], songs[i])) {
+      changed.setBit(i);
+    }
+  }
+
+  for (int begin = 0; begin < items.count();) {
+    if (!changed.testBit(begin)) {
+      ++begin;
+      continue;
+    }
+
+    int end = begin + 1;
+    while (end < items.count() && changed.testBit(end)) ++end;
+    AddSongs(songs, begin, end - begin,
+             AddChange(&delta, pb::remote::PlaylistChange::CHANGE, begin));
+    begin = end;
+  }
+
+  items_ = items;
+  songs_ = songs;
+
+  if (delta.changes_size() == 0) return false;
+
+  revision_++;
+  history_ << delta;
+  while (history_.count() > kMaxHistory) history_.removeFirst();
+  return true;
+}
+
+void PlaylistDeltaTracker::AddReorder(
+    const QList<int>& order, pb::remote::ResponsePlaylistDelta* delta) {
+  int first = 0;
+  while (first < order.count() && order[first] == first) ++first;
+  if (first == order.count()) return;
+
+  int last = order.count() - 1;
+  while (order[last] == last) --last;
+
+  // Dragging a block of rows somewhere else rotates the rows in between.
+  const int count = last - first + 1;
+  const int shift = order[first] - first;
+  bool rotated = true;
+  for (int i = 0; i < count && rotated; ++i) {
+    rotated = order[first + i] == first + (shift + i) % count;
+  }
+
+  if (rotated) {
+    // Either the rows after the first shift moved up, or the first shift rows
+    // moved down - send whichever is fewer.
+    pb::remote::PlaylistChange* change = nullptr;
+    if (count - shift <= shift) {
+      change =
+          AddChange(delta, pb::remote::PlaylistChange::MOVE, first + shift);
+      change->set_count(count - shift);
+      change->set_destination(first);
+    } else {
+      change = AddChange(delta, pb::remote::PlaylistChange::MOVE, first);
+      change->set_count(shift);
+      change->set_destination(first + count - shift);
+    }
+    return;
+  }
+
+  pb::remote::PlaylistChange* change =
+      AddChange(delta, pb::remote::PlaylistChange::REORDER, first);
+  for (int i = first; i <= last; ++i) change->add_order(order[i] - first);
+}
+
+pb::remote::PlaylistChange* PlaylistDeltaTracker::AddChange(
+    pb::remote::ResponsePlaylistDelta* delta,
+    pb::remote::PlaylistChange::Type type, int row) {
+  pb::remote::PlaylistChange* change = delta->add_changes();
+  change->set_type(type);
+  change->set_row(row);
+  return change;
+}
+
+void PlaylistDeltaTracker::AddSongs(const SongList& songs, int row, int count,
+                                    pb::remote::PlaylistChange* change) {
+  QImage null_img;
+  for (int i = row; i < row + count; ++i) {
+    OutgoingDataCreator::CreateSong(songs[i], null_img, i, change->add_songs());
+  }
+  change->set_count(count);
+}
+
+bool PlaylistDeltaTracker::DeltaSince(
+    qint64 base_revision, pb::remote::ResponsePlaylistDelta* delta) const {
+  if (revision_ == 0 || base_revision <= 0) return false;
+
+  delta->set_base_revision(base_revision);
+  delta->set_revision(revision_);
+  if (base_revision == revision_) return true;
+
+  int i = 0;
+  while (i < history_.count() && history_[i].base_revision() != base_revision) {
+    ++i;
+  }
+  if (i == history_.count()) return false;
+
+  int song_count = 0;
+  for (; i < history_.count(); ++i) {
+    for (const pb::remote::PlaylistChange& change : history_[i].changes()) {
+      song_count += change.songs_size();
+    }
+    delta->mutable_changes()->MergeFrom(history_[i].changes());
+  }
+
+  return song_count < items_.count();
+}
@@ -0,0 +1,82 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NETWORKREMOTE_PLAYLISTDELTATRACKER_H_
+#define NETWORKREMOTE_PLAYLISTDELTATRACKER_H_
+
+#include <QList>
+
+#include "core/song.h"
+#include "playlist/playlistitem.h"
+#include "remotecontrolmessages.pb.h"
+
+// Remembers the last few revisions of a playlist that were sent to the remote
+// clients, so a client that has one of them can be sent just the rows that
+// changed instead of the whole playlist.
+//
+// Items are told apart by identity, so a song that's moved keeps its place in
+// the client's list and is never sent again.
+class PlaylistDeltaTracker {
+ public:
+  PlaylistDeltaTracker();
+
+  static const int kMaxHistory;
+
+  // 0 until Reset is called.
+  qint64 revision() const { return revision_; }
+
+  // The songs at the current revision.
+  const SongList& songs() const { return songs_; }
+
+  // Forgets the history, and starts again from these items.
+  void Reset(qint64 revision, const PlaylistItemList& items);
+
+  // Compares the items with the current revision, and if anything changed
+  // saves the difference as the next revision.  Returns false if nothing
+  // changed.
+  bool Update(const PlaylistItemList& items);
+
+  // Fills delta with the changes from base_revision to the current revision.
+  // Returns false if base_revision isn't known any more, or if the delta
+  // wouldn't be any smaller than the whole playlist.
+  bool DeltaSince(qint64 base_revision,
+                  pb::remote::ResponsePlaylistDelta* delta) const;
+
+ private:
+  static bool SongChanged(const Song& before, const Song& after);
+
+  static pb::remote::PlaylistChange* AddChange(
+      pb::remote::ResponsePlaylistDelta* delta,
+      pb::remote::PlaylistChange::Type type, int row);
+  static void AddSongs(const SongList& songs, int row, int count,
+                       pb::remote::PlaylistChange* change);
+
+  // Adds a MOVE if the rows in the middle of order were rotated, otherwise a
+  // REORDER.
+  static void AddReorder(const QList<int>& order,
+                         pb::remote::ResponsePlaylistDelta* delta);
+
+ private:
+  qint64 revision_;
+  PlaylistItemList items_;
+  SongList songs_;
+
+  // Oldest first.  Each one goes from the revision before it to the one
+  // after.
+  QList<pb::remote::ResponsePlaylistDelta> history_;
+};
+
+#endif  // NETWORKREMOTE_PLAYLISTDELTATRACKER_H_
@@ -21,13 +21,30 @@
 #include "networkremote.h"
 
 #include <QDataStream>
+#include <QFile>
 #include <QSettings>
+#include <QtEndian>
+
+// Once this much is waiting to go out on the socket, new messages are kept
+// back until it's written.  Slow clients then only get the newest of the
+// messages that replace each other, instead of an ever growing buffer.
+const qint64 RemoteClient::kMaxBytesToWrite = 256 * 1024;
+
+// A client that's this far behind isn't reading what it's sent, so it's
+// disconnected rather than left to use up more memory.  Songs and the library
+// are sent in chunks that are all queued at once, and can be much bigger than
+// this, so they don't count.
+const qint64 RemoteClient::kMaxPendingBytes = 128 * 1024 * 1024;
 
 RemoteClient::RemoteClient(Application* app, QTcpSocket* client)
     : app_(app),
       downloader_(false),
+      send_deltas_(false),
+      library_revision_(-1),
       client_(client),
-      song_sender_(new SongSender(app, this)) {
+      song_sender_(new SongSender(app, this)),
+      pending_bytes_(0),
+      file_writer_(new SocketFileWriter(client, this)) {
   // Open the buffer
   buffer_.setData(QByteArray());
   buffer_.open(QIODevice::ReadWrite);
@@ -35,6 +52,8 @@ RemoteClient::RemoteClient(Application* app, QTcpSocket* client)
 
   // Connect to the slot IncomingData when receiving data
   connect(client, SIGNAL(readyRead()), this, SLOT(IncomingData()));
+  connect(client, SIGNAL(bytesWritten(qint64)), this, SLOT(WritePending()));
+  connect(file_writer_, SIGNAL(Finished(bool)), SLOT(FileWritten(bool)));
 
   // Check if we use auth code
   QSettings s;
@@ -51,6 +70,8 @@ RemoteClient::RemoteClient(Application* app, QTcpSocket* client)
 }
 
 RemoteClient::~RemoteClient() {
+  ClearPending();
+
   client_->close();
   if (client_->state() == QAbstractSocket::ConnectedState)
     client_->waitForDisconnected(2000);
@@ -115,6 +136,7 @@ void RemoteClient::ParseMessage(const QByteArray& data) {
 
   if (msg.type() == pb::remote::CONNECT) {
     setDownloader(msg.request_connect().downloader());
+    send_deltas_ = msg.request_connect().send_deltas();
     qDebug() << "Downloader" << downloader_;
   }
 
@@ -154,24 +176,23 @@ void RemoteClient::DisconnectClient(pb::remote::ReasonDisconnect reason) {
 
 // Sends data to client without check if authenticated
 void RemoteClient::SendDataToClient(pb::remote::Message* msg) {
-  // Set the default version
-  msg->set_version(msg->default_instance().version());
-
   // Check if we are still connected
   if (client_->state() == QTcpSocket::ConnectedState) {
-    // Serialize the message
-    std::string data = msg->SerializeAsString();
-
-    // write the length of the data first
-    QDataStream s(client_);
-    s << qint32(data.length());
-    if (downloader_) {
-      // Don't use QDataSteam for large files
-      client_->write(data.data(), data.length());
-    } else {
-      s.writeRawData(data.data(), data.length());
+    // Skip the queue and throw away what's in it, this is only used for the
+    // last message before closing the connection.
+    ClearPending();
+
+    if (file_writer_->is_active()) {
+      // The message would end up in the middle of the file, where the client
+      // can't find it, so there's no way of sending it.
+      file_writer_->Abort();
+      client_->abort();
+      return;
     }
 
+    Frame frame = MakeFrame(msg);
+    client_->write(frame.data);
+
     // Do NOT flush data here! If the client is already disconnected, it
     // causes a SIGPIPE termination!!!
   } else {
@@ -180,10 +201,153 @@ void RemoteClient::SendDataToClient(pb::remote::Message* msg) {
   }
 }
 
+RemoteClient::Frame RemoteClient::MakeFrame(pb::remote::Message* msg) {
+  // Set the default version
+  msg->set_version(msg->default_instance().version());
+
+  Frame frame;
+  frame.type = msg->type();
+  if (msg->has_response_playlist_songs()) {
+    frame.playlist_id =
+        msg->response_playlist_songs().requested_playlist().id();
+  } else if (msg->has_response_playlist_delta()) {
+    frame.playlist_id = msg->response_playlist_delta().playlist_id();
+  }
+
+  // Serialize the message straight after its length
+  const int size = msg->ByteSize();
+  frame.data.resize(sizeof(qint32) + size);
+  uchar* data = reinterpret_cast<uchar*>(frame.data.data());
+  qToBigEndian<qint32>(size, data);
+  msg->SerializeWithCachedSizesToArray(data + sizeof(qint32));
+
+  return frame;
+}
+
+bool RemoteClient::Supersedes(const Frame& frame, const Frame& queued) {
+  switch (frame.type) {
+    // These only say what things are like now
+    case pb::remote::INFO:
+    case pb::remote::CURRENT_METAINFO:
+    case pb::remote::PLAYLISTS:
+    case pb::remote::ENGINE_STATE_CHANGED:
+    case pb::remote::KEEP_ALIVE:
+    case pb::remote::UPDATE_TRACK_POSITION:
+    case pb::remote::ACTIVE_PLAYLIST_CHANGED:
+    case pb::remote::SET_VOLUME:
+    case pb::remote::REPEAT:
+    case pb::remote::SHUFFLE:
+      return queued.type == frame.type;
+
+    // A whole playlist makes the deltas before it pointless
+    case pb::remote::PLAYLIST_SONGS:
+      return (queued.type == pb::remote::PLAYLIST_SONGS ||
+              queued.type == pb::remote::PLAYLIST_DELTA) &&
+             queued.playlist_id == frame.playlist_id;
+
+    default:
+      return false;
+  }
+}
+
+void RemoteClient::SendFrame(const Frame& frame) {
+  // Check if client is authenticated before sending the data
+  if (!authenticated_) return;
+
+  if (client_->state() != QTcpSocket::ConnectedState) {
+    qDebug() << "Closed";
+    client_->close();
+    return;
+  }
+
+  // Drop anything still waiting that this replaces.  The new frame goes at
+  // the end, so it still comes after everything that was sent before it.
+  for (int i = pending_.count() - 1; i >= 0; --i) {
+    if (Supersedes(frame, pending_[i])) {
+      pending_bytes_ -= CappedSize(pending_.takeAt(i));
+    }
+  }
+  pending_ << frame;
+  pending_bytes_ += CappedSize(frame);
+
+  // Downloads only ever carry files, and the client reads them as fast as it
+  // can.
+  if (!downloader_ && pending_bytes_ > kMaxPendingBytes) {
+    qLog(Warning) << "Client has" << pending_bytes_
+                  << "bytes waiting to be sent, disconnecting it";
+    ClearPending();
+    client_->abort();
+    return;
+  }
+
+  WritePending();
+}
+
+void RemoteClient::WritePending() {
+  // Nothing else can go until the file that's being sent has finished
+  if (file_writer_->is_active()) return;
+
+  // Do NOT flush data here! If the client is already disconnected, it
+  // causes a SIGPIPE termination!!!
+  while (!pending_.isEmpty() && client_->bytesToWrite() < kMaxBytesToWrite &&
+         client_->state() == QTcpSocket::ConnectedState) {
+    const Frame frame = pending_.takeFirst();
+    pending_bytes_ -= CappedSize(frame);
+
+    if (frame.filename.isEmpty()) {
+      client_->write(frame.data);
+      continue;
+    }
+
+    // The message promises the file comes next, so it can only be written if
+    // the file can be
+    if (!file_writer_->Open(frame.filename, frame.file_size,
+                            frame.remove_file)) {
+      continue;
+    }
+
+    client_->write(frame.data);
+    file_writer_->Start();
+
+    // FileWritten carries on once the file's gone
+    return;
+  }
+}
+
+qint64 RemoteClient::CappedSize(const Frame& frame) {
+  switch (frame.type) {
+    case pb::remote::SONG_FILE_CHUNK:
+    case pb::remote::LIBRARY_CHUNK:
+      return 0;
+    default:
+      return frame.data.size();
+  }
+}
+
+void RemoteClient::ClearPending() {
+  // Nothing else is going to delete the files these were going to send.
+  for (const Frame& frame : pending_) {
+    if (frame.remove_file) QFile::remove(frame.filename);
+  }
+  pending_.clear();
+  pending_bytes_ = 0;
+}
+
+void RemoteClient::FileWritten(bool success) {
+  if (!success) {
+    // The client can't tell where the next message starts any more
+    qLog(Warning) << "Couldn't send a file, disconnecting the client";
+    client_->abort();
+    return;
+  }
+
+  WritePending();
+}
+
 void RemoteClient::SendData(pb::remote::Message* msg) {
   // Check if client is authenticated before sending the data
   if (authenticated_) {
-    SendDataToClient(msg);
+    SendFrame(MakeFrame(msg));
   }
 }
 
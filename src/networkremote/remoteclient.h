@@ -4,7 +4,9 @@
 #include <QAbstractSocket>
 #include <QTcpSocket>
 #include <QBuffer>
+#include <QMap>
 
+#include "socketfilewriter.h"
 #include "songsender.h"
 
 #include "core/application.h"
@@ -16,8 +18,39 @@ class RemoteClient : public QObject {
   RemoteClient(Application* app, QTcpSocket* client);
   ~RemoteClient();
 
+  // A message that's been serialized, with its length in front, ready to be
+  // written to any number of clients.  The data is shared between them.
+  //
+  // If filename is set, the first file_size bytes of the file are written
+  // straight after the message, and if remove_file is set the file's deleted
+  // afterwards.
+  struct Frame {
+    Frame()
+        : type(pb::remote::UNKNOWN),
+          playlist_id(-1),
+          file_size(0),
+          remove_file(false) {}
+
+    QByteArray data;
+    pb::remote::MsgType type;
+    int playlist_id;
+
+    QString filename;
+    qint64 file_size;
+    bool remove_file;
+  };
+
+  static const qint64 kMaxBytesToWrite;
+  static const qint64 kMaxPendingBytes;
+
+  static Frame MakeFrame(pb::remote::Message* msg);
+
+  // Whether queued is out of date once frame has been sent.
+  static bool Supersedes(const Frame& frame, const Frame& queued);
+
   // This method checks if client is authenticated before sending the data
   void SendData(pb::remote::Message* msg);
+  void SendFrame(const Frame& frame);
   QAbstractSocket::SocketState State();
   void setDownloader(bool downloader);
   bool isDownloader() { return downloader_; }
@@ -25,8 +58,27 @@ class RemoteClient : public QObject {
 
   SongSender* song_sender() { return song_sender_; }
 
+  // Whether the client asked for deltas instead of whole playlists and
+  // libraries when it connected.
+  bool send_deltas() const { return send_deltas_; }
+
+  // The revisions the client told us it has, or that we've sent it since.
+  // The socket delivers everything in order, so once something's written the
+  // client will have it before anything we send afterwards.  -1 if we don't
+  // know.
+  qint64 playlist_revision(int id) const {
+    return playlist_revisions_.value(id, -1);
+  }
+  void set_playlist_revision(int id, qint64 revision) {
+    playlist_revisions_[id] = revision;
+  }
+  qint64 library_revision() const { return library_revision_; }
+  void set_library_revision(qint64 revision) { library_revision_ = revision; }
+
  private slots:
   void IncomingData();
+  void WritePending();
+  void FileWritten(bool success);
 
 signals:
   void Parse(const pb::remote::Message& msg);
@@ -37,6 +89,13 @@ signals:
   // Sends data to client without check if authenticated
   void SendDataToClient(pb::remote::Message* msg);
 
+  // How much of frame counts towards kMaxPendingBytes.
+  static qint64 CappedSize(const Frame& frame);
+
+  // Drops every frame that's waiting, and deletes their files if they were
+  // going to be.
+  void ClearPending();
+
   Application* app_;
 
   bool use_auth_code_;
@@ -44,12 +103,23 @@ signals:
   bool authenticated_;
   bool allow_downloads_;
   bool downloader_;
+  bool send_deltas_;
+
+  QMap<int, qint64> playlist_revisions_;
+  qint64 library_revision_;
 
   QTcpSocket* client_;
   bool reading_protobuf_;
   quint32 expected_length_;
   QBuffer buffer_;
   SongSender* song_sender_;
+
+  // Frames waiting for the socket to catch up with what's already been
+  // written to it.  pending_bytes_ is the size of the ones that count towards
+  // kMaxPendingBytes.
+  QList<Frame> pending_;
+  qint64 pending_bytes_;
+  SocketFileWriter* file_writer_;
 };
 
 #endif  // REMOTECLIENT_H
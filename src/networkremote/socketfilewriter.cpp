@@ -0,0 +1,169 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "socketfilewriter.h"
+
+#include <QAbstractSocket>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "core/logging.h"
+
+// The most that's handed to the socket at once.
+const qint64 SocketFileWriter::kChunkSize = 1024 * 1024;
+
+#ifdef Q_OS_LINUX
+namespace {
+
+// Unlike send, sendfile can't be told not to raise SIGPIPE when the client
+// has gone away, so it's blocked while writing and thrown away if it was
+// raised.
+ssize_t SendFile(int socket, int file, off_t* offset, size_t count) {
+  sigset_t sigpipe;
+  sigset_t old_mask;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+
+  const ssize_t ret = sendfile(socket, file, offset, count);
+  const int error = errno;
+
+  if (ret < 0 && error == EPIPE) {
+    const struct timespec no_wait = {0, 0};
+    sigtimedwait(&sigpipe, nullptr, &no_wait);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+  errno = error;
+  return ret;
+}
+
+}  // namespace
+#endif  // Q_OS_LINUX
+
+SocketFileWriter::SocketFileWriter(QAbstractSocket* socket, QObject* parent)
+    : QObject(parent),
+      socket_(socket),
+      notifier_(nullptr),
+      remove_file_(false),
+      started_(false),
+      offset_(0),
+      size_(0) {
+  // Qt's own buffer has to be empty before the file can go after it.
+  connect(socket_, SIGNAL(bytesWritten(qint64)), SLOT(Write()));
+}
+
+SocketFileWriter::~SocketFileWriter() {
+  if (is_active() && remove_file_) file_.remove();
+}
+
+bool SocketFileWriter::Open(const QString& filename, qint64 size,
+                            bool remove_file) {
+  file_.setFileName(filename);
+  if (!file_.open(QIODevice::ReadOnly)) {
+    qLog(Warning) << "Couldn't open" << filename;
+    if (remove_file) file_.remove();
+    return false;
+  }
+
+  remove_file_ = remove_file;
+  started_ = false;
+  offset_ = 0;
+  size_ = size;
+  return true;
+}
+
+void SocketFileWriter::Start() {
+  started_ = true;
+  Write();
+}
+
+void SocketFileWriter::Write() {
+  if (!started_ || socket_->bytesToWrite() > 0) return;
+
+#ifdef Q_OS_LINUX
+  if (!notifier_) {
+    notifier_ = new QSocketNotifier(socket_->socketDescriptor(),
+                                    QSocketNotifier::Write, this);
+    connect(notifier_, SIGNAL(activated(int)), SLOT(Write()));
+  }
+  notifier_->setEnabled(false);
+
+  while (offset_ < size_) {
+    off_t offset = offset_;
+    const ssize_t written =
+        SendFile(socket_->socketDescriptor(), file_.handle(), &offset,
+                 qMin(size_ - offset_, kChunkSize));
+    const int error = errno;
+
+    if (written > 0) {
+      offset_ += written;
+    } else if (written < 0 && error == EINTR) {
+      continue;
+    } else if (written < 0 && (error == EAGAIN || error == EWOULDBLOCK)) {
+      // Carry on when the socket has room again
+      notifier_->setEnabled(true);
+      return;
+    } else {
+      // Either the connection's gone or the file got shorter
+      qLog(Warning) << "Couldn't send" << file_.fileName() << "-"
+                    << (written == 0 ? "end of file" : strerror(error));
+      Finish(false);
+      return;
+    }
+  }
+#else
+  if (offset_ < size_) {
+    const QByteArray data = file_.read(qMin(size_ - offset_, kChunkSize));
+    if (data.isEmpty()) {
+      qLog(Warning) << "Couldn't read" << file_.fileName();
+      Finish(false);
+      return;
+    }
+
+    socket_->write(data);
+    offset_ += data.size();
+
+    // The rest goes when the socket's written this chunk
+    if (offset_ < size_) return;
+  }
+#endif  // Q_OS_LINUX
+
+  Finish(true);
+}
+
+void SocketFileWriter::Abort() {
+  if (!is_active()) return;
+
+  started_ = false;
+  if (notifier_) notifier_->setEnabled(false);
+
+  file_.close();
+  if (remove_file_) file_.remove();
+  remove_file_ = false;
+}
+
+void SocketFileWriter::Finish(bool success) {
+  Abort();
+  emit Finished(success);
+}
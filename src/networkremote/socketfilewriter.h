@@ -0,0 +1,74 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NETWORKREMOTE_SOCKETFILEWRITER_H_
+#define NETWORKREMOTE_SOCKETFILEWRITER_H_
+
+#include <QFile>
+#include <QObject>
+
+class QAbstractSocket;
+class QSocketNotifier;
+
+// Writes the contents of a file to a socket, after whatever has already been
+// written to the socket.  On Linux the file goes from the page cache straight
+// to the socket with sendfile, and is never copied into Clementine at all.
+// Elsewhere it's read a chunk at a time as the socket drains.
+class SocketFileWriter : public QObject {
+  Q_OBJECT
+
+ public:
+  SocketFileWriter(QAbstractSocket* socket, QObject* parent = nullptr);
+  ~SocketFileWriter();
+
+  static const qint64 kChunkSize;
+
+  bool is_active() const { return file_.isOpen(); }
+
+  // Opens the file, ready to write the first size bytes of it.  If
+  // remove_file is set the file is deleted when it's been written, or if
+  // writing it fails.
+  bool Open(const QString& filename, qint64 size, bool remove_file);
+
+  // Starts writing the file that was opened.  Finished is emitted once all of
+  // it has been handed to the socket.
+  void Start();
+
+  // Stops writing the file without emitting Finished.  The socket is left
+  // part of the way through it, so it has to be closed as well.
+  void Abort();
+
+ signals:
+  void Finished(bool success);
+
+ private slots:
+  void Write();
+
+ private:
+  void Finish(bool success);
+
+ private:
+  QAbstractSocket* socket_;
+  QSocketNotifier* notifier_;
+
+  QFile file_;
+  bool remove_file_;
+  bool started_;
+  qint64 offset_;
+  qint64 size_;
+};
+
+#endif  // NETWORKREMOTE_SOCKETFILEWRITER_H_
@@ -17,7 +17,10 @@
 
 #include "songsender.h"
 
+#include <QCache>
+#include <QDateTime>
 #include <QFileInfo>
+#include <QMutex>
 
 #include "core/application.h"
 #include "core/logging.h"
@@ -30,11 +33,25 @@
 
 const quint32 SongSender::kFileChunkSize = 100000;  // in Bytes
 
+namespace {
+
+struct CachedHash {
+  QDateTime modified;
+  qint64 size;
+  QByteArray sha1;
+};
+
+QMutex hash_cache_mutex;
+QCache<QString, CachedHash> hash_cache(1000);
+
+}  // namespace
+
 SongSender::SongSender(Application* app, RemoteClient* client)
     : app_(app),
       client_(client),
       transcoder_(
-          new Transcoder(this, NetworkRemote::kTranscoderSettingPostfix)) {
+          new Transcoder(this, NetworkRemote::kTranscoderSettingPostfix)),
+      raw_file_data_(false) {
   QSettings s;
   s.beginGroup(NetworkRemote::kSettingsGroup);
 
@@ -68,6 +85,8 @@ SongSender::~SongSender() {
 }
 
 void SongSender::SendSongs(const pb::remote::RequestDownloadSongs& request) {
+  raw_file_data_ = request.raw_file_data();
+
   Song current_song;
   if (app_->player()->GetCurrentItem()) {
     current_song = app_->player()->GetCurrentItem()->Metadata();
@@ -237,11 +256,16 @@ void SongSender::SendSingleSong(DownloadItem download_item) {
     local_file = transcoder_map_.take(local_file);
   }
 
+  if (raw_file_data_) {
+    SendRawFile(download_item, local_file, is_transcoded);
+    return;
+  }
+
   // Open the file
   QFile file(local_file);
 
   // Get sha1 for file
-  QByteArray sha1 = Utilities::Sha1File(file).toHex();
+  QByteArray sha1 = FileHash(local_file).toHex();
   qLog(Debug) << "sha1 for file" << local_file << "=" << sha1;
 
   file.open(QIODevice::ReadOnly);
@@ -252,8 +276,6 @@ void SongSender::SendSingleSong(DownloadItem download_item) {
       msg.mutable_response_song_file_chunk();
   msg.set_type(pb::remote::SONG_FILE_CHUNK);
 
-  QImage null_image;
-
   // Calculate the number of chunks
   int chunk_count = qRound((file.size() / kFileChunkSize) + 0.5);
   int chunk_number = 1;
@@ -274,21 +296,7 @@ void SongSender::SendSingleSong(DownloadItem download_item) {
     // On the first chunk send the metadata, so the client knows
     // what file it receives.
     if (chunk_number == 1) {
-      int i = app_->playlist_manager()->active()->current_row();
-      pb::remote::SongMetadata* song_metadata =
-          msg.mutable_response_song_file_chunk()->mutable_song_metadata();
-      OutgoingDataCreator::CreateSong(download_item.song_, null_image, i,
-                                      song_metadata);
-
-      // if the file was transcoded, we have to change the filename and filesize
-      if (is_transcoded) {
-        song_metadata->set_file_size(file.size());
-        QString basefilename = download_item.song_.basefilename();
-        QFileInfo info(basefilename);
-        basefilename.replace("." + info.suffix(),
-                             "." + transcoder_preset_.extension_);
-        song_metadata->set_filename(DataCommaSizeFromQString(basefilename));
-      }
+      SetFileMetadata(download_item, is_transcoded, file.size(), chunk);
     }
 
     // Send data directly to the client
@@ -309,6 +317,78 @@ void SongSender::SendSingleSong(DownloadItem download_item) {
   }
 }
 
+void SongSender::SendRawFile(const DownloadItem& download_item,
+                             const QString& local_file, bool is_transcoded) {
+  const qint64 size = QFileInfo(local_file).size();
+  const QByteArray sha1 = FileHash(local_file).toHex();
+
+  // One message with everything but the data, which the client reads
+  // straight off the socket after it
+  pb::remote::Message msg;
+  msg.set_type(pb::remote::SONG_FILE_CHUNK);
+
+  pb::remote::ResponseSongFileChunk* chunk =
+      msg.mutable_response_song_file_chunk();
+  chunk->set_chunk_count(1);
+  chunk->set_chunk_number(1);
+  chunk->set_file_count(download_item.song_count_);
+  chunk->set_file_number(download_item.song_no_);
+  chunk->set_size(size);
+  chunk->set_file_hash(sha1.data(), sha1.size());
+  chunk->set_raw_data_follows(true);
+  SetFileMetadata(download_item, is_transcoded, size, chunk);
+
+  // The temporary transcoded file goes once it's been sent
+  RemoteClient::Frame frame = RemoteClient::MakeFrame(&msg);
+  frame.filename = local_file;
+  frame.file_size = size;
+  frame.remove_file = is_transcoded;
+  client_->SendFrame(frame);
+}
+
+void SongSender::SetFileMetadata(const DownloadItem& download_item,
+                                 bool is_transcoded, qint64 file_size,
+                                 pb::remote::ResponseSongFileChunk* chunk) {
+  int i = app_->playlist_manager()->active()->current_row();
+  pb::remote::SongMetadata* song_metadata = chunk->mutable_song_metadata();
+  OutgoingDataCreator::CreateSong(download_item.song_, QImage(), i,
+                                  song_metadata);
+
+  // if the file was transcoded, we have to change the filename and filesize
+  if (is_transcoded) {
+    song_metadata->set_file_size(file_size);
+    QString basefilename = download_item.song_.basefilename();
+    QFileInfo info(basefilename);
+    basefilename.replace("." + info.suffix(),
+                         "." + transcoder_preset_.extension_);
+    song_metadata->set_filename(DataCommaSizeFromQString(basefilename));
+  }
+}
+
+QByteArray SongSender::FileHash(const QString& filename) {
+  const QFileInfo info(filename);
+
+  {
+    QMutexLocker l(&hash_cache_mutex);
+    const CachedHash* cached = hash_cache.object(filename);
+    if (cached && cached->modified == info.lastModified() &&
+        cached->size == info.size()) {
+      return cached->sha1;
+    }
+  }
+
+  QFile file(filename);
+  CachedHash* cached = new CachedHash;
+  cached->modified = info.lastModified();
+  cached->size = info.size();
+  cached->sha1 = Utilities::Sha1File(file);
+
+  const QByteArray sha1 = cached->sha1;
+  QMutexLocker l(&hash_cache_mutex);
+  hash_cache.insert(filename, cached);
+  return sha1;
+}
+
 void SongSender::SendAlbum(const Song& song) {
   // No streams!
   if (song.url().scheme() != "file") return;
@@ -30,6 +30,10 @@ class SongSender : public QObject {
 
   static const quint32 kFileChunkSize;
 
+  // The file's SHA-1.  Hashing a whole FLAC takes about as long as sending
+  // it, so the hashes are kept until the file changes.
+  static QByteArray FileHash(const QString& filename);
+
  public slots:
   void SendSongs(const pb::remote::RequestDownloadSongs& request);
   void ResponseSongOffer(bool accepted);
@@ -45,12 +49,18 @@ class SongSender : public QObject {
   TranscoderPreset transcoder_preset_;
   Transcoder* transcoder_;
   bool transcode_lossless_files_;
+  bool raw_file_data_;
 
   QQueue<DownloadItem> download_queue_;
   QMap<QString, QString> transcoder_map_;
   int total_transcode_;
 
   void SendSingleSong(DownloadItem download_item);
+  void SendRawFile(const DownloadItem& download_item,
+                   const QString& local_file, bool is_transcoded);
+  void SetFileMetadata(const DownloadItem& download_item, bool is_transcoded,
+                       qint64 file_size,
+                       pb::remote::ResponseSongFileChunk* chunk);
   void SendAlbum(const Song& song);
   void SendPlaylist(int playlist_id);
   void SendUrls(const pb::remote::RequestDownloadSongs& request);
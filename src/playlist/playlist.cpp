@@ -31,6 +31,7 @@
 #include <QMimeData>
 #include <QMutableListIterator>
 #include <QSortFilterProxyModel>
+#include <QTimer>
 #include <QUndoStack>
 #include <QtConcurrentRun>
 #include <QtDebug>
@@ -97,6 +98,8 @@ const int Playlist::kUndoItemLimit = 500;
 const qint64 Playlist::kMinScrobblePointNsecs = 31ll * kNsecPerSec;
 const qint64 Playlist::kMaxScrobblePointNsecs = 240ll * kNsecPerSec;
 
+const int Playlist::kSaveDelayMsec = 500;
+
 Playlist::Playlist(PlaylistBackend* backend, TaskManager* task_manager,
                    LibraryBackend* library, int id, const QString& special_type,
                    bool favorite, QObject* parent)
@@ -119,9 +122,14 @@ Playlist::Playlist(PlaylistBackend* backend, TaskManager* task_manager,
       ignore_sorting_(false),
       undo_stack_(new QUndoStack(this)),
       special_type_(special_type),
-      cancel_restore_(false) {
+      cancel_restore_(false),
+      save_timer_(new QTimer(this)) {
   undo_stack_->setUndoLimit(kUndoStackSize);
 
+  save_timer_->setSingleShot(true);
+  save_timer_->setInterval(kSaveDelayMsec);
+  connect(save_timer_, SIGNAL(timeout()), SLOT(SaveNow()));
+
   connect(this, SIGNAL(rowsInserted(const QModelIndex&, int, int)),
           SIGNAL(PlaylistChanged()));
   connect(this, SIGNAL(rowsRemoved(const QModelIndex&, int, int)),
@@ -132,6 +140,19 @@ Playlist::Playlist(PlaylistBackend* backend, TaskManager* task_manager,
   proxy_->setSourceModel(this);
   queue_->setSourceModel(this);
 
+  play_order_.set_playable_predicate([this](int row) {
+    return proxy_->filterAcceptsRow(row, QModelIndex()) &&
+           !items_[row]->GetShouldSkip();
+  });
+  connect(proxy_, SIGNAL(layoutChanged()), SLOT(FilterChanged()));
+  connect(proxy_, SIGNAL(modelReset()), SLOT(FilterChanged()));
+  connect(proxy_, SIGNAL(rowsInserted(QModelIndex, int, int)),
+          SLOT(FilterChanged()));
+  connect(proxy_, SIGNAL(rowsRemoved(QModelIndex, int, int)),
+          SLOT(FilterChanged()));
+  connect(this, SIGNAL(dataChanged(QModelIndex, QModelIndex)),
+          SLOT(RowsChanged(QModelIndex, QModelIndex)));
+
   connect(queue_, SIGNAL(rowsAboutToBeRemoved(QModelIndex, int, int)),
           SLOT(TracksAboutToBeDequeued(QModelIndex, int, int)));
   connect(queue_, SIGNAL(rowsRemoved(QModelIndex, int, int)),
@@ -146,6 +167,13 @@ Playlist::Playlist(PlaylistBackend* backend, TaskManager* task_manager,
 }
 
 Playlist::~Playlist() {
+  // Wait for the last save, since Clementine might be about to exit.
+  if (save_timer_->isActive() && backend_) {
+    save_timer_->stop();
+    backend_->SavePlaylistBlocking(id_, items_, changed_items_,
+                                   last_played_row(), dynamic_playlist_);
+  }
+
   items_.clear();
   library_items_by_id_.clear();
 }
@@ -431,6 +459,9 @@ void Playlist::SongSaveComplete(TagReaderReply* reply,
 
 void Playlist::ItemReloadComplete(const QPersistentModelIndex& index) {
   if (index.isValid()) {
+    changed_items_ << item_at(index.row());
+    Save();
+
     emit dataChanged(index, index);
     emit EditingFinished(index);
   }
@@ -450,13 +481,37 @@ int Playlist::last_played_row() const {
 
 void Playlist::ShuffleModeChanged(PlaylistSequence::ShuffleMode mode) {
   is_shuffled_ = (mode != PlaylistSequence::Shuffle_Off);
+  play_order_.set_shuffle_mode(mode);
   ReshuffleIndices();
 }
 
+void Playlist::FilterChanged() { play_order_.InvalidatePlayable(); }
+
+void Playlist::RowsChanged(const QModelIndex& top_left,
+                           const QModelIndex& bottom_right) {
+  const int first = qMax(top_left.row(), 0);
+  const int last = qMin(bottom_right.row(), items_.count() - 1);
+  if (first > last) return;
+
+  // The song might not match the filter any more, or it might have been
+  // skipped.  Its album might have changed too.
+  play_order_.InvalidatePlayable(first, last);
+  play_order_.SetAlbumKeys(first, AlbumKeys(first, last - first + 1));
+}
+
 bool Playlist::FilterContainsVirtualIndex(int i) const {
-  if (i < 0 || i >= virtual_items_.count()) return false;
+  if (i < 0 || i >= play_order_.count()) return false;
+
+  return proxy_->filterAcceptsRow(play_order_.row_at(i), QModelIndex());
+}
 
-  return proxy_->filterAcceptsRow(virtual_items_[i], QModelIndex());
+QStringList Playlist::AlbumKeys(int first, int count) const {
+  QStringList ret;
+  ret.reserve(count);
+  for (int i = first; i < first + count; ++i) {
+    ret << items_[i]->Metadata().AlbumKey();
+  }
+  return ret;
 }
 
 int Playlist::NextVirtualIndex(int i, bool ignore_repeat_track) const {
@@ -469,42 +524,14 @@ int Playlist::NextVirtualIndex(int i, bool ignore_repeat_track) const {
   // This one's easy - if we have to repeat the current track then just return i
   if (repeat_mode == PlaylistSequence::Repeat_Track && !ignore_repeat_track) {
     if (!FilterContainsVirtualIndex(i))
-      return virtual_items_.count();  // It's not in the filter any more
-    return i;
-  }
-
-  // If we're not bothered about whether a song is on the same album then
-  // return the next virtual index, whatever it is.
-  if (!album_only) {
-    ++i;
-
-    // Advance i until we find any track that is in the filter, skipping
-    // the selected to be skipped
-    while (i < virtual_items_.count() &&
-           (!FilterContainsVirtualIndex(i) ||
-            item_at(virtual_items_[i])->GetShouldSkip())) {
-      ++i;
-    }
+      return play_order_.count();  // It's not in the filter any more
     return i;
   }
 
-  // We need to advance i until we get something else on the same album
-  Song last_song = current_item_metadata();
-  for (int j = i + 1; j < virtual_items_.count(); ++j) {
-    if (item_at(virtual_items_[j])->GetShouldSkip()) {
-      continue;
-    }
-    Song this_song = item_at(virtual_items_[j])->Metadata();
-    if (((last_song.is_compilation() && this_song.is_compilation()) ||
-         last_song.artist() == this_song.artist()) &&
-        last_song.album() == this_song.album() &&
-        FilterContainsVirtualIndex(j)) {
-      return j;  // Found one
-    }
-  }
-
-  // Couldn't find one - return past the end of the list
-  return virtual_items_.count();
+  // Advance i until we find any track that is in the filter, skipping the
+  // selected to be skipped, and staying on the current album if we have to.
+  return play_order_.Next(
+      i, album_only ? play_order_.album_of_row(current_row()) : -1);
 }
 
 int Playlist::PreviousVirtualIndex(int i, bool ignore_repeat_track) const {
@@ -520,35 +547,10 @@ int Playlist::PreviousVirtualIndex(int i, bool ignore_repeat_track) const {
     return i;
   }
 
-  // If we're not bothered about whether a song is on the same album then
-  // return the previous virtual index, whatever it is.
-  if (!album_only) {
-    --i;
-
-    // Decrement i until we find any track that is in the filter
-    while (i >= 0 && (!FilterContainsVirtualIndex(i) ||
-                      item_at(virtual_items_[i])->GetShouldSkip()))
-      --i;
-    return i;
-  }
-
-  // We need to decrement i until we get something else on the same album
-  Song last_song = current_item_metadata();
-  for (int j = i - 1; j >= 0; --j) {
-    if (item_at(virtual_items_[j])->GetShouldSkip()) {
-      continue;
-    }
-    Song this_song = item_at(virtual_items_[j])->Metadata();
-    if (((last_song.is_compilation() && this_song.is_compilation()) ||
-         last_song.artist() == this_song.artist()) &&
-        last_song.album() == this_song.album() &&
-        FilterContainsVirtualIndex(j)) {
-      return j;  // Found one
-    }
-  }
-
-  // Couldn't find one - return before the start of the list
-  return -1;
+  // Decrement i until we find any track that is in the filter, staying on the
+  // current album if we have to.
+  return play_order_.Previous(
+      i, album_only ? play_order_.album_of_row(current_row()) : -1);
 }
 
 int Playlist::next_row(bool ignore_repeat_track) const {
@@ -559,7 +561,7 @@ int Playlist::next_row(bool ignore_repeat_track) const {
 
   int next_virtual_index =
       NextVirtualIndex(current_virtual_index_, ignore_repeat_track);
-  if (next_virtual_index >= virtual_items_.count()) {
+  if (next_virtual_index >= play_order_.count()) {
     // We've gone off the end of the playlist.
 
     switch (playlist_sequence_->repeat_mode()) {
@@ -577,10 +579,10 @@ int Playlist::next_row(bool ignore_repeat_track) const {
   }
 
   // Still off the end?  Then just give up
-  if (next_virtual_index < 0 || next_virtual_index >= virtual_items_.count())
+  if (next_virtual_index < 0 || next_virtual_index >= play_order_.count())
     return -1;
 
-  return virtual_items_[next_virtual_index];
+  return play_order_.row_at(next_virtual_index);
 }
 
 int Playlist::previous_row(bool ignore_repeat_track) const {
@@ -598,7 +600,7 @@ int Playlist::previous_row(bool ignore_repeat_track) const {
 
       default:
         prev_virtual_index =
-            PreviousVirtualIndex(virtual_items_.count(), ignore_repeat_track);
+            PreviousVirtualIndex(play_order_.count(), ignore_repeat_track);
         break;
     }
   }
@@ -606,7 +608,7 @@ int Playlist::previous_row(bool ignore_repeat_track) const {
   // Still off the beginning?  Then just give up
   if (prev_virtual_index < 0) return -1;
 
-  return virtual_items_[prev_virtual_index];
+  return play_order_.row_at(prev_virtual_index);
 }
 
 int Playlist::dynamic_history_length() const {
@@ -643,11 +645,10 @@ void Playlist::set_current_row(int i, bool is_stopping) {
     ReshuffleIndices();
 
     // Bring the one we've been asked to play to the start of the list
-    virtual_items_.takeAt(virtual_items_.indexOf(i));
-    virtual_items_.prepend(i);
+    play_order_.MoveToFront(i);
     current_virtual_index_ = 0;
   } else if (is_shuffled_) {
-    current_virtual_index_ = virtual_items_.indexOf(i);
+    current_virtual_index_ = play_order_.position_of(i);
   } else {
     current_virtual_index_ = i;
   }
@@ -920,7 +921,8 @@ void Playlist::MoveItemsWithoutUndo(const QList<int>& source_rows, int pos) {
           pidx, index(pidx.row() + d, pidx.column(), QModelIndex()));
     }
   }
-  current_virtual_index_ = virtual_items_.indexOf(current_row());
+  play_order_.SetAlbumKeys(AlbumKeys(0, items_.count()));
+  current_virtual_index_ = play_order_.position_of(current_row());
 
   layoutChanged();
   Save();
@@ -969,7 +971,8 @@ void Playlist::MoveItemsWithoutUndo(int start, const QList<int>& dest_rows) {
           pidx, index(pidx.row() + d, pidx.column(), QModelIndex()));
     }
   }
-  current_virtual_index_ = virtual_items_.indexOf(current_row());
+  play_order_.SetAlbumKeys(AlbumKeys(0, items_.count()));
+  current_virtual_index_ = play_order_.position_of(current_row());
 
   layoutChanged();
   Save();
@@ -1042,12 +1045,12 @@ void Playlist::InsertItemsWithoutUndo(const PlaylistItemList& items, int pos,
 
   const int start = pos == -1 ? items_.count() : pos;
   const int end = start + items.count() - 1;
+  const int current_album = play_order_.album_of_row(current_row());
 
   beginInsertRows(QModelIndex(), start, end);
   for (int i = start; i <= end; ++i) {
     PlaylistItemPtr item = items[i - start];
     items_.insert(i, item);
-    virtual_items_ << virtual_items_.count();
 
     if (item->type() == "Library") {
       int id = item->Metadata().id();
@@ -1062,8 +1065,18 @@ void Playlist::InsertItemsWithoutUndo(const PlaylistItemList& items, int pos,
       last_played_item_index_ = current_item_index_;
     }
   }
+
+  // Only the new items are shuffled, the ones that haven't been played yet
+  // stay where they are.  This is done before anything connected to
+  // rowsInserted() can ask for the next song.
+  play_order_.InsertRows(start, AlbumKeys(start, items.count()),
+                         current_virtual_index_ + 1, current_album);
   endInsertRows();
 
+  if (current_row() != -1) {
+    current_virtual_index_ = play_order_.position_of(current_row());
+  }
+
   if (enqueue) {
     QModelIndexList indexes;
     for (int i = start; i <= end; ++i) {
@@ -1073,7 +1086,6 @@ void Playlist::InsertItemsWithoutUndo(const PlaylistItemList& items, int pos,
   }
 
   Save();
-  ReshuffleIndices();
 }
 
 void Playlist::InsertLibraryItems(const SongList& songs, int pos, bool play_now,
@@ -1171,6 +1183,7 @@ void Playlist::UpdateItems(const SongList& songs) {
           new_item = PlaylistItemPtr(new SongPlaylistItem(song));
         }
         items_[i] = new_item;
+        changed_items_ << new_item;
         emit dataChanged(index(i, 0), index(i, ColumnCount - 1));
         // Also update undo actions
         for (int i = 0; i < undo_stack_->count(); i++) {
@@ -1434,6 +1447,8 @@ void Playlist::ReOrderWithoutUndo(const PlaylistItemList& new_items) {
     changePersistentIndex(idx,
                           index(new_rows[item], idx.column(), idx.parent()));
   }
+  play_order_.SetAlbumKeys(AlbumKeys(0, items_.count()));
+  current_virtual_index_ = play_order_.position_of(current_row());
 
   layoutChanged();
 
@@ -1460,15 +1475,23 @@ void Playlist::SetCurrentIsPaused(bool paused) {
 void Playlist::Save() const {
   if (!backend_ || is_loading_) return;
 
-  backend_->SavePlaylistAsync(id_, items_, last_played_row(),
+  save_timer_->start();
+}
+
+void Playlist::SaveNow() {
+  save_timer_->stop();
+  if (!backend_) return;
+
+  backend_->SavePlaylistAsync(id_, items_, changed_items_, last_played_row(),
                               dynamic_playlist_);
+  changed_items_.clear();
 }
 
 void Playlist::Restore() {
   if (!backend_) return;
 
   items_.clear();
-  virtual_items_.clear();
+  play_order_.Reset();
   library_items_by_id_.clear();
 
   cancel_restore_ = false;
@@ -1627,27 +1650,18 @@ PlaylistItemList Playlist::RemoveItemsWithoutUndo(int row, int count) {
     }
   }
 
+  play_order_.RemoveRows(row, count);
   endRemoveRows();
 
-  QList<int>::iterator it = virtual_items_.begin();
-  int i = 0;
-  while (it != virtual_items_.end()) {
-    if (*it >= items_.count())
-      it = virtual_items_.erase(it);
-    else
-      ++it;
-    ++i;
-  }
-
   // Reset current_virtual_index_
   if (current_row() == -1)
     if (row - 1 > 0 && row - 1 < items_.size()) {
-      current_virtual_index_ = virtual_items_.indexOf(row - 1);
+      current_virtual_index_ = play_order_.position_of(row - 1);
     } else {
       current_virtual_index_ = -1;
     }
   else
-    current_virtual_index_ = virtual_items_.indexOf(current_row());
+    current_virtual_index_ = play_order_.position_of(current_row());
 
   Save();
   return ret;
@@ -1833,6 +1847,7 @@ void Playlist::ReloadItems(const QList<int>& rows) {
     PlaylistItemPtr item = item_at(row);
 
     item->Reload();
+    changed_items_ << item;
 
     if (row == current_row()) {
       InformOfCurrentSongChange();
@@ -1903,18 +1918,6 @@ void Playlist::Shuffle() {
   undo_stack_->push(new PlaylistUndoCommands::ShuffleItems(this, new_items));
 }
 
-namespace {
-bool AlbumShuffleComparator(const QMap<QString, int>& album_key_positions,
-                            const QMap<int, QString>& album_keys, int left,
-                            int right) {
-  const int left_pos = album_key_positions[album_keys[left]];
-  const int right_pos = album_key_positions[album_keys[right]];
-
-  if (left_pos == right_pos) return left < right;
-  return left_pos < right_pos;
-}
-}
-
 void Playlist::ReshuffleIndices() {
   if (!playlist_sequence_) {
     return;
@@ -1922,71 +1925,17 @@ void Playlist::ReshuffleIndices() {
 
   if (playlist_sequence_->shuffle_mode() == PlaylistSequence::Shuffle_Off) {
     // No shuffling - sort the virtual item list normally.
-    std::sort(virtual_items_.begin(), virtual_items_.end());
+    play_order_.Shuffle(0, -1);
     if (current_row() != -1)
-      current_virtual_index_ = virtual_items_.indexOf(current_row());
+      current_virtual_index_ = play_order_.position_of(current_row());
     return;
   }
 
-  // If the user is already playing a song, advance the begin iterator to
-  // only shuffle items that haven't been played yet.
-  QList<int>::iterator begin = virtual_items_.begin();
-  QList<int>::iterator end = virtual_items_.end();
-  if (current_virtual_index_ != -1)
-    std::advance(begin, current_virtual_index_ + 1);
-
-  switch (playlist_sequence_->shuffle_mode()) {
-    case PlaylistSequence::Shuffle_Off:
-      // Handled above.
-      break;
-
-    case PlaylistSequence::Shuffle_All:
-    case PlaylistSequence::Shuffle_InsideAlbum:
-      std::random_shuffle(begin, end);
-      break;
-
-    case PlaylistSequence::Shuffle_Albums: {
-      QMap<int, QString> album_keys;  // real index -> key
-      QSet<QString> album_key_set;    // unique keys
-
-      // Find all the unique albums in the playlist
-      for (QList<int>::iterator it = begin; it != end; ++it) {
-        const int index = *it;
-        const QString key = items_[index]->Metadata().AlbumKey();
-        album_keys[index] = key;
-        album_key_set << key;
-      }
-
-      // Shuffle them
-      QStringList shuffled_album_keys = album_key_set.toList();
-      std::random_shuffle(shuffled_album_keys.begin(),
-                          shuffled_album_keys.end());
-
-      // If the user is currently playing a song, force its album to be first
-      // Or if the song was not playing but it was selected, force its album
-      // to be first.
-      if (current_virtual_index_ != -1 || current_row() != -1) {
-        const QString key = items_[current_row()]->Metadata().AlbumKey();
-        const int pos = shuffled_album_keys.indexOf(key);
-        if (pos >= 1) {
-          std::swap(shuffled_album_keys[0], shuffled_album_keys[pos]);
-        }
-      }
-
-      // Create album key -> position mapping for fast lookup
-      QMap<QString, int> album_key_positions;
-      for (int i = 0; i < shuffled_album_keys.count(); ++i) {
-        album_key_positions[shuffled_album_keys[i]] = i;
-      }
-
-      // Sort the virtual items
-      std::stable_sort(begin, end,
-                       std::bind(AlbumShuffleComparator, album_key_positions,
-                                 album_keys, _1, _2));
-
-      break;
-    }
-  }
+  // If the user is already playing a song, only shuffle items that haven't
+  // been played yet.  If the user is currently playing a song, or it was
+  // selected but not playing, album shuffle forces its album to be first.
+  play_order_.Shuffle(current_virtual_index_ + 1,
+                      play_order_.album_of_row(current_row()));
 }
 
 void Playlist::set_sequence(PlaylistSequence* v) {
@@ -23,6 +23,7 @@
 
 #include "playlistitem.h"
 #include "playlistsequence.h"
+#include "playorder.h"
 #include "core/tagreaderclient.h"
 #include "core/song.h"
 #include "smartplaylists/generator_fwd.h"
@@ -36,6 +37,7 @@ class InternetService;
 class TaskManager;
 
 class QSortFilterProxyModel;
+class QTimer;
 class QUndoStack;
 
 namespace PlaylistUndoCommands {
@@ -164,6 +166,8 @@ class Playlist : public QAbstractListModel {
   static const qint64 kMinScrobblePointNsecs;
   static const qint64 kMaxScrobblePointNsecs;
 
+  static const int kSaveDelayMsec;
+
   static bool CompareItems(int column, Qt::SortOrder order, PlaylistItemPtr a,
                            PlaylistItemPtr b);
 
@@ -174,7 +178,8 @@ class Playlist : public QAbstractListModel {
   static bool set_column_value(Song& song, Column column,
                                const QVariant& value);
 
-  // Persistence
+  // Persistence.  Save() waits for kSaveDelayMsec so a burst of changes is
+  // written to the database in one go.
   void Save() const;
   void Restore();
 
@@ -359,6 +364,7 @@ signals:
   int NextVirtualIndex(int i, bool ignore_repeat_track) const;
   int PreviousVirtualIndex(int i, bool ignore_repeat_track) const;
   bool FilterContainsVirtualIndex(int i) const;
+  QStringList AlbumKeys(int first, int count) const;
   void TurnOnDynamicPlaylist(smart_playlists::GeneratorPtr gen);
 
   void InsertInternetItems(const InternetModel* model,
@@ -396,6 +402,10 @@ signals:
   void ItemReloadComplete(const QPersistentModelIndex& index);
   void ItemsLoaded(QFuture<PlaylistItemList> future);
   void SongInsertVetoListenerDestroyed();
+  void SaveNow();
+  void FilterChanged();
+  void RowsChanged(const QModelIndex& top_left,
+                   const QModelIndex& bottom_right);
 
  private:
   bool is_loading_;
@@ -412,8 +422,7 @@ signals:
   bool favorite_;
 
   PlaylistItemList items_;
-  QList<int> virtual_items_;  // Contains the indices into items_ in the order
-                              // that they will be played.
+  PlayOrder play_order_;  // The order that items_ will be played in.
   // A map of library ID to playlist item - for fast lookups when library
   // items change.
   QMultiMap<int, PlaylistItemPtr> library_items_by_id_;
@@ -446,6 +455,11 @@ signals:
 
   // Cancel async restore if songs are already replaced
   bool cancel_restore_;
+
+  QTimer* save_timer_;
+  // Items whose metadata changed in place since the last save.  Other
+  // changes are worked out by PlaylistBackend from the list of items.
+  PlaylistItemList changed_items_;
 };
 
 // QDataStream& operator <<(QDataStream&, const Playlist*);
@@ -20,10 +20,12 @@
 #include <memory>
 #include <functional>
 
+#include <QCoreApplication>
 #include <QFile>
 #include <QHash>
 #include <QMutexLocker>
 #include <QSqlQuery>
+#include <QThread>
 #include <QtDebug>
 
 #include "core/application.h"
@@ -32,6 +34,8 @@
 #include "core/scopedtransaction.h"
 #include "core/song.h"
 #include "library/librarybackend.h"
+#include "library/libraryplaylistitem.h"
+#include "library/songdecoder.h"
 #include "library/sqlrow.h"
 #include "playlist/songplaylistitem.h"
 #include "playlistparsers/cueparser.h"
@@ -43,10 +47,24 @@ using std::shared_ptr;
 using smart_playlists::GeneratorPtr;
 
 const int PlaylistBackend::kSongTableJoins = 4;
+const qint64 PlaylistBackend::kPositionGap = 1 << 16;
+
+static QString InsertItemQuery() {
+  return "INSERT INTO playlist_items"
+         " (playlist, position, type, library_id, radio_service, " +
+         Song::kColumnSpec +
+         ")"
+         " VALUES (:playlist, :position, :type, :library_id, :radio_service, " +
+         Song::kBindSpec + ")";
+}
 
 PlaylistBackend::PlaylistBackend(Application* app, QObject* parent)
     : QObject(parent), app_(app), db_(app_->database()) {}
 
+PlaylistBackend::PlaylistBackend(Application* app, Database* db,
+                                 QObject* parent)
+    : QObject(parent), app_(app), db_(db) {}
+
 PlaylistBackend::PlaylistList PlaylistBackend::GetAllPlaylists() {
   return GetPlaylists(GetPlaylists_All);
 }
@@ -61,7 +79,7 @@ PlaylistBackend::PlaylistList PlaylistBackend::GetAllFavoritePlaylists() {
 
 PlaylistBackend::PlaylistList PlaylistBackend::GetPlaylists(
     GetPlaylistsFlags flags) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   PlaylistList ret;
@@ -107,7 +125,7 @@ PlaylistBackend::PlaylistList PlaylistBackend::GetPlaylists(
 }
 
 PlaylistBackend::Playlist PlaylistBackend::GetPlaylist(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -137,11 +155,49 @@ PlaylistBackend::Playlist PlaylistBackend::GetPlaylist(int id) {
   return p;
 }
 
-QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist) {
-  QMutexLocker l(db_->Mutex());
+shared_ptr<PlaylistBackend::NewSongFromQueryState>
+PlaylistBackend::NewQueryState(int playlist) {
+  // it's probable that we'll have a few songs associated with the
+  // same CUE so we're caching results of parsing CUEs
+  shared_ptr<NewSongFromQueryState> state(new NewSongFromQueryState);
+
+  // Library songs are usually most of a playlist.  Decoding them straight
+  // from sqlite is much faster than going through QSqlQuery and QVariant for
+  // every column of every row.  Items from the other song tables are rare,
+  // so they're left alone.
+  Database::Locker l(db_, Database::Lock_Read);
+  QSqlDatabase db(db_->Connect());
+
+  SongList songs;
+  SongDecoder decoder;
+  if (decoder.Exec(db, "SELECT ROWID, " + Song::kColumnSpec +
+                           " FROM songs WHERE ROWID IN ("
+                           "   SELECT library_id FROM playlist_items"
+                           "   WHERE playlist = ? AND type = 'Library')",
+                   QVariantList() << playlist, &songs)) {
+    state->library_songs_.reserve(songs.count());
+    for (const Song& song : songs) {
+      state->library_songs_.insert(song.id(), song);
+    }
+    state->have_library_songs_ = true;
+  }
+
+  return state;
+}
+
+QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist, bool library_columns) {
+  Database::Locker l(db_, Database::Lock_Read);
   QSqlDatabase db(db_->Connect());
 
-  QString query = "SELECT songs.ROWID, " + Song::JoinSpec("songs") +
+  // Keep the other columns where the playlist items expect them.
+  QString library_spec = Song::JoinSpec("songs");
+  if (!library_columns) {
+    QStringList nulls;
+    for (int i = 0; i < Song::kColumns.count(); ++i) nulls << "NULL";
+    library_spec = nulls.join(", ");
+  }
+
+  QString query = "SELECT songs.ROWID, " + library_spec +
                   ","
                   "       magnatune_songs.ROWID, " +
                   Song::JoinSpec("magnatune_songs") +
@@ -152,7 +208,7 @@ QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist) {
                   "       p.ROWID, " +
                   Song::JoinSpec("p") +
                   ","
-                  "       p.type, p.radio_service"
+                  "       p.type, p.radio_service, p.position"
                   " FROM playlist_items AS p"
                   " LEFT JOIN songs"
                   "    ON p.library_id = songs.ROWID"
@@ -160,7 +216,8 @@ QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist) {
                   "    ON p.library_id = magnatune_songs.ROWID"
                   " LEFT JOIN jamendo.songs AS jamendo_songs"
                   "    ON p.library_id = jamendo_songs.ROWID"
-                  " WHERE p.playlist = :playlist";
+                  " WHERE p.playlist = :playlist"
+                  " ORDER BY p.position, p.ROWID";
   QSqlQuery q(db);
   // Forward iterations only may be faster
   q.setForwardOnly(true);
@@ -172,30 +229,67 @@ QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist) {
 }
 
 QList<PlaylistItemPtr> PlaylistBackend::GetPlaylistItems(int playlist) {
-  QSqlQuery q = GetPlaylistRows(playlist);
+  int save_count = 0;
+  {
+    QMutexLocker l(&saved_playlists_mutex_);
+    save_count = save_counts_.value(playlist);
+  }
+
+  shared_ptr<NewSongFromQueryState> state_ptr = NewQueryState(playlist);
+  QSqlQuery q = GetPlaylistRows(playlist, !state_ptr->have_library_songs_);
   // Note that as this only accesses the query, not the db, we don't need the
   // mutex.
   if (db_->CheckErrors(q)) return QList<PlaylistItemPtr>();
 
-  // it's probable that we'll have a few songs associated with the
-  // same CUE so we're caching results of parsing CUEs
-  std::shared_ptr<NewSongFromQueryState> state_ptr(new NewSongFromQueryState());
+  // p.ROWID comes after the other joined song tables, and p.position after
+  // p.type and p.radio_service.
+  const int columns_per_join = Song::kColumns.count() + 1;
+  const int rowid_column = columns_per_join * (kSongTableJoins - 1);
+  const int position_column = columns_per_join * kSongTableJoins + 2;
+
   QList<PlaylistItemPtr> playlistitems;
+
+  // Remember which row each item came from, so the next save only has to
+  // write the rows that changed.
+  SavedPlaylist saved;
+  bool saved_complete = true;
+
   while (q.next()) {
-    playlistitems << NewPlaylistItemFromQuery(SqlRow(q), state_ptr);
+    SqlRow row(q);
+    PlaylistItemPtr item = NewPlaylistItemFromQuery(row, state_ptr);
+    playlistitems << item;
+
+    if (!item || row.value(position_column).isNull()) {
+      saved_complete = false;
+      continue;
+    }
+
+    SavedItem saved_item;
+    saved_item.item = item;
+    saved_item.rowid = row.value(rowid_column).toLongLong();
+    saved_item.position = row.value(position_column).toLongLong();
+    saved[item.get()] = saved_item;
   }
+
+  QMutexLocker l(&saved_playlists_mutex_);
+  if (save_counts_.value(playlist) == save_count) {
+    if (saved_complete) {
+      saved_playlists_[playlist] = saved;
+    } else {
+      saved_playlists_.remove(playlist);
+    }
+  }
+
   return playlistitems;
 }
 
 QList<Song> PlaylistBackend::GetPlaylistSongs(int playlist) {
-  QSqlQuery q = GetPlaylistRows(playlist);
+  shared_ptr<NewSongFromQueryState> state_ptr = NewQueryState(playlist);
+  QSqlQuery q = GetPlaylistRows(playlist, !state_ptr->have_library_songs_);
   // Note that as this only accesses the query, not the db, we don't need the
   // mutex.
   if (db_->CheckErrors(q)) return QList<Song>();
 
-  // it's probable that we'll have a few songs associated with the
-  // same CUE so we're caching results of parsing CUEs
-  std::shared_ptr<NewSongFromQueryState> state_ptr(new NewSongFromQueryState());
   QList<Song> songs;
   while (q.next()) {
     songs << NewSongFromQuery(SqlRow(q), state_ptr);
@@ -210,12 +304,20 @@ PlaylistItemPtr PlaylistBackend::NewPlaylistItemFromQuery(
 
   PlaylistItemPtr item(
       PlaylistItem::NewFromType(row.value(playlist_row).toString()));
-  if (item) {
-    item->InitFromQuery(row);
-    return RestoreCueData(item, state);
+  if (!item) return item;
+
+  // The songs table's ROWID comes first.  Its other columns are NULL when the
+  // songs were decoded up front, just as they are for a song that's gone from
+  // the library, so those still go through InitFromQuery.
+  const int id = row.value(0).isNull() ? -1 : row.value(0).toInt();
+  if (state->have_library_songs_ && item->type() == "Library" &&
+      state->library_songs_.contains(id)) {
+    static_cast<LibraryPlaylistItem*>(item.get())
+        ->SetMetadata(state->library_songs_[id]);
   } else {
-    return item;
+    item->InitFromQuery(row);
   }
+  return RestoreCueData(item, state);
 }
 
 Song PlaylistBackend::NewSongFromQuery(
@@ -279,29 +381,55 @@ PlaylistItemPtr PlaylistBackend::RestoreCueData(
 
 void PlaylistBackend::SavePlaylistAsync(int playlist,
                                         const PlaylistItemList& items,
+                                        const PlaylistItemList& changed_items,
                                         int last_played, GeneratorPtr dynamic) {
   metaObject()->invokeMethod(
       this, "SavePlaylist", Qt::QueuedConnection, Q_ARG(int, playlist),
-      Q_ARG(PlaylistItemList, items), Q_ARG(int, last_played),
-      Q_ARG(smart_playlists::GeneratorPtr, dynamic));
+      Q_ARG(PlaylistItemList, items), Q_ARG(PlaylistItemList, changed_items),
+      Q_ARG(int, last_played), Q_ARG(smart_playlists::GeneratorPtr, dynamic));
+}
+
+void PlaylistBackend::SavePlaylistBlocking(
+    int playlist, const PlaylistItemList& items,
+    const PlaylistItemList& changed_items, int last_played,
+    GeneratorPtr dynamic) {
+  if (thread() == QThread::currentThread()) {
+    // Run the saves that are still queued first, so they can't overwrite
+    // this one afterwards.
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+  } else if (thread()->isRunning()) {
+    metaObject()->invokeMethod(
+        this, "SavePlaylist", Qt::BlockingQueuedConnection,
+        Q_ARG(int, playlist), Q_ARG(PlaylistItemList, items),
+        Q_ARG(PlaylistItemList, changed_items), Q_ARG(int, last_played),
+        Q_ARG(smart_playlists::GeneratorPtr, dynamic));
+    return;
+  } else {
+    // The thread has stopped, so anything still queued for it is lost -
+    // including the items that changed in place.  Write the whole playlist.
+    QMutexLocker l(&saved_playlists_mutex_);
+    saved_playlists_.remove(playlist);
+  }
+
+  SavePlaylist(playlist, items, changed_items, last_played, dynamic);
 }
 
 void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
+                                   const PlaylistItemList& changed_items,
                                    int last_played, GeneratorPtr dynamic) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
-  qLog(Debug) << "Saving playlist" << playlist;
+  // Forget what's in the database until the transaction has been committed,
+  // in case it gets rolled back.
+  SavedPlaylist saved;
+  bool have_saved = false;
+  {
+    QMutexLocker saved_l(&saved_playlists_mutex_);
+    have_saved = saved_playlists_.contains(playlist);
+    saved = saved_playlists_.take(playlist);
+  }
 
-  QSqlQuery clear("DELETE FROM playlist_items WHERE playlist = :playlist", db);
-  QSqlQuery insert(
-      "INSERT INTO playlist_items"
-      " (playlist, type, library_id, radio_service, " +
-          Song::kColumnSpec +
-          ")"
-          " VALUES (:playlist, :type, :library_id, :radio_service, " +
-          Song::kBindSpec + ")",
-      db);
   QSqlQuery update(
       "UPDATE playlists SET "
       "   last_played=:last_played,"
@@ -313,18 +441,18 @@ void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
 
   ScopedTransaction transaction(&db);
 
-  // Clear the existing items in the playlist
-  clear.bindValue(":playlist", playlist);
-  clear.exec();
-  if (db_->CheckErrors(clear)) return;
-
-  // Save the new ones
-  for (PlaylistItemPtr item : items) {
-    insert.bindValue(":playlist", playlist);
-    item->BindToQuery(&insert);
+  QSet<const PlaylistItem*> changed;
+  for (PlaylistItemPtr item : changed_items) {
+    changed.insert(item.get());
+  }
 
-    insert.exec();
-    db_->CheckErrors(insert);
+  QVector<qint64> positions;
+  if (have_saved && AssignPositions(items, saved, changed, &positions)) {
+    if (!WriteChangedItems(db, playlist, items, changed, positions, &saved))
+      return;
+  } else {
+    qLog(Debug) << "Saving playlist" << playlist;
+    if (!WriteAllItems(db, playlist, items, &saved)) return;
   }
 
   // Update the last played track number
@@ -343,11 +471,203 @@ void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
   if (db_->CheckErrors(update)) return;
 
   transaction.Commit();
+
+  QMutexLocker saved_l(&saved_playlists_mutex_);
+  save_counts_[playlist]++;
+
+  // Items are tracked by pointer, so a playlist containing the same item
+  // twice can't be saved incrementally.
+  if (saved.count() == items.count()) {
+    saved_playlists_[playlist] = saved;
+  }
+}
+
+bool PlaylistBackend::AssignPositions(const PlaylistItemList& items,
+                                      const SavedPlaylist& saved,
+                                      const QSet<const PlaylistItem*>& changed,
+                                      QVector<qint64>* positions) {
+  const int count = items.count();
+
+  // The saved position of each item, or -1 if it has to be inserted.
+  QVector<qint64> saved_positions(count, -1);
+  for (int i = 0; i < count; ++i) {
+    const PlaylistItem* item = items[i].get();
+    SavedPlaylist::const_iterator it = saved.constFind(item);
+    if (it != saved.constEnd() && !changed.contains(item)) {
+      saved_positions[i] = it->position;
+    }
+  }
+
+  // The longest sequence of items that are still in order keep their
+  // positions.  tails[n] is the last item of the best sequence of length n+1.
+  QVector<int> tails;
+  QVector<int> previous(count, -1);
+  for (int i = 0; i < count; ++i) {
+    const qint64 position = saved_positions[i];
+    if (position == -1) continue;
+
+    int low = 0;
+    int high = tails.count();
+    while (low < high) {
+      const int mid = (low + high) / 2;
+      if (saved_positions[tails[mid]] < position) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+
+    if (low > 0) previous[i] = tails[low - 1];
+    if (low == tails.count()) {
+      tails << i;
+    } else {
+      tails[low] = i;
+    }
+  }
+
+  QVector<bool> keep(count, false);
+  for (int i = tails.isEmpty() ? -1 : tails.last(); i != -1; i = previous[i]) {
+    keep[i] = true;
+  }
+
+  // Space everything else out evenly in the gaps between the items that keep
+  // their positions.
+  positions->resize(count);
+  qint64 low = 0;
+  int run_start = 0;
+  for (int i = 0; i <= count; ++i) {
+    if (i < count && !keep[i]) continue;
+
+    const int run_length = i - run_start;
+    if (run_length > 0) {
+      const qint64 high = i < count ? saved_positions[i]
+                                    : low + kPositionGap * (run_length + 1);
+      const qint64 step = (high - low) / (run_length + 1);
+      if (step < 1) return false;
+
+      for (int j = 0; j < run_length; ++j) {
+        (*positions)[run_start + j] = low + step * (j + 1);
+      }
+    }
+
+    if (i < count) {
+      low = (*positions)[i] = saved_positions[i];
+    }
+    run_start = i + 1;
+  }
+
+  return true;
+}
+
+bool PlaylistBackend::WriteAllItems(QSqlDatabase& db, int playlist,
+                                    const PlaylistItemList& items,
+                                    SavedPlaylist* saved) {
+  QSqlQuery clear("DELETE FROM playlist_items WHERE playlist = :playlist", db);
+  QSqlQuery insert(InsertItemQuery(), db);
+
+  // Clear the existing items in the playlist
+  clear.bindValue(":playlist", playlist);
+  clear.exec();
+  if (db_->CheckErrors(clear)) return false;
+
+  saved->clear();
+
+  // Save the new ones
+  qint64 position = 0;
+  for (PlaylistItemPtr item : items) {
+    position += kPositionGap;
+
+    insert.bindValue(":playlist", playlist);
+    insert.bindValue(":position", position);
+    item->BindToQuery(&insert);
+
+    insert.exec();
+    if (db_->CheckErrors(insert)) continue;
+
+    SavedItem saved_item;
+    saved_item.item = item;
+    saved_item.rowid = insert.lastInsertId().toLongLong();
+    saved_item.position = position;
+    saved->insert(item.get(), saved_item);
+  }
+
+  return true;
+}
+
+bool PlaylistBackend::WriteChangedItems(
+    QSqlDatabase& db, int playlist, const PlaylistItemList& items,
+    const QSet<const PlaylistItem*>& changed, const QVector<qint64>& positions,
+    SavedPlaylist* saved) {
+  QSqlQuery remove("DELETE FROM playlist_items WHERE ROWID = :id", db);
+  QSqlQuery move(
+      "UPDATE playlist_items SET position = :position WHERE ROWID = :id", db);
+  QSqlQuery insert(InsertItemQuery(), db);
+
+  QSet<const PlaylistItem*> present;
+  for (PlaylistItemPtr item : items) {
+    present.insert(item.get());
+  }
+
+  // Remove the rows of items that have gone, and of items that changed and
+  // are written out again below.
+  int removed_count = 0;
+  for (const SavedItem& saved_item : *saved) {
+    const PlaylistItem* item = saved_item.item.get();
+    if (present.contains(item) && !changed.contains(item)) continue;
+
+    remove.bindValue(":id", saved_item.rowid);
+    remove.exec();
+    if (db_->CheckErrors(remove)) return false;
+    removed_count++;
+  }
+
+  SavedPlaylist new_saved;
+  int moved_count = 0;
+  int inserted_count = 0;
+
+  for (int i = 0; i < items.count(); ++i) {
+    PlaylistItemPtr item = items[i];
+
+    SavedItem saved_item;
+    saved_item.item = item;
+    saved_item.position = positions[i];
+
+    SavedPlaylist::const_iterator it = saved->constFind(item.get());
+    if (it != saved->constEnd() && !changed.contains(item.get())) {
+      saved_item.rowid = it->rowid;
+
+      if (it->position != positions[i]) {
+        move.bindValue(":position", positions[i]);
+        move.bindValue(":id", it->rowid);
+        move.exec();
+        if (db_->CheckErrors(move)) return false;
+        moved_count++;
+      }
+    } else {
+      insert.bindValue(":playlist", playlist);
+      insert.bindValue(":position", positions[i]);
+      item->BindToQuery(&insert);
+      insert.exec();
+      if (db_->CheckErrors(insert)) return false;
+
+      saved_item.rowid = insert.lastInsertId().toLongLong();
+      inserted_count++;
+    }
+
+    new_saved.insert(item.get(), saved_item);
+  }
+
+  qLog(Debug) << "Saving playlist" << playlist << "-" << inserted_count
+              << "inserted," << moved_count << "moved," << removed_count
+              << "removed";
+
+  *saved = new_saved;
+  return true;
 }
 
 int PlaylistBackend::CreatePlaylist(const QString& name,
                                     const QString& special_type) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
 
   QSqlQuery q(
@@ -359,11 +679,17 @@ int PlaylistBackend::CreatePlaylist(const QString& name,
   q.exec();
   if (db_->CheckErrors(q)) return -1;
 
-  return q.lastInsertId().toInt();
+  const int id = q.lastInsertId().toInt();
+
+  // A new playlist has no rows, so it can be saved incrementally right away.
+  QMutexLocker saved_l(&saved_playlists_mutex_);
+  saved_playlists_[id] = SavedPlaylist();
+
+  return id;
 }
 
 void PlaylistBackend::RemovePlaylist(int id) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   QSqlQuery delete_playlist("DELETE FROM playlists WHERE ROWID=:id", db);
   QSqlQuery delete_items("DELETE FROM playlist_items WHERE playlist=:id", db);
@@ -379,11 +705,26 @@ void PlaylistBackend::RemovePlaylist(int id) {
   delete_items.exec();
   if (db_->CheckErrors(delete_items)) return;
 
+  {
+    QMutexLocker saved_l(&saved_playlists_mutex_);
+    saved_playlists_.remove(id);
+  }
+
   transaction.Commit();
 }
 
+void PlaylistBackend::ForgetPlaylist(int id) {
+  metaObject()->invokeMethod(this, "ForgetSavedPlaylist", Qt::QueuedConnection,
+                             Q_ARG(int, id));
+}
+
+void PlaylistBackend::ForgetSavedPlaylist(int id) {
+  QMutexLocker l(&saved_playlists_mutex_);
+  saved_playlists_.remove(id);
+}
+
 void PlaylistBackend::RenamePlaylist(int id, const QString& new_name) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET name=:name WHERE ROWID=:id", db);
   q.bindValue(":name", new_name);
@@ -394,7 +735,7 @@ void PlaylistBackend::RenamePlaylist(int id, const QString& new_name) {
 }
 
 void PlaylistBackend::FavoritePlaylist(int id, bool is_favorite) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET is_favorite=:is_favorite WHERE ROWID=:id",
               db);
@@ -406,7 +747,7 @@ void PlaylistBackend::FavoritePlaylist(int id, bool is_favorite) {
 }
 
 void PlaylistBackend::SetPlaylistOrder(const QList<int>& ids) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   ScopedTransaction transaction(&db);
 
@@ -426,7 +767,7 @@ void PlaylistBackend::SetPlaylistOrder(const QList<int>& ids) {
 }
 
 void PlaylistBackend::SetPlaylistUiPath(int id, const QString& path) {
-  QMutexLocker l(db_->Mutex());
+  Database::Locker l(db_, Database::Lock_Write);
   QSqlDatabase db(db_->Connect());
   QSqlQuery q("UPDATE playlists SET ui_path=:path WHERE ROWID=:id", db);
 
@@ -20,12 +20,17 @@
 
 #include <QHash>
 #include <QList>
+#include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QSet>
+#include <QVector>
 
 #include "playlistitem.h"
 #include "smartplaylists/generator_fwd.h"
 
+#include "gtest/gtest_prod.h"
+
 class Application;
 class Database;
 
@@ -34,6 +39,8 @@ class PlaylistBackend : public QObject {
 
  public:
   Q_INVOKABLE PlaylistBackend(Application* app, QObject* parent = nullptr);
+  // Uses db instead of the application's database.
+  PlaylistBackend(Application* app, Database* db, QObject* parent = nullptr);
 
   struct Playlist {
     Playlist() : id(-1), favorite(false), last_played(0) {}
@@ -55,6 +62,11 @@ class PlaylistBackend : public QObject {
 
   static const int kSongTableJoins;
 
+  // Gap left between the positions of adjacent items when a playlist is
+  // written out in full, so items can be inserted or moved between them later
+  // without renumbering the rest.
+  static const qint64 kPositionGap;
+
   PlaylistList GetAllPlaylists();
   PlaylistList GetAllOpenPlaylists();
   PlaylistList GetAllFavoritePlaylists();
@@ -68,25 +80,85 @@ class PlaylistBackend : public QObject {
 
   int CreatePlaylist(const QString& name, const QString& special_type);
   void SavePlaylistAsync(int playlist, const PlaylistItemList& items,
+                         const PlaylistItemList& changed_items,
                          int last_played,
                          smart_playlists::GeneratorPtr dynamic);
+  // Saves the playlist and waits for it to be written, after any saves that
+  // are still queued.  Safe to call once the backend's thread has stopped.
+  void SavePlaylistBlocking(int playlist, const PlaylistItemList& items,
+                            const PlaylistItemList& changed_items,
+                            int last_played,
+                            smart_playlists::GeneratorPtr dynamic);
   void RenamePlaylist(int id, const QString& new_name);
   void FavoritePlaylist(int id, bool is_favorite);
   void RemovePlaylist(int id);
+  // Drops what's known about a playlist's rows once it's been closed, after
+  // any saves that are still queued.  It's written out in full if it's
+  // opened and saved again.
+  void ForgetPlaylist(int id);
 
   Application* app() const { return app_; }
 
  public slots:
+  // Only writes the rows that changed since the playlist was last loaded or
+  // saved.  changed_items are items whose metadata changed in place.
   void SavePlaylist(int playlist, const PlaylistItemList& items,
-                    int last_played, smart_playlists::GeneratorPtr dynamic);
+                    const PlaylistItemList& changed_items, int last_played,
+                    smart_playlists::GeneratorPtr dynamic);
+
+ private slots:
+  void ForgetSavedPlaylist(int id);
 
  private:
+  FRIEND_TEST(PlaylistBackendTest, AssignPositionsKeepsItemsInOrder);
+  FRIEND_TEST(PlaylistBackendTest, AssignPositionsMovesItemsOutOfOrder);
+  FRIEND_TEST(PlaylistBackendTest, AssignPositionsWritesChangedItemsAgain);
+  FRIEND_TEST(PlaylistBackendTest, AssignPositionsFailsWhenGapIsFull);
+
   struct NewSongFromQueryState {
+    NewSongFromQueryState() : have_library_songs_(false) {}
+
     QHash<QString, SongList> cached_cues_;
     QMutex mutex_;
+
+    // The playlist's library songs by ID, if they could be decoded up front.
+    // Otherwise they come from the songs table columns of each row.
+    QHash<int, Song> library_songs_;
+    bool have_library_songs_;
   };
 
-  QSqlQuery GetPlaylistRows(int playlist);
+  // A row in the playlist_items table.
+  struct SavedItem {
+    PlaylistItemPtr item;
+    qint64 rowid;
+    qint64 position;
+  };
+  // The rows in the database for a playlist, keyed by the item they were
+  // written from.  The items are held so their pointers can't be reused.
+  typedef QHash<const PlaylistItem*, SavedItem> SavedPlaylist;
+
+  // Sets state up for the rows GetPlaylistRows() returns.
+  std::shared_ptr<NewSongFromQueryState> NewQueryState(int playlist);
+  // Without library_columns the songs table's columns are all NULL, apart
+  // from its ROWID.
+  QSqlQuery GetPlaylistRows(int playlist, bool library_columns);
+
+  // Works out a position for each item, keeping as many of the saved
+  // positions as possible so only moved items need their rows updating.
+  // Returns false if there's no room left between the positions of the
+  // surrounding items, and the playlist has to be renumbered.
+  static bool AssignPositions(const PlaylistItemList& items,
+                              const SavedPlaylist& saved,
+                              const QSet<const PlaylistItem*>& changed,
+                              QVector<qint64>* positions);
+
+  bool WriteAllItems(QSqlDatabase& db, int playlist,
+                     const PlaylistItemList& items, SavedPlaylist* saved);
+  bool WriteChangedItems(QSqlDatabase& db, int playlist,
+                         const PlaylistItemList& items,
+                         const QSet<const PlaylistItem*>& changed,
+                         const QVector<qint64>& positions,
+                         SavedPlaylist* saved);
 
   Song NewSongFromQuery(const SqlRow& row,
                         std::shared_ptr<NewSongFromQueryState> state);
@@ -104,6 +176,14 @@ class PlaylistBackend : public QObject {
 
   Application* app_;
   Database* db_;
+
+  // Playlists whose rows in the database are known exactly.  Others are
+  // written out in full the next time they're saved.
+  QMap<int, SavedPlaylist> saved_playlists_;
+  // Incremented each time a playlist is saved, so a load that raced with a
+  // save doesn't replace the newer state.
+  QMap<int, int> save_counts_;
+  QMutex saved_playlists_mutex_;
 };
 
 #endif  // PLAYLISTBACKEND_H
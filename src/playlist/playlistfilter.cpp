@@ -18,12 +18,36 @@
 #include "playlistfilter.h"
 #include "playlistfilterparser.h"
 
+#include <QtConcurrentMap>
 #include <QtDebug>
 
+namespace {
+
+// A range of rows that's tested against a filter on one thread.  Each chunk
+// only touches its own rows.
+struct FilterChunk {
+  const FilterTree* tree;
+  FilterRow* const* rows;
+  bool* results;
+  int begin;
+  int end;
+};
+
+void TestFilterChunk(FilterChunk& chunk) {
+  for (int i = chunk.begin; i < chunk.end; ++i) {
+    chunk.results[i] = chunk.tree->accept(chunk.rows[i]);
+  }
+}
+
+}  // namespace
+
+const int PlaylistFilter::kParallelFilterRows = 2000;
+const int PlaylistFilter::kFilterChunkSize = 1000;
+
 PlaylistFilter::PlaylistFilter(QObject* parent)
     : QSortFilterProxyModel(parent),
-      filter_tree_(new NopFilter),
-      query_hash_(0) {
+      playlist_(nullptr),
+      filter_tree_(new NopFilter) {
   setDynamicSortFilter(true);
 
   column_names_["title"] = Playlist::Column_Title;
@@ -61,19 +85,168 @@ void PlaylistFilter::sort(int column, Qt::SortOrder order) {
   sourceModel()->sort(column, order);
 }
 
+void PlaylistFilter::setSourceModel(QAbstractItemModel* source_model) {
+  if (sourceModel()) {
+    disconnect(sourceModel(),
+               SIGNAL(dataChanged(QModelIndex, QModelIndex)), this,
+               SLOT(SourceDataChanged(QModelIndex, QModelIndex)));
+    disconnect(sourceModel(), SIGNAL(rowsInserted(QModelIndex, int, int)),
+               this, SLOT(SourceRowsInserted(QModelIndex, int, int)));
+    disconnect(sourceModel(),
+               SIGNAL(rowsAboutToBeRemoved(QModelIndex, int, int)), this,
+               SLOT(SourceRowsAboutToBeRemoved(QModelIndex, int, int)));
+    disconnect(sourceModel(), SIGNAL(modelAboutToBeReset()), this,
+               SLOT(SourceModelAboutToBeReset()));
+  }
+
+  playlist_ = qobject_cast<Playlist*>(source_model);
+  rows_.clear();
+  accepted_.clear();
+  filter_.clear();
+
+  // These have to be connected before QSortFilterProxyModel connects its own
+  // slots, so stale results are gone by the time it filters changed rows.
+  if (source_model) {
+    connect(source_model, SIGNAL(dataChanged(QModelIndex, QModelIndex)),
+            SLOT(SourceDataChanged(QModelIndex, QModelIndex)));
+    connect(source_model, SIGNAL(rowsInserted(QModelIndex, int, int)),
+            SLOT(SourceRowsInserted(QModelIndex, int, int)));
+    connect(source_model, SIGNAL(rowsAboutToBeRemoved(QModelIndex, int, int)),
+            SLOT(SourceRowsAboutToBeRemoved(QModelIndex, int, int)));
+    connect(source_model, SIGNAL(modelAboutToBeReset()),
+            SLOT(SourceModelAboutToBeReset()));
+  }
+
+  QSortFilterProxyModel::setSourceModel(source_model);
+}
+
+void PlaylistFilter::SourceDataChanged(const QModelIndex& top_left,
+                                       const QModelIndex& bottom_right) {
+  if (!playlist_) return;
+
+  // The row might hold a new item, so forget the cached values as well.
+  for (int row = top_left.row(); row <= bottom_right.row(); ++row) {
+    const PlaylistItem* item = playlist_->item_at(row).get();
+    rows_.remove(item);
+    accepted_.remove(item);
+  }
+}
+
+void PlaylistFilter::SourceRowsInserted(const QModelIndex& parent, int start,
+                                        int end) {
+  if (!playlist_) return;
+
+  for (int row = start; row <= end; ++row) {
+    const PlaylistItem* item = playlist_->item_at(row).get();
+    rows_.remove(item);
+    accepted_.remove(item);
+  }
+}
+
+void PlaylistFilter::SourceRowsAboutToBeRemoved(const QModelIndex& parent,
+                                                int start, int end) {
+  if (!playlist_) return;
+
+  for (int row = start; row <= end; ++row) {
+    const PlaylistItem* item = playlist_->item_at(row).get();
+    rows_.remove(item);
+    accepted_.remove(item);
+  }
+}
+
+void PlaylistFilter::SourceModelAboutToBeReset() {
+  rows_.clear();
+  accepted_.clear();
+
+  // Test all the new rows in one go the next time the proxy filters them
+  filter_.clear();
+}
+
+FilterRow* PlaylistFilter::CachedRow(const PlaylistItem* item) const {
+  const Song song = item->Metadata();
+
+  QHash<const PlaylistItem*, FilterRow>::iterator it = rows_.find(item);
+  if (it == rows_.end()) {
+    it = rows_.insert(item, FilterRow(song));
+  } else if (!it->song().SharesDataWith(song)) {
+    *it = FilterRow(song);
+  }
+  return &it.value();
+}
+
+void PlaylistFilter::SetFilter(const QString& filter) const {
+  FilterParser p(filter, column_names_, numerical_columns_);
+  filter_tree_.reset(p.parse());
+  filter_ = filter;
+  accepted_.clear();
+
+  if (!playlist_ || filter_tree_->type() == FilterTree::Nop) return;
+
+  const int count = playlist_->rowCount();
+  QVector<const PlaylistItem*> items(count);
+
+  // Only keep the cached values of items that are still in the playlist
+  QHash<const PlaylistItem*, FilterRow> old_rows;
+  old_rows.swap(rows_);
+  rows_.reserve(count);
+
+  for (int i = 0; i < count; ++i) {
+    const PlaylistItem* item = playlist_->item_at(i).get();
+    items[i] = item;
+
+    QHash<const PlaylistItem*, FilterRow>::const_iterator it =
+        old_rows.constFind(item);
+    if (it != old_rows.constEnd()) rows_.insert(item, it.value());
+    CachedRow(item);
+  }
+  old_rows.clear();
+
+  // Nothing is inserted into rows_ from here on, so these stay valid
+  QVector<FilterRow*> rows(count);
+  for (int i = 0; i < count; ++i) {
+    rows[i] = &rows_[items[i]];
+  }
+
+  QVector<bool> results(count);
+  if (count < kParallelFilterRows) {
+    for (int i = 0; i < count; ++i) {
+      results[i] = filter_tree_->accept(rows[i]);
+    }
+  } else {
+    QList<FilterChunk> chunks;
+    for (int begin = 0; begin < count; begin += kFilterChunkSize) {
+      FilterChunk chunk = {filter_tree_.data(), rows.constData(),
+                           results.data(), begin,
+                           qMin(count, begin + kFilterChunkSize)};
+      chunks << chunk;
+    }
+    QtConcurrent::blockingMap(chunks, TestFilterChunk);
+  }
+
+  accepted_.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    accepted_.insert(items[i], results[i]);
+  }
+}
+
 bool PlaylistFilter::filterAcceptsRow(int row,
                                       const QModelIndex& parent) const {
-  QString filter = filterRegExp().pattern();
+  // The whole playlist is tested when the filter changes, so that only
+  // happens once however many rows there are.
+  const QString filter = filterRegExp().pattern();
+  if (filter != filter_) {
+    SetFilter(filter);
+  }
 
-  uint hash = qHash(filter);
-  if (hash != query_hash_) {
-    // Parse the query
-    FilterParser p(filter, column_names_, numerical_columns_);
-    filter_tree_.reset(p.parse());
+  if (!playlist_ || filter_tree_->type() == FilterTree::Nop) return true;
 
-    query_hash_ = hash;
-  }
+  const PlaylistItem* item = playlist_->item_at(row).get();
+  QHash<const PlaylistItem*, bool>::const_iterator it =
+      accepted_.constFind(item);
+  if (it != accepted_.constEnd()) return it.value();
 
-  // Test the row
-  return filter_tree_->accept(row, parent, sourceModel());
+  // A row that was added or changed since the filter was set
+  const bool accepted = filter_tree_->accept(CachedRow(item));
+  accepted_.insert(item, accepted);
+  return accepted;
 }
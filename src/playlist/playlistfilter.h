@@ -18,15 +18,15 @@
 #ifndef PLAYLISTFILTER_H
 #define PLAYLISTFILTER_H
 
+#include <QHash>
 #include <QScopedPointer>
 #include <QSortFilterProxyModel>
 
 #include "playlist.h"
+#include "playlistfilterparser.h"
 
 #include <QSet>
 
-class FilterTree;
-
 class PlaylistFilter : public QSortFilterProxyModel {
   Q_OBJECT
 
@@ -34,17 +34,47 @@ class PlaylistFilter : public QSortFilterProxyModel {
   PlaylistFilter(QObject* parent = nullptr);
   ~PlaylistFilter();
 
+  // Playlists with at least this many rows are filtered on several threads
+  static const int kParallelFilterRows;
+  static const int kFilterChunkSize;
+
   // QAbstractItemModel
   void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 
+  // QAbstractProxyModel
+  void setSourceModel(QAbstractItemModel* source_model);
+
   // QSortFilterProxyModel
   // public so Playlist::NextVirtualIndex and friends can get at it
   bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
 
+ private slots:
+  void SourceDataChanged(const QModelIndex& top_left,
+                         const QModelIndex& bottom_right);
+  void SourceRowsInserted(const QModelIndex& parent, int start, int end);
+  void SourceRowsAboutToBeRemoved(const QModelIndex& parent, int start,
+                                  int end);
+  void SourceModelAboutToBeReset();
+
  private:
-  // Mutable because they're modified from filterAcceptsRow() const
+  // Parses a new filter and tests every row in the playlist against it, so
+  // filterAcceptsRow() only has to look up the result.
+  void SetFilter(const QString& filter) const;
+
+  // Returns the cached values of an item, updating them if its metadata has
+  // changed.
+  FilterRow* CachedRow(const PlaylistItem* item) const;
+
+  Playlist* playlist_;
+
+  // Mutable because they're modified from filterAcceptsRow() const.
+  // Items can be freed without their rows being removed (when they're replaced
+  // in place), so entries for new items are dropped in case one was given the
+  // address of an old one.
   mutable QScopedPointer<FilterTree> filter_tree_;
-  mutable uint query_hash_;
+  mutable QString filter_;
+  mutable QHash<const PlaylistItem*, FilterRow> rows_;
+  mutable QHash<const PlaylistItem*, bool> accepted_;
 
   QMap<QString, int> column_names_;
   QSet<int> numerical_columns_;
@@ -18,8 +18,104 @@
 #include "playlistfilterparser.h"
 #include "playlist.h"
 #include "core/logging.h"
+#include "core/timeconstants.h"
 
-#include <QAbstractItemModel>
+FilterRow::FilterRow(const Song& song) : song_(song) {}
+
+const QString& FilterRow::text(int column) {
+  QHash<int, QString>::iterator it = text_.find(column);
+  if (it != text_.end()) return it.value();
+
+  // These should match what Playlist::data() shows for each column
+  QString text;
+  switch (column) {
+    case Playlist::Column_Title:
+      text = song_.PrettyTitle();
+      break;
+    case Playlist::Column_Artist:
+      text = song_.artist();
+      break;
+    case Playlist::Column_Album:
+      text = song_.album();
+      break;
+    case Playlist::Column_AlbumArtist:
+      text = song_.playlist_albumartist();
+      break;
+    case Playlist::Column_Composer:
+      text = song_.composer();
+      break;
+    case Playlist::Column_Performer:
+      text = song_.performer();
+      break;
+    case Playlist::Column_Grouping:
+      text = song_.grouping();
+      break;
+    case Playlist::Column_Genre:
+      text = song_.genre();
+      break;
+    case Playlist::Column_Comment:
+      text = song_.comment().simplified();
+      break;
+    case Playlist::Column_Filename:
+      text = song_.url().toString();
+      break;
+    case Playlist::Column_Length:
+      text = QString::number(song_.length_nanosec());
+      break;
+    case Playlist::Column_Track:
+      text = QString::number(song_.track());
+      break;
+    case Playlist::Column_Disc:
+      text = QString::number(song_.disc());
+      break;
+    case Playlist::Column_Year:
+      text = QString::number(song_.year());
+      break;
+    case Playlist::Column_OriginalYear:
+      text = QString::number(song_.effective_originalyear());
+      break;
+    case Playlist::Column_Score:
+      text = QString::number(song_.score());
+      break;
+    case Playlist::Column_BPM:
+      text = QString::number(song_.bpm());
+      break;
+    case Playlist::Column_Bitrate:
+      text = QString::number(song_.bitrate());
+      break;
+    case Playlist::Column_Rating:
+      text = QString::number(song_.rating());
+      break;
+  }
+
+  return text_.insert(column, text.toLower()).value();
+}
+
+int FilterRow::number(int column) const {
+  switch (column) {
+    case Playlist::Column_Length: {
+      const qint64 length = song_.length_nanosec();
+      return length < 0 ? length : length / kNsecPerSec;
+    }
+    case Playlist::Column_Track:
+      return song_.track();
+    case Playlist::Column_Disc:
+      return song_.disc();
+    case Playlist::Column_Year:
+      return song_.year();
+    case Playlist::Column_OriginalYear:
+      return song_.effective_originalyear();
+    case Playlist::Column_Score:
+      return song_.score();
+    case Playlist::Column_BPM:
+      return static_cast<int>(song_.bpm());
+    case Playlist::Column_Bitrate:
+      return song_.bitrate();
+    case Playlist::Column_Rating:
+      return static_cast<int>(song_.rating() * 10.0 + 0.5);
+  }
+  return 0;
+}
 
 class SearchTermComparator {
  public:
@@ -105,80 +201,64 @@ class LexicalLeComparator : public SearchTermComparator {
   QString search_term_;
 };
 
-class GtComparator : public SearchTermComparator {
+class NumericalComparator {
  public:
-  explicit GtComparator(int value) : search_term_(value) {}
-  virtual bool Matches(const QString& element) const {
-    return element.toInt() > search_term_;
-  }
+  virtual ~NumericalComparator() {}
+  virtual bool Matches(int element) const = 0;
+};
+
+class NumericalEqComparator : public NumericalComparator {
+ public:
+  explicit NumericalEqComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element == search_term_; }
 
  private:
   int search_term_;
 };
 
-class GeComparator : public SearchTermComparator {
+class NumericalNeComparator : public NumericalComparator {
  public:
-  explicit GeComparator(int value) : search_term_(value) {}
-  virtual bool Matches(const QString& element) const {
-    return element.toInt() >= search_term_;
-  }
+  explicit NumericalNeComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element != search_term_; }
 
  private:
   int search_term_;
 };
 
-class LtComparator : public SearchTermComparator {
+class GtComparator : public NumericalComparator {
  public:
-  explicit LtComparator(int value) : search_term_(value) {}
-  virtual bool Matches(const QString& element) const {
-    return element.toInt() < search_term_;
-  }
+  explicit GtComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element > search_term_; }
 
  private:
   int search_term_;
 };
 
-class LeComparator : public SearchTermComparator {
+class GeComparator : public NumericalComparator {
  public:
-  explicit LeComparator(int value) : search_term_(value) {}
-  virtual bool Matches(const QString& element) const {
-    return element.toInt() <= search_term_;
-  }
+  explicit GeComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element >= search_term_; }
 
  private:
   int search_term_;
 };
 
-// The length field of the playlist (entries) contains a
-// song's running time in nano seconds. However, We don't
-// really care about nano seconds, just seconds. Thus, with
-// this decorator we drop the last 9 digits, if that many
-// are present.
-class DropTailComparatorDecorator : public SearchTermComparator {
+class LtComparator : public NumericalComparator {
  public:
-  explicit DropTailComparatorDecorator(SearchTermComparator* cmp) : cmp_(cmp) {}
-
-  virtual bool Matches(const QString& element) const {
-    if (element.length() > 9)
-      return cmp_->Matches(element.left(element.length() - 9));
-    else
-      return cmp_->Matches(element);
-  }
+  explicit LtComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element < search_term_; }
 
  private:
-  QScopedPointer<SearchTermComparator> cmp_;
+  int search_term_;
 };
 
-class RatingComparatorDecorator : public SearchTermComparator {
+class LeComparator : public NumericalComparator {
  public:
-  explicit RatingComparatorDecorator(SearchTermComparator* cmp) : cmp_(cmp) {}
-  virtual bool Matches(const QString& element) const {
-    return cmp_->Matches(
-        QString::number(static_cast<int>(element.toDouble() * 10.0 + 0.5)));
-  }
+  explicit LeComparator(int value) : search_term_(value) {}
+  virtual bool Matches(int element) const { return element <= search_term_; }
 
  private:
-  QScopedPointer<SearchTermComparator> cmp_;
+  int search_term_;
 };
 
 // filter that applies a SearchTermComparator to all fields of a playlist entry
@@ -188,11 +268,9 @@ class FilterTerm : public FilterTree {
                       const QList<int>& columns)
       : cmp_(comparator), columns_(columns) {}
 
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
+  virtual bool accept(FilterRow* row) const {
     for (int i : columns_) {
-      QModelIndex idx(model->index(row, i, parent));
-      if (cmp_->Matches(idx.data().toString().toLower())) return true;
+      if (cmp_->Matches(row->text(i))) return true;
     }
     return false;
   }
@@ -210,10 +288,8 @@ class FilterColumnTerm : public FilterTree {
   FilterColumnTerm(int column, SearchTermComparator* comparator)
       : col(column), cmp_(comparator) {}
 
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
-    QModelIndex idx(model->index(row, col, parent));
-    return cmp_->Matches(idx.data().toString().toLower());
+  virtual bool accept(FilterRow* row) const {
+    return cmp_->Matches(row->text(col));
   }
   virtual FilterType type() { return Column; }
 
@@ -222,14 +298,28 @@ class FilterColumnTerm : public FilterTree {
   QScopedPointer<SearchTermComparator> cmp_;
 };
 
+// filter that applies a NumericalComparator to one numerical field of a
+// playlist entry
+class FilterNumericalColumnTerm : public FilterTree {
+ public:
+  FilterNumericalColumnTerm(int column, NumericalComparator* comparator)
+      : col(column), cmp_(comparator) {}
+
+  virtual bool accept(FilterRow* row) const {
+    return cmp_->Matches(row->number(col));
+  }
+  virtual FilterType type() { return Column; }
+
+ private:
+  int col;
+  QScopedPointer<NumericalComparator> cmp_;
+};
+
 class NotFilter : public FilterTree {
  public:
   explicit NotFilter(const FilterTree* inv) : child_(inv) {}
 
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
-    return !child_->accept(row, parent, model);
-  }
+  virtual bool accept(FilterRow* row) const { return !child_->accept(row); }
   virtual FilterType type() { return Not; }
 
  private:
@@ -240,10 +330,9 @@ class OrFilter : public FilterTree {
  public:
   ~OrFilter() { qDeleteAll(children_); }
   virtual void add(FilterTree* child) { children_.append(child); }
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
+  virtual bool accept(FilterRow* row) const {
     for (FilterTree* child : children_) {
-      if (child->accept(row, parent, model)) return true;
+      if (child->accept(row)) return true;
     }
     return false;
   }
@@ -257,10 +346,9 @@ class AndFilter : public FilterTree {
  public:
   virtual ~AndFilter() { qDeleteAll(children_); }
   virtual void add(FilterTree* child) { children_.append(child); }
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
+  virtual bool accept(FilterRow* row) const {
     for (FilterTree* child : children_) {
-      if (!child->accept(row, parent, model)) return false;
+      if (!child->accept(row)) return false;
     }
     return true;
   }
@@ -451,13 +539,11 @@ FilterTree* FilterParser::createSearchTermTreeNode(
   }
   // here comes a mess :/
   // well, not that much of a mess, but so many options -_-
-  SearchTermComparator* cmp = nullptr;
-  if (prefix == "!=" || prefix == "<>") {
-    cmp = new NeComparator(search);
-  } else if (!col.isEmpty() && columns_.contains(col) &&
-             numerical_columns_.contains(columns_[col])) {
-    // the length column contains the time in seconds (nano seconds, actually -
-    //  the "nano" part is handled by the DropTailComparatorDecorator,  though).
+  if (!col.isEmpty() && columns_.contains(col) &&
+      numerical_columns_.contains(columns_[col])) {
+    // Numerical columns are compared as numbers, in the units given by
+    // FilterRow::number() - seconds for the length and half stars for the
+    // rating.
     int search_value;
     if (columns_[col] == Playlist::Column_Length) {
       search_value = parseTime(search);
@@ -466,8 +552,11 @@ FilterTree* FilterParser::createSearchTermTreeNode(
     } else {
       search_value = search.toInt();
     }
-    // alright, back to deciding which comparator we'll use
-    if (prefix == ">") {
+
+    NumericalComparator* cmp = nullptr;
+    if (prefix == "!=" || prefix == "<>") {
+      cmp = new NumericalNeComparator(search_value);
+    } else if (prefix == ">") {
       cmp = new GtComparator(search_value);
     } else if (prefix == ">=") {
       cmp = new GeComparator(search_value);
@@ -476,30 +565,29 @@ FilterTree* FilterParser::createSearchTermTreeNode(
     } else if (prefix == "<=") {
       cmp = new LeComparator(search_value);
     } else {
-      // convert back because for time/rating
-      cmp = new EqComparator(QString::number(search_value));
+      cmp = new NumericalEqComparator(search_value);
     }
+    return new FilterNumericalColumnTerm(columns_[col], cmp);
+  }
+
+  SearchTermComparator* cmp = nullptr;
+  if (prefix == "!=" || prefix == "<>") {
+    cmp = new NeComparator(search);
+  } else if (prefix == "=") {
+    cmp = new EqComparator(search);
+  } else if (prefix == ">") {
+    cmp = new LexicalGtComparator(search);
+  } else if (prefix == ">=") {
+    cmp = new LexicalGeComparator(search);
+  } else if (prefix == "<") {
+    cmp = new LexicalLtComparator(search);
+  } else if (prefix == "<=") {
+    cmp = new LexicalLeComparator(search);
   } else {
-    if (prefix == "=") {
-      cmp = new EqComparator(search);
-    } else if (prefix == ">") {
-      cmp = new LexicalGtComparator(search);
-    } else if (prefix == ">=") {
-      cmp = new LexicalGeComparator(search);
-    } else if (prefix == "<") {
-      cmp = new LexicalLtComparator(search);
-    } else if (prefix == "<=") {
-      cmp = new LexicalLeComparator(search);
-    } else {
-      cmp = new DefaultComparator(search);
-    }
+    cmp = new DefaultComparator(search);
   }
+
   if (columns_.contains(col)) {
-    if (columns_[col] == Playlist::Column_Length) {
-      cmp = new DropTailComparatorDecorator(cmp);
-    } else if (columns_[col] == Playlist::Column_Rating) {
-      cmp = new RatingComparatorDecorator(cmp);
-    }
     return new FilterColumnTerm(columns_[col], cmp);
   } else {
     return new FilterTerm(cmp, columns_.values());
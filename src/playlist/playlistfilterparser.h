@@ -18,19 +18,40 @@
 #ifndef PLAYLISTFILTERPARSER_H
 #define PLAYLISTFILTERPARSER_H
 
+#include <QHash>
 #include <QMap>
-#include <QModelIndex>
 #include <QSet>
 #include <QString>
 
-class QAbstractItemModel;
+#include "core/song.h"
+
+// The values of one playlist item that filters are tested against.  The
+// lowercased text of a column is worked out the first time a filter needs it
+// and then kept, so later searches on the same playlist don't have to convert
+// anything.
+class FilterRow {
+ public:
+  explicit FilterRow(const Song& song = Song());
+
+  const Song& song() const { return song_; }
+
+  // The lowercased text of a column, as shown in the playlist.
+  const QString& text(int column);
+
+  // The value of a numerical column, in the units filters use: seconds for
+  // the length and half stars for the rating.
+  int number(int column) const;
+
+ private:
+  Song song_;
+  QHash<int, QString> text_;
+};
 
 // structure for filter parse tree
 class FilterTree {
  public:
   virtual ~FilterTree() {}
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const = 0;
+  virtual bool accept(FilterRow* row) const = 0;
   enum FilterType { Nop = 0, Or, And, Not, Column, Term };
   virtual FilterType type() = 0;
 };
@@ -38,10 +59,7 @@ class FilterTree {
 // trivial filter that accepts *anything*
 class NopFilter : public FilterTree {
  public:
-  virtual bool accept(int row, const QModelIndex& parent,
-                      const QAbstractItemModel* const model) const {
-    return true;
-  }
+  virtual bool accept(FilterRow* row) const { return true; }
   virtual FilterType type() { return Nop; }
 };
 
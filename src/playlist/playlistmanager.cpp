@@ -300,6 +300,9 @@ bool PlaylistManager::Close(int id) {
   if (!data.p->is_favorite()) {
     playlist_backend_->RemovePlaylist(id);
     emit PlaylistDeleted(id);
+  } else {
+    // Otherwise the backend would keep all its items alive
+    playlist_backend_->ForgetPlaylist(id);
   }
   delete data.p;
 
@@ -0,0 +1,417 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "playorder.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace {
+
+const int kWordBits = 64;
+const quint64 kAllBits = ~quint64(0);
+
+}  // namespace
+
+PlayOrder::PlayOrder()
+    : shuffle_mode_(PlaylistSequence::Shuffle_Off),
+      album_links_dirty_(true),
+      skips_dirty_(false) {}
+
+void PlayOrder::set_playable_predicate(PlayablePredicate predicate) {
+  playable_predicate_ = predicate;
+  InvalidatePlayable();
+}
+
+void PlayOrder::set_shuffle_mode(PlaylistSequence::ShuffleMode mode) {
+  shuffle_mode_ = mode;
+}
+
+int PlayOrder::position_of(int row) const {
+  if (row < 0 || row >= position_.count()) return -1;
+  return position_[row];
+}
+
+int PlayOrder::album_of_row(int row) const {
+  if (row < 0 || row >= album_.count()) return -1;
+  return album_[row];
+}
+
+int PlayOrder::AlbumId(const QString& key) {
+  QHash<QString, int>::const_iterator it = album_ids_.constFind(key);
+  if (it != album_ids_.constEnd()) return it.value();
+
+  const int id = album_ids_.count();
+  album_ids_.insert(key, id);
+  return id;
+}
+
+void PlayOrder::Reset(const QStringList& album_keys) {
+  const int count = album_keys.count();
+
+  album_ids_.clear();
+  album_.resize(count);
+  order_.resize(count);
+  position_.resize(count);
+
+  for (int i = 0; i < count; ++i) {
+    album_[i] = AlbumId(album_keys[i]);
+    order_[i] = i;
+    position_[i] = i;
+  }
+
+  album_links_dirty_ = true;
+  InvalidatePlayable();
+}
+
+void PlayOrder::SetAlbumKeys(const QStringList& album_keys) {
+  if (album_keys.count() != order_.count()) {
+    Reset(album_keys);
+    return;
+  }
+
+  // Start the ids again so albums that aren't in the playlist any more don't
+  // take up space.
+  album_ids_.clear();
+  for (int i = 0; i < album_keys.count(); ++i) {
+    album_[i] = AlbumId(album_keys[i]);
+  }
+
+  album_links_dirty_ = true;
+  InvalidatePlayable();
+}
+
+void PlayOrder::SetAlbumKeys(int first_row, const QStringList& album_keys) {
+  for (int i = 0; i < album_keys.count(); ++i) {
+    const int row = first_row + i;
+    if (row < 0 || row >= album_.count()) continue;
+
+    const int album = AlbumId(album_keys[i]);
+    if (album_[row] != album) {
+      album_[row] = album;
+      album_links_dirty_ = true;
+    }
+  }
+}
+
+void PlayOrder::InsertRows(int row, const QStringList& album_keys, int begin,
+                           int first_album) {
+  const int count = album_keys.count();
+  if (count == 0) return;
+
+  row = qBound(0, row, order_.count());
+  begin = qBound(0, begin, order_.count());
+
+  // Make room for the new rows.
+  for (int i = 0; i < order_.count(); ++i) {
+    if (order_[i] >= row) order_[i] += count;
+  }
+  album_.insert(row, count, 0);
+  for (int i = 0; i < count; ++i) {
+    album_[row + i] = AlbumId(album_keys[i]);
+  }
+
+  order_.reserve(order_.count() + count);
+  switch (shuffle_mode_) {
+    case PlaylistSequence::Shuffle_Off:
+      order_.resize(order_.count() + count);
+      for (int i = 0; i < order_.count(); ++i) order_[i] = i;
+      break;
+
+    case PlaylistSequence::Shuffle_All:
+    case PlaylistSequence::Shuffle_InsideAlbum:
+      // Each new row swaps places with a random unplayed one, which leaves
+      // them as well shuffled as if they'd all been shuffled together.
+      for (int i = 0; i < count; ++i) {
+        order_ << row + i;
+        const int last = order_.count() - 1;
+        std::swap(order_[last], order_[begin + rand() % (last - begin + 1)]);
+      }
+      break;
+
+    case PlaylistSequence::Shuffle_Albums:
+      for (int i = 0; i < count; ++i) order_ << row + i;
+      break;
+  }
+
+  position_.resize(order_.count());
+  UpdatePositions();
+
+  if (shuffle_mode_ == PlaylistSequence::Shuffle_Albums) {
+    ShuffleAlbums(begin, first_album);
+  }
+
+  album_links_dirty_ = true;
+  InvalidatePlayable();
+}
+
+void PlayOrder::RemoveRows(int row, int count) {
+  if (row < 0 || count <= 0 || row + count > order_.count()) return;
+
+  int out = 0;
+  for (int i = 0; i < order_.count(); ++i) {
+    const int r = order_[i];
+    if (r >= row && r < row + count) continue;
+
+    order_[out++] = r >= row + count ? r - count : r;
+  }
+  order_.resize(out);
+  album_.remove(row, count);
+
+  position_.resize(out);
+  UpdatePositions();
+
+  album_links_dirty_ = true;
+  InvalidatePlayable();
+}
+
+void PlayOrder::Shuffle(int begin, int first_album) {
+  begin = qBound(0, begin, order_.count());
+
+  switch (shuffle_mode_) {
+    case PlaylistSequence::Shuffle_Off:
+      // Everything goes back in playlist order, even what's been played.
+      for (int i = 0; i < order_.count(); ++i) order_[i] = i;
+      UpdatePositions();
+      break;
+
+    case PlaylistSequence::Shuffle_All:
+    case PlaylistSequence::Shuffle_InsideAlbum:
+      std::random_shuffle(order_.begin() + begin, order_.end());
+      UpdatePositions(begin);
+      break;
+
+    case PlaylistSequence::Shuffle_Albums:
+      ShuffleAlbums(begin, first_album);
+      break;
+  }
+
+  album_links_dirty_ = true;
+  skips_dirty_ = true;
+}
+
+void PlayOrder::ShuffleAlbums(int begin, int first_album) {
+  // The rows that haven't been played yet, in playlist order.
+  QVector<int> rows;
+  rows.reserve(order_.count() - begin);
+  for (int row = 0; row < position_.count(); ++row) {
+    if (position_[row] >= begin) rows << row;
+  }
+
+  // Put their albums in a random order.
+  QVector<int> albums;
+  QVector<int> album_rank(album_ids_.count(), -1);
+  for (int row : rows) {
+    int& rank = album_rank[album_[row]];
+    if (rank == -1) {
+      rank = 0;
+      albums << album_[row];
+    }
+  }
+
+  std::random_shuffle(albums.begin(), albums.end());
+  const int first = albums.indexOf(first_album);
+  if (first >= 1) std::swap(albums[0], albums[first]);
+
+  for (int i = 0; i < albums.count(); ++i) album_rank[albums[i]] = i;
+
+  // A counting sort on the albums' ranks, which keeps the songs on each album
+  // in playlist order.
+  QVector<int> album_start(albums.count() + 1, 0);
+  for (int row : rows) album_start[album_rank[album_[row]] + 1]++;
+  for (int i = 1; i < album_start.count(); ++i) {
+    album_start[i] += album_start[i - 1];
+  }
+  for (int row : rows) {
+    order_[begin + album_start[album_rank[album_[row]]]++] = row;
+  }
+
+  UpdatePositions(begin);
+}
+
+void PlayOrder::MoveToFront(int row) {
+  const int position = position_of(row);
+  if (position <= 0) return;
+
+  std::rotate(order_.begin(), order_.begin() + position,
+              order_.begin() + position + 1);
+  for (int i = 0; i <= position; ++i) position_[order_[i]] = i;
+
+  album_links_dirty_ = true;
+  skips_dirty_ = true;
+}
+
+void PlayOrder::UpdatePositions(int begin) {
+  for (int i = begin; i < order_.count(); ++i) position_[order_[i]] = i;
+}
+
+void PlayOrder::UpdateAlbumLinks() const {
+  if (!album_links_dirty_) return;
+
+  // A counting sort of the positions by album, which keeps each album's in
+  // order.
+  const int albums = album_ids_.count();
+  album_begin_.fill(0, albums + 1);
+  for (int i = 0; i < order_.count(); ++i) {
+    album_begin_[album_[order_[i]] + 1]++;
+  }
+  for (int i = 1; i <= albums; ++i) album_begin_[i] += album_begin_[i - 1];
+
+  QVector<int> next = album_begin_;
+  album_positions_.resize(order_.count());
+  for (int i = 0; i < order_.count(); ++i) {
+    album_positions_[next[album_[order_[i]]]++] = i;
+  }
+
+  album_links_dirty_ = false;
+}
+
+int PlayOrder::Next(int position, int album) const {
+  position = qMax(position, -1);
+
+  if (album == -1) {
+    for (position = NextCandidate(position + 1); position < order_.count();
+         position = NextCandidate(position + 1)) {
+      if (IsPlayable(order_[position])) return position;
+    }
+    return order_.count();
+  }
+
+  UpdateAlbumLinks();
+  if (album >= album_ids_.count()) return order_.count();
+
+  const int* begin = album_positions_.constData() + album_begin_[album];
+  const int* end = album_positions_.constData() + album_begin_[album + 1];
+  for (const int* it = std::upper_bound(begin, end, position); it != end;
+       ++it) {
+    if (IsPlayable(order_[*it])) return *it;
+  }
+  return order_.count();
+}
+
+int PlayOrder::Previous(int position, int album) const {
+  position = qMin(position, order_.count());
+
+  if (album == -1) {
+    for (position = PreviousCandidate(position - 1); position >= 0;
+         position = PreviousCandidate(position - 1)) {
+      if (IsPlayable(order_[position])) return position;
+    }
+    return -1;
+  }
+
+  UpdateAlbumLinks();
+  if (album >= album_ids_.count()) return -1;
+
+  const int* begin = album_positions_.constData() + album_begin_[album];
+  const int* end = album_positions_.constData() + album_begin_[album + 1];
+  for (const int* it = std::lower_bound(begin, end, position); it != begin;) {
+    --it;
+    if (IsPlayable(order_[*it])) return *it;
+  }
+  return -1;
+}
+
+int PlayOrder::NextCandidate(int position) const {
+  UpdateSkips();
+  if (position >= order_.count()) return order_.count();
+
+  int word = position / kWordBits;
+  quint64 bits = ~skips_[word] & (kAllBits << (position % kWordBits));
+  while (bits == 0) {
+    if (++word == skips_.count()) return order_.count();
+    bits = ~skips_[word];
+  }
+
+  int ret = word * kWordBits;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    ++ret;
+  }
+  return qMin(ret, order_.count());
+}
+
+int PlayOrder::PreviousCandidate(int position) const {
+  UpdateSkips();
+  if (position < 0) return -1;
+
+  int word = position / kWordBits;
+  quint64 bits =
+      ~skips_[word] & (kAllBits >> (kWordBits - 1 - position % kWordBits));
+  while (bits == 0) {
+    if (--word < 0) return -1;
+    bits = ~skips_[word];
+  }
+
+  int ret = word * kWordBits + kWordBits - 1;
+  while (!(bits >> (kWordBits - 1))) {
+    bits <<= 1;
+    --ret;
+  }
+  return ret;
+}
+
+void PlayOrder::SetSkip(int position) const {
+  skips_[position / kWordBits] |= quint64(1) << (position % kWordBits);
+}
+
+void PlayOrder::UpdateSkips() const {
+  if (!skips_dirty_) return;
+
+  skips_.fill(0, (order_.count() + kWordBits - 1) / kWordBits);
+  for (int i = 0; i < order_.count(); ++i) {
+    const int row = order_[i];
+    if (playable_known_.testBit(row) && !playable_.testBit(row)) SetSkip(i);
+  }
+
+  skips_dirty_ = false;
+}
+
+bool PlayOrder::IsPlayable(int row) const {
+  if (!playable_known_.testBit(row)) {
+    const bool playable = !playable_predicate_ || playable_predicate_(row);
+    playable_.setBit(row, playable);
+    playable_known_.setBit(row);
+
+    if (!playable && !skips_dirty_) SetSkip(position_[row]);
+  }
+  return playable_.testBit(row);
+}
+
+void PlayOrder::InvalidatePlayable() {
+  playable_known_.fill(false, order_.count());
+  playable_.resize(order_.count());
+
+  // Nothing's known, so nothing's skipped, whatever the order.
+  skips_.fill(0, (order_.count() + kWordBits - 1) / kWordBits);
+  skips_dirty_ = false;
+}
+
+void PlayOrder::InvalidatePlayable(int first_row, int last_row) {
+  first_row = qMax(first_row, 0);
+  last_row = qMin(last_row, playable_known_.count() - 1);
+  if (first_row > last_row) return;
+
+  playable_known_.fill(false, first_row, last_row + 1);
+
+  if (!skips_dirty_) {
+    for (int row = first_row; row <= last_row; ++row) {
+      const int position = position_[row];
+      skips_[position / kWordBits] &= ~(quint64(1) << (position % kWordBits));
+    }
+  }
+}
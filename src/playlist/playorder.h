@@ -0,0 +1,134 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAYLIST_PLAYORDER_H_
+#define PLAYLIST_PLAYORDER_H_
+
+#include <functional>
+
+#include <QBitArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include "playlistsequence.h"
+
+// The order a playlist's rows get played in.  A "position" is an index into
+// the play order and a "row" is an index into the playlist.
+//
+// Albums are kept as small integer ids, and whether each row can be played is
+// looked up once and then cached in a bitmap, so finding the next or previous
+// song never has to touch the songs' metadata.  Rows that are known to be
+// unplayable are also marked in play order, so runs of them are skipped 64 at
+// a time.
+class PlayOrder {
+ public:
+  // Whether the row can be played - it's in the filter and not skipped.
+  typedef std::function<bool(int row)> PlayablePredicate;
+
+  PlayOrder();
+
+  void set_playable_predicate(PlayablePredicate predicate);
+  void set_shuffle_mode(PlaylistSequence::ShuffleMode mode);
+
+  int count() const { return order_.count(); }
+  int row_at(int position) const { return order_[position]; }
+
+  // These return -1 if the row isn't in the playlist.
+  int position_of(int row) const;
+  int album_of_row(int row) const;
+
+  // Forgets everything, and starts again with one row for each album key.
+  void Reset(const QStringList& album_keys = QStringList());
+
+  // Gives every row a new album key, after the rows have been moved around.
+  // The play order stays the same, but which rows are playable is looked up
+  // again.
+  void SetAlbumKeys(const QStringList& album_keys);
+
+  // Gives the rows from first_row onwards new album keys, after their songs'
+  // metadata has changed.
+  void SetAlbumKeys(int first_row, const QStringList& album_keys);
+
+  // Adds rows without reshuffling the ones that are there already.  When
+  // shuffled the new rows go somewhere from the position begin onwards, in
+  // album shuffle mode first_album stays in front of the others.
+  void InsertRows(int row, const QStringList& album_keys, int begin,
+                  int first_album);
+  void RemoveRows(int row, int count);
+
+  // Shuffles everything from the position begin onwards, or puts all the rows
+  // back in playlist order if shuffle is off.
+  void Shuffle(int begin, int first_album);
+
+  // Moves the row to position 0.
+  void MoveToFront(int row);
+
+  // The next playable position after position, optionally only looking at
+  // songs on the given album.  Returns count() if there isn't one.
+  int Next(int position, int album = -1) const;
+
+  // The previous playable position before position, optionally only looking
+  // at songs on the given album.  Returns -1 if there isn't one.
+  int Previous(int position, int album = -1) const;
+
+  // Call these when the filter or the songs' skip flags have changed.
+  void InvalidatePlayable();
+  void InvalidatePlayable(int first_row, int last_row);
+
+ private:
+  int AlbumId(const QString& key);
+  bool IsPlayable(int row) const;
+
+  // The first position from position onwards, or the last one up to it, that
+  // isn't known to be unplayable.  count() or -1 if there isn't one.
+  int NextCandidate(int position) const;
+  int PreviousCandidate(int position) const;
+  void SetSkip(int position) const;
+  void UpdateSkips() const;
+
+  void ShuffleAlbums(int begin, int first_album);
+  void UpdatePositions(int begin = 0);
+  void UpdateAlbumLinks() const;
+
+ private:
+  PlayablePredicate playable_predicate_;
+  PlaylistSequence::ShuffleMode shuffle_mode_;
+
+  QVector<int> order_;     // position -> row
+  QVector<int> position_;  // row -> position
+
+  QHash<QString, int> album_ids_;
+  QVector<int> album_;  // row -> album id
+
+  // The positions of each album's songs in order, one album after another.
+  // Album n's are from album_begin_[n] up to album_begin_[n + 1].  These are
+  // rebuilt the first time they're needed after the order changes.
+  mutable bool album_links_dirty_;
+  mutable QVector<int> album_positions_;
+  mutable QVector<int> album_begin_;
+
+  // Which rows have been looked up, and which of those can be played.
+  mutable QBitArray playable_known_;
+  mutable QBitArray playable_;
+
+  // position -> known to be unplayable, 64 positions to a word.  Rebuilt from
+  // the bitmaps above when the order changes.
+  mutable bool skips_dirty_;
+  mutable QVector<quint64> skips_;
+};
+
+#endif  // PLAYLIST_PLAYORDER_H_
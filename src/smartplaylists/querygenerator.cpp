@@ -16,30 +16,50 @@
 */
 
 #include "querygenerator.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
 #include "library/librarybackend.h"
 
 #include <QtDebug>
 
 namespace smart_playlists {
 
-QueryGenerator::QueryGenerator() : dynamic_(false), current_pos_(0) {}
+QueryGenerator::QueryGenerator()
+    : dynamic_(false),
+      last_id_(-1),
+      cache_(nullptr) {}
 
 QueryGenerator::QueryGenerator(const QString& name, const Search& search,
                                bool dynamic)
-    : search_(search), dynamic_(dynamic), current_pos_(0) {
+    : search_(search),
+      dynamic_(dynamic),
+      last_id_(-1),
+      cache_(nullptr) {
   set_name(name);
 }
 
+QueryGenerator::~QueryGenerator() {
+  // The cache might be in the middle of hearing about a change on the
+  // library's thread, so it's deleted there.
+  if (cache_) cache_->deleteLater();
+}
+
 void QueryGenerator::Load(const Search& search) {
   search_ = search;
   dynamic_ = false;
-  current_pos_ = 0;
+  last_id_ = -1;
+  last_value_ = QVariant();
+  InvalidateCache();
 }
 
 void QueryGenerator::Load(const QByteArray& data) {
   QDataStream s(data);
   s >> search_;
   s >> dynamic_;
+  InvalidateCache();
 }
 
 QByteArray QueryGenerator::Save() const {
@@ -53,23 +73,20 @@ QByteArray QueryGenerator::Save() const {
 
 PlaylistItemList QueryGenerator::Generate() {
   previous_ids_.clear();
-  current_pos_ = 0;
+  last_id_ = -1;
+  last_value_ = QVariant();
   return GenerateMore(0);
 }
 
 PlaylistItemList QueryGenerator::GenerateMore(int count) {
-  Search search_copy = search_;
-  search_copy.id_not_in_ = previous_ids_;
-  if (count) {
-    search_copy.limit_ = count;
+  if (!count) {
+    count = search_.limit_;
   }
 
-  if (search_copy.sort_type_ != Search::Sort_Random) {
-    search_copy.first_item_ = current_pos_;
-    current_pos_ += search_copy.limit_;
-  }
+  SongList songs = search_.sort_type_ == Search::Sort_Random
+                       ? RandomSongs(count)
+                       : NextSortedSongs(count);
 
-  SongList songs = backend_->FindSongs(search_copy);
   PlaylistItemList items;
   for (const Song& song : songs) {
     items << PlaylistItemPtr(PlaylistItem::NewFromSongsTable(
@@ -82,4 +99,182 @@ PlaylistItemList QueryGenerator::GenerateMore(int count) {
   return items;
 }
 
+SongList QueryGenerator::NextSortedSongs(int count) {
+  // Each page starts after the last song of the one before, instead of
+  // making sqlite sort and skip everything up to an OFFSET.
+  Search search_copy = search_;
+  search_copy.limit_ = count;
+  search_copy.after_id_ = last_id_;
+  search_copy.after_value_ = last_value_;
+
+  SongList songs = backend_->FindSongs(search_copy);
+  if (!songs.isEmpty()) {
+    last_id_ = songs.last().id();
+    last_value_ = backend_->GetSongColumn(
+        last_id_, SearchTerm::FieldColumnName(search_.sort_field_));
+  }
+  return songs;
+}
+
+SongList QueryGenerator::RandomSongs(int count) {
+  UpdateCachedIds();
+
+  // The songs we've just given out aren't picked again.
+  const QList<int> ids =
+      SampleIds(cache_->ids(), QSet<int>::fromList(previous_ids_), count);
+  if (ids.isEmpty()) return SongList();
+
+  QHash<int, Song> songs_by_id;
+  for (const Song& song : backend_->GetSongsById(ids)) {
+    songs_by_id[song.id()] = song;
+  }
+
+  SongList ret;
+  for (int id : ids) {
+    if (songs_by_id.contains(id)) ret << songs_by_id[id];
+  }
+  return ret;
+}
+
+QList<int> QueryGenerator::SampleIds(const QSet<int>& ids,
+                                     const QSet<int>& exclude, int count) {
+  // Reservoir sampling - every id has the same chance of being picked, and
+  // it only takes one pass.
+  QList<int> ret;
+  int seen = 0;
+  for (int id : ids) {
+    if (exclude.contains(id)) continue;
+    ++seen;
+
+    if (count == -1 || ret.count() < count) {
+      ret << id;
+    } else {
+      const int i = rand() % seen;
+      if (i < count) ret[i] = id;
+    }
+  }
+
+  // The reservoir isn't in a random order until it's been filled up.
+  std::random_shuffle(ret.begin(), ret.end());
+  return ret;
+}
+
+void QueryGenerator::UpdateCachedIds() {
+  if (!cache_) {
+    cache_ = new QueryGeneratorCache(backend_);
+    cache_->moveToThread(backend_->thread());
+  }
+  cache_->Update(search_);
+}
+
+void QueryGenerator::InvalidateCache() {
+  if (cache_) cache_->Invalidate();
+}
+
+const int QueryGeneratorCache::kMaxStaleIds = 1000;
+
+QueryGeneratorCache::QueryGeneratorCache(LibraryBackend* backend)
+    : backend_(backend), valid_(false), generation_(0) {
+  connect(backend_, SIGNAL(SongsDiscovered(SongList)),
+          SLOT(SongsChanged(SongList)));
+  connect(backend_, SIGNAL(SongsStatisticsChanged(SongList)),
+          SLOT(SongsChanged(SongList)));
+  connect(backend_, SIGNAL(SongsRatingChanged(SongList)),
+          SLOT(SongsChanged(SongList)));
+  connect(backend_, SIGNAL(SongsDeleted(SongList)),
+          SLOT(SongsDeleted(SongList)));
+  connect(backend_, SIGNAL(DatabaseReset()), SLOT(Invalidate()));
+}
+
+void QueryGeneratorCache::Update(const Search& search) {
+  QMutexLocker l(&mutex_);
+
+  if (!valid_) {
+    // Songs that change while we're looking are checked next time.
+    valid_ = true;
+    stale_ids_.clear();
+    const int generation = generation_;
+    l.unlock();
+
+    bool ok = false;
+    const QList<int> ids = backend_->FindSongIds(search, &ok);
+
+    l.relock();
+    if (generation != generation_) return;
+    if (!ok) {
+      // Try again next time.
+      valid_ = false;
+      return;
+    }
+    ids_ = QSet<int>::fromList(ids);
+  }
+
+  if (stale_ids_.isEmpty()) return;
+
+  // Only look at the songs that changed since last time.
+  Search search_copy = search;
+  search_copy.id_in_ = stale_ids_.toList();
+  stale_ids_.clear();
+  const int generation = generation_;
+  l.unlock();
+
+  bool ok = false;
+  const QSet<int> matching =
+      QSet<int>::fromList(backend_->FindSongIds(search_copy, &ok));
+
+  l.relock();
+  if (generation != generation_) return;
+  if (!ok) {
+    // Leave the cache as it was and check them again next time.
+    for (int id : search_copy.id_in_) stale_ids_ << id;
+    return;
+  }
+
+  for (int id : search_copy.id_in_) {
+    if (matching.contains(id)) {
+      ids_ << id;
+    } else {
+      ids_.remove(id);
+    }
+  }
+}
+
+QSet<int> QueryGeneratorCache::ids() {
+  QMutexLocker l(&mutex_);
+  return ids_;
+}
+
+void QueryGeneratorCache::Invalidate() {
+  QMutexLocker l(&mutex_);
+  valid_ = false;
+  generation_++;
+  ids_.clear();
+  stale_ids_.clear();
+}
+
+void QueryGeneratorCache::SongsChanged(const SongList& songs) {
+  // Whether they still match can wait until we need more songs.
+  QMutexLocker l(&mutex_);
+  if (!valid_) return;
+
+  for (const Song& song : songs) {
+    stale_ids_ << song.id();
+  }
+
+  // Checking this many songs one by one would make the query too big, so
+  // start again instead.
+  if (stale_ids_.count() > kMaxStaleIds) {
+    valid_ = false;
+    stale_ids_.clear();
+  }
+}
+
+void QueryGeneratorCache::SongsDeleted(const SongList& songs) {
+  QMutexLocker l(&mutex_);
+  for (const Song& song : songs) {
+    ids_.remove(song.id());
+    stale_ids_.remove(song.id());
+  }
+}
+
 }  // namespace
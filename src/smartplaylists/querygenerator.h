@@ -18,16 +18,63 @@
 #ifndef QUERYPLAYLISTGENERATOR_H
 #define QUERYPLAYLISTGENERATOR_H
 
+#include <QMutex>
+#include <QSet>
+#include <QVariant>
+
 #include "generator.h"
 #include "search.h"
 
+class LibraryBackend;
+
 namespace smart_playlists {
 
+// The IDs of all the songs that match a random search, so more songs can be
+// picked without sorting the library every time.  It lives on the library's
+// thread and is told about the library's changes there, so the generator that
+// owns it can be deleted on any thread.
+class QueryGeneratorCache : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit QueryGeneratorCache(LibraryBackend* backend);
+
+  // More changed songs than this and it's quicker to find all the matching
+  // songs again than to check each one.
+  static const int kMaxStaleIds;
+
+  // Finds the songs that match the search the first time, and after that only
+  // checks the ones that have changed.
+  void Update(const Search& search);
+  QSet<int> ids();
+
+ public slots:
+  void Invalidate();
+
+ private slots:
+  void SongsChanged(const SongList& songs);
+  void SongsDeleted(const SongList& songs);
+
+ private:
+  LibraryBackend* backend_;
+
+  // The cache isn't locked while the database is, because the library might
+  // be waiting to tell us about a change while holding the database lock.
+  QMutex mutex_;
+  bool valid_;
+  int generation_;  // Incremented when the cache is invalidated
+  QSet<int> ids_;
+  QSet<int> stale_ids_;  // Songs that changed, and might not match any more
+};
+
 class QueryGenerator : public Generator {
+  Q_OBJECT
+
  public:
   QueryGenerator();
   QueryGenerator(const QString& name, const Search& search,
                  bool dynamic = false);
+  ~QueryGenerator();
 
   QString type() const { return "Query"; }
 
@@ -43,12 +90,29 @@ class QueryGenerator : public Generator {
   Search search() const { return search_; }
   int GetDynamicFuture() { return search_.limit_; }
 
+  // Picks count of ids at random, leaving out the ones in exclude.  A count
+  // of -1 picks all of them.
+  static QList<int> SampleIds(const QSet<int>& ids, const QSet<int>& exclude,
+                              int count);
+
+ private:
+  SongList RandomSongs(int count);
+  SongList NextSortedSongs(int count);
+  void InvalidateCache();
+  void UpdateCachedIds();
+
  private:
   Search search_;
   bool dynamic_;
 
   QList<int> previous_ids_;
-  int current_pos_;
+
+  // Where the last page of a sorted search ended.
+  int last_id_;
+  QVariant last_value_;
+
+  // Created the first time a random search needs it.
+  QueryGeneratorCache* cache_;
 };
 
 }  // namespace
@@ -32,7 +32,7 @@ Search::Search(SearchType type, TermList terms, SortType sort_type,
       sort_type_(sort_type),
       sort_field_(sort_field),
       limit_(limit),
-      first_item_(0) {}
+      after_id_(-1) {}
 
 void Search::Reset() {
   search_type_ = Type_And;
@@ -40,14 +40,15 @@ void Search::Reset() {
   sort_type_ = Sort_Random;
   sort_field_ = SearchTerm::Field_Title;
   limit_ = -1;
-  first_item_ = 0;
+  id_in_.clear();
+  after_id_ = -1;
+  after_value_ = QVariant();
 }
 
-QString Search::ToSql(const QString& songs_table) const {
-  QString sql = "SELECT ROWID," + Song::kColumnSpec + " FROM " + songs_table;
+QStringList Search::WhereClauses() const {
+  QStringList where_clauses;
 
   // Add search terms
-  QStringList where_clauses;
   QStringList term_where_clauses;
   for (const SearchTerm& term : terms_) {
     term_where_clauses << term.ToSql();
@@ -58,13 +59,14 @@ QString Search::ToSql(const QString& songs_table) const {
     where_clauses << "(" + term_where_clauses.join(boolean_op) + ")";
   }
 
-  // Restrict the IDs of songs if we're making a dynamic playlist
-  if (!id_not_in_.isEmpty()) {
+  // Restrict the IDs of songs if we're checking whether some of them still
+  // match
+  if (!id_in_.isEmpty()) {
     QString numbers;
-    for (int id : id_not_in_) {
+    for (int id : id_in_) {
       numbers += (numbers.isEmpty() ? "" : ",") + QString::number(id);
     }
-    where_clauses << "(ROWID NOT IN (" + numbers + "))";
+    where_clauses << "(ROWID IN (" + numbers + "))";
   }
 
   // We never want to include songs that have been deleted, but are still kept
@@ -72,22 +74,51 @@ QString Search::ToSql(const QString& songs_table) const {
   // unmounted.
   where_clauses << "unavailable = 0";
 
-  if (!where_clauses.isEmpty()) {
-    sql += " WHERE " + where_clauses.join(" AND ");
+  return where_clauses;
+}
+
+bool Search::is_paged() const {
+  return sort_type_ != Sort_Random && after_id_ != -1;
+}
+
+QString Search::ToSql(const QString& songs_table) const {
+  QString sql = "SELECT ROWID," + Song::kColumnSpec + " FROM " + songs_table;
+
+  QStringList where_clauses = WhereClauses();
+  const QString column = SearchTerm::FieldColumnName(sort_field_);
+  const bool ascending = sort_type_ == Sort_FieldAsc;
+
+  // Carry on from where the last page ended.  The ROWID breaks ties, so songs
+  // with the same value don't get skipped or repeated.  SQLite sorts NULLs
+  // before everything else.
+  if (is_paged()) {
+    const QString after_id =
+        QString("ROWID %1 %2").arg(ascending ? ">" : "<").arg(after_id_);
+
+    if (after_value_.isNull()) {
+      where_clauses << (ascending
+                            ? "(" + column + " IS NOT NULL OR " + after_id + ")"
+                            : "(" + column + " IS NULL AND " + after_id + ")");
+    } else {
+      where_clauses << "(" + column + (ascending ? " > ?" : " < ?") + " OR (" +
+                           column + " = ? AND " + after_id + ")" +
+                           (ascending ? "" : " OR " + column + " IS NULL") +
+                           ")";
+    }
   }
 
+  sql += " WHERE " + where_clauses.join(" AND ");
+
   // Add sort by
   if (sort_type_ == Sort_Random) {
     sql += " ORDER BY random()";
   } else {
-    sql += " ORDER BY " + SearchTerm::FieldColumnName(sort_field_) +
-           (sort_type_ == Sort_FieldAsc ? " ASC" : " DESC");
+    const QString direction = ascending ? " ASC" : " DESC";
+    sql += " ORDER BY " + column + direction + ", ROWID" + direction;
   }
 
   // Add limit
-  if (first_item_) {
-    sql += QString(" LIMIT %1 OFFSET %2").arg(limit_).arg(first_item_);
-  } else if (limit_ != -1) {
+  if (limit_ != -1) {
     sql += " LIMIT " + QString::number(limit_);
   }
   qLog(Debug) << sql;
@@ -95,6 +126,19 @@ QString Search::ToSql(const QString& songs_table) const {
   return sql;
 }
 
+QVariantList Search::BoundValues() const {
+  QVariantList ret;
+  if (is_paged() && !after_value_.isNull()) {
+    ret << after_value_ << after_value_;
+  }
+  return ret;
+}
+
+QString Search::ToIdsSql(const QString& songs_table) const {
+  return "SELECT ROWID FROM " + songs_table + " WHERE " +
+         WhereClauses().join(" AND ");
+}
+
 bool Search::is_valid() const {
   if (search_type_ == Type_All) return true;
   return !terms_.isEmpty();
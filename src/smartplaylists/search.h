@@ -18,6 +18,9 @@
 #ifndef SMARTPLAYLISTSEARCH_H
 #define SMARTPLAYLISTSEARCH_H
 
+#include <QStringList>
+#include <QVariant>
+
 #include "generator.h"
 #include "searchterm.h"
 
@@ -48,11 +51,22 @@ class Search {
   int limit_;
 
   // Not persisted, used to alter the behaviour of the query
-  QList<int> id_not_in_;
-  int first_item_;
+  QList<int> id_in_;
+
+  // Sorted searches only return the songs that sort after this one.
+  int after_id_;
+  QVariant after_value_;
 
   void Reset();
   QString ToSql(const QString& songs_table) const;
+  QVariantList BoundValues() const;
+
+  // Just the ROWIDs of the matching songs, in no particular order.
+  QString ToIdsSql(const QString& songs_table) const;
+
+ private:
+  QStringList WhereClauses() const;
+  bool is_paged() const;
 };
 
 }  // namespace
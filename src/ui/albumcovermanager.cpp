@@ -27,6 +27,7 @@
 #include "covers/albumcoverloader.h"
 #include "covers/coverproviders.h"
 #include "covers/coversearchstatisticsdialog.h"
+#include "covers/thumbnailcache.h"
 #include "library/librarybackend.h"
 #include "library/libraryquery.h"
 #include "library/sqlrow.h"
@@ -48,11 +49,13 @@
 #include <QMessageBox>
 #include <QPainter>
 #include <QProgressBar>
+#include <QScrollBar>
 #include <QSettings>
 #include <QShortcut>
 #include <QTimer>
 
 const char* AlbumCoverManager::kSettingsGroup = "CoverManager";
+const int AlbumCoverManager::kPrioritiseDelayMsec = 100;
 
 AlbumCoverManager::AlbumCoverManager(Application* app,
                                      LibraryBackend* library_backend,
@@ -73,7 +76,8 @@ AlbumCoverManager::AlbumCoverManager(Application* app,
       progress_bar_(new QProgressBar(this)),
       abort_progress_(new QPushButton(this)),
       jobs_(0),
-      library_backend_(library_backend) {
+      library_backend_(library_backend),
+      prioritise_timer_(new QTimer(this)) {
   ui_->setupUi(this);
   ui_->albums->set_cover_manager(this);
 
@@ -181,6 +185,10 @@ void AlbumCoverManager::Init() {
           SLOT(ArtistChanged(QListWidgetItem*)));
   connect(ui_->filter, SIGNAL(textChanged(QString)), SLOT(UpdateFilter()));
   connect(filter_group, SIGNAL(triggered(QAction*)), SLOT(UpdateFilter()));
+  connect(ui_->filter, SIGNAL(textChanged(QString)), prioritise_timer_,
+          SLOT(start()));
+  connect(filter_group, SIGNAL(triggered(QAction*)), prioritise_timer_,
+          SLOT(start()));
   connect(ui_->view, SIGNAL(clicked()), ui_->view, SLOT(showMenu()));
   connect(ui_->fetch, SIGNAL(clicked()), SLOT(FetchAlbumCovers()));
   connect(ui_->export_covers, SIGNAL(clicked()), SLOT(ExportCovers()));
@@ -208,6 +216,15 @@ void AlbumCoverManager::Init() {
   connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
           SLOT(CoverImageLoaded(quint64, QImage)));
 
+  // Which covers are on screen is only worked out once scrolling or typing
+  // in the filter has stopped for a moment.
+  prioritise_timer_->setSingleShot(true);
+  prioritise_timer_->setInterval(kPrioritiseDelayMsec);
+  connect(prioritise_timer_, SIGNAL(timeout()),
+          SLOT(PrioritiseVisibleCovers()));
+  connect(ui_->albums->verticalScrollBar(), SIGNAL(valueChanged(int)),
+          prioritise_timer_, SLOT(start()));
+
   cover_searcher_->Init(cover_fetcher_);
 
   new ForceScrollPerPixel(ui_->albums, this);
@@ -339,16 +356,26 @@ void AlbumCoverManager::ArtistChanged(QListWidgetItem* current) {
     item->setToolTip(info.artist + " - " + info.album_name);
 
     if (!info.art_automatic.isEmpty() || !info.art_manual.isEmpty()) {
+      item->setData(Role_PathAutomatic, info.art_automatic);
+      item->setData(Role_PathManual, info.art_manual);
+
+      QPixmap cached_pixmap;
+      if (app_->thumbnail_cache()->Find(ThumbnailCacheKey(item),
+                                        cover_loader_options_.desired_height_,
+                                        &cached_pixmap)) {
+        item->setIcon(cached_pixmap);
+        continue;
+      }
+
       quint64 id = app_->album_cover_loader()->LoadImageAsync(
           cover_loader_options_, info.art_automatic, info.art_manual,
           info.first_url.toLocalFile());
-      item->setData(Role_PathAutomatic, info.art_automatic);
-      item->setData(Role_PathManual, info.art_manual);
       cover_loading_tasks_[id] = item;
     }
   }
 
   UpdateFilter();
+  prioritise_timer_->start();
 }
 
 void AlbumCoverManager::CoverImageLoaded(quint64 id, const QImage& image) {
@@ -358,10 +385,20 @@ void AlbumCoverManager::CoverImageLoaded(quint64 id, const QImage& image) {
 
   if (image.isNull()) return;
 
+  app_->thumbnail_cache()->Insert(ThumbnailCacheKey(item),
+                                  cover_loader_options_.desired_height_, image);
   item->setIcon(QPixmap::fromImage(image));
   UpdateFilter();
 }
 
+QString AlbumCoverManager::ThumbnailCacheKey(
+    const QListWidgetItem* item) const {
+  return "albumcovermanager:" + item->data(Role_ArtistName).toString() + "/" +
+         item->data(Role_AlbumName).toString() + "," +
+         item->data(Role_PathManual).toString() + "," +
+         item->data(Role_PathAutomatic).toString();
+}
+
 void AlbumCoverManager::UpdateFilter() {
   const QString filter = ui_->filter->text().toLower();
   const bool hide_with_covers = filter_without_covers_->isChecked();
@@ -394,6 +431,34 @@ void AlbumCoverManager::UpdateFilter() {
   ui_->without_cover->setText(QString::number(without_cover));
 }
 
+void AlbumCoverManager::PrioritiseVisibleCovers() {
+  if (cover_loading_tasks_.isEmpty()) return;
+
+  QHash<QListWidgetItem*, quint64> tasks_by_item;
+  for (QMap<quint64, QListWidgetItem*>::const_iterator it =
+           cover_loading_tasks_.constBegin();
+       it != cover_loading_tasks_.constEnd(); ++it) {
+    tasks_by_item.insert(it.value(), it.key());
+  }
+
+  // Load the covers that are on screen before the rest
+  const QRect visible_rect = ui_->albums->viewport()->rect();
+  QSet<quint64> visible_tasks;
+  for (int i = 0; i < ui_->albums->count(); ++i) {
+    QListWidgetItem* item = ui_->albums->item(i);
+    if (item->isHidden() || !tasks_by_item.contains(item)) continue;
+
+    const QModelIndex index = ui_->albums->model()->index(i, 0);
+    if (ui_->albums->visualRect(index).intersects(visible_rect)) {
+      visible_tasks.insert(tasks_by_item[item]);
+    }
+  }
+
+  if (!visible_tasks.isEmpty()) {
+    app_->album_cover_loader()->PrioritiseTasks(visible_tasks);
+  }
+}
+
 bool AlbumCoverManager::ShouldHide(const QListWidgetItem& item,
                                    const QString& filter,
                                    HideCovers hide) const {
@@ -579,6 +644,10 @@ void AlbumCoverManager::UpdateCoverInList(QListWidgetItem* item,
                                                           QString(), cover);
   item->setData(Role_PathManual, cover);
   cover_loading_tasks_[id] = item;
+
+  // The new cover might have been saved over the old one.
+  app_->thumbnail_cache()->Remove(ThumbnailCacheKey(item),
+                                  cover_loader_options_.desired_height_);
 }
 
 void AlbumCoverManager::LoadCoverFromFile() {
@@ -752,6 +821,10 @@ void AlbumCoverManager::SaveAndSetCover(QListWidgetItem* item,
                                                           QString(), path);
   item->setData(Role_PathManual, path);
   cover_loading_tasks_[id] = item;
+
+  // The cover is always saved to the same path for this album.
+  app_->thumbnail_cache()->Remove(ThumbnailCacheKey(item),
+                                  cover_loader_options_.desired_height_);
 }
 
 void AlbumCoverManager::ExportCovers() {
@@ -43,6 +43,7 @@ class QMenu;
 class QNetworkAccessManager;
 class QPushButton;
 class QProgressBar;
+class QTimer;
 
 class AlbumCoverManager : public QMainWindow {
   Q_OBJECT
@@ -52,6 +53,7 @@ class AlbumCoverManager : public QMainWindow {
   ~AlbumCoverManager();
 
   static const char* kSettingsGroup;
+  static const int kPrioritiseDelayMsec;
 
   LibraryBackend* backend() const;
   QIcon no_cover_icon() const { return no_cover_icon_; }
@@ -80,6 +82,7 @@ signals:
   void ArtistChanged(QListWidgetItem* current);
   void CoverImageLoaded(quint64 id, const QImage& image);
   void UpdateFilter();
+  void PrioritiseVisibleCovers();
   void FetchAlbumCovers();
   void ExportCovers();
   void AlbumCoverFetched(quint64 id, const QImage& image,
@@ -131,6 +134,9 @@ signals:
 
   Song ItemAsSong(QListWidgetItem* item);
 
+  // Identifies the item's cover in the thumbnail cache.
+  QString ThumbnailCacheKey(const QListWidgetItem* item) const;
+
   void UpdateStatusText();
   bool ShouldHide(const QListWidgetItem& item, const QString& filter,
                   HideCovers hide) const;
@@ -171,6 +177,8 @@ signals:
 
   LibraryBackend* library_backend_;
 
+  QTimer* prioritise_timer_;
+
   FRIEND_TEST(AlbumCoverManagerTest, HidesItemsWithCover);
   FRIEND_TEST(AlbumCoverManagerTest, HidesItemsWithoutCover);
   FRIEND_TEST(AlbumCoverManagerTest, HidesItemsWithFilter);
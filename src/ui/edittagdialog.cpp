@@ -61,6 +61,9 @@ EditTagDialog::EditTagDialog(Application* app, QWidget* parent)
       cover_art_id_(0),
       cover_art_is_set_(false),
       results_dialog_(new TrackSelectionDialog(this)) {
+  // The full size image is shown when the cover is clicked
+  cover_options_.keep_original_image_ = true;
+
   QIcon nocover = IconLoader::Load("nocover", IconLoader::Other);
   cover_options_.default_output_image_ =
       AlbumCoverLoader::ScaleAndPad(cover_options_,
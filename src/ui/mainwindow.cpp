@@ -41,6 +41,7 @@
 #include <qtsparkle/Updater>
 #endif
 
+#include "analysis/libraryanalyzer.h"
 #include "core/appearance.h"
 #include "core/application.h"
 #include "core/backgroundstreams.h"
@@ -142,6 +143,7 @@
 
 #ifdef HAVE_MOODBAR
 #include "moodbar/moodbarcontroller.h"
+#include "moodbar/moodbarloader.h"
 #include "moodbar/moodbarproxystyle.h"
 #endif
 
@@ -162,6 +164,7 @@ const char* MainWindow::kAllFilesFilterSpec = QT_TR_NOOP("All Files (*)");
 namespace {
 const int kTrackSliderUpdateTimeMs = 40;
 const int kTrackPositionUpdateTimeMs = 1000;
+const int kResumeMoodbarPrecomputeDelayMs = 60000;
 }
 
 MainWindow::MainWindow(Application* app, SystemTrayIcon* tray_icon, OSD* osd,
@@ -471,6 +474,8 @@ MainWindow::MainWindow(Application* app, SystemTrayIcon* tray_icon, OSD* osd,
           SLOT(IncrementalScan()));
   connect(ui_->action_full_library_scan, SIGNAL(triggered()), app_->library(),
           SLOT(FullScan()));
+  connect(ui_->action_analyze_library, SIGNAL(triggered()),
+          app_->library_analyzer(), SLOT(AnalyzeLibrary()));
   connect(ui_->action_queue_manager, SIGNAL(triggered()),
           SLOT(ShowQueueManager()));
   connect(ui_->action_add_files_to_transcoder, SIGNAL(triggered()),
@@ -891,6 +896,16 @@ MainWindow::MainWindow(Application* app, SystemTrayIcon* tray_icon, OSD* osd,
   connect(app_->moodbar_controller(),
           SIGNAL(CurrentMoodbarDataChanged(QByteArray)),
           ui_->track_slider->moodbar_style(), SLOT(SetMoodbarData(QByteArray)));
+  connect(ui_->action_precompute_moodbars, SIGNAL(triggered()),
+          app_->moodbar_loader(), SLOT(PrecomputeLibrary()));
+
+  // Carry on with a library moodbar job from last time, once startup is over
+  if (MoodbarLoader::IsPrecomputePending()) {
+    QTimer::singleShot(kResumeMoodbarPrecomputeDelayMs,
+                       app_->moodbar_loader(), SLOT(PrecomputeLibrary()));
+  }
+#else
+  ui_->action_precompute_moodbars->setVisible(false);
 #endif
 
   // Now playing widget
@@ -59,6 +59,12 @@ void MultiLoadingIndicator::UpdateText() {
       task_text += QString(" %1%").arg(percentage);
     }
 
+    if (task.throughput) {
+      task_text += " " + tr("(%1 %2/s)")
+                             .arg(task.throughput)
+                             .arg(task.throughput_unit);
+    }
+
     strings << task_text;
   }
 
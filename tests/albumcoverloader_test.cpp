@@ -0,0 +1,120 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QTemporaryFile>
+#include <QtConcurrentMap>
+#include <QtDebug>
+
+#include "covers/albumcoverloader.h"
+#include "covers/albumcoverloaderoptions.h"
+
+namespace {
+
+class AlbumCoverLoaderTest : public ::testing::Test {
+ protected:
+  static const int kBenchmarkCovers = 200;
+
+  virtual void SetUp() {
+    // A cover the size of the ones usually found next to music files
+    QImage image(1000, 1000, QImage::Format_RGB32);
+    QPainter p(&image);
+    p.fillRect(image.rect(), Qt::darkBlue);
+    p.fillRect(100, 200, 600, 300, Qt::yellow);
+    p.end();
+
+    file_.setFileTemplate(QDir::tempPath() + "/covertest-XXXXXX.jpg");
+    ASSERT_TRUE(file_.open());
+    ASSERT_TRUE(image.save(&file_, "JPG")) << "Qt's JPEG plugin is missing";
+    file_.close();
+  }
+
+  AlbumCoverLoaderOptions Options(int size) const {
+    AlbumCoverLoaderOptions options;
+    options.desired_height_ = size;
+    return options;
+  }
+
+  // Returns the number of covers decoded per second.
+  double Benchmark(const AlbumCoverLoaderOptions& options, bool full_decode,
+                   bool parallel) {
+    QList<QString> files;
+    for (int i = 0; i < kBenchmarkCovers; ++i) files << file_.fileName();
+
+    AlbumCoverLoaderOptions decode_options(options);
+    decode_options.keep_original_image_ = full_decode;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto load = [decode_options](const QString& filename) {
+      AlbumCoverLoader::ScaleAndPad(
+          decode_options,
+          AlbumCoverLoader::ReadImage(decode_options, filename));
+    };
+
+    if (parallel) {
+      QtConcurrent::blockingMap(files, load);
+    } else {
+      for (const QString& filename : files) load(filename);
+    }
+
+    return kBenchmarkCovers * 1000.0 / qMax(1ll, timer.elapsed());
+  }
+
+  QTemporaryFile file_;
+};
+
+TEST_F(AlbumCoverLoaderTest, ReadsImageAtDesiredSize) {
+  QImage image = AlbumCoverLoader::ReadImage(Options(128), file_.fileName());
+  EXPECT_EQ(QSize(128, 128), image.size());
+}
+
+TEST_F(AlbumCoverLoaderTest, KeepsOriginalImageIfAsked) {
+  AlbumCoverLoaderOptions options(Options(128));
+  options.keep_original_image_ = true;
+  QImage image = AlbumCoverLoader::ReadImage(options, file_.fileName());
+  EXPECT_EQ(QSize(1000, 1000), image.size());
+}
+
+TEST_F(AlbumCoverLoaderTest, DoesNotScaleUnscaledImages) {
+  AlbumCoverLoaderOptions options(Options(128));
+  options.scale_output_image_ = false;
+  QImage image = AlbumCoverLoader::ReadImage(options, file_.fileName());
+  EXPECT_EQ(QSize(1000, 1000), image.size());
+}
+
+// Decodes 1200 covers and only prints the timings, so it doesn't run with the
+// other tests.  Run it with --gtest_also_run_disabled_tests.
+TEST_F(AlbumCoverLoaderTest, DISABLED_Benchmark) {
+  for (int size : QList<int>() << 32 << 128) {
+    const AlbumCoverLoaderOptions options(Options(size));
+    qDebug() << size << "px, full decode:"
+             << Benchmark(options, true, false) << "covers/sec";
+    qDebug() << size << "px, decode at size:"
+             << Benchmark(options, false, false) << "covers/sec";
+    qDebug() << size << "px, decode at size in parallel:"
+             << Benchmark(options, false, true) << "covers/sec";
+  }
+}
+
+}  // namespace
@@ -29,7 +29,7 @@
 class DatabaseTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
-    database_.reset(new MemoryDatabase);
+    database_.reset(new MemoryDatabase(nullptr));
   }
 
   std::unique_ptr<Database> database_;
@@ -53,6 +53,25 @@ TEST_F(DatabaseTest, DatabaseInitialises) {
   EXPECT_FALSE(q.next());
 }
 
+TEST_F(DatabaseTest, InMemoryDatabaseIsNotWal) {
+  EXPECT_FALSE(database_->is_wal());
+}
+
+TEST_F(DatabaseTest, LockersCanBeNested) {
+  {
+    Database::Locker write(database_.get(), Database::Lock_Write);
+    Database::Locker read(database_.get(), Database::Lock_Read);
+    Database::Locker write_again(database_.get(), Database::Lock_Write);
+  }
+  {
+    Database::Locker read(database_.get(), Database::Lock_Read);
+    Database::Locker write(database_.get(), Database::Lock_Write);
+  }
+
+  EXPECT_EQ(2, database_->lock_stats(Database::Lock_Read).count);
+  EXPECT_EQ(3, database_->lock_stats(Database::Lock_Write).count);
+}
+
 TEST_F(DatabaseTest, FTSOpenParsesSimpleInput) {
   sqlite3_tokenizer_cursor* cursor = nullptr;
   Database::FTSOpen(nullptr, "foo", 3, &cursor);
@@ -0,0 +1,132 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <QElapsedTimer>
+#include <QtDebug>
+
+#include "analyzers/fft.h"
+#include "analyzers/fht.h"
+
+namespace {
+
+class FFTTest : public ::testing::Test {
+ protected:
+  // Something like music: a few tones and some noise.
+  static std::vector<float> Signal(int size) {
+    std::vector<float> ret(size);
+    unsigned int seed = 1;
+    for (int i = 0; i < size; ++i) {
+      seed = seed * 1103515245 + 12345;
+      const float noise = ((seed >> 16) & 0x7fff) / 32768.0f - 0.5f;
+      ret[i] = 0.5 * sin(2 * M_PI * 5 * i / size) +
+               0.3 * sin(2 * M_PI * 37 * i / size + 1) + 0.1 * noise;
+    }
+    return ret;
+  }
+
+  static void ExpectNear(const std::vector<float>& expected,
+                         const std::vector<float>& actual, int count) {
+    for (int i = 0; i < count; ++i) {
+      const float tolerance = 1e-3 * qMax(1.0f, fabsf(expected[i]));
+      ASSERT_NEAR(expected[i], actual[i], tolerance) << "at " << i;
+    }
+  }
+};
+
+TEST_F(FFTTest, MatchesDiscreteFourierTransform) {
+  for (int exp = 3; exp <= 10; ++exp) {
+    FFT fft(exp);
+    const int size = fft.size();
+    std::vector<float> signal = Signal(size);
+
+    std::vector<float> expected(size);
+    for (int k = 0; k < size / 2; ++k) {
+      double re = 0, im = 0;
+      for (int n = 0; n < size; ++n) {
+        re += signal[n] * cos(2 * M_PI * k * n / size);
+        im -= signal[n] * sin(2 * M_PI * k * n / size);
+      }
+      expected[k] = 2 * (re * re + im * im);
+    }
+
+    fft.power2(&signal[0]);
+    ExpectNear(expected, signal, size / 2);
+  }
+}
+
+TEST_F(FFTTest, MatchesFHTSpectrum) {
+  for (int exp = 3; exp <= 12; ++exp) {
+    FHT fht(exp);
+    FFT fft(exp);
+    std::vector<float> expected = Signal(fht.size());
+    std::vector<float> actual = expected;
+
+    fht.spectrum(&expected[0]);
+    fft.spectrum(&actual[0]);
+    ExpectNear(expected, actual, fht.size() / 2);
+  }
+}
+
+TEST_F(FFTTest, MatchesFHTLogSpectrum) {
+  for (int exp = 4; exp <= 9; ++exp) {
+    FHT fht(exp);
+    FFT fft(exp);
+    std::vector<float> expected = Signal(fht.size());
+    std::vector<float> actual = expected;
+
+    std::vector<float> copy = expected;
+    fht.logSpectrum(&expected[0], &copy[0]);
+    fft.logSpectrum(&actual[0]);
+    ExpectNear(expected, actual, fht.size() / 2);
+  }
+}
+
+TEST_F(FFTTest, Benchmark) {
+  static const int kIterations = 5000;
+
+  for (int exp = 7; exp <= 12; ++exp) {
+    FHT fht(exp);
+    FFT fft(exp);
+    const std::vector<float> signal = Signal(fht.size());
+    std::vector<float> data;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < kIterations; ++i) {
+      data = signal;
+      fht.spectrum(&data[0]);
+    }
+    const qint64 fht_nsec = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < kIterations; ++i) {
+      data = signal;
+      fft.spectrum(&data[0]);
+    }
+    const qint64 fft_nsec = timer.nsecsElapsed();
+
+    qDebug() << "Size" << fht.size() << "- FHT:" << fht_nsec / kIterations
+             << "ns, FFT:" << fft_nsec / kIterations << "ns";
+  }
+}
+
+}  // namespace
@@ -0,0 +1,167 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryFile>
+
+#include "core/utilities.h"
+#include "library/libraryfileindex.h"
+
+namespace {
+
+class LibraryFileIndexTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Use a unique name for the directory.
+    QTemporaryFile file(QDir::tempPath() + "/libraryfileindextest-XXXXXX");
+    ASSERT_TRUE(file.open());
+    directory_ = file.fileName() + ".d";
+    ASSERT_TRUE(QDir().mkpath(directory_ + "/subdir"));
+
+    WriteFile("a.mp3", "aaaa");
+    WriteFile("b.mp3", "bbbb");
+
+    index_.SetDirectory(directory_, Entries());
+  }
+
+  virtual void TearDown() { Utilities::RemoveRecursive(directory_); }
+
+  void WriteFile(const QString& name, const QByteArray& data) {
+    QFile file(directory_ + "/" + name);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write(data);
+  }
+
+  LibraryFileIndex::EntryList Entries(QStringList* names = nullptr) const {
+    LibraryFileIndex::EntryList entries;
+    EXPECT_TRUE(LibraryFileIndex::ReadDirectory(directory_, &entries, names));
+    return entries;
+  }
+
+  // Returns false if the directory needs a normal scan.
+  bool FindChanges(const LibraryFileIndex& index, QStringList* changed,
+                   QList<quint64>* removed) const {
+    QStringList names;
+    const LibraryFileIndex::EntryList entries = Entries(&names);
+    return index.FindChanges(directory_, entries, names, changed, removed);
+  }
+
+  QString directory_;
+  LibraryFileIndex index_;
+};
+
+TEST_F(LibraryFileIndexTest, ReadsDirectory) {
+  QStringList names;
+  const LibraryFileIndex::EntryList entries = Entries(&names);
+
+  ASSERT_EQ(3, entries.count());
+  ASSERT_EQ(3, names.count());
+  names.sort();
+  EXPECT_EQ(QStringList() << "a.mp3"
+                          << "b.mp3"
+                          << "subdir",
+            names);
+
+  for (int i = 0; i < entries.count(); ++i) {
+    EXPECT_EQ(LibraryFileIndex::HashName(names[i]), entries[i].name_hash);
+  }
+}
+
+TEST_F(LibraryFileIndexTest, NothingChanged) {
+  QStringList changed;
+  QList<quint64> removed;
+  ASSERT_TRUE(FindChanges(index_, &changed, &removed));
+  EXPECT_TRUE(changed.isEmpty());
+  EXPECT_TRUE(removed.isEmpty());
+}
+
+TEST_F(LibraryFileIndexTest, FindsChangedAndNewFiles) {
+  WriteFile("a.mp3", "more");
+  WriteFile("c.mp3", "cccc");
+
+  QStringList changed;
+  QList<quint64> removed;
+  ASSERT_TRUE(FindChanges(index_, &changed, &removed));
+  changed.sort();
+  EXPECT_EQ(QStringList() << "a.mp3"
+                          << "c.mp3",
+            changed);
+  EXPECT_TRUE(removed.isEmpty());
+}
+
+TEST_F(LibraryFileIndexTest, FindsRemovedFiles) {
+  ASSERT_TRUE(QFile::remove(directory_ + "/b.mp3"));
+
+  QStringList changed;
+  QList<quint64> removed;
+  ASSERT_TRUE(FindChanges(index_, &changed, &removed));
+  EXPECT_TRUE(changed.isEmpty());
+  EXPECT_EQ(QList<quint64>() << LibraryFileIndex::HashName("b.mp3"), removed);
+}
+
+TEST_F(LibraryFileIndexTest, NewSubdirectoryNeedsNormalScan) {
+  ASSERT_TRUE(QDir().mkpath(directory_ + "/another"));
+
+  QStringList changed;
+  QList<quint64> removed;
+  EXPECT_FALSE(FindChanges(index_, &changed, &removed));
+}
+
+TEST_F(LibraryFileIndexTest, RemovedSubdirectoryNeedsNormalScan) {
+  ASSERT_TRUE(QDir().rmdir(directory_ + "/subdir"));
+
+  QStringList changed;
+  QList<quint64> removed;
+  EXPECT_FALSE(FindChanges(index_, &changed, &removed));
+}
+
+TEST_F(LibraryFileIndexTest, UnknownDirectoryNeedsNormalScan) {
+  LibraryFileIndex index;
+  QStringList changed;
+  QList<quint64> removed;
+  EXPECT_FALSE(FindChanges(index, &changed, &removed));
+}
+
+TEST_F(LibraryFileIndexTest, SavesAndLoads) {
+  const QString filename = directory_ + ".index";
+
+  {
+    LibraryFileIndex index;
+    index.Load(filename);
+    index.SetDirectory(directory_, Entries());
+    index.Save();
+
+    // Changes are appended to the file.
+    ASSERT_TRUE(QFile::remove(directory_ + "/b.mp3"));
+    index.SetDirectory(directory_, Entries());
+    index.Save();
+  }
+
+  LibraryFileIndex index;
+  index.Load(filename);
+  QFile::remove(filename);
+
+  QStringList changed;
+  QList<quint64> removed;
+  ASSERT_TRUE(FindChanges(index, &changed, &removed));
+  EXPECT_TRUE(changed.isEmpty());
+  EXPECT_TRUE(removed.isEmpty());
+}
+
+}  // namespace
@@ -0,0 +1,199 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QSignalSpy>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/libraryquery.h"
+#include "library/librarysongstore.h"
+
+namespace {
+
+class LibrarySongStoreTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+  }
+
+  // Adds songs to the database, and returns them with their IDs set.
+  SongList AddSongs(const SongList& songs) {
+    QSignalSpy spy(backend_.get(), SIGNAL(SongsDiscovered(SongList)));
+    backend_->AddOrUpdateSongs(songs);
+    EXPECT_EQ(1, spy.count());
+    if (spy.isEmpty()) return SongList();
+    return spy[0][0].value<SongList>();
+  }
+
+  static Song MakeSong(const QString& artist, const QString& album,
+                       const QString& title) {
+    static int sFileNumber = 0;
+
+    Song ret;
+    ret.Init(title, artist, album, 123);
+    ret.set_directory_id(1);
+    ret.set_url(
+        QUrl::fromLocalFile(QString("/tmp/%1.mp3").arg(sFileNumber++)));
+    ret.set_mtime(1);
+    ret.set_ctime(1);
+    ret.set_filesize(1);
+    return ret;
+  }
+
+  QStringList Artists(const LibrarySongStore::ConditionList& conditions =
+                          LibrarySongStore::ConditionList()) const {
+    QStringList ret;
+    for (const QVariantList& row :
+         store_.Distinct(QList<LibrarySongStore::Field>()
+                             << LibrarySongStore::Field_Artist,
+                         QueryOptions(), conditions)) {
+      ret << row[0].toString();
+    }
+    ret.sort();
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  LibrarySongStore store_;
+};
+
+TEST_F(LibrarySongStoreTest, LoadsSongsFromDatabase) {
+  AddSongs(SongList() << MakeSong("Artist 1", "Album 1", "Title 1")
+                      << MakeSong("Artist 1", "Album 2", "Title 2")
+                      << MakeSong("Artist 2", "Album 3", "Title 3"));
+
+  EXPECT_FALSE(store_.is_loaded());
+  store_.Load(backend_.get());
+  ASSERT_TRUE(store_.is_loaded());
+  EXPECT_EQ(3, store_.song_count());
+  EXPECT_EQ(QStringList() << "Artist 1"
+                          << "Artist 2",
+            Artists());
+}
+
+TEST_F(LibrarySongStoreTest, DistinctWithConditions) {
+  AddSongs(SongList() << MakeSong("Artist 1", "Album 1", "Title 1")
+                      << MakeSong("Artist 1", "Album 1", "Title 2")
+                      << MakeSong("Artist 1", "Album 2", "Title 3")
+                      << MakeSong("Artist 2", "Album 3", "Title 4"));
+  store_.Load(backend_.get());
+
+  LibrarySongStore::ConditionList conditions;
+  conditions << LibrarySongStore::Condition(LibrarySongStore::Field_Artist,
+                                            "Artist 1");
+
+  QStringList albums;
+  for (const QVariantList& row : store_.Distinct(
+           QList<LibrarySongStore::Field>() << LibrarySongStore::Field_Album,
+           QueryOptions(), conditions)) {
+    albums << row[0].toString();
+  }
+  albums.sort();
+  EXPECT_EQ(QStringList() << "Album 1"
+                          << "Album 2",
+            albums);
+
+  EXPECT_TRUE(store_.Any(QueryOptions(), conditions));
+
+  LibrarySongStore::ConditionList missing;
+  missing << LibrarySongStore::Condition(LibrarySongStore::Field_Artist,
+                                         "Nobody");
+  EXPECT_FALSE(store_.Any(QueryOptions(), missing));
+  EXPECT_TRUE(Artists(missing).isEmpty());
+}
+
+TEST_F(LibrarySongStoreTest, IgnoresChangesUntilLoaded) {
+  const SongList songs =
+      AddSongs(SongList() << MakeSong("Artist", "Album", "Title"));
+
+  // The store reads the songs from the database when it's loaded instead.
+  store_.AddOrUpdateSongs(songs);
+  EXPECT_FALSE(store_.is_loaded());
+  EXPECT_EQ(0, store_.song_count());
+}
+
+TEST_F(LibrarySongStoreTest, AddsUpdatesAndRemovesSongs) {
+  store_.Load(backend_.get());
+  ASSERT_TRUE(store_.is_loaded());
+
+  SongList songs = AddSongs(SongList() << MakeSong("Artist 1", "Album", "1")
+                                       << MakeSong("Artist 2", "Album", "2"));
+  ASSERT_EQ(2, songs.count());
+  store_.AddOrUpdateSongs(songs);
+  EXPECT_EQ(QStringList() << "Artist 1"
+                          << "Artist 2",
+            Artists());
+
+  songs[0].set_artist("Artist 3");
+  store_.AddOrUpdateSongs(SongList() << songs[0]);
+  EXPECT_EQ(2, store_.song_count());
+  EXPECT_EQ(QStringList() << "Artist 2"
+                          << "Artist 3",
+            Artists());
+
+  store_.RemoveSongs(SongList() << songs[1]);
+  EXPECT_EQ(1, store_.song_count());
+  EXPECT_EQ(QStringList() << "Artist 3", Artists());
+
+  songs[0].set_unavailable(true);
+  store_.AddOrUpdateSongs(SongList() << songs[0]);
+  EXPECT_EQ(0, store_.song_count());
+}
+
+TEST_F(LibrarySongStoreTest, ClearForgetsSongs) {
+  AddSongs(SongList() << MakeSong("Artist", "Album", "Title"));
+  store_.Load(backend_.get());
+  ASSERT_EQ(1, store_.song_count());
+
+  store_.Clear();
+  EXPECT_FALSE(store_.is_loaded());
+  EXPECT_EQ(0, store_.song_count());
+
+  // Songs added behind the store's back are picked up when it's reloaded.
+  AddSongs(SongList() << MakeSong("Another artist", "Album", "Title"));
+  store_.Load(backend_.get());
+  EXPECT_EQ(QStringList() << "Another artist"
+                          << "Artist",
+            Artists());
+}
+
+TEST_F(LibrarySongStoreTest, FiltersUntaggedSongs) {
+  AddSongs(SongList() << MakeSong("Artist", "Album", "Title")
+                      << MakeSong("", "Album", "Title"));
+  store_.Load(backend_.get());
+
+  QueryOptions options;
+  options.set_query_mode(QueryOptions::QueryMode_Untagged);
+  const QList<QVariantList> rows = store_.Distinct(
+      QList<LibrarySongStore::Field>() << LibrarySongStore::Field_Artist,
+      options, LibrarySongStore::ConditionList());
+  ASSERT_EQ(1, rows.count());
+  EXPECT_EQ(QString(), rows[0][0].toString());
+}
+
+}  // namespace
@@ -0,0 +1,123 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryFile>
+
+#include "core/linuxfslistener.h"
+#include "core/utilities.h"
+
+namespace {
+
+class LinuxFSListenerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Use a unique name for the directory.
+    QTemporaryFile file(QDir::tempPath() + "/linuxfslistenertest-XXXXXX");
+    ASSERT_TRUE(file.open());
+    directory_ = file.fileName() + ".d";
+    ASSERT_TRUE(QDir().mkpath(directory_));
+
+    listener_.Init();
+    listener_.AddPath(directory_);
+  }
+
+  virtual void TearDown() { Utilities::RemoveRecursive(directory_); }
+
+  void WriteFile(const QString& name) {
+    QFile file(directory_ + "/" + name);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write("data");
+  }
+
+  // Runs the event loop for long enough that the listener has emitted
+  // anything it's going to.
+  void WaitForChanges() {
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < LinuxFSListener::kCoalesceIntervalMsec * 3) {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+  }
+
+  QString directory_;
+  LinuxFSListener listener_;
+};
+
+TEST_F(LinuxFSListenerTest, ReportsChangedFiles) {
+  QSignalSpy paths(&listener_, SIGNAL(PathChanged(QString)));
+  QSignalSpy files(&listener_, SIGNAL(FilesChanged(QString, QStringList)));
+
+  WriteFile("a.mp3");
+  WaitForChanges();
+
+  EXPECT_EQ(0, paths.count());
+  ASSERT_EQ(1, files.count());
+  EXPECT_EQ(directory_, files[0][0].toString());
+  EXPECT_EQ(QStringList() << "a.mp3", files[0][1].toStringList());
+}
+
+TEST_F(LinuxFSListenerTest, CoalescesBursts) {
+  QSignalSpy files(&listener_, SIGNAL(FilesChanged(QString, QStringList)));
+
+  QStringList names;
+  for (int i = 0; i < 20; ++i) {
+    names << QString("%1.mp3").arg(i);
+    WriteFile(names.last());
+  }
+  ASSERT_TRUE(QFile::remove(directory_ + "/0.mp3"));
+  WaitForChanges();
+
+  ASSERT_EQ(1, files.count());
+  QStringList changed = files[0][1].toStringList();
+  changed.sort();
+  names.sort();
+  EXPECT_EQ(names, changed);
+}
+
+TEST_F(LinuxFSListenerTest, NewSubdirectoryChangesPath) {
+  QSignalSpy paths(&listener_, SIGNAL(PathChanged(QString)));
+  QSignalSpy files(&listener_, SIGNAL(FilesChanged(QString, QStringList)));
+
+  WriteFile("a.mp3");
+  ASSERT_TRUE(QDir().mkpath(directory_ + "/subdir"));
+  WaitForChanges();
+
+  // The whole directory is rescanned, so its files aren't reported as well.
+  ASSERT_EQ(1, paths.count());
+  EXPECT_EQ(directory_, paths[0][0].toString());
+  EXPECT_EQ(0, files.count());
+}
+
+TEST_F(LinuxFSListenerTest, RemovedPathIsNotReported) {
+  QSignalSpy paths(&listener_, SIGNAL(PathChanged(QString)));
+  QSignalSpy files(&listener_, SIGNAL(FilesChanged(QString, QStringList)));
+
+  listener_.RemovePath(directory_);
+  WriteFile("a.mp3");
+  WaitForChanges();
+
+  EXPECT_EQ(0, paths.count());
+  EXPECT_EQ(0, files.count());
+}
+
+}  // namespace
@@ -0,0 +1,183 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QScopedPointer>
+
+#include "core/logging.h"
+#include "core/messagehandler.h"
+#include "tagreadermessages.pb.h"
+
+namespace {
+
+class TestHandler : public AbstractMessageHandler<pb::tagreader::Message> {
+ public:
+  TestHandler(QIODevice* device)
+      : AbstractMessageHandler<pb::tagreader::Message>(device, nullptr),
+        received_(0),
+        received_bytes_(0) {}
+
+  int received() const { return received_; }
+  qint64 received_bytes() const { return received_bytes_; }
+
+ protected:
+  void MessageArrived(const pb::tagreader::Message& message) {
+    received_++;
+    received_bytes_ += message.load_embedded_art_response().data().size();
+  }
+
+ private:
+  int received_;
+  qint64 received_bytes_;
+};
+
+class MessageHandlerTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    const QString name =
+        QString("messagehandler_test_%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    ASSERT_TRUE(server_.listen(name));
+
+    client_socket_.connectToServer(name);
+    ASSERT_TRUE(client_socket_.waitForConnected(1000));
+    ASSERT_TRUE(server_.waitForNewConnection(1000));
+
+    // The worker side sends, the application side receives.
+    sender_.reset(new TestHandler(&client_socket_));
+    receiver_.reset(new TestHandler(server_.nextPendingConnection()));
+  }
+
+  void TearDown() {
+    sender_.reset();
+    receiver_.reset();
+  }
+
+  bool EnableSharedMemory() {
+    const QString key =
+        QString("messagehandler_test_shm_%1")
+            .arg(QCoreApplication::applicationPid());
+    if (!receiver_->OfferSharedMemory(key, 16 * 1024 * 1024)) return false;
+
+    for (int i = 0; i < 100 && !sender_->is_writing_shared_memory(); ++i) {
+      client_socket_.waitForReadyRead(10);
+      QCoreApplication::processEvents();
+    }
+    return sender_->is_writing_shared_memory();
+  }
+
+  // Sends count messages of message_size bytes each, and returns how many
+  // milliseconds it took for them to arrive.
+  qint64 SendMessages(int count, int message_size) {
+    pb::tagreader::Message message;
+    message.mutable_load_embedded_art_response()->set_data(
+        std::string(message_size, 'x'));
+
+    const int expected = receiver_->received() + count;
+    const qint64 expected_bytes =
+        receiver_->received_bytes() + qint64(count) * message_size;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < count; ++i) {
+      sender_->SendMessage(message);
+      QCoreApplication::processEvents();
+    }
+    while (receiver_->received() < expected && timer.elapsed() < 30000) {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+
+    EXPECT_EQ(expected, receiver_->received());
+    EXPECT_EQ(expected_bytes, receiver_->received_bytes());
+    return qMax(qint64(1), timer.elapsed());
+  }
+
+  // Logs how fast count messages of message_size bytes each arrived.
+  void RunBenchmark(const char* transport, int count, int message_size) {
+    const qint64 elapsed = SendMessages(count, message_size);
+
+    qLog(Info) << transport << count << "messages of" << message_size
+               << "bytes:" << count * 1000 / elapsed << "messages/sec,"
+               << qint64(count) * message_size * 1000 / elapsed /
+                      (1024 * 1024) << "MB/sec";
+  }
+
+  // Writes a frame that says a message is in the shared memory ring, and
+  // returns true if the receiver dropped the connection because of it.
+  bool SendSharedMemoryFrame(quint32 offset, quint32 size) {
+    QDataStream s(&client_socket_);
+    s << quint32(0x80000000 | (2 * sizeof(quint32))) << offset << size;
+    client_socket_.flush();
+
+    for (int i = 0; i < 100 && client_socket_.state() ==
+                                   QLocalSocket::ConnectedState; ++i) {
+      client_socket_.waitForDisconnected(10);
+      QCoreApplication::processEvents();
+    }
+    return client_socket_.state() != QLocalSocket::ConnectedState;
+  }
+
+  QLocalServer server_;
+  QLocalSocket client_socket_;
+  QScopedPointer<TestHandler> sender_;
+  QScopedPointer<TestHandler> receiver_;
+};
+
+TEST_F(MessageHandlerTest, SocketMessages) {
+  SendMessages(100, 256);
+  SendMessages(5, 256 * 1024);
+  EXPECT_FALSE(sender_->is_writing_shared_memory());
+}
+
+TEST_F(MessageHandlerTest, SharedMemoryMessages) {
+  ASSERT_TRUE(EnableSharedMemory());
+  SendMessages(100, 256);
+  SendMessages(5, 256 * 1024);
+}
+
+TEST_F(MessageHandlerTest, SharedMemoryMessageOutsideRing) {
+  ASSERT_TRUE(EnableSharedMemory());
+  EXPECT_TRUE(SendSharedMemoryFrame(16 * 1024 * 1024 - 10, 20));
+}
+
+TEST_F(MessageHandlerTest, SharedMemoryMessageOverflowsOffset) {
+  ASSERT_TRUE(EnableSharedMemory());
+  EXPECT_TRUE(SendSharedMemoryFrame(100, 0xFFFFFFF0));
+}
+
+TEST_F(MessageHandlerTest, SharedMemoryMessageWithoutRing) {
+  EXPECT_TRUE(SendSharedMemoryFrame(0, 10));
+}
+
+// Pushes about 400MB through each transport, so it doesn't run with the other
+// tests.  Run it with --gtest_also_run_disabled_tests.
+TEST_F(MessageHandlerTest, DISABLED_Benchmark) {
+  RunBenchmark("Socket", 10000, 256);
+  RunBenchmark("Socket", 200, 2 * 1024 * 1024);
+
+  ASSERT_TRUE(EnableSharedMemory());
+  RunBenchmark("Shared memory", 10000, 256);
+  RunBenchmark("Shared memory", 200, 2 * 1024 * 1024);
+}
+
+}  // namespace
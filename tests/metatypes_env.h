@@ -26,6 +26,8 @@
 #include "core/song.h"
 #include "core/songloader.h"
 #include "library/directory.h"
+#include "playlist/playlistitem.h"
+#include "smartplaylists/generator.h"
 
 class MetatypesEnvironment : public ::testing::Environment {
 public:
@@ -37,6 +39,9 @@ public:
     qRegisterMetaType<SongList>("SongList");
     qRegisterMetaType<QModelIndex>("QModelIndex");
     qRegisterMetaType<SongLoader::Result>("SongLoader::Result");
+    qRegisterMetaType<PlaylistItemList>("PlaylistItemList");
+    qRegisterMetaType<smart_playlists::GeneratorPtr>(
+        "smart_playlists::GeneratorPtr");
   }
 };
 
@@ -0,0 +1,158 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "core/utilities.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "networkremote/outgoingdatacreator.h"
+
+namespace {
+
+class OutgoingDataCreatorTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+
+    SongList songs;
+    for (const QString& title : QStringList() << "a"
+                                              << "b"
+                                              << "c") {
+      Song song;
+      song.Init(title, "Artist", "Album", 123);
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile("/tmp/" + title + ".mp3"));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs << song;
+    }
+    backend_->AddOrUpdateSongs(songs);
+
+    for (const Song& song : songs) {
+      ids_ << backend_->GetSongByUrl(song.url()).id();
+    }
+
+    filename_ = Utilities::GetTemporaryFileName();
+  }
+
+  virtual void TearDown() { QFile::remove(filename_); }
+
+  // Runs a query against the exported file, and returns the first column of
+  // each row.  Returns an empty list if the query fails.
+  QStringList Export(const QString& sql) {
+    QStringList ret;
+    {
+      QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "export");
+      db.setDatabaseName(filename_);
+      EXPECT_TRUE(db.open());
+
+      QSqlQuery q(db);
+      if (q.exec(sql)) {
+        while (q.next()) ret << q.value(0).toString();
+      }
+    }
+    QSqlDatabase::removeDatabase("export");
+
+    ret.sort();
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  QList<int> ids_;
+  QString filename_;
+};
+
+TEST_F(OutgoingDataCreatorTest, LibraryChangesSince) {
+  QHash<int, qint64> changed;
+  changed[1] = 5;
+  changed[2] = 7;
+  QHash<int, qint64> deleted;
+  deleted[3] = 6;
+  deleted[4] = 4;
+
+  QList<int> changed_ids;
+  QList<int> deleted_ids;
+  ASSERT_TRUE(OutgoingDataCreator::LibraryChangesSince(
+      changed, deleted, 5, &changed_ids, &deleted_ids));
+  EXPECT_EQ(QList<int>() << 2, changed_ids);
+  EXPECT_EQ(QList<int>() << 3, deleted_ids);
+}
+
+TEST_F(OutgoingDataCreatorTest, TooManyChangesSendsWholeLibrary) {
+  QHash<int, qint64> changed;
+  for (int i = 0; i <= OutgoingDataCreator::kMaxLibraryChanges; ++i) {
+    changed[i] = 2;
+  }
+
+  QList<int> changed_ids;
+  QList<int> deleted_ids;
+  EXPECT_FALSE(OutgoingDataCreator::LibraryChangesSince(
+      changed, QHash<int, qint64>(), 1, &changed_ids, &deleted_ids));
+
+  // Songs from before the client's revision don't count.
+  changed_ids.clear();
+  EXPECT_TRUE(OutgoingDataCreator::LibraryChangesSince(
+      changed, QHash<int, qint64>(), 2, &changed_ids, &deleted_ids));
+  EXPECT_TRUE(changed_ids.isEmpty());
+}
+
+TEST_F(OutgoingDataCreatorTest, ExportsWholeLibrary) {
+  ASSERT_TRUE(OutgoingDataCreator::ExportLibrary(database_.get(), filename_,
+                                                 false, nullptr, QList<int>()));
+
+  EXPECT_EQ(QStringList() << "a"
+                          << "b"
+                          << "c",
+            Export("SELECT title FROM songs"));
+  EXPECT_TRUE(Export("SELECT song_id FROM deleted_songs").isEmpty());
+}
+
+TEST_F(OutgoingDataCreatorTest, ExportsChangedSongs) {
+  const QList<int> changed = QList<int>() << ids_[1];
+  ASSERT_TRUE(OutgoingDataCreator::ExportLibrary(
+      database_.get(), filename_, true, &changed, QList<int>() << 42));
+
+  EXPECT_EQ(QStringList() << "b", Export("SELECT title FROM songs"));
+  EXPECT_EQ(QStringList() << QString::number(ids_[1]),
+            Export("SELECT song_id FROM songs"));
+  EXPECT_EQ(QStringList() << "42", Export("SELECT song_id FROM deleted_songs"));
+}
+
+TEST_F(OutgoingDataCreatorTest, ExportsNoChangedSongs) {
+  const QList<int> changed;
+  ASSERT_TRUE(OutgoingDataCreator::ExportLibrary(database_.get(), filename_,
+                                                 true, &changed, QList<int>()));
+
+  EXPECT_TRUE(Export("SELECT title FROM songs").isEmpty());
+}
+
+}  // namespace
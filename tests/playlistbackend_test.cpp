@@ -0,0 +1,288 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QSqlQuery>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/libraryplaylistitem.h"
+#include "playlist/playlistbackend.h"
+#include "playlist/songplaylistitem.h"
+
+namespace {
+
+class PlaylistBackendTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new PlaylistBackend(nullptr, database_.get()));
+    playlist_ = backend_->CreatePlaylist("Test", QString());
+    ASSERT_NE(-1, playlist_);
+  }
+
+  static PlaylistItemPtr MakeItem(const QString& title) {
+    Song song;
+    song.Init(title, "Artist", "Album", 123);
+    song.set_url(QUrl("http://example.com/" + title));
+    return PlaylistItemPtr(new SongPlaylistItem(song));
+  }
+
+  void Save(const PlaylistItemList& items,
+            const PlaylistItemList& changed = PlaylistItemList()) {
+    backend_->SavePlaylist(playlist_, items, changed, -1,
+                           smart_playlists::GeneratorPtr());
+  }
+
+  // The playlist's rows in the database, in order, as title -> ROWID.
+  QList<QPair<QString, qint64>> Rows() {
+    QSqlQuery q(database_->Connect());
+    q.prepare(
+        "SELECT title, ROWID FROM playlist_items"
+        " WHERE playlist = :playlist ORDER BY position");
+    q.bindValue(":playlist", playlist_);
+    EXPECT_TRUE(q.exec());
+
+    QList<QPair<QString, qint64>> ret;
+    while (q.next()) {
+      ret << qMakePair(q.value(0).toString(), q.value(1).toLongLong());
+    }
+    return ret;
+  }
+
+  static QStringList Titles(const QList<QPair<QString, qint64>>& rows) {
+    QStringList ret;
+    for (const auto& row : rows) ret << row.first;
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<PlaylistBackend> backend_;
+  int playlist_;
+};
+
+TEST_F(PlaylistBackendTest, AssignPositionsKeepsItemsInOrder) {
+  const qint64 gap = PlaylistBackend::kPositionGap;
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+  PlaylistItemPtr added = MakeItem("added");
+
+  PlaylistBackend::SavedPlaylist saved;
+  saved[a.get()] = {a, 1, gap};
+  saved[b.get()] = {b, 2, gap * 2};
+  saved[c.get()] = {c, 3, gap * 3};
+
+  QVector<qint64> positions;
+  ASSERT_TRUE(PlaylistBackend::AssignPositions(
+      PlaylistItemList() << a << added << b << c, saved,
+      QSet<const PlaylistItem*>(), &positions));
+  EXPECT_EQ(QVector<qint64>() << gap << gap + gap / 2 << gap * 2 << gap * 3,
+            positions);
+}
+
+TEST_F(PlaylistBackendTest, AssignPositionsMovesItemsOutOfOrder) {
+  const qint64 gap = PlaylistBackend::kPositionGap;
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+
+  PlaylistBackend::SavedPlaylist saved;
+  saved[a.get()] = {a, 1, gap};
+  saved[b.get()] = {b, 2, gap * 2};
+  saved[c.get()] = {c, 3, gap * 3};
+
+  // a and b stay where they are, and c goes in front of them.
+  QVector<qint64> positions;
+  ASSERT_TRUE(PlaylistBackend::AssignPositions(
+      PlaylistItemList() << c << a << b, saved, QSet<const PlaylistItem*>(),
+      &positions));
+  EXPECT_EQ(QVector<qint64>() << gap / 2 << gap << gap * 2, positions);
+}
+
+TEST_F(PlaylistBackendTest, AssignPositionsWritesChangedItemsAgain) {
+  const qint64 gap = PlaylistBackend::kPositionGap;
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+
+  PlaylistBackend::SavedPlaylist saved;
+  saved[a.get()] = {a, 1, gap};
+  saved[b.get()] = {b, 2, gap * 4};
+  saved[c.get()] = {c, 3, gap * 5};
+
+  // b's saved position isn't kept, so it goes halfway between a and c.
+  QSet<const PlaylistItem*> changed;
+  changed << b.get();
+  QVector<qint64> positions;
+  ASSERT_TRUE(PlaylistBackend::AssignPositions(PlaylistItemList() << a << b
+                                                                  << c,
+                                               saved, changed, &positions));
+  EXPECT_EQ(QVector<qint64>() << gap << gap * 3 << gap * 5, positions);
+}
+
+TEST_F(PlaylistBackendTest, AssignPositionsFailsWhenGapIsFull) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+
+  PlaylistBackend::SavedPlaylist saved;
+  saved[a.get()] = {a, 1, 1};
+  saved[b.get()] = {b, 2, 2};
+
+  QVector<qint64> positions;
+  EXPECT_FALSE(PlaylistBackend::AssignPositions(
+      PlaylistItemList() << a << MakeItem("added") << b, saved,
+      QSet<const PlaylistItem*>(), &positions));
+}
+
+TEST_F(PlaylistBackendTest, SavesInsertedAndRemovedItems) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+  Save(PlaylistItemList() << a << b << c);
+  const QList<QPair<QString, qint64>> before = Rows();
+  ASSERT_EQ(QStringList() << "a"
+                          << "b"
+                          << "c",
+            Titles(before));
+
+  Save(PlaylistItemList() << a << MakeItem("d") << c);
+  const QList<QPair<QString, qint64>> after = Rows();
+  ASSERT_EQ(QStringList() << "a"
+                          << "d"
+                          << "c",
+            Titles(after));
+
+  // The rows of the items that didn't change are left alone.
+  EXPECT_EQ(before[0].second, after[0].second);
+  EXPECT_EQ(before[2].second, after[2].second);
+}
+
+TEST_F(PlaylistBackendTest, SavesMovedItems) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+  Save(PlaylistItemList() << a << b << c);
+  const QList<QPair<QString, qint64>> before = Rows();
+
+  Save(PlaylistItemList() << c << a << b);
+  const QList<QPair<QString, qint64>> after = Rows();
+  ASSERT_EQ(QStringList() << "c"
+                          << "a"
+                          << "b",
+            Titles(after));
+
+  // Moving an item only changes its position.
+  EXPECT_EQ(before[2].second, after[0].second);
+  EXPECT_EQ(before[0].second, after[1].second);
+  EXPECT_EQ(before[1].second, after[2].second);
+}
+
+TEST_F(PlaylistBackendTest, RewritesChangedItems) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  PlaylistItemPtr c = MakeItem("c");
+  const PlaylistItemList items = PlaylistItemList() << a << b << c;
+  Save(items);
+  const QList<QPair<QString, qint64>> before = Rows();
+
+  Save(items, PlaylistItemList() << b);
+  const QList<QPair<QString, qint64>> after = Rows();
+  ASSERT_EQ(Titles(before), Titles(after));
+
+  EXPECT_EQ(before[0].second, after[0].second);
+  EXPECT_NE(before[1].second, after[1].second);
+  EXPECT_EQ(before[2].second, after[2].second);
+}
+
+TEST_F(PlaylistBackendTest, ForgetsClosedPlaylist) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+  const PlaylistItemList items = PlaylistItemList() << a << b;
+  Save(items);
+  const QList<QPair<QString, qint64>> before = Rows();
+  EXPECT_LT(1, a.use_count());
+
+  backend_->ForgetPlaylist(playlist_);
+  QCoreApplication::processEvents();
+  EXPECT_EQ(1, a.use_count());
+
+  // Nothing's known about the rows any more, so they're all written again.
+  Save(items);
+  EXPECT_EQ(Titles(before), Titles(Rows()));
+  EXPECT_LT(1, a.use_count());
+}
+
+TEST_F(PlaylistBackendTest, LoadsLibrarySongs) {
+  LibraryBackend library;
+  library.Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+               Library::kSubdirsTable, Library::kFtsTable);
+  library.AddDirectory("/tmp");
+
+  Song song;
+  song.Init("Title", "Artist", "Album", 123);
+  song.set_directory_id(1);
+  song.set_url(QUrl::fromLocalFile("/tmp/song.mp3"));
+  song.set_mtime(1);
+  song.set_ctime(1);
+  song.set_filesize(1);
+  library.AddOrUpdateSongs(SongList() << song);
+  song = library.GetSongByUrl(song.url());
+  ASSERT_TRUE(song.is_valid());
+
+  // The same song twice, and one that isn't in the library any more.
+  Song missing(song);
+  missing.set_id(song.id() + 1);
+  Save(PlaylistItemList() << PlaylistItemPtr(new LibraryPlaylistItem(song))
+                          << PlaylistItemPtr(new LibraryPlaylistItem(song))
+                          << PlaylistItemPtr(new LibraryPlaylistItem(missing)));
+
+  const QList<PlaylistItemPtr> items = backend_->GetPlaylistItems(playlist_);
+  ASSERT_EQ(3, items.count());
+  EXPECT_EQ("Library", items[0]->type());
+  EXPECT_EQ(song.id(), items[0]->Metadata().id());
+  EXPECT_EQ("Title", items[0]->Metadata().title());
+  EXPECT_EQ("Album", items[0]->Metadata().album());
+  EXPECT_EQ(song.url(), items[0]->Metadata().url());
+  EXPECT_EQ(song.id(), items[1]->Metadata().id());
+  EXPECT_EQ(-1, items[2]->Metadata().id());
+  EXPECT_TRUE(items[2]->Metadata().title().isEmpty());
+}
+
+TEST_F(PlaylistBackendTest, SavesBlockingOnTheSameThread) {
+  PlaylistItemPtr a = MakeItem("a");
+  PlaylistItemPtr b = MakeItem("b");
+
+  // The queued save runs first, so it can't overwrite the later one.
+  backend_->SavePlaylistAsync(playlist_, PlaylistItemList() << a, {}, -1,
+                              smart_playlists::GeneratorPtr());
+  backend_->SavePlaylistBlocking(playlist_, PlaylistItemList() << a << b, {},
+                                 -1, smart_playlists::GeneratorPtr());
+  QCoreApplication::processEvents();
+
+  EXPECT_EQ(QStringList() << "a"
+                          << "b",
+            Titles(Rows()));
+}
+
+}  // namespace
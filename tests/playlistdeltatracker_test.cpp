@@ -0,0 +1,218 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QStringList>
+
+#include "networkremote/playlistdeltatracker.h"
+#include "playlist/songplaylistitem.h"
+
+namespace {
+
+class PlaylistDeltaTrackerTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    for (const QString& title : QStringList() << "A"
+                                              << "B"
+                                              << "C"
+                                              << "D"
+                                              << "E"
+                                              << "F") {
+      items_ << Item(title);
+    }
+    titles_ = Titles(items_);
+    tracker_.Reset(100, items_);
+  }
+
+  static PlaylistItemPtr Item(const QString& title) {
+    Song song;
+    song.Init(title, "Artist", "Album", 123);
+    return PlaylistItemPtr(new SongPlaylistItem(song));
+  }
+
+  static QStringList Titles(const PlaylistItemList& items) {
+    QStringList ret;
+    for (const PlaylistItemPtr& item : items) ret << item->Metadata().title();
+    return ret;
+  }
+
+  static QString Title(const pb::remote::SongMetadata& song) {
+    return QString::fromUtf8(song.title().c_str());
+  }
+
+  // Does what a client would with the delta.
+  static QStringList Apply(QStringList titles,
+                           const pb::remote::ResponsePlaylistDelta& delta) {
+    for (const pb::remote::PlaylistChange& change : delta.changes()) {
+      const int row = change.row();
+
+      switch (change.type()) {
+        case pb::remote::PlaylistChange::INSERT:
+          for (int i = 0; i < change.songs_size(); ++i) {
+            titles.insert(row + i, Title(change.songs(i)));
+          }
+          break;
+
+        case pb::remote::PlaylistChange::REMOVE:
+          for (int i = 0; i < change.count(); ++i) titles.removeAt(row);
+          break;
+
+        case pb::remote::PlaylistChange::MOVE: {
+          const QStringList moved = titles.mid(row, change.count());
+          for (int i = 0; i < change.count(); ++i) titles.removeAt(row);
+          for (int i = 0; i < moved.count(); ++i) {
+            titles.insert(change.destination() + i, moved[i]);
+          }
+          break;
+        }
+
+        case pb::remote::PlaylistChange::REORDER: {
+          const QStringList before = titles;
+          for (int i = 0; i < change.order_size(); ++i) {
+            titles[row + i] = before[row + change.order(i)];
+          }
+          break;
+        }
+
+        case pb::remote::PlaylistChange::CHANGE:
+          for (int i = 0; i < change.songs_size(); ++i) {
+            titles[row + i] = Title(change.songs(i));
+          }
+          break;
+      }
+    }
+    return titles;
+  }
+
+  // Updates the tracker and checks the delta turns the old playlist into the
+  // new one.
+  pb::remote::ResponsePlaylistDelta UpdateAndCheck(
+      const PlaylistItemList& items) {
+    const qint64 base_revision = tracker_.revision();
+
+    EXPECT_TRUE(tracker_.Update(items));
+    EXPECT_EQ(base_revision + 1, tracker_.revision());
+
+    pb::remote::ResponsePlaylistDelta delta;
+    EXPECT_TRUE(tracker_.DeltaSince(base_revision, &delta));
+    EXPECT_EQ(Titles(items), Apply(titles_, delta));
+
+    titles_ = Titles(items);
+    return delta;
+  }
+
+  PlaylistItemList items_;
+  QStringList titles_;  // What the client has
+  PlaylistDeltaTracker tracker_;
+};
+
+TEST_F(PlaylistDeltaTrackerTest, NothingChanged) {
+  EXPECT_FALSE(tracker_.Update(items_));
+  EXPECT_EQ(100, tracker_.revision());
+
+  pb::remote::ResponsePlaylistDelta delta;
+  EXPECT_TRUE(tracker_.DeltaSince(100, &delta));
+  EXPECT_EQ(0, delta.changes_size());
+}
+
+TEST_F(PlaylistDeltaTrackerTest, InsertAndRemove) {
+  PlaylistItemList items = items_;
+  items.removeAt(4);
+  items.removeAt(1);
+  items.insert(2, Item("X"));
+  items.prepend(Item("Y"));
+
+  pb::remote::ResponsePlaylistDelta delta = UpdateAndCheck(items);
+
+  // Only the new songs are sent.
+  int song_count = 0;
+  for (const pb::remote::PlaylistChange& change : delta.changes()) {
+    EXPECT_NE(pb::remote::PlaylistChange::MOVE, change.type());
+    EXPECT_NE(pb::remote::PlaylistChange::REORDER, change.type());
+    song_count += change.songs_size();
+  }
+  EXPECT_EQ(2, song_count);
+}
+
+TEST_F(PlaylistDeltaTrackerTest, MoveBlock) {
+  PlaylistItemList items = items_;
+  items.move(4, 1);
+
+  pb::remote::ResponsePlaylistDelta delta = UpdateAndCheck(items);
+  ASSERT_EQ(1, delta.changes_size());
+  EXPECT_EQ(pb::remote::PlaylistChange::MOVE, delta.changes(0).type());
+  EXPECT_EQ(1, delta.changes(0).count());
+  EXPECT_EQ(0, delta.changes(0).songs_size());
+}
+
+TEST_F(PlaylistDeltaTrackerTest, Reorder) {
+  PlaylistItemList items;
+  for (const PlaylistItemPtr& item : items_) items.prepend(item);
+
+  pb::remote::ResponsePlaylistDelta delta = UpdateAndCheck(items);
+  ASSERT_EQ(1, delta.changes_size());
+  EXPECT_EQ(pb::remote::PlaylistChange::REORDER, delta.changes(0).type());
+  EXPECT_EQ(0, delta.changes(0).songs_size());
+}
+
+TEST_F(PlaylistDeltaTrackerTest, MetadataChanged) {
+  Song song = items_[3]->Metadata();
+  song.set_title("Z");
+  items_[3]->SetTemporaryMetadata(song);
+
+  pb::remote::ResponsePlaylistDelta delta = UpdateAndCheck(items_);
+
+  ASSERT_EQ(1, delta.changes_size());
+  EXPECT_EQ(pb::remote::PlaylistChange::CHANGE, delta.changes(0).type());
+  EXPECT_EQ(3, delta.changes(0).row());
+  ASSERT_EQ(1, delta.changes(0).songs_size());
+  EXPECT_EQ("Z", Title(delta.changes(0).songs(0)));
+}
+
+TEST_F(PlaylistDeltaTrackerTest, DeltaOverSeveralRevisions) {
+  const QStringList before = titles_;
+
+  PlaylistItemList items = items_;
+  items.removeAt(0);
+  UpdateAndCheck(items);
+  items.move(0, 3);
+  UpdateAndCheck(items);
+  items << Item("X");
+  UpdateAndCheck(items);
+
+  pb::remote::ResponsePlaylistDelta delta;
+  ASSERT_TRUE(tracker_.DeltaSince(100, &delta));
+  EXPECT_EQ(100, delta.base_revision());
+  EXPECT_EQ(103, delta.revision());
+  EXPECT_EQ(Titles(items), Apply(before, delta));
+
+  // Revisions the tracker never had need the whole playlist.
+  EXPECT_FALSE(tracker_.DeltaSince(99, &delta));
+  EXPECT_FALSE(tracker_.DeltaSince(-1, &delta));
+}
+
+TEST_F(PlaylistDeltaTrackerTest, DeltaBiggerThanPlaylist) {
+  PlaylistItemList items;
+  for (int i = 0; i < 3; ++i) items << Item("X");
+
+  EXPECT_TRUE(tracker_.Update(items));
+
+  pb::remote::ResponsePlaylistDelta delta;
+  EXPECT_FALSE(tracker_.DeltaSince(100, &delta));
+}
+
+}  // namespace
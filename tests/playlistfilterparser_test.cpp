@@ -0,0 +1,113 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include "core/song.h"
+#include "core/timeconstants.h"
+#include "playlist/playlist.h"
+#include "playlist/playlistfilterparser.h"
+
+namespace {
+
+class PlaylistFilterParserTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    columns_["title"] = Playlist::Column_Title;
+    columns_["artist"] = Playlist::Column_Artist;
+    columns_["year"] = Playlist::Column_Year;
+    columns_["length"] = Playlist::Column_Length;
+    columns_["rating"] = Playlist::Column_Rating;
+
+    numerical_columns_ << Playlist::Column_Year << Playlist::Column_Length
+                       << Playlist::Column_Rating;
+
+    song_.Init("Some Title", "Some Artist", "Some Album",
+               225 * kNsecPerSec);
+    song_.set_year(2001);
+    song_.set_rating(0.6);
+  }
+
+  bool Accepts(const QString& filter) {
+    FilterParser parser(filter, columns_, numerical_columns_);
+    std::unique_ptr<FilterTree> tree(parser.parse());
+    FilterRow row(song_);
+    return tree->accept(&row);
+  }
+
+  QMap<QString, int> columns_;
+  QSet<int> numerical_columns_;
+  Song song_;
+};
+
+TEST_F(PlaylistFilterParserTest, EmptyFilterAcceptsEverything) {
+  EXPECT_TRUE(Accepts(""));
+  EXPECT_TRUE(Accepts("   "));
+}
+
+TEST_F(PlaylistFilterParserTest, MatchesAnyColumnIgnoringCase) {
+  EXPECT_TRUE(Accepts("title"));
+  EXPECT_TRUE(Accepts("ARTIST"));
+  EXPECT_FALSE(Accepts("nothing"));
+}
+
+TEST_F(PlaylistFilterParserTest, MatchesOneColumn) {
+  EXPECT_TRUE(Accepts("artist:some"));
+  EXPECT_FALSE(Accepts("artist:title"));
+  EXPECT_TRUE(Accepts("title:=\"some title\""));
+}
+
+TEST_F(PlaylistFilterParserTest, ComparesNumbers) {
+  EXPECT_TRUE(Accepts("year:2001"));
+  EXPECT_TRUE(Accepts("year:>2000"));
+  EXPECT_FALSE(Accepts("year:<2001"));
+  EXPECT_TRUE(Accepts("year:!=1999"));
+  EXPECT_FALSE(Accepts("year:!=2001"));
+}
+
+TEST_F(PlaylistFilterParserTest, ComparesLengthInSeconds) {
+  EXPECT_TRUE(Accepts("length:3:45"));
+  EXPECT_TRUE(Accepts("length:>3:00"));
+  EXPECT_FALSE(Accepts("length:<=3:44"));
+  EXPECT_FALSE(Accepts("length:!=225"));
+}
+
+TEST_F(PlaylistFilterParserTest, ComparesRatingInStars) {
+  EXPECT_TRUE(Accepts("rating:3"));
+  EXPECT_TRUE(Accepts("rating:>=2.5"));
+  EXPECT_FALSE(Accepts("rating:>3"));
+}
+
+TEST_F(PlaylistFilterParserTest, CombinesTerms) {
+  EXPECT_TRUE(Accepts("some AND title"));
+  EXPECT_FALSE(Accepts("some AND nothing"));
+  EXPECT_TRUE(Accepts("nothing OR title"));
+  EXPECT_FALSE(Accepts("-title"));
+  EXPECT_TRUE(Accepts("-(nothing OR year:1999)"));
+}
+
+TEST_F(PlaylistFilterParserTest, RowTextIsLowercased) {
+  FilterRow row(song_);
+  EXPECT_EQ("some title", row.text(Playlist::Column_Title));
+  EXPECT_EQ("2001", row.text(Playlist::Column_Year));
+  EXPECT_EQ(225, row.number(Playlist::Column_Length));
+  EXPECT_EQ(6, row.number(Playlist::Column_Rating));
+}
+
+}  // namespace
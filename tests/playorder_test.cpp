@@ -0,0 +1,286 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include <QSet>
+
+#include "playlist/playorder.h"
+
+namespace {
+
+// Rows 0-2 are on album a, 3-4 on b and 5-9 on c.
+QStringList AlbumKeys() {
+  return QStringList() << "a"
+                       << "a"
+                       << "a"
+                       << "b"
+                       << "b"
+                       << "c"
+                       << "c"
+                       << "c"
+                       << "c"
+                       << "c";
+}
+
+QList<int> Rows(const PlayOrder& order) {
+  QList<int> ret;
+  for (int i = 0; i < order.count(); ++i) ret << order.row_at(i);
+  return ret;
+}
+
+void ExpectPositionsMatch(const PlayOrder& order) {
+  for (int i = 0; i < order.count(); ++i) {
+    EXPECT_EQ(i, order.position_of(order.row_at(i)));
+  }
+}
+
+TEST(PlayOrderTest, UnshuffledIsPlaylistOrder) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+
+  EXPECT_EQ(10, order.count());
+  EXPECT_EQ(QList<int>() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9,
+            Rows(order));
+  EXPECT_EQ(0, order.Next(-1));
+  EXPECT_EQ(10, order.Next(9));
+  EXPECT_EQ(9, order.Previous(10));
+  EXPECT_EQ(-1, order.Previous(0));
+}
+
+TEST(PlayOrderTest, SkipsUnplayableRows) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+
+  QSet<int> hidden;
+  hidden << 1 << 2 << 4;
+  order.set_playable_predicate([&hidden](int row) {
+    return !hidden.contains(row);
+  });
+
+  EXPECT_EQ(3, order.Next(0));
+  EXPECT_EQ(0, order.Previous(3));
+  EXPECT_EQ(3, order.Next(0, order.album_of_row(3)));
+  EXPECT_EQ(10, order.Next(3, order.album_of_row(3)));
+
+  // The answers are cached until they're invalidated.
+  hidden.clear();
+  EXPECT_EQ(3, order.Next(0));
+  order.InvalidatePlayable(1, 1);
+  EXPECT_EQ(1, order.Next(0));
+  EXPECT_EQ(3, order.Next(1));
+  order.InvalidatePlayable();
+  EXPECT_EQ(2, order.Next(1));
+}
+
+TEST(PlayOrderTest, StaysOnAlbum) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+
+  const int c = order.album_of_row(5);
+  EXPECT_EQ(6, order.Next(5, c));
+  EXPECT_EQ(10, order.Next(9, c));
+  EXPECT_EQ(5, order.Next(-1, c));
+  EXPECT_EQ(5, order.Next(0, c));
+  EXPECT_EQ(9, order.Previous(10, c));
+  EXPECT_EQ(-1, order.Previous(5, c));
+  EXPECT_EQ(-1, order.Previous(3, c));
+}
+
+TEST(PlayOrderTest, ChangedAlbumKeys) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+
+  // Row 4 moves from album b to c, and row 3 to a new album.
+  order.SetAlbumKeys(3, QStringList() << "d"
+                                      << "c");
+  const int c = order.album_of_row(5);
+  EXPECT_EQ(c, order.album_of_row(4));
+  EXPECT_EQ(4, order.Previous(5, c));
+  EXPECT_EQ(5, order.Next(4, c));
+
+  const int d = order.album_of_row(3);
+  EXPECT_NE(c, d);
+  EXPECT_NE(order.album_of_row(0), d);
+  EXPECT_EQ(3, order.Next(-1, d));
+  EXPECT_EQ(10, order.Next(3, d));
+}
+
+TEST(PlayOrderTest, ShuffleKeepsPlayedSongs) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_All);
+  order.Shuffle(3, -1);
+
+  QList<int> rows = Rows(order);
+  EXPECT_EQ(QList<int>() << 0 << 1 << 2, rows.mid(0, 3));
+
+  qSort(rows);
+  EXPECT_EQ(QList<int>() << 0 << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9,
+            rows);
+  ExpectPositionsMatch(order);
+}
+
+TEST(PlayOrderTest, ShuffleAlbumsKeepsAlbumsTogether) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_Albums);
+  order.Shuffle(0, order.album_of_row(3));
+
+  EXPECT_EQ(QList<int>() << 3 << 4, Rows(order).mid(0, 2));
+
+  // Each album's songs are together, and in playlist order.
+  QSet<int> finished_albums;
+  for (int i = 1; i < order.count(); ++i) {
+    const int row = order.row_at(i);
+    const int previous_row = order.row_at(i - 1);
+    const int album = order.album_of_row(row);
+
+    if (album == order.album_of_row(previous_row)) {
+      EXPECT_EQ(previous_row + 1, row);
+    } else {
+      finished_albums << order.album_of_row(previous_row);
+      EXPECT_FALSE(finished_albums.contains(album));
+    }
+  }
+  ExpectPositionsMatch(order);
+}
+
+TEST(PlayOrderTest, MoveToFront) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.MoveToFront(6);
+
+  EXPECT_EQ(QList<int>() << 6 << 0 << 1 << 2 << 3 << 4 << 5 << 7 << 8 << 9,
+            Rows(order));
+  ExpectPositionsMatch(order);
+
+  const int c = order.album_of_row(6);
+  EXPECT_EQ(6, order.Next(0, c));
+  EXPECT_EQ(7, order.Next(6, c));
+}
+
+TEST(PlayOrderTest, InsertUnshuffled) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.InsertRows(3, QStringList() << "d"
+                                    << "d",
+                   0, -1);
+
+  EXPECT_EQ(12, order.count());
+  for (int i = 0; i < order.count(); ++i) EXPECT_EQ(i, order.row_at(i));
+  EXPECT_EQ(order.album_of_row(3), order.album_of_row(4));
+  EXPECT_EQ(order.album_of_row(0), order.album_of_row(2));
+  EXPECT_EQ(order.album_of_row(5), order.album_of_row(6));
+  EXPECT_NE(order.album_of_row(2), order.album_of_row(3));
+}
+
+TEST(PlayOrderTest, InsertShuffledKeepsPlayedSongs) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_All);
+  order.Shuffle(0, -1);
+  const QList<int> before = Rows(order);
+
+  // Insert before every row, so they all get renumbered.
+  order.InsertRows(0, QStringList() << "d"
+                                    << "d"
+                                    << "d",
+                   4, -1);
+
+  ASSERT_EQ(13, order.count());
+  for (int i = 0; i < 4; ++i) EXPECT_EQ(before[i] + 3, order.row_at(i));
+
+  QList<int> rows = Rows(order);
+  qSort(rows);
+  for (int i = 0; i < rows.count(); ++i) EXPECT_EQ(i, rows[i]);
+  ExpectPositionsMatch(order);
+}
+
+TEST(PlayOrderTest, Remove) {
+  PlayOrder order;
+  order.Reset(AlbumKeys());
+  order.MoveToFront(6);
+  order.RemoveRows(2, 3);
+
+  EXPECT_EQ(QList<int>() << 3 << 0 << 1 << 2 << 4 << 5 << 6, Rows(order));
+  ExpectPositionsMatch(order);
+
+  // Rows 2, 3 and 4 went, so album a has two songs left and b has none.
+  EXPECT_EQ(order.album_of_row(0), order.album_of_row(1));
+  EXPECT_NE(order.album_of_row(1), order.album_of_row(2));
+  EXPECT_EQ(order.album_of_row(2), order.album_of_row(6));
+}
+
+TEST(PlayOrderTest, LargePlaylist) {
+  QStringList keys;
+  for (int i = 0; i < 200000; ++i) keys << QString::number(i / 12);
+
+  PlayOrder order;
+  order.Reset(keys);
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_Albums);
+  order.Shuffle(0, -1);
+  ExpectPositionsMatch(order);
+
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_All);
+  order.Shuffle(0, -1);
+  ExpectPositionsMatch(order);
+
+  // Walk the whole playlist a song at a time.
+  int steps = 0;
+  for (int i = order.Next(-1); i < order.count(); i = order.Next(i)) ++steps;
+  EXPECT_EQ(200000, steps);
+}
+
+TEST(PlayOrderTest, NarrowFilter) {
+  QStringList keys;
+  for (int i = 0; i < 200000; ++i) keys << QString::number(i / 12);
+
+  PlayOrder order;
+  order.Reset(keys);
+  order.set_shuffle_mode(PlaylistSequence::Shuffle_All);
+  order.Shuffle(0, -1);
+
+  int lookups = 0;
+  order.set_playable_predicate([&lookups](int row) {
+    ++lookups;
+    return row % 50000 == 0;
+  });
+
+  // Each row is only looked up once, however often the order is walked.
+  for (int pass = 0; pass < 3; ++pass) {
+    QList<int> rows;
+    for (int i = order.Next(-1); i < order.count(); i = order.Next(i)) {
+      rows << order.row_at(i);
+    }
+    EXPECT_EQ(4, rows.count());
+
+    QList<int> backwards;
+    for (int i = order.Previous(order.count()); i >= 0;
+         i = order.Previous(i)) {
+      backwards.prepend(order.row_at(i));
+    }
+    EXPECT_EQ(rows, backwards);
+  }
+  EXPECT_EQ(200000, lookups);
+
+  // Moving a song keeps what's known about the others.
+  order.MoveToFront(order.row_at(order.Next(-1)));
+  EXPECT_EQ(0, order.Next(-1));
+  EXPECT_EQ(200000, lookups);
+}
+
+}  // namespace
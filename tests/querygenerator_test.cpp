@@ -0,0 +1,217 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QMap>
+#include <QSet>
+
+#include "core/database.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "smartplaylists/querygenerator.h"
+#include "smartplaylists/search.h"
+
+using smart_playlists::QueryGenerator;
+using smart_playlists::QueryGeneratorCache;
+using smart_playlists::Search;
+using smart_playlists::SearchTerm;
+
+namespace {
+
+QSet<int> Range(int first, int last) {
+  QSet<int> ret;
+  for (int i = first; i <= last; ++i) ret << i;
+  return ret;
+}
+
+TEST(QueryGeneratorTest, SampleIds) {
+  const QList<int> ids =
+      QueryGenerator::SampleIds(Range(0, 99), QSet<int>(), 10);
+
+  EXPECT_EQ(10, ids.count());
+  EXPECT_EQ(10, ids.toSet().count());
+  for (int id : ids) EXPECT_TRUE(id >= 0 && id <= 99);
+}
+
+TEST(QueryGeneratorTest, SampleIdsExcludes) {
+  const QList<int> ids =
+      QueryGenerator::SampleIds(Range(0, 99), Range(0, 94), 10);
+
+  EXPECT_EQ(Range(95, 99), ids.toSet());
+}
+
+TEST(QueryGeneratorTest, SampleAllIds) {
+  const QList<int> ids =
+      QueryGenerator::SampleIds(Range(0, 99), Range(0, 9), -1);
+
+  EXPECT_EQ(Range(10, 99), ids.toSet());
+}
+
+TEST(QueryGeneratorTest, SampleIsUniform) {
+  // Every id should be picked about as often as the others.
+  QMap<int, int> picked;
+  for (int i = 0; i < 10000; ++i) {
+    for (int id : QueryGenerator::SampleIds(Range(0, 9), QSet<int>(), 2)) {
+      picked[id]++;
+    }
+  }
+
+  for (int id = 0; id < 10; ++id) {
+    EXPECT_GT(picked[id], 1700);
+    EXPECT_LT(picked[id], 2300);
+  }
+}
+
+TEST(QueryGeneratorTest, SortedSearchPaging) {
+  Search search(Search::Type_All, Search::TermList(), Search::Sort_FieldAsc,
+                SearchTerm::Field_Year, 20);
+
+  EXPECT_FALSE(search.ToSql("songs").contains("OFFSET"));
+  EXPECT_TRUE(search.BoundValues().isEmpty());
+
+  search.after_id_ = 42;
+  search.after_value_ = 1999;
+  const QString sql = search.ToSql("songs");
+  EXPECT_TRUE(sql.contains("(year > ? OR (year = ? AND ROWID > 42))"));
+  EXPECT_TRUE(sql.contains("ORDER BY year ASC, ROWID ASC"));
+  EXPECT_TRUE(sql.endsWith("LIMIT 20"));
+  EXPECT_EQ(QVariantList() << 1999 << 1999, search.BoundValues());
+
+  search.sort_type_ = Search::Sort_FieldDesc;
+  EXPECT_TRUE(search.ToSql("songs").contains(
+      "(year < ? OR (year = ? AND ROWID < 42) OR year IS NULL)"));
+}
+
+TEST(QueryGeneratorTest, IdsSql) {
+  Search search(Search::Type_All, Search::TermList(), Search::Sort_Random,
+                SearchTerm::Field_Year, 20);
+  search.id_in_ << 1 << 2 << 3;
+
+  EXPECT_EQ("SELECT ROWID FROM songs WHERE (ROWID IN (1,2,3)) AND "
+            "unavailable = 0",
+            search.ToIdsSql("songs"));
+}
+
+class QueryGeneratorCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+  }
+
+  static Song MakeSong(const QString& artist) {
+    static int sFileNumber = 0;
+
+    Song ret;
+    ret.Init("Title", artist, "Album", 123);
+    ret.set_directory_id(1);
+    ret.set_url(
+        QUrl::fromLocalFile(QString("/tmp/%1.mp3").arg(sFileNumber++)));
+    ret.set_mtime(1);
+    ret.set_ctime(1);
+    ret.set_filesize(1);
+    return ret;
+  }
+
+  // The songs by artist X.
+  static Search ArtistSearch() {
+    return Search(Search::Type_And,
+                  Search::TermList() << SearchTerm(SearchTerm::Field_Artist,
+                                                   SearchTerm::Op_Equals, "X"),
+                  Search::Sort_Random, SearchTerm::Field_Title);
+  }
+
+  // Returns the songs with their IDs set.
+  SongList AddOrUpdate(const SongList& songs) {
+    backend_->AddOrUpdateSongs(songs);
+
+    SongList ret;
+    for (const Song& song : songs) {
+      ret << backend_->GetSongByUrl(song.url());
+    }
+    return ret;
+  }
+
+  static QSet<int> Ids(const SongList& songs) {
+    QSet<int> ret;
+    for (const Song& song : songs) ret << song.id();
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(QueryGeneratorCacheTest, ChecksChangedSongs) {
+  SongList songs = AddOrUpdate(SongList() << MakeSong("X") << MakeSong("Y"));
+
+  QueryGeneratorCache cache(backend_.get());
+  cache.Update(ArtistSearch());
+  EXPECT_EQ(Ids(songs.mid(0, 1)), cache.ids());
+
+  songs[0].set_artist("Y");
+  songs[1].set_artist("X");
+  AddOrUpdate(songs);
+  cache.Update(ArtistSearch());
+  EXPECT_EQ(Ids(songs.mid(1, 1)), cache.ids());
+
+  backend_->DeleteSongs(songs.mid(1, 1));
+  EXPECT_TRUE(cache.ids().isEmpty());
+}
+
+TEST_F(QueryGeneratorCacheTest, StartsAgainAfterManyChanges) {
+  const SongList first = AddOrUpdate(SongList() << MakeSong("X"));
+
+  QueryGeneratorCache cache(backend_.get());
+  cache.Update(ArtistSearch());
+
+  SongList more;
+  for (int i = 0; i <= QueryGeneratorCache::kMaxStaleIds; ++i) {
+    more << MakeSong(i % 2 ? "X" : "Y");
+  }
+  more = AddOrUpdate(more);
+  cache.Update(ArtistSearch());
+
+  QSet<int> expected = Ids(first);
+  for (const Song& song : more) {
+    if (song.artist() == "X") expected << song.id();
+  }
+  EXPECT_EQ(expected, cache.ids());
+}
+
+TEST_F(QueryGeneratorCacheTest, DatabaseResetInvalidates) {
+  AddOrUpdate(SongList() << MakeSong("X"));
+
+  QueryGeneratorCache cache(backend_.get());
+  cache.Update(ArtistSearch());
+  ASSERT_EQ(1, cache.ids().count());
+
+  backend_->DeleteAll();
+  EXPECT_TRUE(cache.ids().isEmpty());
+
+  const SongList songs = AddOrUpdate(SongList() << MakeSong("X"));
+  cache.Update(ArtistSearch());
+  EXPECT_EQ(Ids(songs), cache.ids());
+}
+
+}  // namespace
@@ -0,0 +1,107 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+
+#include "analyzers/rastercanvas.h"
+
+namespace {
+
+const QRgb kBlack = qRgb(0, 0, 0);
+const QRgb kRed = qRgb(255, 0, 0);
+const QRgb kGreen = qRgb(0, 255, 0);
+
+class RasterCanvasTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    canvas_.resize(QSize(8, 4));
+    canvas_.fill(kBlack);
+    canvas_.clearDirty();
+  }
+
+  QRgb Pixel(int x, int y) const { return canvas_.image().pixel(x, y); }
+
+  RasterCanvas canvas_;
+};
+
+TEST_F(RasterCanvasTest, ResizeMarksEverythingDirty) {
+  RasterCanvas canvas;
+  canvas.resize(QSize(3, 2));
+  EXPECT_EQ(QRect(0, 0, 3, 2), canvas.dirtyRect());
+  EXPECT_EQ(RasterCanvas::format(), canvas.image().format());
+}
+
+TEST_F(RasterCanvasTest, FillRect) {
+  canvas_.fillRect(2, 1, 3, 2, kRed);
+
+  EXPECT_EQ(QRect(2, 1, 3, 2), canvas_.dirtyRect());
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      const bool inside = x >= 2 && x < 5 && y >= 1 && y < 3;
+      EXPECT_EQ(inside ? kRed : kBlack, Pixel(x, y)) << x << "," << y;
+    }
+  }
+}
+
+TEST_F(RasterCanvasTest, FillRectIsClipped) {
+  canvas_.fillRect(-2, 3, 4, 10, kRed);
+  EXPECT_EQ(QRect(0, 3, 2, 1), canvas_.dirtyRect());
+  EXPECT_EQ(kRed, Pixel(1, 3));
+  EXPECT_EQ(kBlack, Pixel(2, 3));
+
+  canvas_.clearDirty();
+  canvas_.fillRect(8, 0, 2, 2, kRed);
+  EXPECT_FALSE(canvas_.isDirty());
+}
+
+TEST_F(RasterCanvasTest, BlitIsClippedToSourceAndCanvas) {
+  QImage source(2, 3, RasterCanvas::format());
+  source.fill(kGreen);
+
+  // Asks for more than the source has, and runs off the bottom of the canvas.
+  canvas_.blit(6, 2, source, 0, 1, 10, 10);
+
+  EXPECT_EQ(QRect(6, 2, 2, 2), canvas_.dirtyRect());
+  EXPECT_EQ(kGreen, Pixel(6, 2));
+  EXPECT_EQ(kGreen, Pixel(7, 3));
+  EXPECT_EQ(kBlack, Pixel(5, 2));
+  EXPECT_EQ(kBlack, Pixel(6, 1));
+}
+
+TEST_F(RasterCanvasTest, BlitCopiesFromSourceOffset) {
+  QImage source(4, 1, RasterCanvas::format());
+  source.fill(kBlack);
+  source.setPixel(2, 0, kRed);
+
+  canvas_.blit(0, 0, source, 2, 0, 2, 1);
+  EXPECT_EQ(kRed, Pixel(0, 0));
+  EXPECT_EQ(kBlack, Pixel(1, 0));
+}
+
+TEST_F(RasterCanvasTest, ScrollLeft) {
+  canvas_.fillRect(3, 0, 1, 4, kRed);
+  canvas_.clearDirty();
+
+  canvas_.scrollLeft(2);
+
+  EXPECT_EQ(canvas_.image().rect(), canvas_.dirtyRect());
+  EXPECT_EQ(kRed, Pixel(1, 0));
+  EXPECT_EQ(kBlack, Pixel(3, 0));
+  // The uncovered columns keep what they had.
+  EXPECT_EQ(kBlack, Pixel(7, 3));
+}
+
+}  // namespace
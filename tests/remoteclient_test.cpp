@@ -0,0 +1,291 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QtEndian>
+
+#include "networkremote/remoteclient.h"
+
+namespace {
+
+RemoteClient::Frame MakeFrame(pb::remote::MsgType type, int playlist_id = -1) {
+  pb::remote::Message msg;
+  msg.set_type(type);
+  if (type == pb::remote::PLAYLIST_SONGS) {
+    msg.mutable_response_playlist_songs()->mutable_requested_playlist()->set_id(
+        playlist_id);
+  } else if (type == pb::remote::PLAYLIST_DELTA) {
+    msg.mutable_response_playlist_delta()->set_playlist_id(playlist_id);
+  }
+  return RemoteClient::MakeFrame(&msg);
+}
+
+TEST(RemoteClientFrameTest, MakeFrame) {
+  pb::remote::Message msg;
+  msg.set_type(pb::remote::PLAYLIST_SONGS);
+  msg.mutable_response_playlist_songs()->mutable_requested_playlist()->set_id(
+      5);
+
+  const RemoteClient::Frame frame = RemoteClient::MakeFrame(&msg);
+  EXPECT_EQ(pb::remote::PLAYLIST_SONGS, frame.type);
+  EXPECT_EQ(5, frame.playlist_id);
+  EXPECT_TRUE(frame.filename.isEmpty());
+
+  // The length goes first, then the message.
+  ASSERT_GE(frame.data.size(), int(sizeof(qint32)));
+  const qint32 size = qFromBigEndian<qint32>(
+      reinterpret_cast<const uchar*>(frame.data.constData()));
+  EXPECT_EQ(frame.data.size() - int(sizeof(qint32)), size);
+
+  pb::remote::Message parsed;
+  ASSERT_TRUE(parsed.ParseFromArray(frame.data.constData() + sizeof(qint32),
+                                    size));
+  EXPECT_EQ(pb::remote::PLAYLIST_SONGS, parsed.type());
+  EXPECT_EQ(5, parsed.response_playlist_songs().requested_playlist().id());
+  EXPECT_EQ(msg.default_instance().version(), parsed.version());
+
+  EXPECT_EQ(7, MakeFrame(pb::remote::PLAYLIST_DELTA, 7).playlist_id);
+  EXPECT_EQ(-1, MakeFrame(pb::remote::KEEP_ALIVE).playlist_id);
+}
+
+TEST(RemoteClientFrameTest, StateSupersedesSameType) {
+  const RemoteClient::Frame keep_alive = MakeFrame(pb::remote::KEEP_ALIVE);
+  const RemoteClient::Frame volume = MakeFrame(pb::remote::SET_VOLUME);
+
+  EXPECT_TRUE(RemoteClient::Supersedes(keep_alive, keep_alive));
+  EXPECT_TRUE(RemoteClient::Supersedes(volume, volume));
+  EXPECT_FALSE(RemoteClient::Supersedes(keep_alive, volume));
+  EXPECT_FALSE(RemoteClient::Supersedes(volume, keep_alive));
+}
+
+TEST(RemoteClientFrameTest, PlaylistSupersedesDeltas) {
+  const RemoteClient::Frame songs = MakeFrame(pb::remote::PLAYLIST_SONGS, 1);
+  const RemoteClient::Frame delta = MakeFrame(pb::remote::PLAYLIST_DELTA, 1);
+
+  EXPECT_TRUE(RemoteClient::Supersedes(songs, songs));
+  EXPECT_TRUE(RemoteClient::Supersedes(songs, delta));
+  EXPECT_FALSE(RemoteClient::Supersedes(delta, delta));
+  EXPECT_FALSE(RemoteClient::Supersedes(delta, songs));
+
+  // Only the same playlist
+  EXPECT_FALSE(RemoteClient::Supersedes(
+      songs, MakeFrame(pb::remote::PLAYLIST_DELTA, 2)));
+  EXPECT_FALSE(RemoteClient::Supersedes(
+      songs, MakeFrame(pb::remote::PLAYLIST_SONGS, 2)));
+}
+
+TEST(RemoteClientFrameTest, OtherMessagesAreKept) {
+  const RemoteClient::Frame lyrics = MakeFrame(pb::remote::LYRICS);
+  EXPECT_FALSE(RemoteClient::Supersedes(lyrics, lyrics));
+}
+
+class RemoteClientTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    ASSERT_TRUE(server_.listen(QHostAddress::LocalHost));
+    socket_.connectToHost(QHostAddress::LocalHost, server_.serverPort());
+    ASSERT_TRUE(server_.waitForNewConnection(5000));
+    ASSERT_TRUE(socket_.waitForConnected(5000));
+
+    client_.reset(new RemoteClient(nullptr, server_.nextPendingConnection()));
+  }
+
+  // A frame that fills up the socket's buffer, so the ones after it have to
+  // wait.
+  static RemoteClient::Frame BigFrame() {
+    RemoteClient::Frame frame = MakeFrame(pb::remote::LYRICS);
+    frame.data.append(QByteArray(RemoteClient::kMaxBytesToWrite, '\0'));
+    return frame;
+  }
+
+  // Runs the event loop until size bytes have arrived, and returns them.
+  QByteArray Receive(qint64 size) {
+    QByteArray ret;
+
+    // Makes sure the loop wakes up to give up if nothing arrives
+    QTimer tick;
+    tick.start(100);
+
+    QElapsedTimer timer;
+    timer.start();
+    while (ret.size() < size && timer.elapsed() < 10000) {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+      ret += socket_.readAll();
+    }
+    return ret;
+  }
+
+  // The types of the messages in data.  The big frame's padding isn't part of
+  // its message, so it's skipped along with it.
+  static QList<pb::remote::MsgType> Types(const QByteArray& data) {
+    QList<pb::remote::MsgType> ret;
+    int pos = 0;
+    while (pos + int(sizeof(qint32)) <= data.size()) {
+      const qint32 size = qFromBigEndian<qint32>(
+          reinterpret_cast<const uchar*>(data.constData() + pos));
+      pos += sizeof(qint32);
+
+      pb::remote::Message msg;
+      EXPECT_TRUE(msg.ParseFromArray(data.constData() + pos, size));
+      ret << msg.type();
+      pos += size;
+
+      if (msg.type() == pb::remote::LYRICS) {
+        pos += RemoteClient::kMaxBytesToWrite;
+      }
+    }
+    return ret;
+  }
+
+  // A frame that sends a temporary file after it, and deletes it afterwards.
+  static RemoteClient::Frame FileFrame() {
+    QTemporaryFile file;
+    file.setAutoRemove(false);
+    EXPECT_TRUE(file.open());
+    file.write(QByteArray(1024 * 1024, 'x'));
+    file.flush();
+
+    RemoteClient::Frame frame = MakeFrame(pb::remote::SONG_FILE_CHUNK);
+    frame.filename = file.fileName();
+    frame.file_size = file.size();
+    frame.remove_file = true;
+    return frame;
+  }
+
+  QTcpServer server_;
+  QTcpSocket socket_;
+  std::unique_ptr<RemoteClient> client_;
+};
+
+TEST_F(RemoteClientTest, CoalescesWaitingFrames) {
+  const RemoteClient::Frame big = BigFrame();
+  const RemoteClient::Frame keep_alive = MakeFrame(pb::remote::KEEP_ALIVE);
+  const RemoteClient::Frame delta = MakeFrame(pb::remote::PLAYLIST_DELTA, 1);
+  const RemoteClient::Frame songs = MakeFrame(pb::remote::PLAYLIST_SONGS, 1);
+
+  client_->SendFrame(big);
+  client_->SendFrame(keep_alive);
+  client_->SendFrame(delta);
+  client_->SendFrame(keep_alive);
+  client_->SendFrame(songs);
+
+  // The second keep alive replaced the first, and the playlist replaced the
+  // delta.  Each goes where the newer one was sent.
+  const QByteArray data =
+      Receive(big.data.size() + keep_alive.data.size() + songs.data.size());
+  EXPECT_EQ(QList<pb::remote::MsgType>() << pb::remote::LYRICS
+                                         << pb::remote::KEEP_ALIVE
+                                         << pb::remote::PLAYLIST_SONGS,
+            Types(data));
+}
+
+TEST_F(RemoteClientTest, KeepsOrderOfOtherFrames) {
+  const RemoteClient::Frame big = BigFrame();
+  const RemoteClient::Frame delta1 = MakeFrame(pb::remote::PLAYLIST_DELTA, 1);
+  const RemoteClient::Frame delta2 = MakeFrame(pb::remote::PLAYLIST_DELTA, 2);
+  const RemoteClient::Frame volume = MakeFrame(pb::remote::SET_VOLUME);
+
+  client_->SendFrame(big);
+  client_->SendFrame(delta1);
+  client_->SendFrame(volume);
+  client_->SendFrame(delta2);
+
+  const QByteArray data = Receive(big.data.size() + delta1.data.size() +
+                                  volume.data.size() + delta2.data.size());
+  EXPECT_EQ(QList<pb::remote::MsgType>() << pb::remote::LYRICS
+                                         << pb::remote::PLAYLIST_DELTA
+                                         << pb::remote::SET_VOLUME
+                                         << pb::remote::PLAYLIST_DELTA,
+            Types(data));
+}
+
+TEST_F(RemoteClientTest, DisconnectsClientThatFallsBehind) {
+  client_->SendFrame(BigFrame());
+
+  // The frames share their data, so this doesn't use much memory.
+  const RemoteClient::Frame frame = BigFrame();
+  for (qint64 queued = 0; queued <= RemoteClient::kMaxPendingBytes;
+       queued += frame.data.size()) {
+    ASSERT_EQ(QAbstractSocket::ConnectedState, client_->State());
+    client_->SendFrame(frame);
+  }
+
+  EXPECT_NE(QAbstractSocket::ConnectedState, client_->State());
+}
+
+TEST_F(RemoteClientTest, SendsFileBiggerThanLimit) {
+  client_->SendFrame(BigFrame());
+
+  // A song that's sent in chunks is queued all at once.
+  RemoteClient::Frame chunk = MakeFrame(pb::remote::SONG_FILE_CHUNK);
+  chunk.data.append(QByteArray(RemoteClient::kMaxBytesToWrite, '\0'));
+  for (qint64 queued = 0; queued <= RemoteClient::kMaxPendingBytes;
+       queued += chunk.data.size()) {
+    client_->SendFrame(chunk);
+  }
+  EXPECT_EQ(QAbstractSocket::ConnectedState, client_->State());
+
+  // Other messages can still be sent after it.
+  client_->SendFrame(MakeFrame(pb::remote::KEEP_ALIVE));
+  EXPECT_EQ(QAbstractSocket::ConnectedState, client_->State());
+}
+
+TEST_F(RemoteClientTest, DownloaderIsNotDisconnected) {
+  client_->setDownloader(true);
+  client_->SendFrame(BigFrame());
+
+  const RemoteClient::Frame frame = BigFrame();
+  for (qint64 queued = 0; queued <= RemoteClient::kMaxPendingBytes;
+       queued += frame.data.size()) {
+    client_->SendFrame(frame);
+  }
+  EXPECT_EQ(QAbstractSocket::ConnectedState, client_->State());
+}
+
+TEST_F(RemoteClientTest, RemovesFilesOfWaitingFrames) {
+  const RemoteClient::Frame frame = FileFrame();
+  client_->SendFrame(BigFrame());
+  client_->SendFrame(frame);
+  ASSERT_TRUE(QFile::exists(frame.filename));
+
+  client_.reset();
+  EXPECT_FALSE(QFile::exists(frame.filename));
+}
+
+TEST_F(RemoteClientTest, DisconnectStopsFile) {
+  // The file's header is written straight away, so the file's being sent.
+  const RemoteClient::Frame frame = FileFrame();
+  client_->SendFrame(frame);
+  ASSERT_TRUE(QFile::exists(frame.filename));
+
+  // There's nowhere to put the disconnect message, so the connection's just
+  // closed.
+  client_->DisconnectClient(pb::remote::Server_Shutdown);
+  EXPECT_FALSE(QFile::exists(frame.filename));
+  EXPECT_NE(QAbstractSocket::ConnectedState, client_->State());
+}
+
+}  // namespace
@@ -0,0 +1,93 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "gtest/gtest.h"
+
+#include <QVector>
+
+#include "analysis/replaygain.h"
+
+namespace {
+
+// Ten seconds of a stereo sine wave.
+QVector<float> Sine(double amplitude, double frequency) {
+  const int frames = ReplayGain::kSampleRate * 10;
+  QVector<float> ret(frames * 2);
+  for (int i = 0; i < frames; ++i) {
+    ret[i * 2] = ret[i * 2 + 1] =
+        amplitude * sin(2 * M_PI * frequency * i / ReplayGain::kSampleRate);
+  }
+  return ret;
+}
+
+double TrackGain(const QVector<float>& samples, ReplayGain* rg) {
+  rg->AddSamples(samples.constData(), samples.size() / 2);
+  double gain = 0;
+  EXPECT_TRUE(rg->TrackGain(&gain));
+  return gain;
+}
+
+TEST(ReplayGainTest, NoSamples) {
+  ReplayGain rg;
+  double gain = 0;
+  EXPECT_FALSE(rg.TrackGain(&gain));
+}
+
+TEST(ReplayGainTest, KnownSine) {
+  // A 1kHz sine at half scale is 81.3dB on the 16-bit scale, and the equal
+  // loudness filter takes 8.3dB off it at 1kHz.
+  ReplayGain rg;
+  EXPECT_NEAR(-8.15, TrackGain(Sine(0.5, 1000), &rg), 0.05);
+  EXPECT_NEAR(0.5, rg.peak(), 0.001);
+}
+
+TEST(ReplayGainTest, HalvingAmplitudeAddsSixDb) {
+  ReplayGain loud;
+  ReplayGain quiet;
+  EXPECT_NEAR(6.02, TrackGain(Sine(0.25, 1000), &quiet) -
+                        TrackGain(Sine(0.5, 1000), &loud),
+              0.02);
+}
+
+TEST(ReplayGainTest, EqualLoudness) {
+  // The ear is more sensitive at 3kHz than at 100Hz, so the same level needs
+  // less gain.
+  ReplayGain bass;
+  ReplayGain treble;
+  EXPECT_GT(TrackGain(Sine(0.5, 100), &bass),
+            TrackGain(Sine(0.5, 3000), &treble) + 10);
+}
+
+TEST(ReplayGainTest, AlbumGain) {
+  ReplayGain loud;
+  ReplayGain quiet;
+  const double loud_gain = TrackGain(Sine(0.5, 1000), &loud);
+  const double quiet_gain = TrackGain(Sine(0.1, 1000), &quiet);
+
+  ReplayGain::Histogram album;
+  ReplayGain::AddHistogram(loud.histogram(), &album);
+  ReplayGain::AddHistogram(quiet.histogram(), &album);
+
+  // Half the album is loud, so the 95th percentile is in the loud track.
+  double album_gain = 0;
+  ASSERT_TRUE(ReplayGain::Gain(album, &album_gain));
+  EXPECT_DOUBLE_EQ(loud_gain, album_gain);
+  EXPECT_LT(album_gain, quiet_gain);
+}
+
+}  // namespace
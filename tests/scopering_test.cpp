@@ -0,0 +1,177 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <QtDebug>
+
+#include "core/timeconstants.h"
+#include "engines/scopering.h"
+
+namespace {
+
+// 1000 samples per second makes one sample per millisecond.
+const qint64 kNsecPerSample = kNsecPerMsec;
+
+class ScopeRingTest : public ::testing::Test {
+ protected:
+  ScopeRingTest() : ring_(64), next_sample_(0) {}
+
+  // Writes count samples numbered consecutively.
+  void Write(int count) {
+    std::vector<int16_t> samples(count);
+    for (int i = 0; i < count; ++i) samples[i] = next_sample_++;
+    ring_.Write(&samples[0], count, count * kNsecPerSample);
+  }
+
+  std::vector<int16_t> Read(int count, int advance_msec) {
+    std::vector<int16_t> ret(count, -1);
+    EXPECT_TRUE(ring_.Read(&ret[0], count, advance_msec));
+    return ret;
+  }
+
+  ScopeRing ring_;
+  int16_t next_sample_;
+};
+
+TEST_F(ScopeRingTest, NothingToReadBeforeFirstWrite) {
+  int16_t sample;
+  EXPECT_FALSE(ring_.Read(&sample, 1, 0));
+}
+
+TEST_F(ScopeRingTest, ReadsFromStartOfNewestBuffer) {
+  Write(10);
+  Write(10);
+  std::vector<int16_t> samples = Read(4, 0);
+  EXPECT_EQ(10, samples[0]);
+  EXPECT_EQ(13, samples[3]);
+}
+
+TEST_F(ScopeRingTest, AdvancesThroughBufferInTime) {
+  Write(20);
+  EXPECT_EQ(0, Read(4, 0)[0]);
+  EXPECT_EQ(5, Read(4, 5)[0]);
+  EXPECT_EQ(10, Read(4, 5)[0]);
+
+  // Never reads past the end of what was written.
+  EXPECT_EQ(16, Read(4, 100)[0]);
+}
+
+TEST_F(ScopeRingTest, PadsShortReadsWithSilence) {
+  Write(2);
+  std::vector<int16_t> samples = Read(4, 0);
+  EXPECT_EQ(0, samples[0]);
+  EXPECT_EQ(1, samples[1]);
+  EXPECT_EQ(0, samples[2]);
+  EXPECT_EQ(0, samples[3]);
+}
+
+TEST_F(ScopeRingTest, WrapsAround) {
+  for (int i = 0; i < 10; ++i) Write(30);
+  std::vector<int16_t> samples = Read(30, 0);
+  for (int i = 0; i < 30; ++i) {
+    EXPECT_EQ(270 + i, samples[i]);
+  }
+}
+
+TEST_F(ScopeRingTest, KeepsEndOfOversizedBuffer) {
+  Write(100);
+  EXPECT_EQ(36, Read(1, 0)[0]);
+}
+
+TEST(ScopeRingThreadTest, ReadsConsistentSamplesWhileWriting) {
+  static const int kBlocks = 200;
+  static const int kBlockSize = 512;
+  static const int kReadSize = 1024;
+
+  ScopeRing ring;
+  std::atomic<bool> done(false);
+
+  std::thread producer([&ring, &done]() {
+    std::vector<int16_t> samples(kBlockSize);
+    int16_t next = 0;
+    for (int i = 0; i < kBlocks; ++i) {
+      for (int16_t& sample : samples) sample = next++;
+      ring.Write(&samples[0], kBlockSize, 10 * kNsecPerMsec);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    done = true;
+  });
+
+  std::vector<int16_t> samples(kReadSize);
+  qint64 total_latency = 0;
+  int reads = 0;
+  while (!done) {
+    if (!ring.Read(&samples[0], kReadSize, 1)) continue;
+
+    // Early reads are padded with silence at the end.
+    for (int i = 1; i < kReadSize; ++i) {
+      if (samples[i] == 0) continue;
+      ASSERT_EQ(int16_t(samples[i - 1] + 1), samples[i]);
+    }
+    total_latency += ring.latency_nsec();
+    ++reads;
+  }
+  producer.join();
+
+  if (reads) {
+    qDebug() << "Mean cross-thread latency:"
+             << total_latency / reads / 1000 << "usec";
+  }
+}
+
+TEST(ScopeRingThreadTest, CopiesAgainWhenWriterLapsReader) {
+  static const int kBlocks = 20000;
+  static const int kRingSize = 64;
+  static const int kReadSize = 16;
+
+  // Every write fills the whole ring, so it overwrites whatever the reader
+  // is copying.
+  ScopeRing ring(kRingSize);
+  std::atomic<bool> done(false);
+
+  std::thread producer([&ring, &done]() {
+    std::vector<int16_t> samples(kRingSize);
+    int16_t next = 0;
+    for (int i = 0; i < kBlocks; ++i) {
+      for (int16_t& sample : samples) sample = next++;
+      ring.Write(&samples[0], kRingSize, kNsecPerMsec);
+    }
+    done = true;
+  });
+
+  std::vector<int16_t> samples(kReadSize);
+  int torn_reads = 0;
+  while (!done) {
+    if (!ring.Read(&samples[0], kReadSize, 0)) continue;
+
+    for (int i = 1; i < kReadSize; ++i) {
+      if (samples[i] != int16_t(samples[i - 1] + 1)) {
+        ++torn_reads;
+        break;
+      }
+    }
+  }
+  producer.join();
+
+  EXPECT_EQ(0, torn_reads);
+}
+
+}  // namespace
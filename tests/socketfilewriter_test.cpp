@@ -0,0 +1,178 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QtDebug>
+
+#include "networkremote/remoteclient.h"
+#include "networkremote/socketfilewriter.h"
+#include "networkremote/songsender.h"
+
+namespace {
+
+class SocketFileWriterTest : public ::testing::Test {
+ protected:
+  static const qint64 kFileSize = 4 * 1024 * 1024;
+
+  virtual void SetUp() {
+    // Every 4 bytes are different, so anything written in the wrong place
+    // changes the hash.
+    ASSERT_TRUE(file_.open());
+    QByteArray data(kFileSize, Qt::Uninitialized);
+    quint32* words = reinterpret_cast<quint32*>(data.data());
+    for (quint32 i = 0; i < kFileSize / sizeof(quint32); ++i) {
+      words[i] = i * 2654435761u;
+    }
+    ASSERT_EQ(kFileSize, file_.write(data));
+    file_.flush();
+
+    ASSERT_TRUE(server_.listen(QHostAddress::LocalHost));
+    client_.connectToHost(QHostAddress::LocalHost, server_.serverPort());
+    ASSERT_TRUE(server_.waitForNewConnection(5000));
+    ASSERT_TRUE(client_.waitForConnected(5000));
+    socket_ = server_.nextPendingConnection();
+  }
+
+  // Runs the event loop until size bytes have arrived at the client, and
+  // returns the SHA-1 of them.
+  QByteArray Receive(qint64 size) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 received = 0;
+
+    // Makes sure the loop wakes up to give up if nothing arrives
+    QTimer tick;
+    tick.start(100);
+
+    QElapsedTimer timer;
+    timer.start();
+    while (received < size && timer.elapsed() < 60000) {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+      const QByteArray data = client_.readAll();
+      hash.addData(data);
+      received += data.size();
+    }
+
+    EXPECT_EQ(size, received);
+    return hash.result();
+  }
+
+  // The old way: the file in 100kB protobuf chunks, each copied into a
+  // message, serialised and copied again into Qt's socket buffer.  Returns
+  // the number of bytes sent.
+  qint64 SendChunks() {
+    QFile file(file_.fileName());
+    file.open(QIODevice::ReadOnly);
+
+    const QByteArray sha1 = SongSender::FileHash(file_.fileName()).toHex();
+
+    pb::remote::Message msg;
+    msg.set_type(pb::remote::SONG_FILE_CHUNK);
+    pb::remote::ResponseSongFileChunk* chunk =
+        msg.mutable_response_song_file_chunk();
+
+    qint64 sent = 0;
+    while (!file.atEnd()) {
+      const QByteArray data = file.read(SongSender::kFileChunkSize);
+      chunk->set_size(file.size());
+      chunk->set_data(data.data(), data.size());
+      chunk->set_file_hash(sha1.data(), sha1.size());
+
+      const RemoteClient::Frame frame = RemoteClient::MakeFrame(&msg);
+      socket_->write(frame.data);
+      sent += frame.data.size();
+    }
+    return sent;
+  }
+
+  QTemporaryFile file_;
+  QTcpServer server_;
+  QTcpSocket client_;
+  QTcpSocket* socket_;
+};
+
+TEST_F(SocketFileWriterTest, WritesFileAfterHeader) {
+  SocketFileWriter writer(socket_);
+  TestQObject finished;
+  QObject::connect(&writer, SIGNAL(Finished(bool)), &finished,
+                   SLOT(Invoke()));
+
+  ASSERT_TRUE(writer.Open(file_.fileName(), kFileSize, false));
+  EXPECT_TRUE(writer.is_active());
+
+  const QByteArray header = "header";
+  socket_->write(header);
+  writer.Start();
+
+  QCryptographicHash expected(QCryptographicHash::Sha1);
+  expected.addData(header);
+  file_.seek(0);
+  expected.addData(file_.readAll());
+
+  EXPECT_EQ(expected.result(), Receive(header.size() + kFileSize));
+  EXPECT_EQ(1, finished.invoked());
+  EXPECT_FALSE(writer.is_active());
+  EXPECT_TRUE(file_.exists());
+}
+
+TEST_F(SocketFileWriterTest, RemovesFileIfAsked) {
+  QTemporaryFile file;
+  ASSERT_TRUE(file.open());
+  file.write("data");
+  file.close();
+  file.setAutoRemove(false);
+
+  SocketFileWriter writer(socket_);
+  ASSERT_TRUE(writer.Open(file.fileName(), 4, true));
+  writer.Start();
+  Receive(4);
+
+  EXPECT_FALSE(QFile::exists(file.fileName()));
+}
+
+// Sends the file both ways and only prints the timings, so it doesn't run
+// with the other tests.  Run it with --gtest_also_run_disabled_tests.
+TEST_F(SocketFileWriterTest, DISABLED_Benchmark) {
+  // The hash is cached after the first time, so leave it out of both.
+  SongSender::FileHash(file_.fileName());
+
+  QElapsedTimer timer;
+  timer.start();
+  Receive(SendChunks());
+  const qint64 chunks_msec = qMax(1ll, timer.elapsed());
+
+  SocketFileWriter writer(socket_);
+  ASSERT_TRUE(writer.Open(file_.fileName(), kFileSize, false));
+
+  timer.restart();
+  writer.Start();
+  Receive(kFileSize);
+  const qint64 raw_msec = qMax(1ll, timer.elapsed());
+
+  const double megabytes = double(kFileSize) / (1024 * 1024);
+  qDebug() << "Protobuf chunks:" << megabytes * 1000 / chunks_msec << "MB/s";
+  qDebug() << "Raw file data:" << megabytes * 1000 / raw_msec << "MB/s";
+}
+
+}  // namespace
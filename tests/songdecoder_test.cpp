@@ -0,0 +1,189 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/songdecoder.h"
+
+namespace {
+
+class SongDecoderTest : public ::testing::Test {
+ protected:
+  static const int kBenchmarkSongs = 10000;
+
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+  }
+
+  void AddSongs(int count) {
+    SongList songs;
+    for (int i = 0; i < count; ++i) {
+      Song song;
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile(
+          QString("/tmp/music/%1/track %2.mp3").arg(i / 10).arg(i)));
+      song.set_title(QString("Title %1").arg(i));
+      song.set_artist(QString("Artist %1").arg(i / 100));
+      song.set_album(QString("Album %1").arg(i / 10));
+      song.set_genre("Rock");
+      song.set_track(i % 10 + 1);
+      song.set_year(2000 + i % 20);
+      song.set_length_nanosec(180 * 1000000000ll);
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs << song;
+    }
+    backend_->AddOrUpdateSongs(songs);
+  }
+
+  QString AllSongsSql() const {
+    return "SELECT ROWID, " + Song::kColumnSpec + " FROM " +
+           Library::kSongsTable + " ORDER BY ROWID";
+  }
+
+  SongList DecodeWithQuery() {
+    QSqlQuery q(AllSongsSql(), database_->Connect());
+    q.exec();
+
+    SongList ret;
+    while (q.next()) {
+      Song song;
+      song.InitFromQuery(q, true);
+      ret << song;
+    }
+    return ret;
+  }
+
+  SongList DecodeWithDecoder() {
+    SongList ret;
+    SongDecoder decoder;
+    decoder.Exec(database_->Connect(), AllSongsSql(), QVariantList(), &ret);
+    return ret;
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(SongDecoderTest, IsSupported) {
+  EXPECT_TRUE(SongDecoder::IsSupported(database_->Connect()));
+}
+
+TEST_F(SongDecoderTest, MatchesInitFromQuery) {
+  AddSongs(50);
+
+  SongList expected = DecodeWithQuery();
+  SongList actual = DecodeWithDecoder();
+  ASSERT_EQ(50, expected.count());
+  ASSERT_EQ(expected.count(), actual.count());
+
+  for (int i = 0; i < expected.count(); ++i) {
+    const Song& e = expected[i];
+    const Song& a = actual[i];
+    EXPECT_TRUE(a.is_valid());
+    EXPECT_EQ(e.id(), a.id());
+    EXPECT_EQ(e.title(), a.title());
+    EXPECT_EQ(e.artist(), a.artist());
+    EXPECT_EQ(e.album(), a.album());
+    EXPECT_EQ(e.albumartist(), a.albumartist());
+    EXPECT_EQ(e.genre(), a.genre());
+    EXPECT_EQ(e.track(), a.track());
+    EXPECT_EQ(e.disc(), a.disc());
+    EXPECT_EQ(e.year(), a.year());
+    EXPECT_EQ(e.originalyear(), a.originalyear());
+    EXPECT_EQ(e.length_nanosec(), a.length_nanosec());
+    EXPECT_EQ(e.beginning_nanosec(), a.beginning_nanosec());
+    EXPECT_EQ(e.url(), a.url());
+    EXPECT_EQ(e.basefilename(), a.basefilename());
+    EXPECT_EQ(e.directory_id(), a.directory_id());
+    EXPECT_EQ(e.mtime(), a.mtime());
+    EXPECT_EQ(e.filetype(), a.filetype());
+    EXPECT_EQ(e.playcount(), a.playcount());
+    EXPECT_EQ(e.lastplayed(), a.lastplayed());
+    EXPECT_EQ(e.rating(), a.rating());
+    EXPECT_EQ(e.art_manual(), a.art_manual());
+    EXPECT_EQ(e.is_unavailable(), a.is_unavailable());
+  }
+}
+
+TEST_F(SongDecoderTest, DecodesPercentEncodedFilenames) {
+  AddSongs(1);
+
+  SongList songs = DecodeWithDecoder();
+  ASSERT_EQ(1, songs.count());
+  EXPECT_EQ("track 0.mp3", songs[0].basefilename());
+}
+
+TEST_F(SongDecoderTest, SharesRepeatedStrings) {
+  AddSongs(20);
+
+  SongList songs = DecodeWithDecoder();
+  ASSERT_EQ(20, songs.count());
+  EXPECT_EQ(songs[0].artist().constData(), songs[19].artist().constData());
+  EXPECT_EQ(songs[0].album().constData(), songs[9].album().constData());
+}
+
+TEST_F(SongDecoderTest, BindsValues) {
+  AddSongs(10);
+
+  SongList songs;
+  SongDecoder decoder;
+  ASSERT_TRUE(decoder.Exec(database_->Connect(),
+                           "SELECT ROWID, " + Song::kColumnSpec + " FROM " +
+                               Library::kSongsTable + " WHERE track = ?",
+                           QVariantList() << 3, &songs));
+  ASSERT_EQ(1, songs.count());
+  EXPECT_EQ("Title 2", songs[0].title());
+}
+
+// Decodes the library twice, so it doesn't run with the other tests.  Run it
+// with --gtest_also_run_disabled_tests.
+TEST_F(SongDecoderTest, DISABLED_Benchmark) {
+  AddSongs(kBenchmarkSongs);
+
+  QElapsedTimer timer;
+  timer.start();
+  const int query_count = DecodeWithQuery().count();
+  const qint64 query_msec = qMax(1ll, timer.restart());
+  const int decoder_count = DecodeWithDecoder().count();
+  const qint64 decoder_msec = qMax(1ll, timer.elapsed());
+
+  ASSERT_EQ(kBenchmarkSongs, query_count);
+  ASSERT_EQ(kBenchmarkSongs, decoder_count);
+
+  qDebug() << "InitFromQuery:" << query_count * 1000 / query_msec
+           << "songs/sec";
+  qDebug() << "SongDecoder:" << decoder_count * 1000 / decoder_msec
+           << "songs/sec";
+}
+
+}  // namespace
@@ -0,0 +1,138 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTemporaryFile>
+
+#include "core/utilities.h"
+#include "covers/thumbnailcache.h"
+
+namespace {
+
+class ThumbnailCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Use a unique name for the cache directory.
+    QTemporaryFile file(QDir::tempPath() + "/thumbnailcachetest-XXXXXX");
+    ASSERT_TRUE(file.open());
+    directory_ = file.fileName() + ".d";
+  }
+
+  virtual void TearDown() { Utilities::RemoveRecursive(directory_); }
+
+  QImage Image(int width, int height) const {
+    QImage image(width, height, QImage::Format_RGB32);
+    image.fill(qRgb(10, 20, 30));
+    image.setPixel(1, 2, qRgb(200, 100, 50));
+    return image;
+  }
+
+  QStringList Files() const {
+    QStringList ret;
+    QDirIterator it(directory_, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) ret << it.next();
+    return ret;
+  }
+
+  QString directory_;
+};
+
+TEST_F(ThumbnailCacheTest, FindsInsertedThumbnail) {
+  ThumbnailCache cache(directory_);
+  QPixmap pixmap;
+  EXPECT_FALSE(cache.Find("key", 32, &pixmap));
+
+  cache.Insert("key", 32, Image(32, 30));
+  ASSERT_TRUE(cache.Find("key", 32, &pixmap));
+  EXPECT_EQ(QSize(32, 30), pixmap.size());
+
+  // Sizes are cached separately.
+  EXPECT_FALSE(cache.Find("key", 120, &pixmap));
+}
+
+TEST_F(ThumbnailCacheTest, ReadsThumbnailFromDisk) {
+  const QImage image = Image(32, 32);
+  ThumbnailCache(directory_).Insert("key", 32, image);
+
+  // A new cache has nothing in memory.
+  ThumbnailCache cache(directory_);
+  QPixmap pixmap;
+  ASSERT_TRUE(cache.Find("key", 32, &pixmap));
+  EXPECT_EQ(image.size(), pixmap.size());
+  EXPECT_EQ(image.pixel(1, 2), pixmap.toImage().pixel(1, 2));
+  EXPECT_EQ(image.pixel(5, 5), pixmap.toImage().pixel(5, 5));
+}
+
+TEST_F(ThumbnailCacheTest, DoesNotSaveInMemoryThumbnailsToDisk) {
+  ThumbnailCache(directory_)
+      .InsertInMemory("key", 32, QPixmap::fromImage(Image(32, 32)));
+
+  ThumbnailCache cache(directory_);
+  QPixmap pixmap;
+  EXPECT_FALSE(cache.Find("key", 32, &pixmap));
+  EXPECT_TRUE(Files().isEmpty());
+}
+
+TEST_F(ThumbnailCacheTest, RemovesThumbnail) {
+  ThumbnailCache cache(directory_);
+  cache.Insert("key", 32, Image(32, 32));
+  cache.Remove("key", 32);
+
+  QPixmap pixmap;
+  EXPECT_FALSE(cache.Find("key", 32, &pixmap));
+  EXPECT_TRUE(Files().isEmpty());
+}
+
+TEST_F(ThumbnailCacheTest, IgnoresCorruptFiles) {
+  ThumbnailCache(directory_).Insert("key", 32, Image(32, 32));
+
+  const QStringList files = Files();
+  ASSERT_EQ(1, files.count());
+  QFile file(files[0]);
+  ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+  file.resize(file.size() - 1);
+  file.close();
+
+  ThumbnailCache cache(directory_);
+  QPixmap pixmap;
+  EXPECT_FALSE(cache.Find("key", 32, &pixmap));
+}
+
+TEST_F(ThumbnailCacheTest, KeepsDiskCacheUnderLimit) {
+  // Each 512x512 thumbnail takes 1MB on disk.
+  ThumbnailCache cache(directory_);
+  const QImage image = Image(512, 512);
+  const int count = ThumbnailCache::kDiskCacheBytes / (512 * 512 * 4) + 10;
+  for (int i = 0; i < count; ++i) {
+    cache.Insert(QString::number(i), 512, image);
+  }
+
+  qint64 total = 0;
+  for (const QString& filename : Files()) {
+    total += QFileInfo(filename).size();
+  }
+  EXPECT_LE(total, ThumbnailCache::kDiskCacheBytes);
+  EXPECT_LT(Files().count(), count);
+}
+
+}  // namespace